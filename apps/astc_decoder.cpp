@@ -0,0 +1,970 @@
+#include "astc_decoder.h"
+
+#include <array>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "thread_pool.h"
+
+
+namespace {
+
+    constexpr uint32_t BLOCK_SIZE = 16;
+    constexpr uint32_t MAX_TEXEL_COUNT = 12 * 12;
+    constexpr uint32_t MAX_WEIGHT_COUNT = 64;
+    // Handing rows to a pool thread costs more than decoding fewer of them than this
+    constexpr uint32_t MIN_BLOCK_ROWS_PER_THREAD = 16;
+
+    constexpr std::array<uint8_t, 4> ERROR_COLOR = { 255, 0, 255, 255 };
+
+    // In the order of VkFormat, which goes UNORM then SRGB for each footprint from VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+    constexpr std::array<std::array<uint8_t, 2>, 14> FOOTPRINTS = {{
+        { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+        { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+    }};
+
+
+    // Integer sequence encoding of a value range, which is 2^bits times 3 if there is a trit or times 5 if a quint
+    struct QuantMethod {
+        uint8_t m_trits, m_quints, m_bits;
+    };
+
+    // From 2 levels to 256. Weights use the first 12.
+    constexpr std::array<QuantMethod, 21> QUANT_METHODS = {{
+        { 0, 0, 1 }, { 1, 0, 0 }, { 0, 0, 2 }, { 0, 1, 0 }, { 1, 0, 1 }, { 0, 0, 3 }, { 0, 1, 1 },
+        { 1, 0, 2 }, { 0, 0, 4 }, { 0, 1, 2 }, { 1, 0, 3 }, { 0, 0, 5 }, { 0, 1, 3 }, { 1, 0, 4 },
+        { 0, 0, 6 }, { 0, 1, 4 }, { 1, 0, 5 }, { 0, 0, 7 }, { 0, 1, 5 }, { 1, 0, 6 }, { 0, 0, 8 },
+    }};
+
+    constexpr uint32_t WEIGHT_QUANT_COUNT = 12;
+    // Colors need at least 6 levels or the block is invalid
+    constexpr uint32_t MIN_COLOR_QUANT = 4;
+
+    uint32_t ise_bit_count(const uint32_t count, const uint32_t quant) {
+        const auto& method = QUANT_METHODS[quant];
+        return count * method.m_bits + (count * 8 * method.m_trits + 4) / 5 + (count * 7 * method.m_quints + 2) / 3;
+    }
+
+
+    struct BlockMode {
+        uint8_t m_grid_width = 0, m_grid_height = 0;
+        uint8_t m_weight_quant = 0;
+        uint8_t m_weight_bits = 0;
+        bool m_dual_plane = false;
+        bool m_valid = false;  // Regardless of footprint, which may still be smaller than the grid
+    };
+
+    struct Tables {
+        std::array<std::array<uint8_t, 5>, 256> m_trits;
+        std::array<std::array<uint8_t, 3>, 128> m_quints;
+        std::array<std::array<uint8_t, 32>, WEIGHT_QUANT_COUNT> m_weight_unquant;  // To [0, 64]
+        std::array<std::array<uint8_t, 256>, QUANT_METHODS.size()> m_color_unquant;
+        std::array<BlockMode, 2048> m_block_modes;
+    };
+
+    uint32_t bit_of(const uint32_t value, const uint32_t index) {
+        return (value >> index) & 1;
+    }
+
+    uint32_t bits_of(const uint32_t value, const uint32_t index, const uint32_t count) {
+        return (value >> index) & ((1u << count) - 1);
+    }
+
+    void make_trits(Tables& t) {
+        for (uint32_t T = 0; T < 256; ++T) {
+            uint32_t C, t4, t3, t2, t1, t0;
+
+            if (bits_of(T, 2, 3) == 7) {
+                C = (bits_of(T, 5, 3) << 2) | bits_of(T, 0, 2);
+                t4 = t3 = 2;
+            }
+            else {
+                C = bits_of(T, 0, 5);
+                if (bits_of(T, 5, 2) == 3) {
+                    t4 = 2;
+                    t3 = bit_of(T, 7);
+                }
+                else {
+                    t4 = bit_of(T, 7);
+                    t3 = bits_of(T, 5, 2);
+                }
+            }
+
+            if (bits_of(C, 0, 2) == 3) {
+                t2 = 2;
+                t1 = bit_of(C, 4);
+                t0 = (bit_of(C, 3) << 1) | (bit_of(C, 2) & ~bit_of(C, 3) & 1);
+            }
+            else if (bits_of(C, 2, 2) == 3) {
+                t2 = 2;
+                t1 = 2;
+                t0 = bits_of(C, 0, 2);
+            }
+            else {
+                t2 = bit_of(C, 4);
+                t1 = bits_of(C, 2, 2);
+                t0 = (bit_of(C, 1) << 1) | (bit_of(C, 0) & ~bit_of(C, 1) & 1);
+            }
+
+            t.m_trits[T] = { uint8_t(t0), uint8_t(t1), uint8_t(t2), uint8_t(t3), uint8_t(t4) };
+        }
+    }
+
+    void make_quints(Tables& t) {
+        for (uint32_t Q = 0; Q < 128; ++Q) {
+            uint32_t q2, q1, q0;
+
+            if (bits_of(Q, 1, 2) == 3 && bits_of(Q, 5, 2) == 0) {
+                q2 = (bit_of(Q, 0) << 2) | ((bit_of(Q, 4) & ~bit_of(Q, 0) & 1) << 1) | (bit_of(Q, 3) & ~bit_of(Q, 0) & 1);
+                q1 = q0 = 4;
+            }
+            else {
+                uint32_t C;
+                if (bits_of(Q, 1, 2) == 3) {
+                    q2 = 4;
+                    C = (bits_of(Q, 3, 2) << 3) | ((~bits_of(Q, 5, 2) & 3) << 1) | bit_of(Q, 0);
+                }
+                else {
+                    q2 = bits_of(Q, 5, 2);
+                    C = bits_of(Q, 0, 5);
+                }
+
+                if (bits_of(C, 0, 3) == 5) {
+                    q1 = 4;
+                    q0 = bits_of(C, 3, 2);
+                }
+                else {
+                    q1 = bits_of(C, 3, 2);
+                    q0 = bits_of(C, 0, 3);
+                }
+            }
+
+            t.m_quints[Q] = { uint8_t(q0), uint8_t(q1), uint8_t(q2) };
+        }
+    }
+
+    // Bit at each position of the unquantization pattern B, 'a' being the lowest bit of the value. '0' is zero.
+    uint32_t unquant_pattern(const char* const pattern, const uint32_t value) {
+        const auto length = std::strlen(pattern);
+        uint32_t result = 0;
+
+        for (size_t i = 0; i < length; ++i) {
+            const auto c = pattern[length - 1 - i];
+            if ('0' != c) {
+                result |= bit_of(value, c - 'a') << i;
+            }
+        }
+
+        return result;
+    }
+
+    uint32_t replicate_bits(const uint32_t value, const uint32_t bits, const uint32_t to_bits) {
+        uint32_t result = 0;
+        int shift = to_bits;
+
+        while (shift > 0) {
+            shift -= bits;
+            result |= shift >= 0 ? value << shift : value >> -shift;
+        }
+
+        return result & ((1u << to_bits) - 1);
+    }
+
+    // Patterns and multipliers of ranges with a trit or quint, from the weight and color unquantization tables of the specification
+    struct UnquantParams {
+        const char* m_pattern;
+        uint32_t m_c;
+    };
+
+    void make_weight_unquant(Tables& t) {
+        const std::array<UnquantParams, WEIGHT_QUANT_COUNT> params = {{
+            { "", 0 }, { "", 0 }, { "", 0 }, { "", 0 },
+            { "0000000", 50 }, { "", 0 }, { "0000000", 28 }, { "b000b0b", 23 },
+            { "", 0 }, { "b0000b0", 13 }, { "cb000cb", 11 }, { "", 0 },
+        }};
+
+        for (uint32_t q = 0; q < WEIGHT_QUANT_COUNT; ++q) {
+            const auto& method = QUANT_METHODS[q];
+            const uint32_t level_count = (1u << method.m_bits) * (method.m_trits ? 3 : 1) * (method.m_quints ? 5 : 1);
+
+            for (uint32_t v = 0; v < level_count; ++v) {
+                const auto m = bits_of(v, 0, method.m_bits);
+                const auto d = v >> method.m_bits;
+                uint32_t result;
+
+                if (0 == method.m_trits && 0 == method.m_quints) {
+                    result = ::replicate_bits(v, method.m_bits, 6);
+                }
+                else if (0 == method.m_bits) {
+                    result = method.m_trits ? std::array<uint32_t, 3>{ 0, 32, 63 }[d] : std::array<uint32_t, 5>{ 0, 16, 32, 47, 63 }[d];
+                }
+                else {
+                    const uint32_t a = bit_of(m, 0) ? 0x7F : 0;
+                    auto T = d * params[q].m_c + ::unquant_pattern(params[q].m_pattern, m);
+                    T ^= a;
+                    result = (a & 0x20) | (T >> 2);
+                }
+
+                t.m_weight_unquant[q][v] = static_cast<uint8_t>(result > 32 ? result + 1 : result);
+            }
+        }
+    }
+
+    void make_color_unquant(Tables& t) {
+        const std::array<UnquantParams, QUANT_METHODS.size()> params = {{
+            { "", 0 }, { "", 0 }, { "", 0 }, { "", 0 },
+            { "000000000", 204 }, { "", 0 }, { "000000000", 113 }, { "b000b0bb0", 93 },
+            { "", 0 }, { "b0000bb00", 54 }, { "cb000cbcb", 44 }, { "", 0 },
+            { "cb0000cbc", 26 }, { "dcb000dcb", 22 }, { "", 0 }, { "dcb0000dc", 13 },
+            { "edcb000ed", 11 }, { "", 0 }, { "edcb0000e", 6 }, { "fedcb000f", 5 },
+            { "", 0 },
+        }};
+
+        for (uint32_t q = 0; q < QUANT_METHODS.size(); ++q) {
+            const auto& method = QUANT_METHODS[q];
+            const uint32_t level_count = (1u << method.m_bits) * (method.m_trits ? 3 : 1) * (method.m_quints ? 5 : 1);
+
+            for (uint32_t v = 0; v < level_count; ++v) {
+                const auto m = bits_of(v, 0, method.m_bits);
+                const auto d = v >> method.m_bits;
+
+                if (0 == method.m_trits && 0 == method.m_quints) {
+                    t.m_color_unquant[q][v] = static_cast<uint8_t>(::replicate_bits(v, method.m_bits, 8));
+                }
+                // Ranges of 3 and 5 levels, which have no bits, are never used for colors
+                else {
+                    const uint32_t a = bit_of(m, 0) ? 0x1FF : 0;
+                    auto T = d * params[q].m_c + ::unquant_pattern(params[q].m_pattern, m);
+                    T ^= a;
+                    t.m_color_unquant[q][v] = static_cast<uint8_t>((a & 0x80) | (T >> 2));
+                }
+            }
+        }
+    }
+
+    void make_block_modes(Tables& t) {
+        for (uint32_t mode = 0; mode < 2048; ++mode) {
+            auto& result = t.m_block_modes[mode];
+
+            uint32_t range = bit_of(mode, 4);
+            uint32_t high_precision = bit_of(mode, 9);
+            uint32_t dual_plane = bit_of(mode, 10);
+            const auto a = bits_of(mode, 5, 2);
+            uint32_t width = 0, height = 0;
+
+            if (bits_of(mode, 0, 2) != 0) {
+                range |= bits_of(mode, 0, 2) << 1;
+                auto b = bits_of(mode, 7, 2);
+
+                switch (bits_of(mode, 2, 2)) {
+                    case 0:
+                        width = b + 4;
+                        height = a + 2;
+                        break;
+                    case 1:
+                        width = b + 8;
+                        height = a + 2;
+                        break;
+                    case 2:
+                        width = a + 2;
+                        height = b + 8;
+                        break;
+                    default:
+                        b &= 1;
+                        if (bit_of(mode, 8)) {
+                            width = b + 2;
+                            height = a + 2;
+                        }
+                        else {
+                            width = a + 2;
+                            height = b + 6;
+                        }
+                        break;
+                }
+            }
+            else {
+                // Void extent and reserved modes
+                if (bits_of(mode, 2, 2) == 0) {
+                    continue;
+                }
+
+                range |= bits_of(mode, 2, 2) << 1;
+                const auto b = bits_of(mode, 9, 2);
+
+                switch (bits_of(mode, 7, 2)) {
+                    case 0:
+                        width = 12;
+                        height = a + 2;
+                        break;
+                    case 1:
+                        width = a + 2;
+                        height = 12;
+                        break;
+                    case 2:
+                        width = a + 6;
+                        height = b + 6;
+                        dual_plane = 0;
+                        high_precision = 0;
+                        break;
+                    default:
+                        if (a > 1) {
+                            continue;
+                        }
+                        width = 0 == a ? 6 : 10;
+                        height = 0 == a ? 10 : 6;
+                        break;
+                }
+            }
+
+            const auto weight_count = width * height * (dual_plane + 1);
+            const auto quant = range - 2 + 6 * high_precision;
+            const auto weight_bits = ::ise_bit_count(weight_count, quant);
+
+            result.m_grid_width = static_cast<uint8_t>(width);
+            result.m_grid_height = static_cast<uint8_t>(height);
+            result.m_weight_quant = static_cast<uint8_t>(quant);
+            result.m_weight_bits = static_cast<uint8_t>(std::min<uint32_t>(weight_bits, 255));
+            result.m_dual_plane = 0 != dual_plane;
+            result.m_valid = weight_count <= MAX_WEIGHT_COUNT && weight_bits >= 24 && weight_bits <= 96;
+        }
+    }
+
+    const Tables& tables() {
+        static const auto table = []() {
+            auto result = std::make_unique<Tables>();
+
+            ::make_trits(*result);
+            ::make_quints(*result);
+            ::make_weight_unquant(*result);
+            ::make_color_unquant(*result);
+            ::make_block_modes(*result);
+
+            return result;
+        }();
+
+        return *table;
+    }
+
+
+    // 128 bits of a block, bit 0 being the lowest bit of the first byte
+    struct Bits128 {
+        uint64_t m_lo, m_hi;
+
+        uint32_t read(const uint32_t pos, const uint32_t count) const {
+            if (0 == count) {
+                return 0;
+            }
+
+            uint64_t result;
+            if (pos >= 64) {
+                result = this->m_hi >> (pos - 64);
+            }
+            else if (0 == pos) {
+                result = this->m_lo;
+            }
+            else {
+                result = (this->m_lo >> pos) | (this->m_hi << (64 - pos));
+            }
+
+            return static_cast<uint32_t>(result & ((uint64_t{ 1 } << count) - 1));
+        }
+    };
+
+    uint64_t reverse_bits(uint64_t x) {
+        x = ((x >> 1) & 0x5555555555555555) | ((x & 0x5555555555555555) << 1);
+        x = ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+        x = ((x >> 4) & 0x0F0F0F0F0F0F0F0F) | ((x & 0x0F0F0F0F0F0F0F0F) << 4);
+        x = ((x >> 8) & 0x00FF00FF00FF00FF) | ((x & 0x00FF00FF00FF00FF) << 8);
+        x = ((x >> 16) & 0x0000FFFF0000FFFF) | ((x & 0x0000FFFF0000FFFF) << 16);
+        return (x >> 32) | (x << 32);
+    }
+
+    // Reads from [begin, end) of bits. Bits past end read as zero, which is how the last group of trits or quints is padded.
+    class BitStream {
+
+    private:
+        const Bits128& m_bits;
+        uint32_t m_pos, m_end;
+
+    public:
+        BitStream(const Bits128& bits, const uint32_t begin, const uint32_t end)
+            : m_bits(bits)
+            , m_pos(begin)
+            , m_end(end)
+        {
+
+        }
+
+        uint32_t read(const uint32_t count) {
+            const auto available = this->m_pos < this->m_end ? std::min(count, this->m_end - this->m_pos) : 0;
+            const auto result = this->m_bits.read(this->m_pos, available);
+            this->m_pos += count;
+            return result;
+        }
+
+    };
+
+    // Indices into the range of quant, not yet unquantized
+    void decode_ise(const Bits128& bits, const uint32_t begin, const uint32_t count, const uint32_t quant, uint8_t* const out) {
+        const auto& t = ::tables();
+        const auto& method = QUANT_METHODS[quant];
+        const auto b = method.m_bits;
+        BitStream stream{ bits, begin, begin + ::ise_bit_count(count, quant) };
+
+        if (method.m_trits) {
+            for (uint32_t i = 0; i < count; i += 5) {
+                uint32_t m[5], T = 0;
+                m[0] = stream.read(b); T |= stream.read(2);
+                m[1] = stream.read(b); T |= stream.read(2) << 2;
+                m[2] = stream.read(b); T |= stream.read(1) << 4;
+                m[3] = stream.read(b); T |= stream.read(2) << 5;
+                m[4] = stream.read(b); T |= stream.read(1) << 7;
+
+                for (uint32_t j = 0; j < 5 && i + j < count; ++j) {
+                    out[i + j] = static_cast<uint8_t>((t.m_trits[T][j] << b) | m[j]);
+                }
+            }
+        }
+        else if (method.m_quints) {
+            for (uint32_t i = 0; i < count; i += 3) {
+                uint32_t m[3], Q = 0;
+                m[0] = stream.read(b); Q |= stream.read(3);
+                m[1] = stream.read(b); Q |= stream.read(2) << 3;
+                m[2] = stream.read(b); Q |= stream.read(2) << 5;
+
+                for (uint32_t j = 0; j < 3 && i + j < count; ++j) {
+                    out[i + j] = static_cast<uint8_t>((t.m_quints[Q][j] << b) | m[j]);
+                }
+            }
+        }
+        else {
+            for (uint32_t i = 0; i < count; ++i) {
+                out[i] = static_cast<uint8_t>(stream.read(b));
+            }
+        }
+    }
+
+
+    using Color = std::array<int, 4>;
+
+    // Second argument gets the base, first the signed offset
+    void bit_transfer_signed(int& a, int& b) {
+        b >>= 1;
+        b |= a & 0x80;
+        a >>= 1;
+        a &= 0x3F;
+        if (a & 0x20) {
+            a -= 0x40;
+        }
+    }
+
+    Color blue_contract(const int r, const int g, const int b, const int a) {
+        return Color{ (r + b) >> 1, (g + b) >> 1, b, a };
+    }
+
+    void clamp_unorm8(Color& c) {
+        for (auto& x : c) {
+            x = std::min(std::max(x, 0), 255);
+        }
+    }
+
+    // False for HDR modes, which LDR decoding treats as errors
+    bool decode_endpoints(const uint32_t cem, const uint8_t* const values, Color& e0, Color& e1) {
+        int v[8];
+        for (uint32_t i = 0; i < ((cem >> 2) + 1) * 2; ++i) {
+            v[i] = values[i];
+        }
+
+        switch (cem) {
+            case 0:
+                e0 = { v[0], v[0], v[0], 255 };
+                e1 = { v[1], v[1], v[1], 255 };
+                return true;
+            case 1: {
+                const auto l0 = (v[0] >> 2) | (v[1] & 0xC0);
+                const auto l1 = std::min(l0 + (v[1] & 0x3F), 255);
+                e0 = { l0, l0, l0, 255 };
+                e1 = { l1, l1, l1, 255 };
+                return true;
+            }
+            case 4:
+                e0 = { v[0], v[0], v[0], v[2] };
+                e1 = { v[1], v[1], v[1], v[3] };
+                return true;
+            case 5:
+                ::bit_transfer_signed(v[1], v[0]);
+                ::bit_transfer_signed(v[3], v[2]);
+                e0 = { v[0], v[0], v[0], v[2] };
+                e1 = { v[0] + v[1], v[0] + v[1], v[0] + v[1], v[2] + v[3] };
+                ::clamp_unorm8(e0);
+                ::clamp_unorm8(e1);
+                return true;
+            case 6:
+                e0 = { (v[0] * v[3]) >> 8, (v[1] * v[3]) >> 8, (v[2] * v[3]) >> 8, 255 };
+                e1 = { v[0], v[1], v[2], 255 };
+                return true;
+            case 10:
+                e0 = { (v[0] * v[3]) >> 8, (v[1] * v[3]) >> 8, (v[2] * v[3]) >> 8, v[4] };
+                e1 = { v[0], v[1], v[2], v[5] };
+                return true;
+            case 8:
+            case 12: {
+                if (8 == cem) {
+                    v[6] = v[7] = 255;
+                }
+
+                if (v[1] + v[3] + v[5] >= v[0] + v[2] + v[4]) {
+                    e0 = { v[0], v[2], v[4], v[6] };
+                    e1 = { v[1], v[3], v[5], v[7] };
+                }
+                else {
+                    e0 = ::blue_contract(v[1], v[3], v[5], v[7]);
+                    e1 = ::blue_contract(v[0], v[2], v[4], v[6]);
+                }
+                return true;
+            }
+            case 9:
+            case 13: {
+                if (9 == cem) {
+                    v[6] = 255;
+                    v[7] = 0;
+                }
+                else {
+                    ::bit_transfer_signed(v[7], v[6]);
+                }
+                ::bit_transfer_signed(v[1], v[0]);
+                ::bit_transfer_signed(v[3], v[2]);
+                ::bit_transfer_signed(v[5], v[4]);
+
+                if (v[1] + v[3] + v[5] >= 0) {
+                    e0 = { v[0], v[2], v[4], v[6] };
+                    e1 = { v[0] + v[1], v[2] + v[3], v[4] + v[5], v[6] + v[7] };
+                }
+                else {
+                    e0 = ::blue_contract(v[0] + v[1], v[2] + v[3], v[4] + v[5], v[6] + v[7]);
+                    e1 = ::blue_contract(v[0], v[2], v[4], v[6]);
+                }
+                ::clamp_unorm8(e0);
+                ::clamp_unorm8(e1);
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+
+    uint32_t hash52(uint32_t x) {
+        x ^= x >> 15;
+        x *= 0xEEDE0891;
+        x ^= x >> 5;
+        x += x << 16;
+        x ^= x >> 7;
+        x ^= x >> 3;
+        x ^= x << 6;
+        x ^= x >> 17;
+        return x;
+    }
+
+    // Partition of a texel in a 2D block as the specification defines it
+    uint32_t select_partition(int seed, int x, int y, const int partition_count, const bool small_block) {
+        if (small_block) {
+            x <<= 1;
+            y <<= 1;
+        }
+
+        seed += (partition_count - 1) * 1024;
+        const auto rnum = ::hash52(static_cast<uint32_t>(seed));
+
+        uint8_t seeds[8];
+        for (uint32_t i = 0; i < 8; ++i) {
+            seeds[i] = static_cast<uint8_t>((rnum >> (i * 4)) & 0xF);
+            seeds[i] = static_cast<uint8_t>(seeds[i] * seeds[i]);
+        }
+
+        int sh1, sh2;
+        if (seed & 1) {
+            sh1 = (seed & 2) ? 4 : 5;
+            sh2 = 3 == partition_count ? 6 : 5;
+        }
+        else {
+            sh1 = 3 == partition_count ? 6 : 5;
+            sh2 = (seed & 2) ? 4 : 5;
+        }
+
+        for (uint32_t i = 0; i < 8; i += 2) {
+            seeds[i] >>= sh1;
+            seeds[i + 1] >>= sh2;
+        }
+
+        // Seeds of z are left out as it's always zero in 2D
+        int a = seeds[0] * x + seeds[1] * y + (rnum >> 14);
+        int b = seeds[2] * x + seeds[3] * y + (rnum >> 10);
+        int c = seeds[4] * x + seeds[5] * y + (rnum >> 6);
+        int d = seeds[6] * x + seeds[7] * y + (rnum >> 2);
+
+        a &= 0x3F;
+        b &= 0x3F;
+        c &= 0x3F;
+        d &= 0x3F;
+
+        if (partition_count < 4) {
+            d = 0;
+        }
+        if (partition_count < 3) {
+            c = 0;
+        }
+
+        if (a >= b && a >= c && a >= d) {
+            return 0;
+        }
+        else if (b >= c && b >= d) {
+            return 1;
+        }
+        else if (c >= d) {
+            return 2;
+        }
+        else {
+            return 3;
+        }
+    }
+
+
+    // State of one decoding thread for blocks of one footprint
+    class BlockDecoder {
+
+    private:
+        uint32_t m_block_width, m_block_height, m_texel_count;
+        bool m_srgb;
+
+        // Partition of each texel for each partition count from 2 and seed, filled when a block first needs it
+        std::vector<uint8_t> m_partitions;
+        std::vector<bool> m_partitions_ready;
+
+    public:
+        BlockDecoder(const uint32_t block_width, const uint32_t block_height, const bool srgb)
+            : m_block_width(block_width)
+            , m_block_height(block_height)
+            , m_texel_count(block_width * block_height)
+            , m_srgb(srgb)
+        {
+
+        }
+
+        // 4 bytes for each texel of the block
+        void decode(const uint8_t* const block, uint8_t* const out) {
+            Bits128 bits;
+            std::memcpy(&bits.m_lo, block, 8);
+            std::memcpy(&bits.m_hi, block + 8, 8);
+
+            if (!this->decode_block(bits, out)) {
+                for (uint32_t i = 0; i < this->m_texel_count; ++i) {
+                    std::memcpy(out + i * 4, ERROR_COLOR.data(), 4);
+                }
+            }
+        }
+
+    private:
+        bool decode_block(const Bits128& bits, uint8_t* const out) {
+            const auto& t = ::tables();
+            const auto mode = bits.read(0, 11);
+
+            if ((mode & 0x1FF) == 0x1FC) {
+                return this->decode_void_extent(bits, out);
+            }
+
+            const auto& block_mode = t.m_block_modes[mode];
+            if (!block_mode.m_valid || block_mode.m_grid_width > this->m_block_width || block_mode.m_grid_height > this->m_block_height) {
+                return false;
+            }
+
+            const auto partition_count = bits.read(11, 2) + 1;
+            if (block_mode.m_dual_plane && 4 == partition_count) {
+                return false;
+            }
+
+            // Color endpoint modes, then bits of more of them and color component selector go below weights
+            int below_weights = 128 - block_mode.m_weight_bits;
+            uint32_t cems[4];
+            int color_begin;
+
+            if (1 == partition_count) {
+                cems[0] = bits.read(13, 4);
+                color_begin = 17;
+            }
+            else {
+                color_begin = 29;
+                auto encoded = bits.read(23, 6);
+
+                if (0 == (encoded & 3)) {
+                    std::fill(cems, cems + partition_count, encoded >> 2);
+                }
+                else {
+                    const auto extra_bits = 3 * partition_count - 4;
+                    below_weights -= extra_bits;
+                    encoded |= bits.read(below_weights, extra_bits) << 6;
+
+                    const auto base_class = (encoded & 3) - 1;
+                    for (uint32_t i = 0; i < partition_count; ++i) {
+                        const auto class_offset = bit_of(encoded, 2 + i);
+                        const auto low = bits_of(encoded, 2 + partition_count + i * 2, 2);
+                        cems[i] = ((base_class + class_offset) << 2) | low;
+                    }
+                }
+            }
+
+            uint32_t dual_plane_channel = 4;
+            if (block_mode.m_dual_plane) {
+                below_weights -= 2;
+                dual_plane_channel = bits.read(below_weights, 2);
+            }
+
+            // Colors
+            uint32_t color_value_count = 0;
+            for (uint32_t i = 0; i < partition_count; ++i) {
+                color_value_count += ((cems[i] >> 2) + 1) * 2;
+            }
+            if (color_value_count > 18) {
+                return false;
+            }
+
+            const auto color_bits = below_weights - color_begin;
+            if (color_bits < 0) {
+                return false;
+            }
+
+            uint32_t color_quant = QUANT_METHODS.size() - 1;
+            while (color_quant >= MIN_COLOR_QUANT && ::ise_bit_count(color_value_count, color_quant) > static_cast<uint32_t>(color_bits)) {
+                --color_quant;
+            }
+            if (color_quant < MIN_COLOR_QUANT) {
+                return false;
+            }
+
+            uint8_t color_values[18];
+            ::decode_ise(bits, color_begin, color_value_count, color_quant, color_values);
+            for (uint32_t i = 0; i < color_value_count; ++i) {
+                color_values[i] = t.m_color_unquant[color_quant][color_values[i]];
+            }
+
+            // HDR endpoints make only texels of their own partition the error color
+            Color endpoints[4][2];
+            for (uint32_t i = 0, offset = 0; i < partition_count; ++i) {
+                if (!::decode_endpoints(cems[i], color_values + offset, endpoints[i][0], endpoints[i][1])) {
+                    const Color error{ ERROR_COLOR[0], ERROR_COLOR[1], ERROR_COLOR[2], ERROR_COLOR[3] };
+                    endpoints[i][0] = error;
+                    endpoints[i][1] = error;
+                }
+                offset += ((cems[i] >> 2) + 1) * 2;
+            }
+
+            // Weights are stored from the most significant bit downwards
+            const Bits128 reversed{ ::reverse_bits(bits.m_hi), ::reverse_bits(bits.m_lo) };
+            const auto plane_count = block_mode.m_dual_plane ? 2u : 1u;
+            const uint32_t grid_size = block_mode.m_grid_width * block_mode.m_grid_height;
+
+            uint8_t grid[MAX_WEIGHT_COUNT];
+            ::decode_ise(reversed, 0, grid_size * plane_count, block_mode.m_weight_quant, grid);
+            for (uint32_t i = 0; i < grid_size * plane_count; ++i) {
+                grid[i] = t.m_weight_unquant[block_mode.m_weight_quant][grid[i]];
+            }
+
+            uint8_t weights[2][MAX_TEXEL_COUNT];
+            this->infill_weights(grid, block_mode.m_grid_width, block_mode.m_grid_height, plane_count, weights);
+
+            const uint8_t* partitions = nullptr;
+            if (partition_count > 1) {
+                partitions = this->partition_table(partition_count, bits.read(13, 10));
+            }
+
+            for (uint32_t i = 0; i < this->m_texel_count; ++i) {
+                const auto& e = endpoints[partitions ? partitions[i] : 0];
+
+                for (uint32_t c = 0; c < 4; ++c) {
+                    const int w = weights[c == dual_plane_channel ? 1 : 0][i];
+                    out[i * 4 + c] = this->interpolate(e[0][c], e[1][c], w);
+                }
+            }
+
+            return true;
+        }
+
+        bool decode_void_extent(const Bits128& bits, uint8_t* const out) const {
+            // HDR colors are errors of LDR decoding, so are reserved bits not set
+            if (bits.read(9, 1) || bits.read(10, 2) != 3) {
+                return false;
+            }
+
+            const auto low_s = bits.read(12, 13), high_s = bits.read(25, 13);
+            const auto low_t = bits.read(38, 13), high_t = bits.read(51, 13);
+            const auto all_ones = 0x1FFF == (low_s & high_s & low_t & high_t);
+            if (!all_ones && (low_s >= high_s || low_t >= high_t)) {
+                return false;
+            }
+
+            uint8_t color[4];
+            for (uint32_t c = 0; c < 4; ++c) {
+                color[c] = this->to_unorm8(bits.read(64 + c * 16, 16));
+            }
+
+            for (uint32_t i = 0; i < this->m_texel_count; ++i) {
+                std::memcpy(out + i * 4, color, 4);
+            }
+
+            return true;
+        }
+
+        // Bilinear infill of the weight grid, to [0, 64] for each texel
+        void infill_weights(const uint8_t* const grid, const uint32_t grid_width, const uint32_t grid_height, const uint32_t plane_count, uint8_t (&out)[2][MAX_TEXEL_COUNT]) const {
+            const auto ds = (1024 + this->m_block_width / 2) / (this->m_block_width - 1);
+            const auto dt = (1024 + this->m_block_height / 2) / (this->m_block_height - 1);
+
+            for (uint32_t t = 0; t < this->m_block_height; ++t) {
+                for (uint32_t s = 0; s < this->m_block_width; ++s) {
+                    const auto gs = (ds * s * (grid_width - 1) + 32) >> 6;
+                    const auto gt = (dt * t * (grid_height - 1) + 32) >> 6;
+                    const auto js = gs >> 4, fs = gs & 0xF;
+                    const auto jt = gt >> 4, ft = gt & 0xF;
+
+                    // Neighbours past the edge have a factor of zero
+                    const auto js1 = std::min(js + 1, grid_width - 1);
+                    const auto jt1 = std::min(jt + 1, grid_height - 1);
+
+                    const auto w11 = (fs * ft + 8) >> 4;
+                    const auto w10 = ft - w11;
+                    const auto w01 = fs - w11;
+                    const auto w00 = 16 - fs - ft + w11;
+
+                    for (uint32_t p = 0; p < plane_count; ++p) {
+                        const auto p00 = grid[(jt * grid_width + js) * plane_count + p];
+                        const auto p01 = grid[(jt * grid_width + js1) * plane_count + p];
+                        const auto p10 = grid[(jt1 * grid_width + js) * plane_count + p];
+                        const auto p11 = grid[(jt1 * grid_width + js1) * plane_count + p];
+
+                        out[p][t * this->m_block_width + s] = static_cast<uint8_t>((p00 * w00 + p01 * w01 + p10 * w10 + p11 * w11 + 8) >> 4);
+                    }
+                }
+            }
+        }
+
+        const uint8_t* partition_table(const uint32_t partition_count, const uint32_t seed) {
+            if (this->m_partitions.empty()) {
+                this->m_partitions.resize(3 * 1024 * this->m_texel_count);
+                this->m_partitions_ready.resize(3 * 1024, false);
+            }
+
+            const auto index = (partition_count - 2) * 1024 + seed;
+            const auto table = this->m_partitions.data() + index * this->m_texel_count;
+
+            if (!this->m_partitions_ready[index]) {
+                const auto small_block = this->m_texel_count < 31;
+
+                for (uint32_t y = 0; y < this->m_block_height; ++y) {
+                    for (uint32_t x = 0; x < this->m_block_width; ++x) {
+                        table[y * this->m_block_width + x] = static_cast<uint8_t>(::select_partition(seed, x, y, partition_count, small_block));
+                    }
+                }
+
+                this->m_partitions_ready[index] = true;
+            }
+
+            return table;
+        }
+
+        // Output is what the RGBA8 decode mode of the specification gives, the top 8 bits of the 16 bit result.
+        // SRGB expands endpoints to 16 bits with 0x80 below, which is the same as interpolating 8 bit ones.
+        // UNORM expands them by replication.
+        uint8_t interpolate(const int e0, const int e1, const int weight) const {
+            if (this->m_srgb) {
+                return static_cast<uint8_t>((e0 * (64 - weight) + e1 * weight + 32) >> 6);
+            }
+            else {
+                const auto c = (e0 * 257 * (64 - weight) + e1 * 257 * weight + 32) >> 6;
+                return this->to_unorm8(c);
+            }
+        }
+
+        uint8_t to_unorm8(const uint32_t value16) const {
+            return static_cast<uint8_t>(value16 >> 8);
+        }
+
+    };
+
+}
+
+
+namespace dal {
+
+    bool is_astc_format(const VkFormat format) {
+        return format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+    }
+
+    ImageData decode_astc(const ImageDataView& src, dal::ThreadPool& threads) {
+        if (!dal::is_astc_format(src.format)) {
+            throw std::runtime_error("image to decode is not ASTC!");
+        }
+
+        const auto format_index = static_cast<uint32_t>(src.format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK);
+        const auto& footprint = FOOTPRINTS[format_index / 2];
+        const auto srgb = 1 == format_index % 2;
+
+        const uint32_t block_width = footprint[0], block_height = footprint[1];
+        const auto blocks_x = (src.width + block_width - 1) / block_width;
+        const auto blocks_y = (src.height + block_height - 1) / block_height;
+
+        if (src.size < size_t{ blocks_x } * blocks_y * BLOCK_SIZE) {
+            throw std::runtime_error("ASTC image data is smaller than its size!");
+        }
+
+        ImageData result;
+        result.width = src.width;
+        result.height = src.height;
+        result.channels = 4;
+        result.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        result.buffer.resize(size_t{ src.width } * src.height * 4);
+
+        // Tables are built before threads start so none of them waits on another
+        ::tables();
+
+        const auto decode_rows = [&](const std::pair<uint32_t, uint32_t> rows) {
+            BlockDecoder decoder{ block_width, block_height, srgb };
+            uint8_t texels[MAX_TEXEL_COUNT * 4];
+
+            for (uint32_t by = rows.first; by < rows.second; ++by) {
+                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+                    decoder.decode(src.data + (size_t{ by } * blocks_x + bx) * BLOCK_SIZE, texels);
+
+                    // Blocks on the right and bottom edges may stick out of the image
+                    const auto x0 = bx * block_width, y0 = by * block_height;
+                    const auto copy_width = std::min(block_width, src.width - x0);
+                    const auto copy_height = std::min(block_height, src.height - y0);
+
+                    for (uint32_t y = 0; y < copy_height; ++y) {
+                        std::memcpy(
+                            result.buffer.data() + (size_t{ y0 + y } * src.width + x0) * 4,
+                            texels + y * block_width * 4,
+                            copy_width * 4
+                        );
+                    }
+                }
+            }
+        };
+
+        const auto part_count = std::max<uint32_t>(std::min(threads.thread_count(), blocks_y / MIN_BLOCK_ROWS_PER_THREAD), 1);
+        if (1 == part_count) {
+            decode_rows({ 0, blocks_y });
+        }
+        else {
+            threads.run_on_each([&](const uint32_t thread_index) {
+                if (thread_index < part_count) {
+                    decode_rows(dal::split_range(blocks_y, part_count, thread_index));
+                }
+            });
+        }
+
+        return result;
+    }
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "thread_pool.h"
+#include "util_windows.h"
+
+
+namespace dal {
+
+    // 2D ASTC formats of every block footprint from 4x4 to 12x12, both UNORM and SRGB
+    bool is_astc_format(const VkFormat format);
+
+    // Transcodes ASTC LDR blocks into R8G8B8A8 texels for devices that can't sample ASTC.
+    // Colors are bit exact to the RGBA8 decode mode of the ASTC specification. Invalid blocks and HDR void extent
+    // blocks come out magenta, as GPUs show them, and so do texels of partitions with HDR endpoints. SRGB formats stay SRGB.
+    // Rows of blocks are split among threads of the pool, the calling thread being one of them.
+    // Images too small to be worth waking the pool for are decoded on the calling thread alone.
+    ImageData decode_astc(const ImageDataView& src, dal::ThreadPool& threads);
+
+}
@@ -0,0 +1,239 @@
+#include <array>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+#include "data_tensor.h"
+#include "timer.h"
+
+
+// Per-model instance lists stored ragged and padded to the largest model, as make_draw_list keeps them.
+// Each pass resets the storage, writes a value for every instance and reads them all back.
+// at() of DataTensor is also timed against the one before strides were precomputed.
+// Exits with failure if any two ways of storing the same values disagree.
+
+
+namespace {
+
+    constexpr uint32_t PASS_COUNT = 200;
+
+
+    template <typename T>
+    T multiply_elements(const T* const data, const size_t size) {
+        T result = 1;
+
+        for (size_t i = 0; i < size; ++i) {
+            result *= data[i];
+        }
+
+        return result;
+    }
+
+    // DataTensor as it was before strides were precomputed. at() multiplies sizes of lower dimensions on every call.
+    template <typename _DataType, uint32_t _Dimension>
+    class BaselineDataTensor {
+
+    public:
+        static constexpr size_t NULL_POS = std::numeric_limits<uint32_t>::max();
+
+    private:
+        std::vector<_DataType> m_data;
+        std::array<uint32_t, _Dimension> m_sizes{ 0 };
+
+    public:
+        void reset(const std::array<uint32_t, _Dimension>& sizes) {
+            this->m_sizes = sizes;
+            this->m_data.clear();
+            this->m_data.resize( ::multiply_elements<uint32_t>(sizes.data(), sizes.size()) );
+        }
+
+        auto& at(const std::array<uint32_t, _Dimension>& indices) {
+            const auto index = this->calc_stretched_index(indices, this->m_sizes);
+            return this->m_data.at(index);
+        }
+        auto& at(const std::array<uint32_t, _Dimension>& indices) const {
+            const auto index = this->calc_stretched_index(indices, this->m_sizes);
+            return this->m_data.at(index);
+        }
+
+    private:
+        static uint32_t calc_stretched_index(const std::array<uint32_t, _Dimension>& indices, const std::array<uint32_t, _Dimension>& sizes) {
+            uint32_t result = 0;
+
+            for (uint32_t i = 0; i < indices.size(); ++i) {
+                if (indices[i] >= sizes[i]) {
+                    return NULL_POS;
+                }
+
+                const auto page_size = ::multiply_elements(sizes.data(), i);
+                result += indices[i] * page_size;
+            }
+
+            return result;
+        }
+
+    };
+
+
+    // Most models are placed once and a few are scattered many times, like props and foliage
+    std::vector<uint32_t> make_skewed_inst_counts(const uint32_t model_count, const uint32_t max_inst_count) {
+        std::vector<uint32_t> result(model_count);
+        uint32_t seed = 12345;
+
+        for (auto& x : result) {
+            seed = seed * 1664525 + 1013904223;
+            const auto rand01 = static_cast<double>(seed >> 8) / static_cast<double>(1 << 24);
+            x = 1 + static_cast<uint32_t>(rand01 * rand01 * rand01 * rand01 * (max_inst_count - 1));
+        }
+
+        return result;
+    }
+
+    std::vector<uint32_t> make_uniform_inst_counts(const uint32_t model_count, const uint32_t max_inst_count) {
+        std::vector<uint32_t> result(model_count);
+
+        for (uint32_t i = 0; i < model_count; ++i) {
+            result[i] = 1 + i % max_inst_count;
+        }
+
+        return result;
+    }
+
+
+    uint64_t run_ragged(const std::vector<uint32_t>& inst_counts, size_t& slot_count) {
+        dal::RaggedTensor<uint32_t> tensor;
+        uint64_t checksum = 0;
+
+        for (uint32_t pass = 0; pass < PASS_COUNT; ++pass) {
+            tensor.reset(inst_counts);
+
+            for (size_t model = 0; model < inst_counts.size(); ++model) {
+                auto row = tensor.row(model);
+                for (uint32_t inst = 0; inst < row.size(); ++inst) {
+                    row[inst] = pass + inst;
+                }
+            }
+
+            for (size_t model = 0; model < inst_counts.size(); ++model) {
+                for (const auto x : tensor.row(model)) {
+                    checksum += x;
+                }
+            }
+        }
+
+        slot_count = tensor.linear_size();
+        return checksum;
+    }
+
+    uint64_t run_padded(const std::vector<uint32_t>& inst_counts, size_t& slot_count) {
+        uint32_t max_inst_count = 0;
+        for (const auto x : inst_counts) {
+            max_inst_count = std::max(max_inst_count, x);
+        }
+
+        dal::DataTensor<uint32_t, 2> tensor;
+        uint64_t checksum = 0;
+
+        for (uint32_t pass = 0; pass < PASS_COUNT; ++pass) {
+            tensor.reset({ max_inst_count, static_cast<uint32_t>(inst_counts.size()) });
+
+            for (uint32_t model = 0; model < inst_counts.size(); ++model) {
+                auto row = tensor.slice(model);
+                for (uint32_t inst = 0; inst < inst_counts[model]; ++inst) {
+                    row[inst] = pass + inst;
+                }
+            }
+
+            for (uint32_t model = 0; model < inst_counts.size(); ++model) {
+                const auto row = tensor.slice(model);
+                for (uint32_t inst = 0; inst < inst_counts[model]; ++inst) {
+                    checksum += row[inst];
+                }
+            }
+        }
+
+        slot_count = tensor.linear_size();
+        return checksum;
+    }
+
+
+    // Padded storage accessed element by element through at()
+    template <typename _Tensor>
+    uint64_t run_at(const std::vector<uint32_t>& inst_counts) {
+        uint32_t max_inst_count = 0;
+        for (const auto x : inst_counts) {
+            max_inst_count = std::max(max_inst_count, x);
+        }
+
+        _Tensor tensor;
+        uint64_t checksum = 0;
+
+        for (uint32_t pass = 0; pass < PASS_COUNT; ++pass) {
+            tensor.reset({ max_inst_count, static_cast<uint32_t>(inst_counts.size()) });
+
+            for (uint32_t model = 0; model < inst_counts.size(); ++model) {
+                for (uint32_t inst = 0; inst < inst_counts[model]; ++inst) {
+                    tensor.at({ inst, model }) = pass + inst;
+                }
+            }
+
+            const auto& const_tensor = tensor;
+            for (uint32_t model = 0; model < inst_counts.size(); ++model) {
+                for (uint32_t inst = 0; inst < inst_counts[model]; ++inst) {
+                    checksum += const_tensor.at({ inst, model });
+                }
+            }
+        }
+
+        return checksum;
+    }
+
+
+    // Returns false if checksums differ
+    bool compare(const char* const name, const std::vector<uint32_t>& inst_counts) {
+        size_t inst_count = 0;
+        for (const auto x : inst_counts) {
+            inst_count += x;
+        }
+
+        size_t ragged_slots = 0, padded_slots = 0;
+
+        dal::Timer timer;
+        const auto ragged_sum = run_ragged(inst_counts, ragged_slots);
+        const auto ragged_ms = timer.checkGetElapsed() * 1000.0;
+        const auto padded_sum = run_padded(inst_counts, padded_slots);
+        const auto padded_ms = timer.checkGetElapsed() * 1000.0;
+        const auto at_sum = run_at<dal::DataTensor<uint32_t, 2>>(inst_counts);
+        const auto at_ms = timer.checkGetElapsed() * 1000.0;
+        const auto baseline_at_sum = run_at<BaselineDataTensor<uint32_t, 2>>(inst_counts);
+        const auto baseline_at_ms = timer.checkGetElapsed() * 1000.0;
+
+        std::cout << name << ": " << inst_counts.size() << " models, " << inst_count << " instances\n";
+        std::cout << "    ragged: " << ragged_slots << " slots, " << ragged_ms << " ms\n";
+        std::cout << "    padded: " << padded_slots << " slots, " << padded_ms << " ms\n";
+        std::cout << "    padded at(): " << at_ms << " ms, before precomputed strides: " << baseline_at_ms << " ms\n";
+
+        if (ragged_sum != padded_sum || ragged_sum != at_sum || ragged_sum != baseline_at_sum) {
+            std::cout << "    checksums differ!\n";
+            return false;
+        }
+
+        return true;
+    }
+
+}
+
+
+int main() {
+    std::cout << PASS_COUNT << " passes of reset, write and read\n";
+
+    bool success = true;
+    success = ::compare("skewed", ::make_skewed_inst_counts(1024, 1024)) && success;
+    success = ::compare("uniform", ::make_uniform_inst_counts(1024, 64)) && success;
+    success = ::compare("single", ::make_uniform_inst_counts(4096, 1)) && success;
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,5 +1,7 @@
 #include "command_pool.h"
 
+#include <array>
+#include <utility>
 #include <stdexcept>
 
 #include "util_vulkan.h"
@@ -7,12 +9,10 @@
 
 namespace {
 
-    VkCommandPool createCommandPool(VkPhysicalDevice PhysDevice, VkDevice logiDevice, VkSurfaceKHR surface) {
-        dal::QueueFamilyIndices queueFamilyIndices = dal::findQueueFamilies(PhysDevice, surface);
-
+    VkCommandPool createCommandPool(const uint32_t queue_family_index, VkDevice logiDevice) {
         VkCommandPoolCreateInfo poolInfo = {};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily();
+        poolInfo.queueFamilyIndex = queue_family_index;
         poolInfo.flags = 0; // Optional
 
         VkCommandPool commandPool = VK_NULL_HANDLE;
@@ -23,6 +23,11 @@ namespace {
         return commandPool;
     }
 
+    VkCommandPool createCommandPool(VkPhysicalDevice PhysDevice, VkDevice logiDevice, VkSurfaceKHR surface) {
+        dal::QueueFamilyIndices queueFamilyIndices = dal::findQueueFamilies(PhysDevice, surface);
+        return ::createCommandPool(queueFamilyIndices.graphicsFamily(), logiDevice);
+    }
+
 }
 
 
@@ -34,6 +39,12 @@ namespace dal {
         this->m_pool = createCommandPool(physDevice, logiDevice, surface);
     }
 
+    void CommandPool::init(const uint32_t queue_family_index, VkDevice logiDevice) {
+        this->destroy(logiDevice);
+
+        this->m_pool = createCommandPool(queue_family_index, logiDevice);
+    }
+
     void CommandPool::destroy(const VkDevice logiDevice) {
         if (VK_NULL_HANDLE != this->m_pool) {
             vkDestroyCommandPool(logiDevice, this->m_pool, nullptr);
@@ -60,18 +71,216 @@ namespace dal {
         return commandBuffer;
     }
 
-    void CommandPool::endSingleTimeCmd(VkCommandBuffer cmdBuffer, VkDevice logiDevice, VkQueue graphicsQueue) {
-        vkEndCommandBuffer(cmdBuffer);
+}
+
+
+namespace dal {
+
+    void UploadQueues::init(
+        const uint32_t graphics_family,
+        const VkQueue graphics_queue,
+        const uint32_t transfer_family,
+        const VkQueue transfer_queue,
+        const VkDevice logiDevice
+    ) {
+        this->m_graphics_family = graphics_family;
+        this->m_graphics_queue = graphics_queue;
+        this->m_transfer_family = transfer_family;
+        this->m_transfer_queue = transfer_queue;
+
+        this->m_graphics_pool.init(graphics_family, logiDevice);
+        this->m_transfer_pool.init(transfer_family, logiDevice);
+        this->m_timeline.init(logiDevice, 0);
+        this->m_last_value = 0;
+    }
+
+    void UploadQueues::destroy(const VkDevice logiDevice) {
+        if (VK_NULL_HANDLE != this->m_timeline.get()) {
+            this->m_timeline.wait(logiDevice, this->m_last_value);
+        }
+
+        for (auto& x : this->m_submitted) {
+            this->free_batch(x, logiDevice);
+        }
+        this->m_submitted.clear();
+        this->free_batch(this->m_recording, logiDevice);
+
+        this->m_timeline.destroy(logiDevice);
+        this->m_last_value = 0;
+        this->m_transfer_pool.destroy(logiDevice);
+        this->m_graphics_pool.destroy(logiDevice);
+    }
+
+    VkCommandBuffer UploadQueues::transfer_cmd(const VkDevice logiDevice) {
+        if (VK_NULL_HANDLE == this->m_recording.m_transfer_cmd) {
+            this->m_recording.m_transfer_cmd = this->m_transfer_pool.beginSingleTimeCmd(logiDevice);
+        }
+
+        return this->m_recording.m_transfer_cmd;
+    }
+
+    VkCommandBuffer UploadQueues::graphics_cmd(const VkDevice logiDevice) {
+        if (VK_NULL_HANDLE == this->m_recording.m_graphics_cmd) {
+            this->m_recording.m_graphics_cmd = this->m_graphics_pool.beginSingleTimeCmd(logiDevice);
+        }
+
+        return this->m_recording.m_graphics_cmd;
+    }
+
+    void UploadQueues::retire_staging_buffer(const VkBuffer buffer, const VkDeviceMemory memory) {
+        this->m_recording.m_staging.push_back(StagingBuffer{ buffer, memory });
+    }
+
+    void UploadQueues::submit(const VkDevice logiDevice) {
+        const auto completed = this->m_timeline.value(logiDevice);
+        for (auto iter = this->m_submitted.begin(); iter != this->m_submitted.end();) {
+            if (iter->m_value <= completed) {
+                this->free_batch(*iter, logiDevice);
+                iter = this->m_submitted.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+
+        auto& batch = this->m_recording;
+        if (VK_NULL_HANDLE == batch.m_transfer_cmd && VK_NULL_HANDLE == batch.m_graphics_cmd) {
+            return;
+        }
+
+        // Each submission waits for the one before, so the transfer batch also comes after the last graphics batch
+        const std::array<std::pair<VkQueue, VkCommandBuffer>, 2> submissions{
+            std::make_pair(this->m_transfer_queue, batch.m_transfer_cmd),
+            std::make_pair(this->m_graphics_queue, batch.m_graphics_cmd),
+        };
+
+        for (auto [queue, cmd_buf] : submissions) {
+            if (VK_NULL_HANDLE == cmd_buf) {
+                continue;
+            }
+
+            dal::assert_vk_success(vkEndCommandBuffer(cmd_buf));
+
+            const auto semaphore = this->m_timeline.get();
+            const uint64_t wait_value = this->m_last_value;
+            const uint64_t signal_value = this->m_last_value + 1;
+            const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+            VkTimelineSemaphoreSubmitInfo timeline_info{};
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timeline_info.waitSemaphoreValueCount = 1;
+            timeline_info.pWaitSemaphoreValues = &wait_value;
+            timeline_info.signalSemaphoreValueCount = 1;
+            timeline_info.pSignalSemaphoreValues = &signal_value;
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &cmdBuffer;
+            VkSubmitInfo submit_info{};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.pNext = &timeline_info;
+            submit_info.waitSemaphoreCount = 1;
+            submit_info.pWaitSemaphores = &semaphore;
+            submit_info.pWaitDstStageMask = &wait_stage;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &cmd_buf;
+            submit_info.signalSemaphoreCount = 1;
+            submit_info.pSignalSemaphores = &semaphore;
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
+            if (VK_SUCCESS != vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE)) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+
+            this->m_last_value = signal_value;
+        }
+
+        batch.m_value = this->m_last_value;
+        this->m_submitted.push_back(std::move(batch));
+        batch = Batch{};
+    }
+
+    void UploadQueues::free_batch(Batch& batch, const VkDevice logiDevice) {
+        if (VK_NULL_HANDLE != batch.m_transfer_cmd) {
+            vkFreeCommandBuffers(logiDevice, this->m_transfer_pool.pool(), 1, &batch.m_transfer_cmd);
+        }
+        if (VK_NULL_HANDLE != batch.m_graphics_cmd) {
+            vkFreeCommandBuffers(logiDevice, this->m_graphics_pool.pool(), 1, &batch.m_graphics_cmd);
+        }
+
+        for (auto& x : batch.m_staging) {
+            vkDestroyBuffer(logiDevice, x.m_buffer, nullptr);
+            vkFreeMemory(logiDevice, x.m_memory, nullptr);
+        }
+
+        batch = Batch{};
+    }
+
+}
+
+
+namespace dal {
+
+    void FrameCommandPools::init(const uint32_t frame_count, const uint32_t thread_count, const uint32_t queue_family_index, const VkDevice logiDevice) {
+        this->destroy(logiDevice);
+
+        this->m_thread_count = thread_count;
+        for (uint32_t i = 0; i < frame_count * thread_count; ++i) {
+            this->m_pools.push_back(::createCommandPool(queue_family_index, logiDevice));
+        }
+    }
+
+    void FrameCommandPools::destroy(const VkDevice logiDevice) {
+        for (auto pool : this->m_pools) {
+            vkDestroyCommandPool(logiDevice, pool, nullptr);
+        }
+        this->m_pools.clear();
+        this->m_thread_count = 0;
+    }
+
+    void FrameCommandPools::reset_at(const uint32_t frame_index, const uint32_t thread_index, const VkDevice logiDevice) {
+        dal::assert_vk_success(
+            vkResetCommandPool(logiDevice, this->pool_at(frame_index, thread_index), 0)
+        );
+    }
+
+}
+
+
+namespace dal {
+
+    void SecondaryCommandBuffers::init(const FrameCommandPools& cmd_pools, const VkDevice logiDevice) {
+        this->destroy(cmd_pools, logiDevice);
+
+        this->m_thread_count = cmd_pools.thread_count();
+        this->m_buffers.resize(cmd_pools.frame_count() * this->m_thread_count);
+
+        for (uint32_t i = 0; i < cmd_pools.frame_count(); ++i) {
+            for (uint32_t thread_index = 0; thread_index < this->m_thread_count; ++thread_index) {
+                VkCommandBufferAllocateInfo allocInfo = {};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = cmd_pools.pool_at(i, thread_index);
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+
+                dal::assert_vk_success(
+                    vkAllocateCommandBuffers(logiDevice, &allocInfo, &this->m_buffers.at(i * this->m_thread_count + thread_index))
+                );
+            }
+        }
+    }
+
+    void SecondaryCommandBuffers::destroy(const FrameCommandPools& cmd_pools, const VkDevice logiDevice) {
+        if (this->m_buffers.empty()) {
+            return;
+        }
+
+        const auto frame_count = this->m_buffers.size() / this->m_thread_count;
+
+        for (uint32_t i = 0; i < frame_count; ++i) {
+            for (uint32_t thread_index = 0; thread_index < this->m_thread_count; ++thread_index) {
+                vkFreeCommandBuffers(logiDevice, cmd_pools.pool_at(i, thread_index), 1, &this->at(i, thread_index));
+            }
+        }
 
-        vkFreeCommandBuffers(logiDevice, this->pool(), 1, &cmdBuffer);
+        this->m_buffers.clear();
+        this->m_thread_count = 0;
     }
 
 }
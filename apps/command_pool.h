@@ -1,9 +1,12 @@
 #pragma once
 
 #include <cassert>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
+#include "semaphore.h"
+
 
 namespace dal {
 
@@ -14,10 +17,10 @@ namespace dal {
 
     public:
         void init(VkPhysicalDevice physDevice, VkDevice logiDevice, VkSurfaceKHR surface);
+        void init(const uint32_t queue_family_index, VkDevice logiDevice);
         void destroy(const VkDevice logiDevice);
 
         VkCommandBuffer beginSingleTimeCmd(const VkDevice logiDevice);
-        void endSingleTimeCmd(VkCommandBuffer cmdBuffer, VkDevice logiDevice, VkQueue graphicsQueue);
 
         auto& pool() const {
             assert(VK_NULL_HANDLE != this->m_pool);
@@ -26,4 +29,140 @@ namespace dal {
 
     };
 
+
+    // Pools and queues to upload resources with.
+    // Copies go to the transfer queue, which is a dedicated one if the device has it, so they don't queue behind rendering.
+    // Anything needing graphics capability, like blits and barriers to fragment shader stage, goes to the graphics queue.
+    // If the two queues are of different families, a resource written on the transfer queue must be released there
+    // and acquired on the graphics queue before use. See needs_ownership_transfer().
+    //
+    // Commands recorded between two submit() calls go to GPU as one batch for each queue, without CPU waiting for either.
+    // Transfer batch signals a timeline value the graphics batch waits on, so releases complete before their acquires.
+    // Frames submitted after submit() must wait on timeline() reaching last_value() before reading what was uploaded.
+    class UploadQueues {
+
+    private:
+        struct StagingBuffer {
+            VkBuffer m_buffer = VK_NULL_HANDLE;
+            VkDeviceMemory m_memory = VK_NULL_HANDLE;
+        };
+
+        // Freed once timeline reaches m_value after submission
+        struct Batch {
+            VkCommandBuffer m_transfer_cmd = VK_NULL_HANDLE;
+            VkCommandBuffer m_graphics_cmd = VK_NULL_HANDLE;
+            std::vector<StagingBuffer> m_staging;
+            uint64_t m_value = 0;
+        };
+
+    private:
+        CommandPool m_graphics_pool, m_transfer_pool;
+        VkQueue m_graphics_queue = VK_NULL_HANDLE;
+        VkQueue m_transfer_queue = VK_NULL_HANDLE;
+        uint32_t m_graphics_family = 0;
+        uint32_t m_transfer_family = 0;
+
+        TimelineSemaphore m_timeline;
+        uint64_t m_last_value = 0;  // Signaled by the last batch submitted
+        Batch m_recording;
+        std::vector<Batch> m_submitted;
+
+    public:
+        void init(
+            const uint32_t graphics_family,
+            const VkQueue graphics_queue,
+            const uint32_t transfer_family,
+            const VkQueue transfer_queue,
+            const VkDevice logiDevice
+        );
+        // Waits for every submitted batch. Commands recorded but not submitted are dropped.
+        void destroy(const VkDevice logiDevice);
+
+        // Command buffer of the batch being recorded, begun on first use. Don't end it.
+        VkCommandBuffer transfer_cmd(const VkDevice logiDevice);
+        VkCommandBuffer graphics_cmd(const VkDevice logiDevice);
+        // Destroyed once the batch being recorded is complete
+        void retire_staging_buffer(const VkBuffer buffer, const VkDeviceMemory memory);
+
+        // Does nothing if nothing was recorded. Also frees batches GPU has completed.
+        void submit(const VkDevice logiDevice);
+
+        bool needs_ownership_transfer() const {
+            return this->m_graphics_family != this->m_transfer_family;
+        }
+        uint32_t graphics_family() const {
+            return this->m_graphics_family;
+        }
+        uint32_t transfer_family() const {
+            return this->m_transfer_family;
+        }
+        auto& timeline() const {
+            return this->m_timeline;
+        }
+        uint64_t last_value() const {
+            return this->m_last_value;
+        }
+
+    private:
+        void free_batch(Batch& batch, const VkDevice logiDevice);
+
+    };
+
+
+    // Pools of one pass for each frame in flight and each recording thread.
+    // A pool must not be used by two threads at once, and resetting the pools of a frame
+    // returns every command buffer the pass recorded for that frame to the initial state.
+    class FrameCommandPools {
+
+    private:
+        std::vector<VkCommandPool> m_pools;  // [frame index][thread index]
+        uint32_t m_thread_count = 0;
+
+    public:
+        void init(const uint32_t frame_count, const uint32_t thread_count, const uint32_t queue_family_index, const VkDevice logiDevice);
+        void destroy(const VkDevice logiDevice);
+
+        // Command buffers allocated from these pools must not be pending execution
+        void reset_at(const uint32_t frame_index, const uint32_t thread_index, const VkDevice logiDevice);
+
+        auto& pool_at(const uint32_t frame_index, const uint32_t thread_index) const {
+            assert(thread_index < this->m_thread_count);
+            return this->m_pools.at(frame_index * this->m_thread_count + thread_index);
+        }
+        uint32_t frame_count() const {
+            return 0 != this->m_thread_count ? this->m_pools.size() / this->m_thread_count : 0;
+        }
+        uint32_t thread_count() const {
+            return this->m_thread_count;
+        }
+
+    };
+
+
+    // Secondary command buffers for each frame in flight and each recording thread.
+    // Each buffer is allocated from the pool of its own frame and thread.
+    class SecondaryCommandBuffers {
+
+    private:
+        std::vector<VkCommandBuffer> m_buffers;  // [frame index][thread index]
+        uint32_t m_thread_count = 0;
+
+    public:
+        void init(const FrameCommandPools& cmd_pools, const VkDevice logiDevice);
+        void destroy(const FrameCommandPools& cmd_pools, const VkDevice logiDevice);
+
+        auto& at(const uint32_t frame_index, const uint32_t thread_index) const {
+            assert(thread_index < this->m_thread_count);
+            return this->m_buffers.at(frame_index * this->m_thread_count + thread_index);
+        }
+        // thread_count() buffers of a frame in thread order, for vkCmdExecuteCommands
+        const VkCommandBuffer* data_at(const uint32_t frame_index) const {
+            return &this->at(frame_index, 0);
+        }
+        uint32_t thread_count() const {
+            return this->m_thread_count;
+        }
+
+    };
+
 }
@@ -3,55 +3,163 @@
 #include <array>
 #include <vector>
 #include <limits>
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
 
 
 namespace dal {
 
-    template <typename T>
-    T _multipliy_elements(const T* const data, const size_t size) {
-        T result = 1;
+    // Non owning view of contiguous elements. Invalidated when the tensor it came from is reset.
+    template <typename _DataType>
+    class DataSpan {
+
+    private:
+        _DataType* m_begin = nullptr;
+        _DataType* m_end = nullptr;
+
+    public:
+        DataSpan() = default;
+        DataSpan(_DataType* const begin, _DataType* const end)
+            : m_begin(begin)
+            , m_end(end)
+        {
 
-        for (size_t i = 0; i < size; ++i) {
-            result *= data[i];
         }
 
-        return result;
-    }
+        _DataType& operator[](const size_t index) const {
+            assert(index < this->size());
+            return this->m_begin[index];
+        }
+        _DataType& at(const size_t index) const {
+            if (index >= this->size()) {
+                throw std::out_of_range("index out of data span");
+            }
+            return this->m_begin[index];
+        }
 
+        _DataType* begin() const {
+            return this->m_begin;
+        }
+        _DataType* end() const {
+            return this->m_end;
+        }
+        _DataType* data() const {
+            return this->m_begin;
+        }
+        size_t size() const {
+            return this->m_end - this->m_begin;
+        }
+        bool empty() const {
+            return this->m_begin == this->m_end;
+        }
 
+    };
+
+
+    // Dense tensor whose first dimension is the fastest varying one.
+    // Strides are computed once at reset, so finding an element costs a multiply and an add for each dimension.
     template <typename _DataType, uint32_t _Dimension>
     class DataTensor {
 
+        static_assert(_Dimension > 0);
+
     public:
-        static constexpr size_t NULL_POS = std::numeric_limits<uint32_t>::max();
+        using index_t = std::array<uint32_t, _Dimension>;
+
+        static constexpr size_t NULL_POS = std::numeric_limits<size_t>::max();
 
     private:
         std::vector<_DataType> m_data;
-        std::array<uint32_t, _Dimension> m_sizes{ 0 };
+        index_t m_sizes{};
+        // Elements between two neighbours along each dimension
+        index_t m_strides{};
 
     public:
-        void reset(const std::array<uint32_t, _Dimension>& sizes) {
+        void reset(const index_t& sizes) {
             this->m_sizes = sizes;
+
+            size_t linear_size = 1;
+            for (uint32_t i = 0; i < _Dimension; ++i) {
+                this->m_strides[i] = static_cast<uint32_t>(linear_size);
+                linear_size *= sizes[i];
+            }
+
+            if (linear_size > std::numeric_limits<uint32_t>::max()) {
+                throw std::length_error("data tensor is too large");
+            }
+
             this->m_data.clear();
-            this->m_data.resize( dal::_multipliy_elements<uint32_t>(sizes.data(), sizes.size()) );
+            this->m_data.resize(linear_size);
         }
         void clear() {
             this->m_data.clear();
-            this->m_sizes = std::array<uint32_t, _Dimension>{ 0 };
+            this->m_sizes = index_t{};
+            this->m_strides = index_t{};
+        }
+
+        // Unchecked except by assert
+        _DataType& operator[](const index_t& indices) {
+            return this->m_data[this->linear_index(indices)];
+        }
+        const _DataType& operator[](const index_t& indices) const {
+            return this->m_data[this->linear_index(indices)];
         }
 
-        auto& at(const std::array<uint32_t, _Dimension>& indices) {
-            const auto index = this->calc_stretched_index(indices, this->m_sizes);
-            return this->m_data.at(index);
+        // Throws std::out_of_range
+        _DataType& at(const index_t& indices) {
+            return this->m_data[this->checked_linear_index(indices)];
         }
-        auto& at(const std::array<uint32_t, _Dimension>& indices) const {
-            const auto index = this->calc_stretched_index(indices, this->m_sizes);
-            return this->m_data.at(index);
+        const _DataType& at(const index_t& indices) const {
+            return this->m_data[this->checked_linear_index(indices)];
+        }
+
+        // Every element whose index in the last dimension is last_index, a contiguous tensor of one less dimension
+        DataSpan<_DataType> slice(const uint32_t last_index) {
+            assert(last_index < this->m_sizes[_Dimension - 1]);
+            const auto begin = this->m_data.data() + static_cast<size_t>(last_index) * this->m_strides[_Dimension - 1];
+            return DataSpan<_DataType>{ begin, begin + this->m_strides[_Dimension - 1] };
+        }
+        DataSpan<const _DataType> slice(const uint32_t last_index) const {
+            assert(last_index < this->m_sizes[_Dimension - 1]);
+            const auto begin = this->m_data.data() + static_cast<size_t>(last_index) * this->m_strides[_Dimension - 1];
+            return DataSpan<const _DataType>{ begin, begin + this->m_strides[_Dimension - 1] };
+        }
+
+        // Returns NULL_POS if any index is out of range
+        size_t find_linear_index(const index_t& indices) const {
+            size_t result = 0;
+
+            for (uint32_t i = 0; i < _Dimension; ++i) {
+                if (indices[i] >= this->m_sizes[i]) {
+                    return NULL_POS;
+                }
+
+                result += static_cast<size_t>(indices[i]) * this->m_strides[i];
+            }
+
+            return result;
+        }
+
+        auto begin() {
+            return this->m_data.begin();
+        }
+        auto end() {
+            return this->m_data.end();
+        }
+        auto begin() const {
+            return this->m_data.begin();
+        }
+        auto end() const {
+            return this->m_data.end();
         }
 
         auto& sizes() const {
             return this->m_sizes;
         }
+        auto& strides() const {
+            return this->m_strides;
+        }
         auto linear_size() const {
             return this->m_data.size();
         }
@@ -63,21 +171,122 @@ namespace dal {
         }
 
     private:
-        static uint32_t calc_stretched_index(const std::array<uint32_t, _Dimension>& indices, const std::array<uint32_t, _Dimension>& sizes) {
-            uint32_t result = 0;
+        size_t linear_index(const index_t& indices) const {
+            size_t result = 0;
 
-            for (uint32_t i = 0; i < indices.size(); ++i) {
-                if (indices[i] >= sizes[i]) {
-                    return NULL_POS;
-                }
-
-                const auto page_size = dal::_multipliy_elements(sizes.data(), i);
-                result += indices[i] * page_size;
+            for (uint32_t i = 0; i < _Dimension; ++i) {
+                assert(indices[i] < this->m_sizes[i]);
+                result += static_cast<size_t>(indices[i]) * this->m_strides[i];
             }
 
             return result;
         }
 
+        size_t checked_linear_index(const index_t& indices) const {
+            const auto result = this->find_linear_index(indices);
+            if (NULL_POS == result) {
+                throw std::out_of_range("index out of data tensor");
+            }
+            return result;
+        }
+
+    };
+
+
+    // Rows of different lengths stored back to back, such as instances of each model.
+    // Row i starts at offsets[i] and ends at offsets[i + 1], so no slot is spent padding short rows to the longest one.
+    template <typename _DataType>
+    class RaggedTensor {
+
+    private:
+        std::vector<_DataType> m_data;
+        // One more than the row count, starting with 0
+        std::vector<size_t> m_offsets{ 0 };
+
+    public:
+        void reset(const std::vector<uint32_t>& row_sizes) {
+            this->m_offsets.resize(row_sizes.size() + 1);
+            this->m_offsets[0] = 0;
+
+            for (size_t i = 0; i < row_sizes.size(); ++i) {
+                this->m_offsets[i + 1] = this->m_offsets[i] + row_sizes[i];
+            }
+
+            this->m_data.clear();
+            this->m_data.resize(this->m_offsets.back());
+        }
+        void clear() {
+            this->m_data.clear();
+            this->m_offsets.assign(1, 0);
+        }
+
+        // Unchecked except by assert
+        _DataType& operator()(const size_t row, const size_t col) {
+            assert(col < this->row_size(row));
+            return this->m_data[this->m_offsets[row] + col];
+        }
+        const _DataType& operator()(const size_t row, const size_t col) const {
+            assert(col < this->row_size(row));
+            return this->m_data[this->m_offsets[row] + col];
+        }
+
+        // Throws std::out_of_range
+        _DataType& at(const size_t row, const size_t col) {
+            return this->m_data[this->checked_linear_index(row, col)];
+        }
+        const _DataType& at(const size_t row, const size_t col) const {
+            return this->m_data[this->checked_linear_index(row, col)];
+        }
+
+        DataSpan<_DataType> row(const size_t row) {
+            assert(row < this->row_count());
+            return DataSpan<_DataType>{ this->m_data.data() + this->m_offsets[row], this->m_data.data() + this->m_offsets[row + 1] };
+        }
+        DataSpan<const _DataType> row(const size_t row) const {
+            assert(row < this->row_count());
+            return DataSpan<const _DataType>{ this->m_data.data() + this->m_offsets[row], this->m_data.data() + this->m_offsets[row + 1] };
+        }
+
+        auto begin() {
+            return this->m_data.begin();
+        }
+        auto end() {
+            return this->m_data.end();
+        }
+        auto begin() const {
+            return this->m_data.begin();
+        }
+        auto end() const {
+            return this->m_data.end();
+        }
+
+        size_t row_count() const {
+            return this->m_offsets.size() - 1;
+        }
+        size_t row_size(const size_t row) const {
+            return this->m_offsets[row + 1] - this->m_offsets[row];
+        }
+        auto& offsets() const {
+            return this->m_offsets;
+        }
+        auto linear_size() const {
+            return this->m_data.size();
+        }
+        auto data() {
+            return this->m_data.data();
+        }
+        auto data() const {
+            return this->m_data.data();
+        }
+
+    private:
+        size_t checked_linear_index(const size_t row, const size_t col) const {
+            if (row >= this->row_count() || col >= this->row_size(row)) {
+                throw std::out_of_range("index out of ragged tensor");
+            }
+            return this->m_offsets[row] + col;
+        }
+
     };
 
 }
@@ -54,18 +54,39 @@ namespace  dal {
     void DepthImage::init(VkExtent2D extent, VkDevice logiDevice, VkPhysicalDevice physDevice) {
         this->m_depth_format = ::findDepthFormat(physDevice);
 
-        dal::createImage(
-            extent.width, extent.height,
-            1,
-            this->m_depth_format,
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            this->depthImage,
-            this->depthImageMemory,
-            logiDevice,
-            physDevice
-        );
+        // Depth is only read as an input attachment in the same render pass and never stored
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = extent.width;
+        imageInfo.extent.height = extent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = this->m_depth_format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (VK_SUCCESS != vkCreateImage(logiDevice, &imageInfo, nullptr, &this->depthImage)) {
+            throw std::runtime_error("failed to create depth image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(logiDevice, this->depthImage, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = dal::find_transient_mem_type(memRequirements.memoryTypeBits, physDevice);
+
+        if (VK_SUCCESS != vkAllocateMemory(logiDevice, &allocInfo, nullptr, &this->depthImageMemory)) {
+            throw std::runtime_error("failed to allocate depth image memory!");
+        }
+
+        vkBindImageMemory(logiDevice, this->depthImage, this->depthImageMemory, 0);
 
         this->depthImageView = dal::createImageView(
             this->depthImage,
@@ -0,0 +1,135 @@
+#include "desc_allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+    VkResult try_allocate(const VkDescriptorPool pool, const VkDescriptorSetLayout layout, VkDescriptorSet& output, const VkDevice logi_device) {
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &layout;
+
+        return vkAllocateDescriptorSets(logi_device, &alloc_info, &output);
+    }
+
+    bool is_pool_exhausted(const VkResult result) {
+        return VK_ERROR_OUT_OF_POOL_MEMORY == result || VK_ERROR_FRAGMENTED_POOL == result;
+    }
+
+}
+
+
+namespace dal {
+
+    void DescAllocator::init(const uint32_t first_pool_set_count, const VkDevice logi_device) {
+        this->destroy(logi_device);
+        this->m_next_pool_set_count = std::max<uint32_t>(first_pool_set_count, 1);
+    }
+
+    void DescAllocator::destroy(const VkDevice logi_device) {
+        this->reset(logi_device);
+
+        for (auto x : this->m_ready_pools) {
+            vkDestroyDescriptorPool(logi_device, x, nullptr);
+        }
+        this->m_ready_pools.clear();
+
+        this->m_observed_desc_counts.clear();
+        this->m_observed_set_count = 0;
+    }
+
+    void DescAllocator::reset(const VkDevice logi_device) {
+        if (VK_NULL_HANDLE != this->m_current_pool) {
+            this->m_full_pools.push_back(this->m_current_pool);
+            this->m_current_pool = VK_NULL_HANDLE;
+        }
+
+        for (auto x : this->m_full_pools) {
+            if (VK_SUCCESS != vkResetDescriptorPool(logi_device, x, 0)) {
+                throw std::runtime_error{ "failed to reset descriptor pool" };
+            }
+            this->m_ready_pools.push_back(x);
+        }
+        this->m_full_pools.clear();
+    }
+
+    VkDescriptorSet DescAllocator::allocate(
+        const VkDescriptorSetLayout layout,
+        const std::vector<VkDescriptorPoolSize>& layout_counts,
+        const VkDevice logi_device
+    ) {
+        for (auto& x : layout_counts) {
+            this->m_observed_desc_counts[x.type] += x.descriptorCount;
+        }
+        ++this->m_observed_set_count;
+
+        VkDescriptorSet result = VK_NULL_HANDLE;
+
+        while (true) {
+            if (VK_NULL_HANDLE != this->m_current_pool) {
+                const auto alloc_result = ::try_allocate(this->m_current_pool, layout, result, logi_device);
+                if (VK_SUCCESS == alloc_result) {
+                    return result;
+                }
+                else if (!::is_pool_exhausted(alloc_result)) {
+                    throw std::runtime_error("failed to allocate descriptor sets!");
+                }
+
+                this->m_full_pools.push_back(this->m_current_pool);
+                this->m_current_pool = VK_NULL_HANDLE;
+            }
+
+            // Pools from before reset may be sized for other layouts. If so, they are passed over.
+            if (!this->m_ready_pools.empty()) {
+                this->m_current_pool = this->m_ready_pools.back();
+                this->m_ready_pools.pop_back();
+                continue;
+            }
+
+            // A new pool always has room for at least one set of the layout
+            this->m_current_pool = this->create_pool(layout_counts, logi_device);
+            if (VK_SUCCESS != ::try_allocate(this->m_current_pool, layout, result, logi_device)) {
+                throw std::runtime_error("failed to allocate descriptor sets!");
+            }
+
+            return result;
+        }
+    }
+
+    VkDescriptorPool DescAllocator::create_pool(const std::vector<VkDescriptorPoolSize>& layout_counts, const VkDevice logi_device) {
+        const auto set_count = this->m_next_pool_set_count;
+        this->m_next_pool_set_count = std::min(set_count * 2, MAX_POOL_SET_COUNT);
+
+        std::vector<VkDescriptorPoolSize> pool_sizes;
+        for (auto& [type, observed_count] : this->m_observed_desc_counts) {
+            auto& x = pool_sizes.emplace_back();
+            x.type = type;
+            // Rounded up so a type seen at all gets at least one descriptor
+            x.descriptorCount = static_cast<uint32_t>((observed_count * set_count + this->m_observed_set_count - 1) / this->m_observed_set_count);
+
+            for (auto& y : layout_counts) {
+                if (y.type == type) {
+                    x.descriptorCount = std::max(x.descriptorCount, y.descriptorCount);
+                }
+            }
+        }
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.poolSizeCount = pool_sizes.size();
+        pool_info.pPoolSizes = pool_sizes.data();
+        pool_info.maxSets = set_count;
+
+        VkDescriptorPool result = VK_NULL_HANDLE;
+        if (VK_SUCCESS != vkCreateDescriptorPool(logi_device, &pool_info, nullptr, &result)) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+
+        return result;
+    }
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+
+namespace dal {
+
+    // Allocates descriptor sets from a chain of pools that grows on demand.
+    // When the current pool runs out or is fragmented, the next pool is taken, so there is no fixed limit to overflow.
+    // A new pool is sized by the ratio of descriptor types allocated so far, and each one holds twice as many sets as the last.
+    // Resetting frees every set at once and keeps the pools for the allocations that follow.
+    class DescAllocator {
+
+    private:
+        std::vector<VkDescriptorPool> m_full_pools;
+        std::vector<VkDescriptorPool> m_ready_pools;
+        VkDescriptorPool m_current_pool = VK_NULL_HANDLE;
+
+        // Descriptors of each type and sets requested since init, which new pools are sized after
+        std::unordered_map<VkDescriptorType, uint64_t> m_observed_desc_counts;
+        uint64_t m_observed_set_count = 0;
+
+        uint32_t m_next_pool_set_count = 0;
+
+        static constexpr uint32_t MAX_POOL_SET_COUNT = 4096;
+
+    public:
+        // Pools are not created until the first allocation
+        void init(const uint32_t first_pool_set_count, const VkDevice logi_device);
+        void destroy(const VkDevice logi_device);
+        // Frees every set allocated so far
+        void reset(const VkDevice logi_device);
+
+        // layout_counts are the descriptors a set of the layout takes, one element for each type
+        VkDescriptorSet allocate(
+            const VkDescriptorSetLayout layout,
+            const std::vector<VkDescriptorPoolSize>& layout_counts,
+            const VkDevice logi_device
+        );
+
+        uint32_t pool_count() const {
+            return this->m_full_pools.size() + this->m_ready_pools.size() + (VK_NULL_HANDLE != this->m_current_pool ? 1 : 0);
+        }
+
+    private:
+        VkDescriptorPool create_pool(const std::vector<VkDescriptorPoolSize>& layout_counts, const VkDevice logi_device);
+
+    };
+
+}
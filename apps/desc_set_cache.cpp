@@ -0,0 +1,73 @@
+#include "desc_set_cache.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+namespace dal {
+
+    void DescSetCache::init(const VkDevice logi_device) {
+        this->destroy(logi_device);
+        this->m_allocator.init(64, logi_device);
+    }
+
+    void DescSetCache::destroy(const VkDevice logi_device) {
+        this->m_allocator.destroy(logi_device);
+        this->m_sets.clear();
+        this->m_hit_count = 0;
+        this->m_dead_set_count = 0;
+    }
+
+    VkDescriptorSet DescSetCache::get(
+        const VkDescriptorSetLayout layout,
+        const VkDescriptorUpdateTemplate update_template,
+        const std::vector<VkDescriptorPoolSize>& layout_counts,
+        const std::vector<DescriptorInfo>& infos,
+        const VkDevice logi_device
+    ) {
+        constexpr size_t WORDS_PER_INFO = sizeof(DescriptorInfo) / sizeof(uint64_t);
+
+        key_t key(1 + infos.size() * WORDS_PER_INFO);
+        key[0] = (uint64_t)(layout);
+        if (!infos.empty()) {
+            std::memcpy(&key[1], infos.data(), infos.size() * sizeof(DescriptorInfo));
+        }
+
+        const auto found = this->m_sets.find(key);
+        if (this->m_sets.end() != found) {
+            ++this->m_hit_count;
+            return found->second;
+        }
+
+        const auto desc_set = this->m_allocator.allocate(layout, layout_counts, logi_device);
+        vkUpdateDescriptorSetWithTemplate(logi_device, desc_set, update_template, infos.data());
+
+        this->m_sets.emplace(std::move(key), desc_set);
+        return desc_set;
+    }
+
+    void DescSetCache::trim(const VkDevice logi_device) {
+        if (!this->m_sets.empty() || 0 == this->m_dead_set_count) {
+            return;
+        }
+
+        this->m_allocator.reset(logi_device);
+        this->m_dead_set_count = 0;
+    }
+
+    void DescSetCache::invalidate_word(const uint64_t handle) {
+        // Any word of a key may match, not only handle words. An offset or range that equals the handle only costs a rewrite.
+        for (auto iter = this->m_sets.begin(); iter != this->m_sets.end();) {
+            const auto& key = iter->first;
+
+            if (key.end() != std::find(key.begin() + 1, key.end(), handle)) {
+                iter = this->m_sets.erase(iter);
+                ++this->m_dead_set_count;
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "layout_cache.h"
+#include "desc_allocator.h"
+
+
+namespace dal {
+
+    // Descriptor sets keyed by their layout and the resources written into them.
+    // Asking for the same resources again returns the same set without writing it,
+    // so draws binding the same things share a set and sets outlive changes that don't touch them.
+    // Keys hold raw handles, so a cached set is only right while the resources it was written with are alive.
+    // Vulkan may give a new resource the handle of a destroyed one, so invalidate must be called before a resource
+    // written into sets is destroyed, or a later get would return a set that points to the dead resource.
+    // Invalidated sets can't be freed one by one. They stay allocated until trim finds no live set left and resets the pools.
+    class DescSetCache {
+
+    private:
+        using key_t = std::vector<uint64_t>;
+
+        DescAllocator m_allocator;
+        std::unordered_map<key_t, VkDescriptorSet, WordKeyHash> m_sets;
+        uint32_t m_hit_count = 0;
+        uint32_t m_dead_set_count = 0;  // Invalidated since the last reset of the pools
+
+    public:
+        void init(const VkDevice logi_device);
+        void destroy(const VkDevice logi_device);
+
+        // infos are in the order update_template reads them, and must come from make_desc_info_* functions
+        VkDescriptorSet get(
+            const VkDescriptorSetLayout layout,
+            const VkDescriptorUpdateTemplate update_template,
+            const std::vector<VkDescriptorPoolSize>& layout_counts,
+            const std::vector<DescriptorInfo>& infos,
+            const VkDevice logi_device
+        );
+
+        // Drops every set written with the buffer or image view. Sets already handed out stay valid until the resource is destroyed.
+        template <typename _Handle>
+        void invalidate(const _Handle handle) {
+            this->invalidate_word((uint64_t)(handle));
+        }
+        // Resets the pools if every set is invalidated, which is the only way sets are freed.
+        // GPU must be done with the invalidated sets.
+        void trim(const VkDevice logi_device);
+
+        uint32_t set_count() const {
+            return this->m_sets.size();
+        }
+        uint32_t hit_count() const {
+            return this->m_hit_count;
+        }
+        uint32_t dead_set_count() const {
+            return this->m_dead_set_count;
+        }
+        uint32_t pool_count() const {
+            return this->m_allocator.pool_count();
+        }
+
+    private:
+        void invalidate_word(const uint64_t handle);
+
+    };
+
+}
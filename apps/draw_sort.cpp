@@ -0,0 +1,111 @@
+#include "draw_sort.h"
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+
+namespace {
+
+    constexpr uint64_t make_mask(const uint32_t bits) {
+        return (uint64_t{ 1 } << bits) - 1;
+    }
+
+    uint64_t clamp_field(const uint64_t value, const uint32_t bits) {
+        return std::min(value, make_mask(bits));
+    }
+
+}
+
+
+namespace dal {
+
+    uint64_t make_sort_key(const DrawPass pass, const uint32_t pipeline, const uint32_t material, const uint32_t mesh, const uint32_t depth_bucket) {
+        uint64_t key = 0;
+
+        key |= ::clamp_field(static_cast<uint32_t>(pass), SORT_KEY_PASS_BITS);
+        key <<= SORT_KEY_PIPELINE_BITS;
+        key |= ::clamp_field(pipeline, SORT_KEY_PIPELINE_BITS);
+        key <<= SORT_KEY_MATERIAL_BITS;
+        key |= ::clamp_field(material, SORT_KEY_MATERIAL_BITS);
+        key <<= SORT_KEY_MESH_BITS;
+        key |= ::clamp_field(mesh, SORT_KEY_MESH_BITS);
+        key <<= SORT_KEY_DEPTH_BITS;
+        key |= ::clamp_field(depth_bucket, SORT_KEY_DEPTH_BITS);
+
+        return key;
+    }
+
+    uint32_t make_depth_bucket(const float distance) {
+        const auto scaled = std::max<double>(0, distance) * 256.0;
+        return static_cast<uint32_t>(std::min<double>(scaled, ::make_mask(SORT_KEY_DEPTH_BITS)));
+    }
+
+    void radix_sort_draws(std::vector<DrawItem>& draws, std::vector<DrawItem>& scratch) {
+        constexpr uint32_t RADIX_BITS = 8;
+        constexpr uint32_t BUCKET_COUNT = 1 << RADIX_BITS;
+
+        scratch.resize(draws.size());
+
+        auto src = &draws;
+        auto dst = &scratch;
+
+        for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS) {
+            std::array<uint32_t, BUCKET_COUNT> offsets{};
+
+            for (const auto& draw : *src) {
+                ++offsets[(draw.m_sort_key >> shift) & (BUCKET_COUNT - 1)];
+            }
+
+            // Every key has the same digit so this pass would not move anything
+            if (std::find(offsets.begin(), offsets.end(), src->size()) != offsets.end()) {
+                continue;
+            }
+
+            uint32_t sum = 0;
+            for (auto& x : offsets) {
+                const auto count = x;
+                x = sum;
+                sum += count;
+            }
+
+            for (const auto& draw : *src) {
+                (*dst)[offsets[(draw.m_sort_key >> shift) & (BUCKET_COUNT - 1)]++] = draw;
+            }
+
+            std::swap(src, dst);
+        }
+
+        if (src != &draws) {
+            draws.swap(scratch);
+        }
+    }
+
+}
+
+
+namespace dal {
+
+    BindStats& BindStats::operator+=(const BindStats& other) {
+        this->m_pipeline += other.m_pipeline;
+        this->m_desc_set += other.m_desc_set;
+        this->m_push_const += other.m_push_const;
+        this->m_vertex_buffer += other.m_vertex_buffer;
+        this->m_index_buffer += other.m_index_buffer;
+        this->m_draw += other.m_draw;
+
+        return *this;
+    }
+
+    void print_bind_stats(const char* const pass_name, const BindStats& unsorted, const BindStats& sorted) {
+        std::cout << "bind calls of " << pass_name << " (unsorted -> sorted)\n";
+        std::cout << "\tpipeline      : " << unsorted.m_pipeline << " -> " << sorted.m_pipeline << '\n';
+        std::cout << "\tdescriptor set: " << unsorted.m_desc_set << " -> " << sorted.m_desc_set << '\n';
+        std::cout << "\tpush constant : " << unsorted.m_push_const << " -> " << sorted.m_push_const << '\n';
+        std::cout << "\tvertex buffer : " << unsorted.m_vertex_buffer << " -> " << sorted.m_vertex_buffer << '\n';
+        std::cout << "\tindex buffer  : " << unsorted.m_index_buffer << " -> " << sorted.m_index_buffer << '\n';
+        std::cout << "\tdraw          : " << unsorted.m_draw << " -> " << sorted.m_draw << '\n';
+    }
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+
+namespace dal {
+
+    enum class DrawPass : uint32_t { gbuffer = 0, shadow = 1 };
+
+    // Bit widths of the fields of a sort key, from the most significant one.
+    // Draws sharing upper fields end up next to each other so their binds can be skipped.
+    constexpr uint32_t SORT_KEY_PASS_BITS     = 4;
+    constexpr uint32_t SORT_KEY_PIPELINE_BITS = 8;
+    constexpr uint32_t SORT_KEY_MATERIAL_BITS = 20;  // Material or descriptor set
+    constexpr uint32_t SORT_KEY_MESH_BITS     = 16;
+    constexpr uint32_t SORT_KEY_DEPTH_BITS    = 16;
+
+    static_assert(64 == SORT_KEY_PASS_BITS + SORT_KEY_PIPELINE_BITS + SORT_KEY_MATERIAL_BITS + SORT_KEY_MESH_BITS + SORT_KEY_DEPTH_BITS);
+
+    // Fields wider than their bit widths are clamped
+    uint64_t make_sort_key(const DrawPass pass, const uint32_t pipeline, const uint32_t material, const uint32_t mesh, const uint32_t depth_bucket);
+
+    // Distance from the camera quantized to 1/256 unit, so near draws come first
+    uint32_t make_depth_bucket(const float distance);
+
+
+    // An instance of a render unit. Recording threads each take a contiguous range of these.
+    struct DrawItem {
+        uint64_t m_sort_key = 0;
+        uint32_t m_model_index;
+        uint32_t m_unit_index;
+        uint32_t m_inst_index;
+    };
+
+    // Stable LSD radix sort on m_sort_key, 8 bits per pass.
+    // Passes where every key has the same byte are skipped. scratch is resized to draws.size().
+    void radix_sort_draws(std::vector<DrawItem>& draws, std::vector<DrawItem>& scratch);
+
+
+    // Number of state changes and draws a recorded command buffer issues
+    struct BindStats {
+        uint32_t m_pipeline = 0;
+        uint32_t m_desc_set = 0;
+        uint32_t m_push_const = 0;
+        uint32_t m_vertex_buffer = 0;
+        uint32_t m_index_buffer = 0;
+        uint32_t m_draw = 0;
+
+        BindStats& operator+=(const BindStats& other);
+    };
+
+    void print_bind_stats(const char* const pass_name, const BindStats& unsorted, const BindStats& sorted);
+
+}
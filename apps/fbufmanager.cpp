@@ -57,9 +57,10 @@ namespace {
 
         switch (usage) {
         case dal::FbufAttachment::Usage::color_attachment:
+            // Only read as input attachment in the same render pass and never stored, so contents need not leave tile memory
             aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
             image_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            flag = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+            flag = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
             break;
         case dal::FbufAttachment::Usage::depth_map:
             aspect_mask = VK_IMAGE_ASPECT_DEPTH_BIT;
@@ -78,6 +79,10 @@ namespace {
         return std::make_tuple(flag, aspect_mask, image_layout);
     }
 
+    VkDeviceSize align_up(const VkDeviceSize value, const VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
 }
 
 namespace dal {
@@ -89,10 +94,34 @@ namespace dal {
             const FbufAttachment::Usage usage,
             const uint32_t width,
             const uint32_t height
+    ) {
+        const auto memReqs = this->init_image(logiDevice, format, usage, width, height);
+
+        VkMemoryAllocateInfo memAlloc{};
+        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memAlloc.allocationSize = memReqs.size;
+        memAlloc.memoryTypeIndex = dal::findMemType(
+            memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physDevice
+        );
+
+        if (VK_SUCCESS != vkAllocateMemory(logiDevice, &memAlloc, nullptr, &this->m_mem)) {
+            throw std::runtime_error{""};
+        }
+
+        this->bind_memory(logiDevice, this->m_mem, 0);
+    }
+
+    VkMemoryRequirements FbufAttachment::init_image(
+        const VkDevice logiDevice,
+        const VkFormat format,
+        const FbufAttachment::Usage usage,
+        const uint32_t width,
+        const uint32_t height
     ) {
         this->destroy(logiDevice);
 
         const auto [usage_flag, aspect_mask, image_layout] = ::interpret_usage(usage);
+        this->m_usage = usage;
         this->m_format = format;
         this->m_width = width;
         this->m_height = height;
@@ -118,25 +147,20 @@ namespace dal {
 
         VkMemoryRequirements memReqs;
         vkGetImageMemoryRequirements(logiDevice, this->m_image, &memReqs);
+        return memReqs;
+    }
 
-        VkMemoryAllocateInfo memAlloc{};
-        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memAlloc.allocationSize = memReqs.size;
-        memAlloc.memoryTypeIndex = dal::findMemType(
-            memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physDevice
-        );
+    void FbufAttachment::bind_memory(const VkDevice logiDevice, const VkDeviceMemory memory, const VkDeviceSize offset) {
+        const auto [usage_flag, aspect_mask, image_layout] = ::interpret_usage(this->m_usage);
 
-        if (VK_SUCCESS != vkAllocateMemory(logiDevice, &memAlloc, nullptr, &this->m_mem)) {
-            throw std::runtime_error{""};
-        }
-        if (VK_SUCCESS != vkBindImageMemory(logiDevice, this->m_image, this->m_mem, 0)) {
-            throw std::runtime_error{""};
+        if (VK_SUCCESS != vkBindImageMemory(logiDevice, this->m_image, memory, offset)) {
+            throw std::runtime_error{ "failed to bind memory to a fbuf attachment" };
         }
 
         VkImageViewCreateInfo imageView{};
         imageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageView.format = format;
+		imageView.format = this->m_format;
         imageView.components.r = VK_COMPONENT_SWIZZLE_R;
         imageView.components.g = VK_COMPONENT_SWIZZLE_G;
         imageView.components.b = VK_COMPONENT_SWIZZLE_B;
@@ -188,39 +212,57 @@ namespace dal {
         this->m_width = width;
         this->m_height = height;
 
-        this->m_position.init(
-            logiDevice, physDevice,
-            VK_FORMAT_R16G16B16A16_SFLOAT,
-            FbufAttachment::Usage::color_attachment,
-            width, height
-        );
-        this->m_normal.init(
-            logiDevice, physDevice,
-            VK_FORMAT_R16G16B16A16_SFLOAT,
+        const auto normal_reqs = this->m_normal.init_image(
+            logiDevice,
+            VK_FORMAT_R16G16_SNORM,
             FbufAttachment::Usage::color_attachment,
             width, height
         );
-        this->m_albedo.init(
+        // sRGB keeps precision in dark albedo. Alpha is linear in sRGB formats so packed material survives.
+        const auto albedo_reqs = this->m_albedo.init_image(
             logiDevice,
-            physDevice,
-            VK_FORMAT_R8G8B8A8_UNORM,
+            VK_FORMAT_R8G8B8A8_SRGB,
             FbufAttachment::Usage::color_attachment,
             width, height
         );
-        this->m_material.init(
+
+        const auto lighting_reqs = this->m_lighting.init_image(
             logiDevice,
-            physDevice,
             VK_FORMAT_R16G16B16A16_SFLOAT,
             FbufAttachment::Usage::color_attachment,
             width, height
         );
+
+        // G-buffer is alive until the lighting is done, which overlaps with the lighting buffer,
+        // so they can't alias each other, but they can share one allocation.
+        const auto albedo_offset = ::align_up(normal_reqs.size, albedo_reqs.alignment);
+        const auto lighting_offset = ::align_up(albedo_offset + albedo_reqs.size, lighting_reqs.alignment);
+
+        VkMemoryAllocateInfo memAlloc{};
+        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memAlloc.allocationSize = lighting_offset + lighting_reqs.size;
+        memAlloc.memoryTypeIndex = dal::find_transient_mem_type(
+            normal_reqs.memoryTypeBits & albedo_reqs.memoryTypeBits & lighting_reqs.memoryTypeBits, physDevice
+        );
+
+        if (VK_SUCCESS != vkAllocateMemory(logiDevice, &memAlloc, nullptr, &this->m_memory)) {
+            throw std::runtime_error{ "failed to allocate memory for gbuf" };
+        }
+
+        this->m_normal.bind_memory(logiDevice, this->m_memory, 0);
+        this->m_albedo.bind_memory(logiDevice, this->m_memory, albedo_offset);
+        this->m_lighting.bind_memory(logiDevice, this->m_memory, lighting_offset);
     }
 
     void GbufManager::Gbuf::destroy(const VkDevice logiDevice) {
-        this->m_position.destroy(logiDevice);
         this->m_normal.destroy(logiDevice);
         this->m_albedo.destroy(logiDevice);
-        this->m_material.destroy(logiDevice);
+        this->m_lighting.destroy(logiDevice);
+
+        if (VK_NULL_HANDLE != this->m_memory) {
+            vkFreeMemory(logiDevice, this->m_memory, nullptr);
+            this->m_memory = VK_NULL_HANDLE;
+        }
     }
 
 
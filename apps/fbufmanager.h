@@ -18,9 +18,11 @@ namespace dal {
         VkDeviceMemory m_mem = VK_NULL_HANDLE;
         VkImageView m_view = VK_NULL_HANDLE;
         VkFormat m_format;
+        Usage m_usage;
         uint32_t m_width = 0, m_height = 0;
 
     public:
+        // Creates the image with its own memory
         void init(
             const VkDevice logiDevice,
             const VkPhysicalDevice physDevice,
@@ -31,6 +33,17 @@ namespace dal {
         );
         void destroy(const VkDevice logiDevice);
 
+        // For placing several attachments in one memory block owned by someone else.
+        // Call bind_memory after init_image, destroy doesn't free memory bound this way.
+        VkMemoryRequirements init_image(
+            const VkDevice logiDevice,
+            const VkFormat format,
+            const FbufAttachment::Usage usage,
+            const uint32_t width,
+            const uint32_t height
+        );
+        void bind_memory(const VkDevice logiDevice, const VkDeviceMemory memory, const VkDeviceSize offset);
+
         auto& view() const {
             return this->m_view;
         }
@@ -56,7 +69,13 @@ namespace dal {
         class Gbuf {
 
         public:
-            FbufAttachment m_position, m_normal, m_albedo, m_material;
+            // Position is reconstructed from depth.
+            // Normal is octahedral encoded in RG, albedo alpha holds 4 bit roughness and 4 bit metallic.
+            FbufAttachment m_normal, m_albedo;
+            // HDR sum of all lights, tone mapped into swapchain image in the last subpass
+            FbufAttachment m_lighting;
+            // All attachments live in this, lazily allocated if the device supports it
+            VkDeviceMemory m_memory = VK_NULL_HANDLE;
             uint32_t m_width, m_height;
 
         public:
@@ -83,34 +102,33 @@ namespace dal {
         void destroy(const VkDevice logiDevice);
 
         auto make_views_array(const VkImageView swapchain_image_view, const VkImageView depth_image_view) const {
-            return std::array<VkImageView, 6>{
+            return std::array<VkImageView, 5>{
                 swapchain_image_view,
                 depth_image_view,
-                this->m_gbuf.m_position.view(),
                 this->m_gbuf.m_normal.view(),
                 this->m_gbuf.m_albedo.view(),
-                this->m_gbuf.m_material.view(),
+                this->m_gbuf.m_lighting.view(),
             };
         }
         auto make_formats_array(const VkFormat swapchain_image_format, const VkFormat depth_image_format) const {
-            return std::array<VkFormat, 6>{
+            return std::array<VkFormat, 5>{
                 swapchain_image_format,
                 depth_image_format,
-                this->m_gbuf.m_position.format(),
                 this->m_gbuf.m_normal.format(),
                 this->m_gbuf.m_albedo.format(),
-                this->m_gbuf.m_material.format(),
+                this->m_gbuf.m_lighting.format(),
             };
         }
         auto make_views_vector(const VkImageView depth_image_view) const {
             return std::vector<VkImageView>{
                 depth_image_view,
-                this->m_gbuf.m_position.view(),
                 this->m_gbuf.m_normal.view(),
                 this->m_gbuf.m_albedo.view(),
-                this->m_gbuf.m_material.view(),
             };
         }
+        auto& lighting_view() const {
+            return this->m_gbuf.m_lighting.view();
+        }
 
     };
 
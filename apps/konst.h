@@ -8,7 +8,20 @@ namespace dal {
     constexpr unsigned WIN_WIDTH = 1280;
     constexpr unsigned WIN_HEIGHT = 720;
 
-    constexpr unsigned MAX_FRAMES_IN_FLIGHT = 2;
+    // Number of frames CPU may record ahead of GPU. Per-frame resources are sized by this, not by swapchain image count.
+    constexpr unsigned FRAMES_IN_FLIGHT = 2;
+
+    // Length of the bindless texture array. Must match MAX_TEXTURE_COUNT of shaders.
+    constexpr unsigned MAX_BINDLESS_TEXTURE_COUNT = 1024;
+
+    // Bytes of texture data uploaded in a frame while textures stream in. At least one mip level goes up each frame anyway.
+    constexpr unsigned TEXTURE_UPLOAD_BUDGET_PER_FRAME = 4 * 1024 * 1024;
+
+    // VRAM textures may take before the largest mip levels of least recently used ones are evicted
+    constexpr unsigned TEXTURE_VRAM_BUDGET = 256 * 1024 * 1024;
+
+    // Draws closer than this need mip level 0 of their textures, and one level less each time the distance doubles
+    constexpr float TEXTURE_FULL_DETAIL_DISTANCE = 4;
 
     const std::array<const char*, 1> VAL_LAYERS_TO_USE = {
        "VK_LAYER_KHRONOS_validation"
@@ -0,0 +1,218 @@
+#include "ktx_texture.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+    constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    struct Ktx2Header {
+        uint8_t m_identifier[12];
+        uint32_t m_vk_format;
+        uint32_t m_type_size;
+        uint32_t m_pixel_width;
+        uint32_t m_pixel_height;
+        uint32_t m_pixel_depth;
+        uint32_t m_layer_count;
+        uint32_t m_face_count;
+        uint32_t m_level_count;
+        uint32_t m_supercompression_scheme;
+
+        uint32_t m_dfd_byte_offset;
+        uint32_t m_dfd_byte_length;
+        uint32_t m_kvd_byte_offset;
+        uint32_t m_kvd_byte_length;
+        uint64_t m_sgd_byte_offset;
+        uint64_t m_sgd_byte_length;
+    };
+    static_assert(sizeof(Ktx2Header) == 80, "KTX2 header struct is not 80 bytes.");
+
+    struct Ktx2LevelIndex {
+        uint64_t m_byte_offset;
+        uint64_t m_byte_length;
+        uint64_t m_uncompressed_byte_length;
+    };
+    static_assert(sizeof(Ktx2LevelIndex) == 24, "KTX2 level index struct is not 24 bytes.");
+
+
+    struct BlockInfo {
+        uint32_t m_width, m_height;
+        uint32_t m_bytes;
+    };
+
+    // Zero bytes if the format is not supported
+    BlockInfo get_block_info(const VkFormat format) {
+        if (VK_FORMAT_ASTC_4x4_UNORM_BLOCK <= format && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+            // UNORM and SRGB of each footprint are next to each other
+            constexpr uint32_t FOOTPRINTS[14][2] = {
+                {  4,  4 }, {  5,  4 }, {  5,  5 }, {  6,  5 }, {  6,  6 }, {  8,  5 }, {  8,  6 },
+                {  8,  8 }, { 10,  5 }, { 10,  6 }, { 10,  8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+            };
+            const auto& footprint = FOOTPRINTS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+            return BlockInfo{ footprint[0], footprint[1], 16 };
+        }
+
+        switch (format) {
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+            case VK_FORMAT_BC4_SNORM_BLOCK:
+                return BlockInfo{ 4, 4, 8 };
+            case VK_FORMAT_BC2_UNORM_BLOCK:
+            case VK_FORMAT_BC2_SRGB_BLOCK:
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            case VK_FORMAT_BC5_SNORM_BLOCK:
+            case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+            case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+                return BlockInfo{ 4, 4, 16 };
+
+            case VK_FORMAT_R8_UNORM:
+            case VK_FORMAT_R8_SRGB:
+                return BlockInfo{ 1, 1, 1 };
+            case VK_FORMAT_R8G8_UNORM:
+            case VK_FORMAT_R8G8_SRGB:
+            case VK_FORMAT_R16_SFLOAT:
+                return BlockInfo{ 1, 1, 2 };
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+            case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+            case VK_FORMAT_R16G16_SFLOAT:
+            case VK_FORMAT_R32_SFLOAT:
+                return BlockInfo{ 1, 1, 4 };
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                return BlockInfo{ 1, 1, 8 };
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                return BlockInfo{ 1, 1, 16 };
+
+            default:
+                return BlockInfo{ 0, 0, 0 };
+        }
+    }
+
+    uint32_t level_extent(const uint32_t base_extent, const uint32_t level) {
+        return std::max<uint32_t>(base_extent >> level, 1);
+    }
+
+    uint32_t block_count(const uint32_t extent, const uint32_t block_extent) {
+        return (extent + block_extent - 1) / block_extent;
+    }
+
+}
+
+
+namespace dal {
+
+    void KtxTexture::open(const std::string& path) {
+        this->m_file.open(path);
+
+        try {
+            this->parse(this->m_file.data(), this->m_file.size());
+        }
+        catch (const std::runtime_error& e) {
+            throw std::runtime_error(std::string{ e.what() } + ": " + path);
+        }
+    }
+
+    void KtxTexture::parse(const uint8_t* const data, const size_t size) {
+        this->m_data = nullptr;
+        this->m_levels.clear();
+
+        Ktx2Header header;
+        if (size < sizeof(Ktx2Header)) {
+            throw std::runtime_error("file is too small for KTX2");
+        }
+        memcpy(&header, data, sizeof(Ktx2Header));
+
+        if (0 != memcmp(header.m_identifier, ::KTX2_IDENTIFIER, sizeof(::KTX2_IDENTIFIER))) {
+            throw std::runtime_error("file is not KTX2");
+        }
+        if (0 != header.m_supercompression_scheme) {
+            throw std::runtime_error("supercompressed KTX2 is not supported");
+        }
+        if (header.m_pixel_depth > 1 || 1 != header.m_face_count) {
+            throw std::runtime_error("only 2D KTX2 textures are supported");
+        }
+
+        const auto format = static_cast<VkFormat>(header.m_vk_format);
+        const auto block = ::get_block_info(format);
+        if (0 == block.m_bytes) {
+            throw std::runtime_error("KTX2 format is not supported");
+        }
+
+        // Zero means 1D, an array of one layer, or levels to be generated respectively. None of them needs anything else.
+        const auto width = header.m_pixel_width;
+        const auto height = std::max<uint32_t>(header.m_pixel_height, 1);
+        const auto layer_count = std::max<uint32_t>(header.m_layer_count, 1);
+        const auto level_count = std::max<uint32_t>(header.m_level_count, 1);
+
+        if (0 == width || level_count > 32) {
+            throw std::runtime_error("KTX2 header is broken");
+        }
+        if (size < sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * level_count) {
+            throw std::runtime_error("KTX2 level index is cut off");
+        }
+
+        for (uint32_t i = 0; i < level_count; ++i) {
+            Ktx2LevelIndex index;
+            memcpy(&index, data + sizeof(Ktx2Header) + sizeof(Ktx2LevelIndex) * i, sizeof(Ktx2LevelIndex));
+
+            const uint64_t layer_size = uint64_t{ ::block_count(::level_extent(width, i), block.m_width) }
+                * ::block_count(::level_extent(height, i), block.m_height) * block.m_bytes;
+
+            if (index.m_byte_length != layer_size * layer_count) {
+                throw std::runtime_error("KTX2 level size does not match its format");
+            }
+            if (index.m_byte_offset > size || index.m_byte_length > size - index.m_byte_offset) {
+                throw std::runtime_error("KTX2 level data is cut off");
+            }
+
+            this->m_levels.push_back(Level{ static_cast<size_t>(index.m_byte_offset), static_cast<size_t>(layer_size) });
+        }
+
+        this->m_data = data;
+        this->m_format = format;
+        this->m_width = width;
+        this->m_height = height;
+        this->m_layer_count = layer_count;
+    }
+
+    ImageDataView KtxTexture::level(const uint32_t level_index, const uint32_t layer_index) const {
+        if (level_index >= this->level_count() || layer_index >= this->layer_count()) {
+            throw std::out_of_range("KTX2 level or layer index out of range");
+        }
+
+        const auto& level = this->m_levels[level_index];
+
+        ImageDataView result;
+        result.width = ::level_extent(this->m_width, level_index);
+        result.height = ::level_extent(this->m_height, level_index);
+        result.format = this->m_format;
+        result.data = this->m_data + level.m_offset + level.m_layer_size * layer_index;
+        result.size = level.m_layer_size;
+        return result;
+    }
+
+    std::vector<ImageDataView> KtxTexture::levels(const uint32_t layer_index) const {
+        std::vector<ImageDataView> result;
+
+        for (uint32_t i = 0; i < this->level_count(); ++i) {
+            result.push_back(this->level(i, layer_index));
+        }
+
+        return result;
+    }
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "util_windows.h"
+
+
+namespace dal {
+
+    // KTX2 container with mip levels and array layers baked in, read through memory mapping.
+    // Level data is handed out as views into the mapped file, so it's copied only once, into a staging buffer.
+    // Supports 2D textures of ASTC LDR, BC and common uncompressed formats without supercompression.
+    class KtxTexture {
+
+    private:
+        struct Level {
+            size_t m_offset;  // From the start of the file
+            size_t m_layer_size;  // Of each array layer, which are stored back to back
+        };
+
+    private:
+        MappedFile m_file;
+        const uint8_t* m_data = nullptr;
+        std::vector<Level> m_levels;  // From the largest
+        VkFormat m_format = VK_FORMAT_UNDEFINED;
+        uint32_t m_width = 0, m_height = 0;
+        uint32_t m_layer_count = 1;
+
+    public:
+        // Throws std::runtime_error if the file is not a KTX2 file this can read
+        void open(const std::string& path);
+        // Same as open but from bytes which must outlive this. Used by open after mapping the file.
+        void parse(const uint8_t* const data, const size_t size);
+
+        ImageDataView level(const uint32_t level_index, const uint32_t layer_index = 0) const;
+        // Levels of one layer from the largest
+        std::vector<ImageDataView> levels(const uint32_t layer_index = 0) const;
+
+        auto format() const {
+            return this->m_format;
+        }
+        auto width() const {
+            return this->m_width;
+        }
+        auto height() const {
+            return this->m_height;
+        }
+        uint32_t level_count() const {
+            return this->m_levels.size();
+        }
+        auto layer_count() const {
+            return this->m_layer_count;
+        }
+
+    };
+
+}
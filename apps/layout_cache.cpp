@@ -0,0 +1,233 @@
+#include "layout_cache.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+    template <typename _Handle>
+    uint64_t handle_to_key(const _Handle handle) {
+        // Non-dispatchable handles are pointers on 64 bit platforms and uint64_t on 32 bit ones
+        return (uint64_t)(handle);
+    }
+
+}
+
+
+namespace dal {
+
+    DescriptorInfo make_desc_info_buffer(const VkBuffer buffer, const VkDeviceSize range) {
+        DescriptorInfo result;
+        std::memset(&result, 0, sizeof(result));
+
+        result.m_buffer.buffer = buffer;
+        result.m_buffer.offset = 0;
+        result.m_buffer.range = range;
+
+        return result;
+    }
+
+    DescriptorInfo make_desc_info_image(const VkImageView view, const VkSampler sampler, const VkImageLayout layout) {
+        DescriptorInfo result;
+        std::memset(&result, 0, sizeof(result));
+
+        result.m_image.sampler = sampler;
+        result.m_image.imageView = view;
+        result.m_image.imageLayout = layout;
+
+        return result;
+    }
+
+    size_t WordKeyHash::operator()(const std::vector<uint64_t>& key) const {
+        uint64_t hash = 14695981039346656037ull;
+
+        for (const auto x : key) {
+            hash ^= x;
+            hash *= 1099511628211ull;
+        }
+
+        return static_cast<size_t>(hash);
+    }
+
+    void LayoutCache::destroy(const VkDevice logi_device) {
+        for (auto& [set_layout, update_template] : this->m_update_templates) {
+            vkDestroyDescriptorUpdateTemplate(logi_device, update_template, nullptr);
+        }
+        this->m_update_templates.clear();
+
+        for (auto& [key, layout] : this->m_pipeline_layouts) {
+            vkDestroyPipelineLayout(logi_device, layout, nullptr);
+        }
+        this->m_pipeline_layouts.clear();
+
+        for (auto& [key, layout] : this->m_set_layouts) {
+            vkDestroyDescriptorSetLayout(logi_device, layout, nullptr);
+        }
+        this->m_set_layouts.clear();
+        this->m_desc_counts.clear();
+    }
+
+    VkDescriptorSetLayout LayoutCache::get_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, const VkDevice logi_device) {
+        return this->get_set_layout(bindings, {}, 0, logi_device);
+    }
+
+    VkDescriptorSetLayout LayoutCache::get_set_layout(
+        const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        const std::vector<VkDescriptorBindingFlags>& binding_flags,
+        const VkDescriptorSetLayoutCreateFlags create_flags,
+        const VkDevice logi_device
+    ) {
+        if (!binding_flags.empty() && binding_flags.size() != bindings.size()) {
+            throw std::runtime_error("descriptor binding flags must be given for every binding");
+        }
+
+        key_t key;
+        key.push_back(create_flags);
+        for (size_t i = 0; i < bindings.size(); ++i) {
+            auto& x = bindings[i];
+            key.push_back(x.binding);
+            key.push_back(x.descriptorType);
+            key.push_back(x.descriptorCount);
+            key.push_back(x.stageFlags);
+            key.push_back(binding_flags.empty() ? 0 : binding_flags[i]);
+        }
+
+        const auto found = this->m_set_layouts.find(key);
+        if (this->m_set_layouts.end() != found) {
+            return found->second;
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{};
+        flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        flags_info.bindingCount = binding_flags.size();
+        flags_info.pBindingFlags = binding_flags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = binding_flags.empty() ? nullptr : &flags_info;
+        layoutInfo.flags = create_flags;
+        layoutInfo.bindingCount = bindings.size();
+        layoutInfo.pBindings = bindings.data();
+
+        VkDescriptorSetLayout result = VK_NULL_HANDLE;
+        if (VK_SUCCESS != vkCreateDescriptorSetLayout(logi_device, &layoutInfo, nullptr, &result)) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        auto& desc_counts = this->m_desc_counts[result];
+        for (auto& x : bindings) {
+            const auto found_count = std::find_if(desc_counts.begin(), desc_counts.end(), [&x](auto& y) { return y.type == x.descriptorType; });
+
+            if (desc_counts.end() != found_count) {
+                found_count->descriptorCount += x.descriptorCount;
+            }
+            else {
+                desc_counts.push_back(VkDescriptorPoolSize{ x.descriptorType, x.descriptorCount });
+            }
+        }
+
+        this->m_set_layouts.emplace(key, result);
+        return result;
+    }
+
+    VkPipelineLayout LayoutCache::get_pipeline_layout(
+        const std::vector<VkDescriptorSetLayout>& set_layouts,
+        const std::vector<VkPushConstantRange>& push_consts,
+        const VkDevice logi_device
+    ) {
+        key_t key;
+        key.push_back(set_layouts.size());
+        for (auto x : set_layouts) {
+            key.push_back(::handle_to_key(x));
+        }
+        for (auto& x : push_consts) {
+            key.push_back(x.stageFlags);
+            key.push_back(x.offset);
+            key.push_back(x.size);
+        }
+
+        const auto found = this->m_pipeline_layouts.find(key);
+        if (this->m_pipeline_layouts.end() != found) {
+            return found->second;
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = set_layouts.size();
+        pipelineLayoutInfo.pSetLayouts = set_layouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = push_consts.size();
+        pipelineLayoutInfo.pPushConstantRanges = push_consts.data();
+
+        VkPipelineLayout result = VK_NULL_HANDLE;
+        if (VK_SUCCESS != vkCreatePipelineLayout(logi_device, &pipelineLayoutInfo, nullptr, &result)) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        this->m_pipeline_layouts.emplace(key, result);
+        return result;
+    }
+
+    VkDescriptorUpdateTemplate LayoutCache::get_update_template(
+        const VkDescriptorSetLayout set_layout,
+        const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        const VkDevice logi_device
+    ) {
+        const auto found = this->m_update_templates.find(set_layout);
+        if (this->m_update_templates.end() != found) {
+            return found->second;
+        }
+
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
+        size_t info_index = 0;
+
+        for (auto& x : bindings) {
+            auto& entry = entries.emplace_back();
+            entry.dstBinding = x.binding;
+            entry.dstArrayElement = 0;
+            entry.descriptorCount = x.descriptorCount;
+            entry.descriptorType = x.descriptorType;
+            entry.offset = info_index * sizeof(DescriptorInfo);
+            entry.stride = sizeof(DescriptorInfo);
+
+            info_index += x.descriptorCount;
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        create_info.descriptorUpdateEntryCount = entries.size();
+        create_info.pDescriptorUpdateEntries = entries.data();
+        create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        create_info.descriptorSetLayout = set_layout;
+
+        VkDescriptorUpdateTemplate result = VK_NULL_HANDLE;
+        if (VK_SUCCESS != vkCreateDescriptorUpdateTemplate(logi_device, &create_info, nullptr, &result)) {
+            throw std::runtime_error("failed to create descriptor update template!");
+        }
+
+        this->m_update_templates.emplace(set_layout, result);
+        return result;
+    }
+
+    VkPipelineLayout LayoutCache::get_pipeline_layout(const ShaderInterface& shader_interface, const VkDevice logi_device) {
+        std::vector<VkDescriptorSetLayout> set_layouts;
+
+        // Sets a shader skips still need a layout in between
+        for (uint32_t i = 0; i < shader_interface.set_count(); ++i) {
+            set_layouts.push_back(this->get_set_layout(shader_interface.make_layout_bindings(i), logi_device));
+        }
+
+        return this->get_pipeline_layout(set_layouts, shader_interface.make_push_const_ranges(), logi_device);
+    }
+
+    const std::vector<VkDescriptorPoolSize>& LayoutCache::desc_counts(const VkDescriptorSetLayout set_layout) const {
+        const auto found = this->m_desc_counts.find(set_layout);
+        if (this->m_desc_counts.end() == found) {
+            throw std::runtime_error("descriptor set layout is not from this cache");
+        }
+
+        return found->second;
+    }
+
+}
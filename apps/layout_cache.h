@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "spirv_reflect.h"
+
+
+namespace dal {
+
+    // One element of the data an update template from LayoutCache reads.
+    // Elements are in the order of bindings and then array elements, one per descriptor.
+    union DescriptorInfo {
+        VkDescriptorBufferInfo m_buffer;
+        VkDescriptorImageInfo m_image;
+        VkBufferView m_texel_buffer;
+    };
+
+    static_assert(0 == sizeof(DescriptorInfo) % sizeof(uint64_t));
+
+    // Unused bytes are zero, so infos made of the same resources compare equal byte by byte
+    DescriptorInfo make_desc_info_buffer(const VkBuffer buffer, const VkDeviceSize range);
+    DescriptorInfo make_desc_info_image(const VkImageView view, const VkSampler sampler, const VkImageLayout layout);
+
+
+    // FNV-1a over the words of a key made of handles and enums
+    struct WordKeyHash {
+        size_t operator()(const std::vector<uint64_t>& key) const;
+    };
+
+
+    // Owns descriptor set layouts, pipeline layouts and update templates.
+    // Identical requests get the same object, so shaders with the same interface share layouts.
+    class LayoutCache {
+
+    private:
+        using key_t = std::vector<uint64_t>;
+
+        std::unordered_map<key_t, VkDescriptorSetLayout, WordKeyHash> m_set_layouts;
+        std::unordered_map<key_t, VkPipelineLayout, WordKeyHash> m_pipeline_layouts;
+        std::unordered_map<VkDescriptorSetLayout, VkDescriptorUpdateTemplate> m_update_templates;
+        std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> m_desc_counts;
+
+    public:
+        void destroy(const VkDevice logi_device);
+
+        VkDescriptorSetLayout get_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, const VkDevice logi_device);
+        // binding_flags is either empty or has one element for each binding
+        VkDescriptorSetLayout get_set_layout(
+            const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+            const std::vector<VkDescriptorBindingFlags>& binding_flags,
+            const VkDescriptorSetLayoutCreateFlags create_flags,
+            const VkDevice logi_device
+        );
+        VkPipelineLayout get_pipeline_layout(
+            const std::vector<VkDescriptorSetLayout>& set_layouts,
+            const std::vector<VkPushConstantRange>& push_consts,
+            const VkDevice logi_device
+        );
+        // Set layout must have come from get_set_layout with the same bindings
+        VkDescriptorUpdateTemplate get_update_template(
+            const VkDescriptorSetLayout set_layout,
+            const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+            const VkDevice logi_device
+        );
+
+        // A set layout for each set the interface uses, then a pipeline layout made of them
+        VkPipelineLayout get_pipeline_layout(const ShaderInterface& shader_interface, const VkDevice logi_device);
+
+        // Descriptors of each type a set of the layout takes from a pool. Set layout must have come from this cache.
+        const std::vector<VkDescriptorPoolSize>& desc_counts(const VkDescriptorSetLayout set_layout) const;
+
+        size_t set_layout_count() const {
+            return this->m_set_layouts.size();
+        }
+        size_t pipeline_layout_count() const {
+            return this->m_pipeline_layouts.size();
+        }
+
+    };
+
+}
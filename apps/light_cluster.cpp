@@ -0,0 +1,313 @@
+#include "light_cluster.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "model_render.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+    #define DAL_LIGHT_CLUSTER_SSE true
+    #include <xmmintrin.h>
+#else
+    #define DAL_LIGHT_CLUSTER_SSE false
+#endif
+
+
+namespace {
+
+    constexpr uint32_t CLUSTER_COUNT_PER_SLICE = dal::CLUSTER_COUNT_X * dal::CLUSTER_COUNT_Y;
+    static_assert(0 == CLUSTER_COUNT_PER_SLICE % 4, "clusters are tested in groups of 4");
+
+
+    // Result is a bit mask of the 4 clusters starting at `offset` which intersect with the sphere.
+    uint32_t test_sphere_vs_4_aabbs(
+        const glm::vec3& center, const float radius, const uint32_t offset,
+        const float* const min_x, const float* const min_y, const float* const min_z,
+        const float* const max_x, const float* const max_y, const float* const max_z
+    ) {
+#if DAL_LIGHT_CLUSTER_SSE
+        const auto zero = _mm_setzero_ps();
+        const auto cx = _mm_set1_ps(center.x);
+        const auto cy = _mm_set1_ps(center.y);
+        const auto cz = _mm_set1_ps(center.z);
+        const auto r2 = _mm_set1_ps(radius * radius);
+
+        // Distance from the sphere center to the box on each axis, 0 if inside
+        const auto dx = _mm_add_ps(
+            _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min_x + offset), cx), zero),
+            _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(max_x + offset)), zero)
+        );
+        const auto dy = _mm_add_ps(
+            _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min_y + offset), cy), zero),
+            _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(max_y + offset)), zero)
+        );
+        const auto dz = _mm_add_ps(
+            _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min_z + offset), cz), zero),
+            _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(max_z + offset)), zero)
+        );
+
+        const auto dist_sqr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(dist_sqr, r2)));
+#else
+        uint32_t result = 0;
+
+        for (uint32_t i = 0; i < 4; ++i) {
+            const auto index = offset + i;
+            const float dx = std::max(min_x[index] - center.x, 0.f) + std::max(center.x - max_x[index], 0.f);
+            const float dy = std::max(min_y[index] - center.y, 0.f) + std::max(center.y - max_y[index], 0.f);
+            const float dz = std::max(min_z[index] - center.z, 0.f) + std::max(center.z - max_z[index], 0.f);
+
+            if (dx*dx + dy*dy + dz*dz <= radius * radius) {
+                result |= (1 << i);
+            }
+        }
+
+        return result;
+#endif
+    }
+
+    // From "Cull that cone!" by Bart Wronski
+    bool is_cone_culled(
+        const glm::vec3& sphere_center, const float sphere_radius,
+        const glm::vec3& cone_tip, const glm::vec3& cone_direc, const float cone_range,
+        const float cos_angle, const float sin_angle
+    ) {
+        const auto v = sphere_center - cone_tip;
+        const float v_len_sqr = glm::dot(v, v);
+        const float v1_len = glm::dot(v, cone_direc);
+        const float dist_closest_point = cos_angle * std::sqrt(std::max(v_len_sqr - v1_len * v1_len, 0.f)) - v1_len * sin_angle;
+
+        const bool angle_cull = dist_closest_point > sphere_radius;
+        const bool front_cull = v1_len > sphere_radius + cone_range;
+        const bool back_cull = v1_len < -sphere_radius;
+
+        return angle_cull || front_cull || back_cull;
+    }
+
+}
+
+
+// LightCluster
+namespace dal {
+
+    void LightCluster::rebuild_grid(const glm::mat4& proj_mat, const float near_plane, const float far_plane, const VkExtent2D extent) {
+        this->m_near = near_plane;
+        this->m_far = far_plane;
+
+        const float log_ratio = std::log(far_plane / near_plane);
+        this->m_slice_scale = static_cast<float>(CLUSTER_COUNT_Z) / log_ratio;
+        this->m_slice_bias = -static_cast<float>(CLUSTER_COUNT_Z) * std::log(near_plane) / log_ratio;
+
+        this->m_tile_width = std::ceil(static_cast<float>(extent.width) / static_cast<float>(CLUSTER_COUNT_X));
+        this->m_tile_height = std::ceil(static_cast<float>(extent.height) / static_cast<float>(CLUSTER_COUNT_Y));
+
+        this->m_min_x.resize(CLUSTER_COUNT); this->m_max_x.resize(CLUSTER_COUNT);
+        this->m_min_y.resize(CLUSTER_COUNT); this->m_max_y.resize(CLUSTER_COUNT);
+        this->m_min_z.resize(CLUSTER_COUNT); this->m_max_z.resize(CLUSTER_COUNT);
+
+        // Symmetric perspective projection is assumed, so view space x is ndc.x * depth / proj[0][0].
+        // proj[1][1] is negated for Vulkan which makes ndc y of -1 the top row, same as gl_FragCoord.
+        const float proj_x = proj_mat[0][0];
+        const float proj_y = proj_mat[1][1];
+
+        for (uint32_t z = 0; z < CLUSTER_COUNT_Z; ++z) {
+            const float depth_near = near_plane * std::pow(far_plane / near_plane, static_cast<float>(z    ) / CLUSTER_COUNT_Z);
+            const float depth_far  = near_plane * std::pow(far_plane / near_plane, static_cast<float>(z + 1) / CLUSTER_COUNT_Z);
+
+            for (uint32_t y = 0; y < CLUSTER_COUNT_Y; ++y) {
+                const float ndc_y0 = (y    ) * this->m_tile_height / extent.height * 2.f - 1.f;
+                const float ndc_y1 = (y + 1) * this->m_tile_height / extent.height * 2.f - 1.f;
+
+                for (uint32_t x = 0; x < CLUSTER_COUNT_X; ++x) {
+                    const float ndc_x0 = (x    ) * this->m_tile_width / extent.width * 2.f - 1.f;
+                    const float ndc_x1 = (x + 1) * this->m_tile_width / extent.width * 2.f - 1.f;
+
+                    const float xs[4] = {
+                        ndc_x0 * depth_near / proj_x, ndc_x1 * depth_near / proj_x,
+                        ndc_x0 * depth_far  / proj_x, ndc_x1 * depth_far  / proj_x,
+                    };
+                    const float ys[4] = {
+                        ndc_y0 * depth_near / proj_y, ndc_y1 * depth_near / proj_y,
+                        ndc_y0 * depth_far  / proj_y, ndc_y1 * depth_far  / proj_y,
+                    };
+
+                    const auto index = x + CLUSTER_COUNT_X * (y + CLUSTER_COUNT_Y * z);
+                    this->m_min_x[index] = *std::min_element(xs, xs + 4);
+                    this->m_max_x[index] = *std::max_element(xs, xs + 4);
+                    this->m_min_y[index] = *std::min_element(ys, ys + 4);
+                    this->m_max_y[index] = *std::max_element(ys, ys + 4);
+                    this->m_min_z[index] = -depth_far;
+                    this->m_max_z[index] = -depth_near;
+                }
+            }
+        }
+    }
+
+    void LightCluster::assign_lights(const glm::mat4& view_mat, const LightManager& lights, const uint32_t max_plight_count, const uint32_t max_slight_count) {
+        lights.fill_storage_data(this->m_plights, this->m_slights, max_plight_count, max_slight_count);
+
+        this->m_plight_hits.clear();
+        this->m_slight_hits.clear();
+
+        for (uint32_t i = 0; i < this->m_plights.size(); ++i) {
+            const auto& plight = this->m_plights[i];
+            const glm::vec3 center{ view_mat * glm::vec4{ glm::vec3{ plight.m_pos_max_dist }, 1 } };
+            this->find_plight_clusters(i, center, plight.m_pos_max_dist.w);
+        }
+
+        for (uint32_t i = 0; i < this->m_slights.size(); ++i) {
+            const auto& slight = this->m_slights[i];
+            const glm::vec3 pos{ view_mat * glm::vec4{ glm::vec3{ slight.m_pos_max_dist }, 1 } };
+            const glm::vec3 direc = glm::normalize(glm::vec3{ view_mat * glm::vec4{ glm::vec3{ slight.m_direc_shadow_index }, 0 } });
+            this->find_slight_clusters(i, pos, direc, slight.m_pos_max_dist.w, slight.m_fade_start_end.y);
+        }
+
+        this->build_index_list();
+    }
+
+    glm::vec4 LightCluster::make_shader_params() const {
+        return glm::vec4{ this->m_slice_scale, this->m_slice_bias, this->m_tile_width, this->m_tile_height };
+    }
+
+    uint32_t LightCluster::calc_slice(const float view_depth) const {
+        const float slice = std::log(view_depth) * this->m_slice_scale + this->m_slice_bias;
+        return static_cast<uint32_t>(std::clamp<float>(slice, 0, CLUSTER_COUNT_Z - 1));
+    }
+
+    void LightCluster::find_plight_clusters(const uint32_t light_index, const glm::vec3& center, const float radius) {
+        const float depth_min = -center.z - radius;
+        const float depth_max = -center.z + radius;
+        if (depth_max < this->m_near || depth_min > this->m_far) {
+            return;
+        }
+
+        const auto slice_first = this->calc_slice(std::max(depth_min, this->m_near));
+        const auto slice_last = this->calc_slice(std::min(depth_max, this->m_far));
+
+        for (uint32_t slice = slice_first; slice <= slice_last; ++slice) {
+            const auto slice_offset = slice * CLUSTER_COUNT_PER_SLICE;
+
+            for (uint32_t i = 0; i < CLUSTER_COUNT_PER_SLICE; i += 4) {
+                const auto mask = ::test_sphere_vs_4_aabbs(
+                    center, radius, slice_offset + i,
+                    this->m_min_x.data(), this->m_min_y.data(), this->m_min_z.data(),
+                    this->m_max_x.data(), this->m_max_y.data(), this->m_max_z.data()
+                );
+
+                for (uint32_t bit = 0; bit < 4; ++bit) {
+                    if (mask & (1 << bit)) {
+                        this->m_plight_hits.emplace_back(slice_offset + i + bit, light_index);
+                    }
+                }
+            }
+        }
+    }
+
+    void LightCluster::find_slight_clusters(const uint32_t light_index, const glm::vec3& pos, const glm::vec3& direc, const float max_dist, const float cos_angle) {
+        const float depth_min = -pos.z - max_dist;
+        const float depth_max = -pos.z + max_dist;
+        if (depth_max < this->m_near || depth_min > this->m_far) {
+            return;
+        }
+
+        const auto slice_first = this->calc_slice(std::max(depth_min, this->m_near));
+        const auto slice_last = this->calc_slice(std::min(depth_max, this->m_far));
+        const float sin_angle = std::sqrt(std::max(1.f - cos_angle * cos_angle, 0.f));
+
+        for (uint32_t index = slice_first * CLUSTER_COUNT_PER_SLICE; index < (slice_last + 1) * CLUSTER_COUNT_PER_SLICE; ++index) {
+            const glm::vec3 aabb_min{ this->m_min_x[index], this->m_min_y[index], this->m_min_z[index] };
+            const glm::vec3 aabb_max{ this->m_max_x[index], this->m_max_y[index], this->m_max_z[index] };
+            const auto sphere_center = (aabb_min + aabb_max) * 0.5f;
+            const auto sphere_radius = glm::length(aabb_max - aabb_min) * 0.5f;
+
+            if (!::is_cone_culled(sphere_center, sphere_radius, pos, direc, max_dist, cos_angle, sin_angle)) {
+                this->m_slight_hits.emplace_back(index, light_index);
+            }
+        }
+    }
+
+    void LightCluster::build_index_list() {
+        this->m_ranges.assign(CLUSTER_COUNT, U_ClusterRange{});
+
+        for (auto& hit : this->m_plight_hits) {
+            ++this->m_ranges[hit.first].m_plight_count;
+        }
+        for (auto& hit : this->m_slight_hits) {
+            ++this->m_ranges[hit.first].m_slight_count;
+        }
+
+        // Prefix sum. Lights that don't fit in the index list are dropped.
+        uint32_t offset = 0;
+        for (auto& range : this->m_ranges) {
+            const auto available = MAX_CLUSTER_LIGHT_INDEX_COUNT - offset;
+            range.m_plight_count = std::min(range.m_plight_count, available);
+            range.m_slight_count = std::min(range.m_slight_count, available - range.m_plight_count);
+            range.m_offset = offset;
+            offset += range.m_plight_count + range.m_slight_count;
+        }
+
+        this->m_light_indices.resize(offset);
+
+        this->m_cursors.assign(CLUSTER_COUNT, 0);
+        for (auto& hit : this->m_plight_hits) {
+            const auto& range = this->m_ranges[hit.first];
+            auto& cursor = this->m_cursors[hit.first];
+
+            if (cursor < range.m_plight_count) {
+                this->m_light_indices[range.m_offset + cursor++] = hit.second;
+            }
+        }
+
+        this->m_cursors.assign(CLUSTER_COUNT, 0);
+        for (auto& hit : this->m_slight_hits) {
+            const auto& range = this->m_ranges[hit.first];
+            auto& cursor = this->m_cursors[hit.first];
+
+            if (cursor < range.m_slight_count) {
+                this->m_light_indices[range.m_offset + range.m_plight_count + cursor++] = hit.second;
+            }
+        }
+    }
+
+}
+
+
+// LightClusterBuffers
+namespace dal {
+
+    void LightClusterBuffers::init(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+        this->m_plights.init(swapchain_count, PLIGHT_BUFFER_SIZE, logi_device, phys_device);
+        this->m_slights.init(swapchain_count, SLIGHT_BUFFER_SIZE, logi_device, phys_device);
+        this->m_ranges.init(swapchain_count, sizeof(U_ClusterRange) * CLUSTER_COUNT, logi_device, phys_device);
+        this->m_light_indices.init(swapchain_count, sizeof(uint32_t) * MAX_CLUSTER_LIGHT_INDEX_COUNT, logi_device, phys_device);
+    }
+
+    void LightClusterBuffers::destroy(const VkDevice logi_device) {
+        this->m_plights.destroy(logi_device);
+        this->m_slights.destroy(logi_device);
+        this->m_ranges.destroy(logi_device);
+        this->m_light_indices.destroy(logi_device);
+    }
+
+    void LightClusterBuffers::copy_to_buffer(const uint32_t index, const LightCluster& cluster) {
+        this->m_plights.set_records(cluster.plights().data(), cluster.plights().size());
+        this->m_slights.set_records(cluster.slights().data(), cluster.slights().size());
+        this->m_ranges.set_records(cluster.ranges().data(), cluster.ranges().size());
+        this->m_light_indices.set_records(cluster.light_indices().data(), cluster.light_indices().size());
+
+        this->m_last_upload_size  = this->m_plights.upload(index);
+        this->m_last_upload_size += this->m_slights.upload(index);
+        this->m_last_upload_size += this->m_ranges.upload(index);
+        this->m_last_upload_size += this->m_light_indices.upload(index);
+    }
+
+    std::vector<const StorageBufferArray*> LightClusterBuffers::buffer_list() const {
+        return std::vector<const StorageBufferArray*>{
+            &this->m_plights.buffers(),
+            &this->m_slights.buffers(),
+            &this->m_ranges.buffers(),
+            &this->m_light_indices.buffers(),
+        };
+    }
+
+}
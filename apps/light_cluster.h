@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "uniform.h"
+
+
+namespace dal {
+
+    class LightManager;
+
+
+    constexpr uint32_t CLUSTER_COUNT_X = 16;
+    constexpr uint32_t CLUSTER_COUNT_Y = 9;
+    constexpr uint32_t CLUSTER_COUNT_Z = 24;
+    constexpr uint32_t CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+
+    // Capacity of the light index list shared by all clusters
+    constexpr uint32_t MAX_CLUSTER_LIGHT_INDEX_COUNT = CLUSTER_COUNT * 32;
+
+    // Light counts are limited by these buffer sizes
+    constexpr uint32_t PLIGHT_BUFFER_SIZE = 256 * 1024;
+    constexpr uint32_t SLIGHT_BUFFER_SIZE = 64 * 1024;
+
+
+    // Froxel grid in view space. Z is sliced exponentially between near and far plane.
+    // Lights are assigned on CPU every frame and the result is a range per cluster into one index list.
+    class LightCluster {
+
+    private:
+        // View space AABB of each cluster, structure of arrays so 4 clusters are tested at once
+        std::vector<float> m_min_x, m_min_y, m_min_z;
+        std::vector<float> m_max_x, m_max_y, m_max_z;
+
+        float m_near = 0, m_far = 0;
+        float m_slice_scale = 0, m_slice_bias = 0;
+        float m_tile_width = 0, m_tile_height = 0;
+
+        std::vector<U_PointLight> m_plights;
+        std::vector<U_SpotLight> m_slights;
+        std::vector<U_ClusterRange> m_ranges;
+        std::vector<uint32_t> m_light_indices;
+
+        // Scratch buffers kept to avoid allocating every frame
+        std::vector<std::pair<uint32_t, uint32_t>> m_plight_hits, m_slight_hits;  // (cluster index, light index)
+        std::vector<uint32_t> m_cursors;
+
+    public:
+        // Must be called whenever the projection matrix or the screen size changes
+        void rebuild_grid(const glm::mat4& proj_mat, const float near_plane, const float far_plane, const VkExtent2D extent);
+        void assign_lights(const glm::mat4& view_mat, const LightManager& lights, const uint32_t max_plight_count, const uint32_t max_slight_count);
+
+        // For U_PerFrame_InComposition::m_cluster_params
+        glm::vec4 make_shader_params() const;
+
+        auto& plights() const {
+            return this->m_plights;
+        }
+        auto& slights() const {
+            return this->m_slights;
+        }
+        auto& ranges() const {
+            return this->m_ranges;
+        }
+        auto& light_indices() const {
+            return this->m_light_indices;
+        }
+
+    private:
+        uint32_t calc_slice(const float view_depth) const;
+
+        void find_plight_clusters(const uint32_t light_index, const glm::vec3& center, const float radius);
+        void find_slight_clusters(const uint32_t light_index, const glm::vec3& pos, const glm::vec3& direc, const float max_dist, const float cos_angle);
+        void build_index_list();
+
+    };
+
+
+    // Storage buffers that carry LightCluster to the composition shader, one set for each swapchain image.
+    // Only records changed since the image's buffer was last written are uploaded.
+    class LightClusterBuffers {
+
+    private:
+        StorageBufferTable<U_PointLight> m_plights;
+        StorageBufferTable<U_SpotLight> m_slights;
+        StorageBufferTable<U_ClusterRange> m_ranges;
+        StorageBufferTable<uint32_t> m_light_indices;
+
+        uint32_t m_last_upload_size = 0;
+
+    public:
+        void init(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device);
+        void destroy(const VkDevice logi_device);
+
+        void copy_to_buffer(const uint32_t index, const LightCluster& cluster);
+
+        uint32_t plight_capacity() const {
+            return this->m_plights.capacity();
+        }
+        uint32_t slight_capacity() const {
+            return this->m_slights.capacity();
+        }
+        // In bytes
+        uint32_t last_upload_size() const {
+            return this->m_last_upload_size;
+        }
+
+        // In the binding order of composition descriptor set
+        std::vector<const StorageBufferArray*> buffer_list() const;
+
+    };
+
+}
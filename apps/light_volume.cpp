@@ -0,0 +1,31 @@
+#include "light_volume.h"
+
+#include <array>
+
+
+namespace dal {
+
+    void LightVolumeDrawArgs::init(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+        this->m_buffers.init(swapchain_count, sizeof(VkDrawIndirectCommand) * 2, logi_device, phys_device, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+
+        for (uint32_t i = 0; i < swapchain_count; ++i) {
+            this->update(i, 0, 0);
+        }
+    }
+
+    void LightVolumeDrawArgs::destroy(const VkDevice logi_device) {
+        this->m_buffers.destroy(logi_device);
+    }
+
+    void LightVolumeDrawArgs::update(const uint32_t index, const uint32_t plight_count, const uint32_t slight_count) {
+        std::array<VkDrawIndirectCommand, 2> args{};
+
+        args[0].vertexCount = PLIGHT_VOLUME_VERTEX_COUNT;
+        args[0].instanceCount = plight_count;
+        args[1].vertexCount = SLIGHT_VOLUME_VERTEX_COUNT;
+        args[1].instanceCount = slight_count;
+
+        this->m_buffers.copy_to_buffer(index, args.data(), sizeof(args), 0);
+    }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "uniform.h"
+
+
+// If true, point and spot lights are drawn as spheres and cones that shade only pixels inside them.
+// Otherwise the full screen composition pass loops over the light clusters.
+#define DAL_LIGHT_VOLUME true
+
+
+namespace dal {
+
+    // Specialization constant 0 of light_volume.vert and light_volume.frag
+    enum class LightVolumeType : uint32_t { point = 0, spot = 1 };
+
+    // Must match light_volume.vert
+    constexpr uint32_t SPHERE_SEGMENT_LON = 16;
+    constexpr uint32_t SPHERE_SEGMENT_LAT = 8;
+    constexpr uint32_t CONE_SEGMENT = 16;
+
+    constexpr uint32_t PLIGHT_VOLUME_VERTEX_COUNT = SPHERE_SEGMENT_LON * SPHERE_SEGMENT_LAT * 6;
+    constexpr uint32_t SLIGHT_VOLUME_VERTEX_COUNT = CONE_SEGMENT * 6;
+
+
+    // Indirect draw arguments for light volumes, one buffer for each swapchain image.
+    // Command buffers are recorded once, so light counts are written here every frame instead.
+    class LightVolumeDrawArgs {
+
+    private:
+        StorageBufferArray m_buffers;
+
+    public:
+        void init(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device);
+        void destroy(const VkDevice logi_device);
+
+        void update(const uint32_t index, const uint32_t plight_count, const uint32_t slight_count);
+
+        auto& buffer_at(const uint32_t index) const {
+            return this->m_buffers.buffer_at(index);
+        }
+
+        static constexpr VkDeviceSize plight_offset() {
+            return 0;
+        }
+        static constexpr VkDeviceSize slight_offset() {
+            return sizeof(VkDrawIndirectCommand);
+        }
+
+    };
+
+}
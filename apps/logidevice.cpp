@@ -13,12 +13,17 @@ namespace dal {
 
     void LogiDeviceAndQueue::init(VkSurfaceKHR surface, VkPhysicalDevice physDevice) {
         const auto indices = findQueueFamilies(physDevice, surface);
+        this->m_families = indices;
 
         // Create vulkan device
         {
             std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
             {
-                std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily(), indices.presentFamily() };
+                std::set<uint32_t> uniqueQueueFamilies = {
+                    indices.graphicsFamily(),
+                    indices.presentFamily(),
+                    indices.transferFamily(),
+                };
 
                 float queuePriority = 1.f;
                 for ( const uint32_t queueFamily : uniqueQueueFamilies ) {
@@ -31,12 +36,31 @@ namespace dal {
                 }
             }
 
+            VkPhysicalDeviceFeatures supportedFeatures;
+            vkGetPhysicalDeviceFeatures(physDevice, &supportedFeatures);
+
             VkPhysicalDeviceFeatures deviceFeatures = {};
             deviceFeatures.samplerAnisotropy = true;
+            deviceFeatures.shaderSampledImageArrayDynamicIndexing = true;
+            // Whichever the device has, so KTX2 of those formats can be sampled
+            deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+            deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+            VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+            indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+            indexingFeatures.descriptorBindingPartiallyBound = true;
+            indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = true;
+            indexingFeatures.descriptorBindingUpdateUnusedWhilePending = true;
+
+            VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+            timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+            timelineFeatures.pNext = &indexingFeatures;
+            timelineFeatures.timelineSemaphore = true;
 
             VkDeviceCreateInfo createInfo = {};
             {
                 createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+                createInfo.pNext = &timelineFeatures;
 
                 createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
                 createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -61,6 +85,7 @@ namespace dal {
 
         vkGetDeviceQueue(this->m_logiDevice, indices.graphicsFamily(), 0, &this->m_graphicsQueue);
         vkGetDeviceQueue(this->m_logiDevice, indices.presentFamily(), 0, &this->m_presentQueue);
+        vkGetDeviceQueue(this->m_logiDevice, indices.transferFamily(), 0, &this->m_transferQueue);
     }
 
     void LogiDeviceAndQueue::destroy(void) {
@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include "util_vulkan.h"
+
 
 namespace dal {
 
@@ -11,6 +13,8 @@ namespace dal {
         VkDevice m_logiDevice = VK_NULL_HANDLE;
         VkQueue m_graphicsQueue = VK_NULL_HANDLE;
         VkQueue m_presentQueue = VK_NULL_HANDLE;
+        VkQueue m_transferQueue = VK_NULL_HANDLE;  // Same as graphics queue if there is no dedicated one
+        QueueFamilyIndices m_families;
 
     public:
         void init(VkSurfaceKHR surface, VkPhysicalDevice physDevice);
@@ -25,6 +29,12 @@ namespace dal {
         auto presentQ(void) const {
             return this->m_presentQueue;
         }
+        auto transferQ(void) const {
+            return this->m_transferQueue;
+        }
+        auto& families(void) const {
+            return this->m_families;
+        }
 
     };
 
@@ -0,0 +1,262 @@
+#include "mip_gen.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+    bool is_srgb(const VkFormat format) {
+        return VK_FORMAT_R8G8B8A8_SRGB == format || VK_FORMAT_B8G8R8A8_SRGB == format;
+    }
+
+
+    // sRGB code to linear scaled to 16 bits. Averaging 16 bit linear keeps the darkest codes apart.
+    const std::array<uint16_t, 256>& srgb_to_linear16() {
+        static const auto table = []() {
+            std::array<uint16_t, 256> result;
+
+            for (int i = 0; i < 256; ++i) {
+                const auto c = static_cast<double>(i) / 255.0;
+                const auto linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+                result[i] = static_cast<uint16_t>(std::lround(linear * 65535.0));
+            }
+
+            return result;
+        }();
+
+        return table;
+    }
+
+    // Inverse of srgb_to_linear16, rounded to the nearest code
+    const std::vector<uint8_t>& linear16_to_srgb() {
+        static const auto table = []() {
+            std::vector<uint8_t> result(65536);
+
+            for (int i = 0; i < 65536; ++i) {
+                const auto linear = static_cast<double>(i) / 65535.0;
+                const auto c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                result[i] = static_cast<uint8_t>(std::lround(std::min(std::max(c, 0.0), 1.0) * 255.0));
+            }
+
+            return result;
+        }();
+
+        return table;
+    }
+
+
+    // 8 bit channels of 2x2 texels averaged exactly with rounding. One output texel is 4 bytes.
+    void average_rows_unorm8(const uint8_t* const row0, const uint8_t* const row1, uint8_t* const out, const uint32_t src_width, const uint32_t out_width) {
+        uint32_t x = 0;
+
+        // Only where both source texels exist, which is every output texel unless src_width is 1
+        if (src_width >= 2) {
+#if defined(__AVX2__)
+            const auto shuffle = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+            const auto two_x16 = _mm256_set1_epi16(2);
+
+            for (; x + 4 <= out_width; x += 4) {
+                const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8));
+                const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8));
+
+                // Texels 0 to 3 and 4 to 7 in 16 bit lanes, each 128 bit lane having two texels
+                const auto s_lo = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)));
+                const auto s_hi = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)));
+
+                // Horizontal neighbours into the low 64 bits of each 128 bit lane
+                const auto p_lo = _mm256_add_epi16(s_lo, _mm256_srli_si256(s_lo, 8));
+                const auto p_hi = _mm256_add_epi16(s_hi, _mm256_srli_si256(s_hi, 8));
+
+                // Output texels 0, 2 in lane 0 and 1, 3 in lane 1
+                auto r = _mm256_unpacklo_epi64(p_lo, p_hi);
+                r = _mm256_srli_epi16(_mm256_add_epi16(r, two_x16), 2);
+                r = _mm256_packus_epi16(r, r);
+                r = _mm256_permutevar8x32_epi32(r, shuffle);
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm256_castsi256_si128(r));
+            }
+#endif
+            const auto zero = _mm_setzero_si128();
+            const auto two = _mm_set1_epi16(2);
+
+            for (; x + 2 <= out_width; x += 2) {
+                const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+                const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+                const auto s_lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                const auto s_hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+                const auto p_lo = _mm_add_epi16(s_lo, _mm_srli_si128(s_lo, 8));
+                const auto p_hi = _mm_add_epi16(s_hi, _mm_srli_si128(s_hi, 8));
+
+                auto r = _mm_unpacklo_epi64(p_lo, p_hi);
+                r = _mm_srli_epi16(_mm_add_epi16(r, two), 2);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(r, r));
+            }
+        }
+
+        for (; x < out_width; ++x) {
+            const auto x0 = x * 2;
+            const auto x1 = std::min(x0 + 1, src_width - 1);
+
+            for (uint32_t c = 0; c < 4; ++c) {
+                const uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+                out[x * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+
+    // Same as average_rows_unorm8 but of 16 bit channels. Rounding of the two averages adds a bias
+    // of under one in 65535, far below a step of 8 bit output.
+    void average_rows_16(const uint16_t* const row0, const uint16_t* const row1, uint16_t* const out, const uint32_t src_width, const uint32_t out_width) {
+        uint32_t x = 0;
+
+        if (src_width >= 2) {
+#if defined(__AVX2__)
+            for (; x + 4 <= out_width; x += 4) {
+                const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8));
+                const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8));
+                const auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8 + 16));
+                const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8 + 16));
+
+                // Two texels in each 128 bit lane
+                const auto v0 = _mm256_avg_epu16(a, b);
+                const auto v1 = _mm256_avg_epu16(c, d);
+                const auto p0 = _mm256_avg_epu16(v0, _mm256_srli_si256(v0, 8));
+                const auto p1 = _mm256_avg_epu16(v1, _mm256_srli_si256(v1, 8));
+
+                // Output texels 0, 2 in lane 0 and 1, 3 in lane 1
+                const auto r = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(p0, p1), 0xD8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * 4), r);
+            }
+#endif
+            for (; x + 2 <= out_width; x += 2) {
+                const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+                const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+                const auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 8));
+                const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 8));
+
+                const auto v0 = _mm_avg_epu16(a, b);
+                const auto v1 = _mm_avg_epu16(c, d);
+                const auto p0 = _mm_avg_epu16(v0, _mm_srli_si128(v0, 8));
+                const auto p1 = _mm_avg_epu16(v1, _mm_srli_si128(v1, 8));
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_unpacklo_epi64(p0, p1));
+            }
+        }
+
+        for (; x < out_width; ++x) {
+            const auto x0 = x * 2;
+            const auto x1 = std::min(x0 + 1, src_width - 1);
+
+            for (uint32_t c = 0; c < 4; ++c) {
+                const uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+                out[x * 4 + c] = static_cast<uint16_t>((sum + 2) / 4);
+            }
+        }
+    }
+
+    // Alpha is not sRGB encoded, so it's only widened
+    void srgb8_to_linear16(const uint8_t* const src, uint16_t* const dst, const uint32_t texel_count) {
+        const auto& table = ::srgb_to_linear16();
+
+        for (uint32_t i = 0; i < texel_count * 4; i += 4) {
+            dst[i + 0] = table[src[i + 0]];
+            dst[i + 1] = table[src[i + 1]];
+            dst[i + 2] = table[src[i + 2]];
+            dst[i + 3] = static_cast<uint16_t>(src[i + 3] * 257);
+        }
+    }
+
+    void linear16_to_srgb8(const uint16_t* const src, uint8_t* const dst, const uint32_t texel_count) {
+        const auto& table = ::linear16_to_srgb();
+
+        for (uint32_t i = 0; i < texel_count * 4; i += 4) {
+            dst[i + 0] = table[src[i + 0]];
+            dst[i + 1] = table[src[i + 1]];
+            dst[i + 2] = table[src[i + 2]];
+            dst[i + 3] = static_cast<uint8_t>((src[i + 3] * 255u + 32767u) / 65535u);
+        }
+    }
+
+}
+
+
+namespace dal {
+
+    bool is_cpu_mipmap_gen_available_for(const VkFormat format) {
+        return CPU_MIPMAP_FORMATS.end() != std::find(CPU_MIPMAP_FORMATS.begin(), CPU_MIPMAP_FORMATS.end(), format);
+    }
+
+    std::vector<ImageData> generate_mipmaps(ImageData base) {
+        if (!dal::is_cpu_mipmap_gen_available_for(base.format)) {
+            throw std::runtime_error("texture image format is not supported by CPU mipmap generation!");
+        }
+
+        std::vector<ImageData> result;
+        result.push_back(std::move(base));
+
+        while (result.back().width > 1 || result.back().height > 1) {
+            result.push_back(dal::downsample_half(result.back()));
+        }
+
+        return result;
+    }
+
+    ImageData downsample_half(const ImageData& src) {
+        if (!dal::is_cpu_mipmap_gen_available_for(src.format)) {
+            throw std::runtime_error("texture image format is not supported by CPU mipmap generation!");
+        }
+        if (src.buffer.size() < size_t{ src.width } * src.height * 4) {
+            throw std::runtime_error("image data is smaller than its size!");
+        }
+
+        ImageData result;
+        result.width = std::max<uint32_t>(src.width / 2, 1);
+        result.height = std::max<uint32_t>(src.height / 2, 1);
+        result.channels = 4;
+        result.format = src.format;
+        result.buffer.resize(size_t{ result.width } * result.height * 4);
+
+        const size_t src_pitch = size_t{ src.width } * 4;
+        const size_t out_pitch = size_t{ result.width } * 4;
+
+        if (::is_srgb(src.format)) {
+            std::vector<uint16_t> linear0(size_t{ src.width } * 4), linear1(size_t{ src.width } * 4), averaged(size_t{ result.width } * 4);
+
+            for (uint32_t y = 0; y < result.height; ++y) {
+                const auto y0 = y * 2;
+                const auto y1 = std::min(y0 + 1, src.height - 1);
+
+                ::srgb8_to_linear16(src.buffer.data() + src_pitch * y0, linear0.data(), src.width);
+                ::srgb8_to_linear16(src.buffer.data() + src_pitch * y1, linear1.data(), src.width);
+                ::average_rows_16(linear0.data(), linear1.data(), averaged.data(), src.width, result.width);
+                ::linear16_to_srgb8(averaged.data(), result.buffer.data() + out_pitch * y, result.width);
+            }
+        }
+        else {
+            for (uint32_t y = 0; y < result.height; ++y) {
+                const auto y0 = y * 2;
+                const auto y1 = std::min(y0 + 1, src.height - 1);
+
+                ::average_rows_unorm8(
+                    src.buffer.data() + src_pitch * y0,
+                    src.buffer.data() + src_pitch * y1,
+                    result.buffer.data() + out_pitch * y,
+                    src.width,
+                    result.width
+                );
+            }
+        }
+
+        return result;
+    }
+
+}
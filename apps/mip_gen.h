@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "util_windows.h"
+
+
+namespace dal {
+
+    // Formats generate_mipmaps can make levels of. Channel order doesn't matter as long as alpha is last.
+    constexpr std::array<VkFormat, 4> CPU_MIPMAP_FORMATS = {
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_R8G8B8A8_SRGB,
+        VK_FORMAT_B8G8R8A8_UNORM,
+        VK_FORMAT_B8G8R8A8_SRGB,
+    };
+
+    bool is_cpu_mipmap_gen_available_for(const VkFormat format);
+
+    // Every level of the full chain down to 1x1 from the largest, which is base itself.
+    // 2x2 box filtered with SSE2, or AVX2 if built with DAL_MIP_GEN_AVX2 on. Colors of sRGB formats are averaged in linear space.
+    // Used where GPU can't blit the format. Safe to call from any thread.
+    std::vector<ImageData> generate_mipmaps(ImageData base);
+
+    // Half the size of src, or 1 where src is already 1. The last row or column of an odd sized src is dropped.
+    ImageData downsample_half(const ImageData& src);
+
+}
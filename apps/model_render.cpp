@@ -1,96 +1,24 @@
 #include "model_render.h"
 
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <stdexcept>
 
+#include "konst.h"
 #include "util_vulkan.h"
+#include "data_tensor.h"
 
 
-// DescSetTensor_Shadow
-namespace dal {
-
-    void DescSetTensor_Shadow::init(const VkDevice logi_device) {
-        this->m_pool.init(150, 150, 150, 150, logi_device);
-    }
+namespace {
 
-    void DescSetTensor_Shadow::destroy(const VkDevice logi_device) {
-        this->m_pool.destroy(logi_device);
-        this->m_desc_sets.clear();
-    }
-
-    void DescSetTensor_Shadow::reset(
-        const std::vector<ModelVK>& models,
-        const std::vector<const UniformBufferArray<U_PerFrame_PerLight>*>& light_ubufs,
-        const uint32_t swapchain_count,
-        const VkDescriptorSetLayout desc_layout_shadow,
-        const VkDevice logi_device
-    ) {
-        const auto max_inst_count = [&models]() {
-            uint32_t result = 0;
-
-            for (auto& x : models) {
-                if (x.instances().size() > result) {
-                    result = x.instances().size();
-                }
-            }
-
-            return result;
-        }();
-
-        this->m_pool.reset(logi_device);
-        this->m_desc_sets.reset({
-            swapchain_count,
-            static_cast<uint32_t>(light_ubufs.size()),
-            static_cast<uint32_t>(models.size()),
-            max_inst_count,
-        });
-
-        for (uint32_t dlight_index = 0; dlight_index < light_ubufs.size(); ++dlight_index) {
-            for (uint32_t model_index = 0; model_index < models.size(); ++model_index) {
-                auto& model = models.at(model_index);
-
-                for (uint32_t inst_index = 0; inst_index < model.instances().size(); ++inst_index) {
-                    for (uint32_t swapchain_index = 0; swapchain_index < swapchain_count; ++swapchain_index) {
-                        auto inst = model.instances().at(inst_index);
-                        auto& one = this->at(swapchain_index, dlight_index, model_index, inst_index);
-                        one = this->m_pool.allocate(desc_layout_shadow, logi_device);
-
-                        one.record_shadow(
-                            inst.uniform_buffers().buffer_at(swapchain_index),
-                            light_ubufs.at(dlight_index)->buffer_at(swapchain_index),
-                            logi_device
-                        );
-                    }
-                }
-            }
+    // Level of the full mip chain a texture seen from the distance needs, assuming texel density of the content is alike
+    uint32_t required_mip_level(const float distance) {
+        if (distance <= dal::TEXTURE_FULL_DETAIL_DISTANCE) {
+            return 0;
         }
-    }
-
-    DescSet& DescSetTensor_Shadow::at(const uint32_t swapchain_index, const uint32_t dlight_index, const uint32_t model_index, const uint32_t inst_index) {
-        return this->m_desc_sets.at({ swapchain_index, dlight_index, model_index, inst_index });
-    }
 
-    const DescSet& DescSetTensor_Shadow::at(const uint32_t swapchain_index, const uint32_t dlight_index, const uint32_t model_index, const uint32_t inst_index) const {
-        return this->m_desc_sets.at({ swapchain_index, dlight_index, model_index, inst_index });
-    }
-
-}
-
-
-// MaterialVK
-namespace dal {
-
-    void MaterialVK::destroy(const VkDevice logi_device) {
-        this->m_material_buffer.destroy(logi_device);
-    }
-
-    void MaterialVK::set_material(
-        const VkImageView texture_image_view,
-        const VkDevice logi_device,
-        const VkPhysicalDevice phys_device
-    ) {
-        this->m_albedo_map = texture_image_view;
-        this->m_material_buffer.init(logi_device, phys_device);
-        this->m_material_buffer.copy_to_buffer(this->m_material_data, logi_device);
+        return static_cast<uint32_t>(std::log2(distance / dal::TEXTURE_FULL_DETAIL_DISTANCE));
     }
 
 }
@@ -102,13 +30,12 @@ namespace dal {
     void RenderUnitVK::set_mesh(
         const std::vector<Vertex>& vertices,
         const std::vector<uint32_t>& indices,
-        dal::CommandPool& cmd_pool,
+        dal::UploadQueues& upload_queues,
         const VkDevice logi_device,
-        const VkPhysicalDevice phys_device,
-        const VkQueue graphics_queue
+        const VkPhysicalDevice phys_device
     ) {
-        this->m_mesh.vertices.init(vertices, logi_device, phys_device, cmd_pool, graphics_queue);
-        this->m_mesh.indices.init(indices, logi_device, phys_device, cmd_pool, graphics_queue);
+        this->m_mesh.vertices.init(vertices, logi_device, phys_device, upload_queues);
+        this->m_mesh.indices.init(indices, logi_device, phys_device, upload_queues);
     }
 
 }
@@ -117,13 +44,25 @@ namespace dal {
 // ModelInstance
 namespace dal {
 
-    void ModelInstance::init(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
-        this->m_ubuf.init(swapchain_count, logi_device, phys_device);
+    void ModelInstance::init(const uint32_t frame_count, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+        this->m_ubuf.init(frame_count, logi_device, phys_device);
         this->update_ubuf(logi_device);
     }
 
     void ModelInstance::destroy(const VkDevice logi_device) {
         this->m_ubuf.destroy(logi_device);
+        this->m_desc_sets.clear();
+    }
+
+    void ModelInstance::write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device) {
+        this->m_desc_sets.resize(this->m_ubuf.array_size());
+
+        for (uint32_t i = 0; i < this->m_ubuf.array_size(); ++i) {
+            auto& ubuf = this->m_ubuf.buffer_at(i);
+            const std::vector<DescriptorInfo> infos{ dal::make_desc_info_buffer(ubuf.buffer(), ubuf.data_size()) };
+
+            this->m_desc_sets.at(i) = desc_sets.get(layouts.layout_per_inst(), layouts.update_template_per_inst(), layouts.desc_counts(layouts.layout_per_inst()), infos, logi_device);
+        }
     }
 
     void ModelInstance::update_ubuf(const VkDevice logi_device) {
@@ -144,68 +83,13 @@ namespace dal {
 }
 
 
-// ModelVK :: DescSet2D
-namespace dal {
-
-    void ModelVK::DescSet2D::init(const VkDevice logi_device) {
-        this->m_pool.init(1024, 1024, 1024, 1024, logi_device);
-    }
-
-    void ModelVK::DescSet2D::destroy(const VkDevice logi_device) {
-        this->m_pool.destroy(logi_device);
-        this->m_desc_sets.clear();
-    }
-
-    DescSet& ModelVK::DescSet2D::at(const uint32_t swapchain_index, const uint32_t inst_index, const uint32_t unit_index) {
-        return this->m_desc_sets.at({ inst_index, unit_index, swapchain_index });
-    }
-    const DescSet& ModelVK::DescSet2D::at(const uint32_t swapchain_index, const uint32_t inst_index, const uint32_t unit_index) const {
-        return this->m_desc_sets.at({ inst_index, unit_index, swapchain_index });
-    }
-
-    void ModelVK::DescSet2D::reset(
-        const std::vector<ModelInstance>& insts,
-        const std::vector<RenderUnitVK>& units,
-        const UniformBufferArray<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-        const uint32_t swapchain_count,
-        const VkSampler texture_sampler,
-        const VkDescriptorSetLayout desc_layout_deferred,
-        const VkDevice logi_device
-    ) {
-        this->m_pool.reset(logi_device);
-        this->m_desc_sets.reset({ static_cast<uint32_t>(insts.size()), static_cast<uint32_t>(units.size()), swapchain_count });
-
-        for (uint32_t inst_index = 0; inst_index < insts.size(); ++inst_index) {
-            for (uint32_t unit_index = 0; unit_index < units.size(); ++unit_index) {
-                for (uint32_t swapchain_index = 0; swapchain_index < swapchain_count; ++swapchain_index) {
-                    auto& one = this->at(swapchain_index, inst_index, unit_index);
-                    one = this->m_pool.allocate(desc_layout_deferred, logi_device);
-                    one.record_deferred(
-                        ubuf_per_frame_in_deferred.buffer_at(swapchain_index),
-                        units.at(unit_index).m_material.m_material_buffer,
-                        insts.at(inst_index).uniform_buffers().buffer_at(swapchain_index),
-                        units.at(unit_index).m_material.m_albedo_map,
-                        texture_sampler,
-                        logi_device
-                    );
-                }
-            }
-        }
-    }
-
-}
-
-
 // ModelVK
 namespace dal {
 
     void ModelVK::destroy(const VkDevice logi_device) {
-        this->m_desc_sets.destroy(logi_device);
-
         for (auto& unit : this->m_render_units) {
             unit.m_mesh.vertices.destroy(logi_device);
             unit.m_mesh.indices.destroy(logi_device);
-            unit.m_material.destroy(logi_device);
         }
         this->m_render_units.clear();
 
@@ -215,37 +99,129 @@ namespace dal {
         this->m_instances.clear();
     }
 
-    void ModelVK::reset_desc_sets(
-        const UniformBufferArray<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-        const uint32_t swapchain_count,
-        const VkSampler texture_sampler,
-        const VkDescriptorSetLayout desc_layout_deferred,
-        const VkDevice logi_device
-    ) {
-        this->m_desc_sets.reset(
-            this->m_instances,
-            this->m_render_units,
-            ubuf_per_frame_in_deferred,
-            swapchain_count,
-            texture_sampler,
-            desc_layout_deferred,
-            logi_device
-        );
+    void ModelVK::write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device) {
+        for (auto& inst : this->m_instances) {
+            inst.write_desc_sets(desc_sets, layouts, logi_device);
+        }
     }
 
     RenderUnitVK& ModelVK::add_unit() {
         return this->m_render_units.emplace_back();
     }
 
-    ModelInstance& ModelVK::add_instance(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+    ModelInstance& ModelVK::add_instance(const uint32_t frame_count, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
         auto& inst = this->m_instances.emplace_back();
-        inst.init(swapchain_count, logi_device, phys_device);
+        inst.init(frame_count, logi_device, phys_device);
         return inst;
     }
 
 }
 
 
+namespace dal {
+
+    std::vector<DrawItem> make_draw_list(const std::vector<ModelVK>& models, const DrawPass pass, const glm::vec3& view_pos) {
+        std::vector<DrawItem> result;
+
+        // A row for each model with an element for each of its instances.
+        // Offset of a row counts instances of the models before it, so offset plus instance index is unique in the scene.
+        RaggedTensor<uint32_t> inst_depth_buckets;
+        {
+            std::vector<uint32_t> inst_counts;
+            inst_counts.reserve(models.size());
+            for (auto& model : models) {
+                inst_counts.push_back(model.instances().size());
+            }
+            inst_depth_buckets.reset(inst_counts);
+        }
+
+        // Units of a model share the distances of its instances
+        if (DrawPass::gbuffer == pass) {
+            for (uint32_t model_index = 0; model_index < models.size(); ++model_index) {
+                auto& instances = models.at(model_index).instances();
+                auto row = inst_depth_buckets.row(model_index);
+
+                for (uint32_t inst_index = 0; inst_index < instances.size(); ++inst_index) {
+                    row[inst_index] = dal::make_depth_bucket(glm::distance(view_pos, instances.at(inst_index).transform().m_pos));
+                }
+            }
+        }
+
+        uint32_t mesh_id = 0;
+
+        for (uint32_t model_index = 0; model_index < models.size(); ++model_index) {
+            auto& model = models.at(model_index);
+            const auto first_inst_id = static_cast<uint32_t>(inst_depth_buckets.offsets().at(model_index));
+
+            for (uint32_t unit_index = 0; unit_index < model.render_units().size(); ++unit_index, ++mesh_id) {
+                auto& unit = model.render_units().at(unit_index);
+                const auto material_id = unit.m_material.m_table_index;
+
+                for (uint32_t inst_index = 0; inst_index < model.instances().size(); ++inst_index) {
+                    auto& draw = result.emplace_back();
+                    draw.m_model_index = model_index;
+                    draw.m_unit_index = unit_index;
+                    draw.m_inst_index = inst_index;
+
+                    switch (pass) {
+                        case DrawPass::gbuffer:
+                            draw.m_sort_key = dal::make_sort_key(pass, 0, material_id, mesh_id, inst_depth_buckets(model_index, inst_index));
+                            break;
+                        case DrawPass::shadow:
+                            // Shadow pass binds no material, only the set of the instance
+                            draw.m_sort_key = dal::make_sort_key(pass, 0, first_inst_id + inst_index, mesh_id, 0);
+                            break;
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+    BindStats count_unsorted_binds(const std::vector<ModelVK>& models, const DrawPass pass, const uint32_t thread_count) {
+        // Replays the old loops split into the same per-thread ranges as the sorted recording.
+        // Every thread binds the pipeline and sets other than the instance one, G-buffer pass has two of those.
+        // Buffers are bound at the start of each render unit and again where a range of a thread begins.
+        // The instance set is bound and the material pushed for each draw.
+        uint32_t draw_count = 0;
+        for (auto& model : models) {
+            draw_count += model.render_units().size() * model.instances().size();
+        }
+
+        std::vector<uint32_t> range_begins;
+        for (uint32_t i = 0; i < thread_count; ++i) {
+            range_begins.push_back(dal::split_range(draw_count, thread_count, i).first);
+        }
+
+        BindStats result;
+        result.m_pipeline = thread_count;
+        result.m_desc_set = thread_count * (DrawPass::gbuffer == pass ? 2 : 1);
+
+        uint32_t draw_index = 0;
+        for (auto& model : models) {
+            for (uint32_t unit_index = 0; unit_index < model.render_units().size(); ++unit_index) {
+                for (uint32_t inst_index = 0; inst_index < model.instances().size(); ++inst_index, ++draw_index) {
+                    const bool range_begins_here = range_begins.end() != std::find(range_begins.begin(), range_begins.end(), draw_index);
+
+                    if (0 == inst_index || range_begins_here) {
+                        ++result.m_vertex_buffer;
+                        ++result.m_index_buffer;
+                    }
+
+                    ++result.m_desc_set;
+                    result.m_push_const += DrawPass::gbuffer == pass ? 1 : 0;
+                    ++result.m_draw;
+                }
+            }
+        }
+
+        return result;
+    }
+
+}
+
+
 // DepthMap
 namespace dal {
 
@@ -298,14 +274,14 @@ namespace dal {
 namespace dal {
 
     void DepthMapRenderTools::init(
-        const uint32_t swapchain_count,
+        const uint32_t frame_count,
         const U_PerFrame_PerLight& per_light_data,
-        const VkRenderPass renderpass_shadow,
-        const VkCommandPool cmd_pool,
+        const uint32_t queue_family_index,
+        const uint32_t record_thread_count,
         const VkDevice logi_device,
         const VkPhysicalDevice phys_device
     ) {
-        this->m_ubufs.init(swapchain_count, logi_device, phys_device);
+        this->m_ubufs.init(frame_count, logi_device, phys_device);
         for (uint32_t i = 0; i < this->m_ubufs.array_size(); ++i) {
             this->update_ubuf_at(i, per_light_data, logi_device);
         }
@@ -313,39 +289,159 @@ namespace dal {
         // Allocate command buffers
         // ------------------------------------------------------------------------------
 
-        this->m_cmd_bufs.resize(swapchain_count);
+        this->m_cmd_pools.init(frame_count, record_thread_count, queue_family_index, logi_device);
+        this->m_cmd_bufs.resize(frame_count);
 
-        VkCommandBufferAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = cmd_pool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = swapchain_count;
+        // Primary buffer of a frame comes from the pool of thread 0 so resetting the frame's pools covers it too
+        for (uint32_t i = 0; i < frame_count; ++i) {
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = this->m_cmd_pools.pool_at(i, 0);
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
 
-        dal::assert_vk_success(
-            vkAllocateCommandBuffers(logi_device, &allocInfo, this->m_cmd_bufs.data())
-        );
+            dal::assert_vk_success(
+                vkAllocateCommandBuffers(logi_device, &allocInfo, &this->m_cmd_bufs.at(i))
+            );
+        }
+
+        this->m_secondary_cmd_bufs.init(this->m_cmd_pools, logi_device);
+        this->m_recorded_revisions.assign(frame_count, 0);
     }
 
-    void DepthMapRenderTools::destroy(const VkCommandPool cmd_pool, const VkDevice logi_device) {
+    void DepthMapRenderTools::destroy(const VkDevice logi_device) {
         this->m_ubufs.destroy(logi_device);
+        this->m_desc_sets.clear();
 
-        if (!this->m_cmd_bufs.empty()) {
-            vkFreeCommandBuffers(logi_device, cmd_pool, this->m_cmd_bufs.size(), this->m_cmd_bufs.data());
-            this->m_cmd_bufs.clear();
+        for (uint32_t i = 0; i < this->m_cmd_bufs.size(); ++i) {
+            vkFreeCommandBuffers(logi_device, this->m_cmd_pools.pool_at(i, 0), 1, &this->m_cmd_bufs.at(i));
         }
+        this->m_cmd_bufs.clear();
+        this->m_recorded_revisions.clear();
+
+        this->m_secondary_cmd_bufs.destroy(this->m_cmd_pools, logi_device);
+        this->m_cmd_pools.destroy(logi_device);
+    }
+
+    void DepthMapRenderTools::write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device) {
+        this->m_desc_sets.resize(this->m_ubufs.array_size());
+
+        for (uint32_t i = 0; i < this->m_ubufs.array_size(); ++i) {
+            auto& ubuf = this->m_ubufs.buffer_at(i);
+            const std::vector<DescriptorInfo> infos{ dal::make_desc_info_buffer(ubuf.buffer(), ubuf.data_size()) };
 
+            this->m_desc_sets.at(i) = desc_sets.get(layouts.layout_per_light(), layouts.update_template_per_light(), layouts.desc_counts(layouts.layout_per_light()), infos, logi_device);
+        }
     }
 
-    void DepthMapRenderTools::update_cmd_buf(
-        const uint32_t swapchain_count,
-        const uint32_t dlight_index,
+    void DepthMapRenderTools::record_cmd_buf_at(
+        const uint32_t frame_index,
+        const uint64_t scene_revision,
         const DepthMap& depth_map,
         const std::vector<ModelVK>& models,
-        const DescSetTensor_Shadow& descsets_shadow,
         const VkRenderPass renderpass_shadow,
         const VkPipeline pipeline_shadow,
-        const VkPipelineLayout pipelayout_shadow
+        const VkPipelineLayout pipelayout_shadow,
+        ThreadPool& record_threads,
+        const VkDevice logi_device
     ) {
+        if (this->m_recorded_revisions.at(frame_index) == scene_revision) {
+            return;
+        }
+
+        auto draw_list = dal::make_draw_list(models, DrawPass::shadow, glm::vec3{ 0 });
+        std::vector<DrawItem> sort_scratch;
+        dal::radix_sort_draws(draw_list, sort_scratch);
+
+        const auto thread_count = this->m_secondary_cmd_bufs.thread_count();
+        std::vector<BindStats> thread_stats(thread_count);
+
+        // Secondary command buffers
+        // ------------------------------------------------------------------------------
+
+        record_threads.run_on_each([&](const uint32_t thread_index) {
+            if (thread_index >= thread_count) {
+                return;
+            }
+
+            const auto [draw_begin, draw_end] = dal::split_range(draw_list.size(), thread_count, thread_index);
+            auto& stats = thread_stats.at(thread_index);
+
+            VkCommandBufferInheritanceInfo inheritance_info{};
+            inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance_info.renderPass = renderpass_shadow;
+            inheritance_info.subpass = 0;
+            inheritance_info.framebuffer = depth_map.framebuffer();
+
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            begin_info.pInheritanceInfo = &inheritance_info;
+
+            auto& cmd_buf = this->m_secondary_cmd_bufs.at(frame_index, thread_index);
+            this->m_cmd_pools.reset_at(frame_index, thread_index, logi_device);
+
+            dal::assert_vk_success( vkBeginCommandBuffer(cmd_buf, &begin_info) );
+
+            // Secondary command buffers inherit no state from the primary one
+            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow);
+            ++stats.m_pipeline;
+            vkCmdBindDescriptorSets(
+                cmd_buf,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelayout_shadow,
+                DESC_SET_SHADOW_PER_LIGHT, 1, &this->m_desc_sets.at(frame_index), 0, nullptr
+            );
+            ++stats.m_desc_set;
+
+            VkBuffer last_vert_buf = VK_NULL_HANDLE;
+            VkBuffer last_index_buf = VK_NULL_HANDLE;
+            VkDescriptorSet last_desc_set = VK_NULL_HANDLE;
+
+            for (uint32_t draw_index = draw_begin; draw_index < draw_end; ++draw_index) {
+                auto& draw = draw_list.at(draw_index);
+                auto& model = models.at(draw.m_model_index);
+                auto& render_unit = model.render_units().at(draw.m_unit_index);
+                auto& desc_set = model.instances().at(draw.m_inst_index).desc_set_at(frame_index);
+
+                if (render_unit.m_mesh.vertices.getBuf() != last_vert_buf) {
+                    VkBuffer vertBuffers[] = {render_unit.m_mesh.vertices.getBuf()};
+                    VkDeviceSize offsets[] = {0};
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, vertBuffers, offsets);
+                    last_vert_buf = vertBuffers[0];
+                    ++stats.m_vertex_buffer;
+                }
+                if (render_unit.m_mesh.indices.getBuf() != last_index_buf) {
+                    vkCmdBindIndexBuffer(cmd_buf, render_unit.m_mesh.indices.getBuf(), 0, VK_INDEX_TYPE_UINT32);
+                    last_index_buf = render_unit.m_mesh.indices.getBuf();
+                    ++stats.m_index_buffer;
+                }
+                if (desc_set != last_desc_set) {
+                    vkCmdBindDescriptorSets(
+                        cmd_buf,
+                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        pipelayout_shadow,
+                        DESC_SET_SHADOW_PER_INST, 1, &desc_set, 0, nullptr
+                    );
+                    last_desc_set = desc_set;
+                    ++stats.m_desc_set;
+                }
+
+                vkCmdDrawIndexed(cmd_buf, render_unit.m_mesh.indices.size(), 1, 0, 0, 0);
+                ++stats.m_draw;
+            }
+
+            dal::assert_vk_success( vkEndCommandBuffer(cmd_buf) );
+        });
+
+        this->m_bind_stats = BindStats{};
+        for (auto& x : thread_stats) {
+            this->m_bind_stats += x;
+        }
+
+        // Primary command buffer
+        // ------------------------------------------------------------------------------
+
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -355,48 +451,23 @@ namespace dal {
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = renderpass_shadow;
+        renderPassInfo.framebuffer = depth_map.framebuffer();
         renderPassInfo.renderArea.offset = { 0, 0 };
         renderPassInfo.renderArea.extent = depth_map.extent();
         renderPassInfo.clearValueCount = clear_values.size();
         renderPassInfo.pClearValues = clear_values.data();
 
-        for (uint32_t i = 0; i < swapchain_count; ++i) {
-            auto& cmd_buf = this->m_cmd_bufs.at(i);
-
-            dal::assert_vk_success( vkBeginCommandBuffer(cmd_buf, &beginInfo) );
-
-            renderPassInfo.framebuffer = depth_map.framebuffer();
-            vkCmdBeginRenderPass(cmd_buf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow);
-
-            for (uint32_t model_index = 0; model_index < models.size(); ++model_index) {
-                auto& model = models.at(model_index);
-
-                for (const auto& render_unit : model.render_units()) {
-                    VkBuffer vertBuffers[] = {render_unit.m_mesh.vertices.getBuf()};
-                    VkDeviceSize offsets[] = {0};
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, vertBuffers, offsets);
-                    vkCmdBindIndexBuffer(cmd_buf, render_unit.m_mesh.indices.getBuf(), 0, VK_INDEX_TYPE_UINT32);
+        auto& cmd_buf = this->m_cmd_bufs.at(frame_index);
 
-                    for (uint32_t inst_index = 0; inst_index < model.instances().size(); ++inst_index) {
-                        auto& inst = model.instances().at(inst_index);
+        dal::assert_vk_success( vkBeginCommandBuffer(cmd_buf, &beginInfo) );
 
-                        vkCmdBindDescriptorSets(
-                            cmd_buf,
-                            VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelayout_shadow,
-                            0, 1, &descsets_shadow.at(i, dlight_index, model_index, inst_index).get(), 0, nullptr
-                        );
-
-                        vkCmdDrawIndexed(cmd_buf, render_unit.m_mesh.indices.size(), 1, 0, 0, 0);
-                    }
-                }
-            }
+        vkCmdBeginRenderPass(cmd_buf, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(cmd_buf, thread_count, this->m_secondary_cmd_bufs.data_at(frame_index));
+        vkCmdEndRenderPass(cmd_buf);
 
-            vkCmdEndRenderPass(cmd_buf);
+        dal::assert_vk_success( vkEndCommandBuffer(cmd_buf) );
 
-            dal::assert_vk_success( vkEndCommandBuffer(cmd_buf) );
-        }
+        this->m_recorded_revisions.at(frame_index) = scene_revision;
     }
 
     void DepthMapRenderTools::update_ubuf_at(const size_t index, const U_PerFrame_PerLight& data, const VkDevice logi_device) {
@@ -410,50 +481,53 @@ namespace dal {
 namespace dal {
 
     void DirectionalLight::init(
-        const uint32_t swapchain_count,
+        const uint32_t frame_count,
         const VkRenderPass renderpass_shadow,
-        const VkCommandPool cmd_pool,
+        const uint32_t queue_family_index,
+        const uint32_t record_thread_count,
         const VkDevice logi_device,
         const VkPhysicalDevice phys_device
     ) {
-        this->destroy(cmd_pool, logi_device);
+        this->destroy(logi_device);
         this->m_depth_map.init(renderpass_shadow, logi_device, phys_device);
 
         U_PerFrame_PerLight data;
         data.m_light_mat = this->make_light_mat();
         this->m_render_tool.init(
-            swapchain_count,
+            frame_count,
             data,
-            renderpass_shadow,
-            cmd_pool,
+            queue_family_index,
+            record_thread_count,
             logi_device,
             phys_device
         );
     }
 
-    void DirectionalLight::destroy(const VkCommandPool cmd_pool, const VkDevice logi_device) {
+    void DirectionalLight::destroy(const VkDevice logi_device) {
         this->m_depth_map.destroy(logi_device);
-        this->m_render_tool.destroy(cmd_pool, logi_device);
+        this->m_render_tool.destroy(logi_device);
     }
 
-    void DirectionalLight::update_cmd_buf(
-        const uint32_t swapchain_count,
-        const uint32_t dlight_index,
+    void DirectionalLight::record_cmd_buf_at(
+        const uint32_t frame_index,
+        const uint64_t scene_revision,
         const std::vector<ModelVK>& models,
-        const DescSetTensor_Shadow& descsets_shadow,
         const VkRenderPass renderpass_shadow,
         const VkPipeline pipeline_shadow,
-        const VkPipelineLayout pipelayout_shadow
+        const VkPipelineLayout pipelayout_shadow,
+        ThreadPool& record_threads,
+        const VkDevice logi_device
     ) {
-        this->m_render_tool.update_cmd_buf(
-            swapchain_count,
-            dlight_index,
+        this->m_render_tool.record_cmd_buf_at(
+            frame_index,
+            scene_revision,
             this->m_depth_map,
             models,
-            descsets_shadow,
             renderpass_shadow,
             pipeline_shadow,
-            pipelayout_shadow
+            pipelayout_shadow,
+            record_threads,
+            logi_device
         );
     }
 
@@ -486,50 +560,53 @@ namespace dal {
 namespace dal {
 
     void SpotLight::init(
-        const uint32_t swapchain_count,
+        const uint32_t frame_count,
         const VkRenderPass renderpass_shadow,
-        const VkCommandPool cmd_pool,
+        const uint32_t queue_family_index,
+        const uint32_t record_thread_count,
         const VkDevice logi_device,
         const VkPhysicalDevice phys_device
     ) {
-        this->destroy(cmd_pool, logi_device);
+        this->destroy(logi_device);
         this->m_depth_map.init(renderpass_shadow, logi_device, phys_device);
 
         U_PerFrame_PerLight data;
         data.m_light_mat = this->make_light_mat();
         this->m_render_tool.init(
-            swapchain_count,
+            frame_count,
             data,
-            renderpass_shadow,
-            cmd_pool,
+            queue_family_index,
+            record_thread_count,
             logi_device,
             phys_device
         );
     }
 
-    void SpotLight::destroy(const VkCommandPool cmd_pool, const VkDevice logi_device) {
+    void SpotLight::destroy(const VkDevice logi_device) {
         this->m_depth_map.destroy(logi_device);
-        this->m_render_tool.destroy(cmd_pool, logi_device);
+        this->m_render_tool.destroy(logi_device);
     }
 
-    void SpotLight::update_cmd_buf(
-        const uint32_t swapchain_count,
-        const uint32_t dlight_index,
+    void SpotLight::record_cmd_buf_at(
+        const uint32_t frame_index,
+        const uint64_t scene_revision,
         const std::vector<ModelVK>& models,
-        const DescSetTensor_Shadow& descsets_shadow,
         const VkRenderPass renderpass_shadow,
         const VkPipeline pipeline_shadow,
-        const VkPipelineLayout pipelayout_shadow
+        const VkPipelineLayout pipelayout_shadow,
+        ThreadPool& record_threads,
+        const VkDevice logi_device
     ) {
-        this->m_render_tool.update_cmd_buf(
-            swapchain_count,
-            dlight_index,
+        this->m_render_tool.record_cmd_buf_at(
+            frame_index,
+            scene_revision,
             this->m_depth_map,
             models,
-            descsets_shadow,
             renderpass_shadow,
             pipeline_shadow,
-            pipelayout_shadow
+            pipelayout_shadow,
+            record_threads,
+            logi_device
         );
     }
 
@@ -542,7 +619,7 @@ namespace dal {
     glm::mat4 SpotLight::make_light_mat() const {
         const auto view_mat = glm::lookAt(this->m_pos, this->m_pos + this->m_direc, glm::vec3{ 0, 1, 0 });
 
-        auto proj_mat = glm::perspective<float>(this->m_fade_end_radians * 2, 1, 1, 20);
+        auto proj_mat = glm::perspective<float>(this->m_fade_end_radians * 2, 1, 1, this->m_max_dist);
         proj_mat[1][1] *= -1;
 
         return proj_mat * view_mat;
@@ -563,39 +640,49 @@ namespace dal {
 // LightManager
 namespace dal {
 
-    void LightManager::destroy(const VkCommandPool cmd_pool, const VkDevice logi_device) {
+    void LightManager::destroy(const VkDevice logi_device) {
         for (auto& dlight : this->m_dlights) {
-            dlight.destroy(cmd_pool, logi_device);
+            dlight.destroy(logi_device);
         }
         for (auto& slight : this->m_slights) {
-            slight.destroy(cmd_pool, logi_device);
+            slight.destroy(logi_device);
         }
     }
 
     void LightManager::fill_uniform_data(U_PerFrame_InComposition& result) const {
-        const auto plight_count = std::min<size_t>(dal::MAX_PLIGHT_COUNT, this->m_plights.size());
         const auto dlight_count = std::min<size_t>(dal::MAX_DLIGHT_COUNT, this->m_dlights.size());
-        const auto slight_count = std::min<size_t>(dal::MAX_SLIGHT_COUNT, this->m_slights.size());
 
-        result.m_num_of_plight_dlight_slight = glm::vec4{ plight_count, dlight_count, slight_count, 0 };
-
-        for (size_t i = 0; i < plight_count; ++i) {
-            result.m_plight_pos[i]   = glm::vec4{ this->m_plights.at(i).m_pos,   1 };
-            result.m_plight_color[i] = glm::vec4{ this->m_plights.at(i).m_color, 1 };
-        }
+        result.m_num_of_plight_dlight_slight = glm::vec4{ this->m_plights.size(), dlight_count, this->m_slights.size(), 0 };
 
         for (size_t i = 0; i < dlight_count; ++i) {
             result.m_dlight_direc[i] = glm::vec4{ this->m_dlights.at(i).m_direc, 0 };
             result.m_dlight_color[i] = glm::vec4{ this->m_dlights.at(i).m_color, 1 };
             result.m_dlight_mat[i] = this->m_dlights.at(i).make_light_mat();
         }
+    }
+
+    void LightManager::fill_storage_data(std::vector<U_PointLight>& plights, std::vector<U_SpotLight>& slights, const size_t max_plight_count, const size_t max_slight_count) const {
+        const auto plight_count = std::min<size_t>(max_plight_count, this->m_plights.size());
+        const auto slight_count = std::min<size_t>(max_slight_count, this->m_slights.size());
+
+        plights.resize(plight_count);
+        slights.resize(slight_count);
+
+        for (size_t i = 0; i < plight_count; ++i) {
+            auto& src = this->m_plights.at(i);
+            plights[i].m_pos_max_dist = glm::vec4{ src.m_pos, src.m_max_dist };
+            plights[i].m_color        = glm::vec4{ src.m_color, 1 };
+        }
 
         for (size_t i = 0; i < slight_count; ++i) {
-            result.m_slight_pos[i]            = glm::vec4{ this->m_slights.at(i).m_pos, 0 };
-            result.m_slight_direc[i]          = glm::vec4{ this->m_slights.at(i).m_direc, 0 };
-            result.m_slight_color[i]          = glm::vec4{ this->m_slights.at(i).m_color, 0 };
-            result.m_slight_fade_start_end[i] = glm::vec4{ this->m_slights.at(i).fade_start(), this->m_slights.at(i).fade_end(), 0, 0 };
-            result.m_slight_mat[i]            = this->m_slights.at(i).make_light_mat();
+            auto& src = this->m_slights.at(i);
+            const float shadow_index = i < dal::MAX_SLIGHT_SHADOW_COUNT ? static_cast<float>(i) : -1.f;
+
+            slights[i].m_pos_max_dist       = glm::vec4{ src.m_pos, src.m_max_dist };
+            slights[i].m_direc_shadow_index = glm::vec4{ src.m_direc, shadow_index };
+            slights[i].m_color              = glm::vec4{ src.m_color, 1 };
+            slights[i].m_fade_start_end     = glm::vec4{ src.fade_start(), src.fade_end(), 0, 0 };
+            slights[i].m_light_mat          = src.make_light_mat();
         }
     }
 
@@ -647,10 +734,10 @@ namespace dal {
 // SceneNode
 namespace dal {
 
-    void SceneNode::init(const VkSurfaceKHR surface, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
-        this->m_cmd_pool.init(phys_device, logi_device, surface);
-        this->m_desc_sets_for_dlights.init(logi_device);
-        this->m_desc_sets_for_slights.init(logi_device);
+    void SceneNode::init(const uint32_t record_thread_count, const VkSurfaceKHR surface, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+        this->m_queue_family_index = dal::findQueueFamilies(phys_device, surface).graphicsFamily();
+        this->m_record_thread_count = record_thread_count;
+        this->m_desc_set_cache.init(logi_device);
     }
 
     void SceneNode::destroy(const VkDevice logi_device) {
@@ -659,81 +746,168 @@ namespace dal {
         }
         this->m_models.clear();
 
-        this->m_lights.destroy(this->m_cmd_pool.pool(), logi_device);
+        this->m_lights.destroy(logi_device);
+
+        this->m_desc_set_cache.destroy(logi_device);
+        this->m_desc_sets_per_frame.clear();
+        this->m_material_table.destroy(logi_device);
+    }
+
+    void SceneNode::update_materials_at(const uint32_t frame_index, const glm::vec3& view_pos, const uint64_t use_stamp) {
+        std::vector<U_Material_InDeferred> records;
+
+        for (auto& model : this->m_models) {
+            // The nearest instance decides the level every unit of the model needs
+            auto nearest = std::numeric_limits<float>::max();
+            for (auto& inst : model.instances()) {
+                nearest = std::min(nearest, glm::distance(inst.transform().m_pos, view_pos));
+            }
+
+            for (auto& unit : model.render_units()) {
+                if (!model.instances().empty()) {
+                    unit.m_material.m_albedo_map->notify_use(::required_mip_level(nearest), use_stamp);
+                }
+
+                records.push_back(unit.m_material.make_record());
+            }
+        }
 
-        this->m_cmd_pool.destroy(logi_device);
-        this->m_desc_sets_for_dlights.destroy(logi_device);
-        this->m_desc_sets_for_slights.destroy(logi_device);
+        // Only records that differ are uploaded
+        this->m_material_table.set_records(records.data(), records.size());
+        this->m_material_table.upload(frame_index);
     }
 
-    void SceneNode::on_swapchain_count_change(
-        const uint32_t swapchain_count,
+    void SceneNode::on_frame_count_change(
+        const uint32_t frame_count,
         const UniformBufferArray<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-        const VkSampler texture_sampler,
-        const VkDescriptorSetLayout desc_layout_deferred,
-        const VkDescriptorSetLayout desc_layout_shadow,
+        const DescriptorSetLayout& desc_layouts,
         const VkRenderPass renderpass_shadow,
-        const VkPipeline pipeline_shadow,
-        const VkPipelineLayout pipelayout_shadow,
         const VkDevice logi_device,
         const VkPhysicalDevice phys_device
     ) {
-        for (auto& model : this->m_models) {
-            for (auto& inst : model.instances()) {
-                inst.init(swapchain_count, logi_device, phys_device);
+        // Every buffer written into cached sets is recreated below, and a new one may get the handle of an old one
+        {
+            const auto invalidate_all = [this](auto& buffers) {
+                for (uint32_t i = 0; i < buffers.array_size(); ++i) {
+                    this->m_desc_set_cache.invalidate(buffers.buffer_at(i).buffer());
+                }
+            };
+
+            for (auto& model : this->m_models) {
+                for (auto& inst : model.instances()) {
+                    invalidate_all(inst.uniform_buffers());
+                }
+            }
+            for (auto& dlight : this->m_lights.dlights()) {
+                invalidate_all(dlight.uniform_buffers());
+            }
+            for (auto& slight : this->m_lights.slights()) {
+                invalidate_all(slight.uniform_buffers());
+            }
+            invalidate_all(this->m_material_table.buffers());
+
+            // Nothing is in flight when the frame count changes
+            this->m_desc_set_cache.trim(logi_device);
+        }
+
+        {
+            std::vector<U_Material_InDeferred> records;
+
+            for (auto& model : this->m_models) {
+                for (auto& unit : model.render_units()) {
+                    unit.m_material.m_table_index = records.size();
+                    records.push_back(unit.m_material.make_record());
+                }
             }
 
-            model.reset_desc_sets(
-                ubuf_per_frame_in_deferred,
-                swapchain_count,
-                texture_sampler,
-                desc_layout_deferred,
+            this->m_material_table.init(frame_count, sizeof(U_Material_InDeferred) * dal::MAX_MATERIAL_COUNT, logi_device, phys_device);
+            this->m_material_table.set_records(records.data(), records.size());
+            for (uint32_t i = 0; i < frame_count; ++i) {
+                this->m_material_table.upload(i);
+            }
+        }
+
+        this->m_desc_sets_per_frame.resize(frame_count);
+        for (uint32_t i = 0; i < frame_count; ++i) {
+            auto& ubuf = ubuf_per_frame_in_deferred.buffer_at(i);
+            const std::vector<DescriptorInfo> infos{
+                dal::make_desc_info_buffer(ubuf.buffer(), ubuf.data_size()),
+                dal::make_desc_info_buffer(this->m_material_table.buffers().buffer_at(i).buffer(), VK_WHOLE_SIZE),
+            };
+
+            this->m_desc_sets_per_frame.at(i) = this->m_desc_set_cache.get(
+                desc_layouts.layout_per_frame(),
+                desc_layouts.update_template_per_frame(),
+                desc_layouts.desc_counts(desc_layouts.layout_per_frame()),
+                infos,
                 logi_device
             );
         }
 
+        for (auto& model : this->m_models) {
+            for (auto& inst : model.instances()) {
+                inst.init(frame_count, logi_device, phys_device);
+            }
+
+            model.write_desc_sets(this->m_desc_set_cache, desc_layouts, logi_device);
+        }
+
         for (auto& dlight : this->m_lights.dlights()) {
-            dlight.init(swapchain_count, renderpass_shadow, this->m_cmd_pool.pool(), logi_device, phys_device);
+            dlight.init(frame_count, renderpass_shadow, this->m_queue_family_index, this->m_record_thread_count, logi_device, phys_device);
+            dlight.write_desc_sets(this->m_desc_set_cache, desc_layouts, logi_device);
         }
         for (auto& slight : this->m_lights.slights()) {
-            slight.init(swapchain_count, renderpass_shadow, this->m_cmd_pool.pool(), logi_device, phys_device);
+            slight.init(frame_count, renderpass_shadow, this->m_queue_family_index, this->m_record_thread_count, logi_device, phys_device);
+            slight.write_desc_sets(this->m_desc_set_cache, desc_layouts, logi_device);
         }
 
-        this->m_desc_sets_for_dlights.reset(
-            this->m_models,
-            this->m_lights.dlight_ubufs(),
-            swapchain_count,
-            desc_layout_shadow,
-            logi_device
-        );
-        this->m_desc_sets_for_slights.reset(
-            this->m_models,
-            this->m_lights.slight_ubufs(),
-            swapchain_count,
-            desc_layout_shadow,
-            logi_device
-        );
+        // Descriptor sets of anything that was recreated are new
+        this->mark_dirty();
+    }
+
+    BindStats SceneNode::shadow_bind_stats() const {
+        BindStats result;
+
+        for (auto& dlight : this->m_lights.dlights()) {
+            result += dlight.bind_stats();
+        }
+        for (auto& slight : this->m_lights.slights()) {
+            result += slight.bind_stats();
+        }
 
-        for (uint32_t i = 0; i < this->m_lights.dlights().size(); ++i) {
-            this->m_lights.dlights().at(i).update_cmd_buf(
-                swapchain_count,
-                i,
+        return result;
+    }
+
+    void SceneNode::record_shadow_cmd_bufs_at(
+        const uint32_t frame_index,
+        const VkRenderPass renderpass_shadow,
+        const VkPipeline pipeline_shadow,
+        const VkPipelineLayout pipelayout_shadow,
+        ThreadPool& record_threads,
+        const VkDevice logi_device
+    ) {
+        for (auto& dlight : this->m_lights.dlights()) {
+            dlight.record_cmd_buf_at(
+                frame_index,
+                this->m_revision,
                 this->m_models,
-                this->m_desc_sets_for_dlights,
                 renderpass_shadow,
                 pipeline_shadow,
-                pipelayout_shadow
+                pipelayout_shadow,
+                record_threads,
+                logi_device
             );
         }
-        for (uint32_t i = 0; i < this->m_lights.slights().size(); ++i) {
-            this->m_lights.slights().at(i).update_cmd_buf(
-                swapchain_count,
-                i,
+        for (auto& slight : this->m_lights.slights()) {
+            slight.record_cmd_buf_at(
+                frame_index,
+                this->m_revision,
                 this->m_models,
-                this->m_desc_sets_for_slights,
                 renderpass_shadow,
                 pipeline_shadow,
-                pipelayout_shadow
+                pipelayout_shadow,
+                record_threads,
+                logi_device
             );
         }
     }
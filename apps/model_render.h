@@ -1,46 +1,19 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <optional>
 
 #include <vulkan/vulkan.h>
 
 #include "vert_data.h"
 #include "uniform.h"
+#include "texture.h"
 #include "view_camera.h"
 #include "command_pool.h"
-#include "data_tensor.h"
-
-
-namespace dal {
-
-    class ModelVK;
-    class DirectionalLight;
-
-
-    class DescSetTensor_Shadow {
-
-    private:
-        DescPool m_pool;
-        DataTensor<DescSet, 4> m_desc_sets;
-
-    public:
-        void init(const VkDevice logi_device);
-        void destroy(const VkDevice logi_device);
-        void reset(
-            const std::vector<ModelVK>& models,
-            const std::vector<const UniformBufferArray<U_PerFrame_PerLight>*>& light_ubufs,
-            const uint32_t swapchain_count,
-            const VkDescriptorSetLayout desc_layout_shadow,
-            const VkDevice logi_device
-        );
-
-        DescSet& at(const uint32_t swapchain_index, const uint32_t dlight_index, const uint32_t model_index, const uint32_t unit_index);
-        const DescSet& at(const uint32_t swapchain_index, const uint32_t dlight_index, const uint32_t model_index, const uint32_t unit_index) const;
-
-    };
-
-}
+#include "thread_pool.h"
+#include "draw_sort.h"
+#include "desc_set_cache.h"
 
 
 namespace dal {
@@ -49,18 +22,21 @@ namespace dal {
 
     public:
         U_Material_InDeferred m_material_data;
-        UniformBuffer<U_Material_InDeferred> m_material_buffer;
-
-        VkImageView m_albedo_map = VK_NULL_HANDLE;
+        std::shared_ptr<TextureUnit> m_albedo_map;
+        // Into the material table of the scene node. G-buffer draws push it instead of binding anything.
+        uint32_t m_table_index = 0;
 
     public:
-        void destroy(const VkDevice logi_device);
+        void set_albedo_map(const std::shared_ptr<TextureUnit>& texture) {
+            this->m_albedo_map = texture;
+        }
 
-        void set_material(
-            const VkImageView texture_image_view,
-            const VkDevice logi_device,
-            const VkPhysicalDevice phys_device
-        );
+        // Texture table index of a streaming texture changes as its mips arrive, so it's read again every time
+        U_Material_InDeferred make_record() const {
+            auto result = this->m_material_data;
+            result.m_albedo_index = this->m_albedo_map->table_index;
+            return result;
+        }
 
     };
 
@@ -74,10 +50,9 @@ namespace dal {
         void set_mesh(
             const std::vector<Vertex>& vertices,
             const std::vector<uint32_t>& indices,
-            dal::CommandPool& cmd_pool,
+            dal::UploadQueues& upload_queues,
             const VkDevice logi_device,
-            const VkPhysicalDevice phys_device,
-            const VkQueue graphics_queue
+            const VkPhysicalDevice phys_device
         );
 
     };
@@ -87,10 +62,12 @@ namespace dal {
     private:
         Transform m_transform;
         UniformBufferArray<U_PerInst_PerFrame_InDeferred> m_ubuf;
+        std::vector<VkDescriptorSet> m_desc_sets;  // Per frame, bound by both G-buffer and shadow programs
 
     public:
-        void init(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device);
+        void init(const uint32_t frame_count, const VkDevice logi_device, const VkPhysicalDevice phys_device);
         void destroy(const VkDevice logi_device);
+        void write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device);
 
         void update_ubuf(const VkDevice logi_device);
         void update_ubuf(const uint32_t index, const VkDevice logi_device);
@@ -104,56 +81,25 @@ namespace dal {
         auto& uniform_buffers() const {
             return this->m_ubuf;
         }
+        auto& desc_set_at(const uint32_t frame_index) const {
+            return this->m_desc_sets.at(frame_index);
+        }
 
     };
 
     class ModelVK {
 
-    private:
-        class DescSet2D {
-
-        private:
-            DescPool m_pool;
-            DataTensor<DescSet, 3> m_desc_sets;
-
-        public:
-            void init(const VkDevice logi_device);
-            void destroy(const VkDevice logi_device);
-            void reset(
-                const std::vector<ModelInstance>& insts,
-                const std::vector<RenderUnitVK>& units,
-                const UniformBufferArray<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-                const uint32_t swapchain_count,
-                const VkSampler texture_sampler,
-                const VkDescriptorSetLayout desc_layout_deferred,
-                const VkDevice logi_device
-            );
-
-            DescSet& at(const uint32_t swapchain_index, const uint32_t inst_index, const uint32_t unit_index);
-            const DescSet& at(const uint32_t swapchain_index, const uint32_t inst_index, const uint32_t unit_index) const;
-
-        };
-
     private:
        std::vector<RenderUnitVK> m_render_units;
        std::vector<ModelInstance> m_instances;
-       DescSet2D m_desc_sets;
 
     public:
-        void init(const VkDevice logi_device) {
-            this->m_desc_sets.init(logi_device);
-        }
         void destroy(const VkDevice logi_device);
-        void reset_desc_sets(
-            const UniformBufferArray<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-            const uint32_t swapchain_count,
-            const VkSampler texture_sampler,
-            const VkDescriptorSetLayout desc_layout_deferred,
-            const VkDevice logi_device
-        );
+        // Sets of instances. Ones whose resources are already in desc_sets are not written again.
+        void write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device);
 
         RenderUnitVK& add_unit();
-        ModelInstance& add_instance(const uint32_t swapchain_count, const VkDevice logi_device, const VkPhysicalDevice phys_device);
+        ModelInstance& add_instance(const uint32_t frame_count, const VkDevice logi_device, const VkPhysicalDevice phys_device);
 
         auto& render_units() {
             return this->m_render_units;
@@ -167,13 +113,18 @@ namespace dal {
         auto& instances() const {
             return this->m_instances;
         }
-        auto& desc_set(const uint32_t swapchain_index, const uint32_t inst_index, const uint32_t unit_index) const {
-            return this->m_desc_sets.at(swapchain_index, inst_index, unit_index);
-        }
 
     };
 
 
+    // Every instance of every render unit with its sort key for the pass, not sorted yet.
+    // view_pos is only used for depth buckets of G-buffer pass.
+    std::vector<DrawItem> make_draw_list(const std::vector<ModelVK>& models, const DrawPass pass, const glm::vec3& view_pos);
+
+    // Binds issued by the nested model, render unit, instance loops recording on thread_count threads, as before sorting
+    BindStats count_unsorted_binds(const std::vector<ModelVK>& models, const DrawPass pass, const uint32_t thread_count);
+
+
     const VkExtent2D SHADOW_MAP_EXTENT = { 1024 * 2, 1024 * 2 };
 
     class DepthMap {
@@ -206,28 +157,36 @@ namespace dal {
 
     public:
         UniformBufferArray<U_PerFrame_PerLight> m_ubufs;  // Per frame
+        std::vector<VkDescriptorSet> m_desc_sets;  // Per frame, set 0 of shadow program
+        FrameCommandPools m_cmd_pools;
         std::vector<VkCommandBuffer> m_cmd_bufs;  // For each frame
+        SecondaryCommandBuffers m_secondary_cmd_bufs;  // Draws inside the render pass
+        std::vector<uint64_t> m_recorded_revisions;  // For each frame, 0 if never recorded
+        BindStats m_bind_stats;  // Of the last recording
 
     public:
         void init(
-            const uint32_t swapchain_count,
+            const uint32_t frame_count,
             const U_PerFrame_PerLight& per_light_data,
-            const VkRenderPass renderpass_shadow,
-            const VkCommandPool cmd_pool,
+            const uint32_t queue_family_index,
+            const uint32_t record_thread_count,
             const VkDevice logi_device,
             const VkPhysicalDevice phys_device
         );
-        void destroy(const VkCommandPool cmd_pool, const VkDevice logi_device);
+        void destroy(const VkDevice logi_device);
+        void write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device);
 
-        void update_cmd_buf(
-            const uint32_t swapchain_count,
-            const uint32_t dlight_index,
+        // Does nothing if the command buffer of the frame was already recorded with scene_revision
+        void record_cmd_buf_at(
+            const uint32_t frame_index,
+            const uint64_t scene_revision,
             const DepthMap& depth_map,
             const std::vector<ModelVK>& models,
-            const DescSetTensor_Shadow& descsets_shadow,
             const VkRenderPass renderpass_shadow,
             const VkPipeline pipeline_shadow,
-            const VkPipelineLayout pipelayout_shadow
+            const VkPipelineLayout pipelayout_shadow,
+            ThreadPool& record_threads,
+            const VkDevice logi_device
         );
         void update_ubuf_at(const size_t index, const U_PerFrame_PerLight& data, const VkDevice logi_device);
 
@@ -239,6 +198,7 @@ namespace dal {
     public:
         glm::vec3 m_pos;
         glm::vec3 m_color;
+        float m_max_dist = 10;  // Light is windowed to zero at this distance so it can be culled
 
     };
 
@@ -255,21 +215,26 @@ namespace dal {
 
     public:
         void init(
-            const uint32_t swapchain_count,
+            const uint32_t frame_count,
             const VkRenderPass renderpass_shadow,
-            const VkCommandPool cmd_pool,
+            const uint32_t queue_family_index,
+            const uint32_t record_thread_count,
             const VkDevice logi_device,
             const VkPhysicalDevice phys_device
         );
-        void destroy(const VkCommandPool cmd_pool, const VkDevice logi_device);
-        void update_cmd_buf(
-            const uint32_t swapchain_count,
-            const uint32_t dlight_index,
+        void destroy(const VkDevice logi_device);
+        void write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device) {
+            this->m_render_tool.write_desc_sets(desc_sets, layouts, logi_device);
+        }
+        void record_cmd_buf_at(
+            const uint32_t frame_index,
+            const uint64_t scene_revision,
             const std::vector<ModelVK>& models,
-            const DescSetTensor_Shadow& descsets_shadow,
             const VkRenderPass renderpass_shadow,
             const VkPipeline pipeline_shadow,
-            const VkPipelineLayout pipelayout_shadow
+            const VkPipelineLayout pipelayout_shadow,
+            ThreadPool& record_threads,
+            const VkDevice logi_device
         );
 
         void update_ubuf_at(const size_t index, const VkDevice logi_device);
@@ -284,6 +249,9 @@ namespace dal {
         auto& cmd_buf_at(const size_t index) const {
             return this->m_render_tool.m_cmd_bufs.at(index);
         }
+        auto& bind_stats() const {
+            return this->m_render_tool.m_bind_stats;
+        }
 
     };
 
@@ -293,6 +261,7 @@ namespace dal {
         glm::vec3 m_pos;
         glm::vec3 m_direc;
         glm::vec3 m_color;
+        float m_max_dist = 20;  // Also the far plane of its shadow map
 
     private:
         float m_fade_start;
@@ -304,21 +273,26 @@ namespace dal {
 
     public:
         void init(
-            const uint32_t swapchain_count,
+            const uint32_t frame_count,
             const VkRenderPass renderpass_shadow,
-            const VkCommandPool cmd_pool,
+            const uint32_t queue_family_index,
+            const uint32_t record_thread_count,
             const VkDevice logi_device,
             const VkPhysicalDevice phys_device
         );
-        void destroy(const VkCommandPool cmd_pool, const VkDevice logi_device);
-        void update_cmd_buf(
-            const uint32_t swapchain_count,
-            const uint32_t dlight_index,
+        void destroy(const VkDevice logi_device);
+        void write_desc_sets(DescSetCache& desc_sets, const DescriptorSetLayout& layouts, const VkDevice logi_device) {
+            this->m_render_tool.write_desc_sets(desc_sets, layouts, logi_device);
+        }
+        void record_cmd_buf_at(
+            const uint32_t frame_index,
+            const uint64_t scene_revision,
             const std::vector<ModelVK>& models,
-            const DescSetTensor_Shadow& descsets_shadow,
             const VkRenderPass renderpass_shadow,
             const VkPipeline pipeline_shadow,
-            const VkPipelineLayout pipelayout_shadow
+            const VkPipelineLayout pipelayout_shadow,
+            ThreadPool& record_threads,
+            const VkDevice logi_device
         );
 
         void update_ubuf_at(const size_t index, const VkDevice logi_device);
@@ -342,6 +316,9 @@ namespace dal {
         auto& cmd_buf_at(const size_t index) const {
             return this->m_render_tool.m_cmd_bufs.at(index);
         }
+        auto& bind_stats() const {
+            return this->m_render_tool.m_bind_stats;
+        }
 
     };
 
@@ -353,9 +330,10 @@ namespace dal {
         std::vector<SpotLight> m_slights;
 
     public:
-        void destroy(const VkCommandPool cmd_pool, const VkDevice logi_device);
+        void destroy(const VkDevice logi_device);
 
         void fill_uniform_data(U_PerFrame_InComposition& output) const;
+        void fill_storage_data(std::vector<U_PointLight>& plights, std::vector<U_SpotLight>& slights, const size_t max_plight_count, const size_t max_slight_count) const;
         std::vector<VkImageView> make_view_list_dlight(const uint32_t size) const;
         std::vector<VkImageView> make_view_list_slight(const uint32_t size) const;
 
@@ -407,29 +385,62 @@ namespace dal {
         std::vector<ModelVK> m_models;
         LightManager m_lights;
 
-        DescSetTensor_Shadow m_desc_sets_for_dlights;
-        DescSetTensor_Shadow m_desc_sets_for_slights;
-        CommandPool m_cmd_pool;
+        DescSetCache m_desc_set_cache;
+        std::vector<VkDescriptorSet> m_desc_sets_per_frame;  // Set 0 of G-buffer program
+        StorageBufferTable<U_Material_InDeferred> m_material_table;  // Materials of every render unit
+        uint32_t m_queue_family_index = 0;
+        uint32_t m_record_thread_count = 1;
+
+        // Bumped whenever something command buffers depend on changes so they get recorded again
+        uint64_t m_revision = 1;
 
     public:
-        void init(const VkSurfaceKHR surface, const VkDevice logi_device, const VkPhysicalDevice phys_device);
+        void init(const uint32_t record_thread_count, const VkSurfaceKHR surface, const VkDevice logi_device, const VkPhysicalDevice phys_device);
         void destroy(const VkDevice logi_device);
-        void on_swapchain_count_change(
-            const uint32_t swapchain_count,
+        // Material records of the frame are written again if any texture they refer to was given a new table index.
+        // Textures are also told which mip level draws seen from view_pos need, stamped with use_stamp.
+        // The frame must not be in use by GPU.
+        void update_materials_at(const uint32_t frame_index, const glm::vec3& view_pos, const uint64_t use_stamp);
+        // Per-frame resources are sized by frame_count, the number of frames in flight
+        void on_frame_count_change(
+            const uint32_t frame_count,
             const UniformBufferArray<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-            const VkSampler texture_sampler,
-            const VkDescriptorSetLayout desc_layout_deferred,
-            const VkDescriptorSetLayout desc_layout_shadow,
+            const DescriptorSetLayout& desc_layouts,
             const VkRenderPass renderpass_shadow,
-            const VkPipeline pipeline_shadow,
-            const VkPipelineLayout pipelayout_shadow,
             const VkDevice logi_device,
             const VkPhysicalDevice phys_device
         );
 
+        // Records shadow map command buffers of a frame in flight whose inputs changed since they were last recorded.
+        // They must not be in use by GPU.
+        void record_shadow_cmd_bufs_at(
+            const uint32_t frame_index,
+            const VkRenderPass renderpass_shadow,
+            const VkPipeline pipeline_shadow,
+            const VkPipelineLayout pipelayout_shadow,
+            ThreadPool& record_threads,
+            const VkDevice logi_device
+        );
+
+        // Must be called after modifying models, instances or shadow casting lights without going through SceneNode
+        void mark_dirty() {
+            ++this->m_revision;
+        }
+        uint64_t revision() const {
+            return this->m_revision;
+        }
+        // Summed over all shadow maps
+        BindStats shadow_bind_stats() const;
+
         auto& models() const {
             return this->m_models;
         }
+        auto& desc_set_per_frame_at(const uint32_t frame_index) const {
+            return this->m_desc_sets_per_frame.at(frame_index);
+        }
+        auto& desc_set_cache() const {
+            return this->m_desc_set_cache;
+        }
         auto& lights() {
             return this->m_lights;
         }
@@ -438,6 +449,7 @@ namespace dal {
         }
 
         auto& add_model() {
+            this->mark_dirty();
             return this->m_models.emplace_back();
         }
         auto& model_at(const uint32_t index) {
@@ -36,6 +36,27 @@ namespace dal {
         vkGetPhysicalDeviceProperties(this->m_phys_device, &this->m_properties);
         vkGetPhysicalDeviceFeatures(this->m_phys_device, &this->m_features);
 
+        // Frame scheduling is built on timeline semaphores, which are core since Vulkan 1.2
+        if (this->m_properties.apiVersion >= VK_API_VERSION_1_2) {
+            VkPhysicalDeviceDescriptorIndexingFeatures indexing_features{};
+            indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+            VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+            timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+            timeline_features.pNext = &indexing_features;
+
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &timeline_features;
+
+            vkGetPhysicalDeviceFeatures2(this->m_phys_device, &features2);
+            this->m_timeline_semaphore = timeline_features.timelineSemaphore;
+            // Bindless texture table is a partially bound array written while command buffers using it are pending
+            this->m_descriptor_indexing = indexing_features.descriptorBindingPartiallyBound
+                && indexing_features.descriptorBindingSampledImageUpdateAfterBind
+                && indexing_features.descriptorBindingUpdateUnusedWhilePending;
+        }
+
         {
             uint32_t extension_count;
             vkEnumerateDeviceExtensionProperties(this->m_phys_device, nullptr, &extension_count, nullptr);
@@ -101,6 +122,13 @@ namespace dal {
         std::cout << "\tASTC compression support : " << this->m_features.textureCompressionASTC_LDR << '\n';
         std::cout << "\tETC2 compression support : " << this->m_features.textureCompressionETC2 << '\n';
         std::cout << "\tBC compression support   : " << this->m_features.textureCompressionBC << '\n';
+        std::cout << "\ttimeline semaphore       : " << this->m_timeline_semaphore << '\n';
+        std::cout << "\tdescriptor indexing      : " << this->m_descriptor_indexing << '\n';
+        {
+            const auto families = dal::findQueueFamilies(this->m_phys_device, this->m_surface);
+            std::cout << "\tdedicated transfer queue : " << families.hasDedicatedTransfer() << '\n';
+            std::cout << "\tdedicated compute queue  : " << families.hasDedicatedCompute() << '\n';
+        }
         std::cout << "\tray tracing support      : "
                     << dal::RAY_TRACING_EXTENSIONS.size() - this->how_many_extensions_not_supported(dal::RAY_TRACING_EXTENSIONS.begin(), dal::RAY_TRACING_EXTENSIONS.end())
                     << " of " << dal::RAY_TRACING_EXTENSIONS.size()
@@ -112,6 +140,14 @@ namespace dal {
         return ::is_mipmap_gen_available_for(format, this->m_phys_device);
     }
 
+    bool PhysDeviceProps::is_sampling_available_for(const VkFormat format) const {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(this->m_phys_device, format, &props);
+
+        constexpr auto NEEDED = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        return NEEDED == (props.optimalTilingFeatures & NEEDED);
+    }
+
     bool PhysDeviceProps::is_usable() const {
         // Application can't function without geometry shaders
         if ( !this->m_features.geometryShader )
@@ -120,6 +156,12 @@ namespace dal {
         if ( !this->m_features.samplerAnisotropy )
             return false;
 
+        if ( !this->m_timeline_semaphore )
+            return false;
+
+        if ( !this->m_descriptor_indexing || !this->m_features.shaderSampledImageArrayDynamicIndexing )
+            return false;
+
         if ( !dal::findQueueFamilies(this->m_phys_device, this->m_surface).isComplete() )
             return false;
 
@@ -17,6 +17,8 @@ namespace dal {
 
         VkPhysicalDeviceProperties m_properties;
         VkPhysicalDeviceFeatures m_features;
+        bool m_timeline_semaphore = false;
+        bool m_descriptor_indexing = false;
         std::vector<VkExtensionProperties> m_available_extensions;
 
         uint32_t m_score = 0;
@@ -31,11 +33,20 @@ namespace dal {
         auto& features() const {
             return this->m_features;
         }
+        bool does_support_timeline_semaphore() const {
+            return this->m_timeline_semaphore;
+        }
+        // Only the parts the bindless texture table needs
+        bool does_support_descriptor_indexing() const {
+            return this->m_descriptor_indexing;
+        }
 
         uint32_t score() const;
         void print_info() const;
 
         bool is_mipmap_gen_available_for(const VkFormat format) const;
+        // Can be sampled with linear filtering in optimal tiling
+        bool is_sampling_available_for(const VkFormat format) const;
 
     private:
         bool is_usable() const;
@@ -0,0 +1,171 @@
+#include "pipeline_cache.h"
+
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+
+namespace {
+
+    constexpr uint32_t CACHE_FILE_MAGIC = 0x43504C44;  // "DLPC"
+
+    // Written before the data from vkGetPipelineCacheData.
+    // Header of the data itself lacks driver version, so it is recorded here.
+    struct CacheFileHeader {
+        uint32_t m_magic;
+        uint32_t m_data_size;
+        uint32_t m_vendor_id;
+        uint32_t m_device_id;
+        uint32_t m_driver_version;
+        uint8_t m_cache_uuid[VK_UUID_SIZE];
+    };
+
+    CacheFileHeader make_header(const VkPhysicalDeviceProperties& props, const size_t data_size) {
+        CacheFileHeader header{};
+
+        header.m_magic = CACHE_FILE_MAGIC;
+        header.m_data_size = data_size;
+        header.m_vendor_id = props.vendorID;
+        header.m_device_id = props.deviceID;
+        header.m_driver_version = props.driverVersion;
+        std::memcpy(header.m_cache_uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+
+        return header;
+    }
+
+    bool is_header_compatible(const CacheFileHeader& header, const VkPhysicalDeviceProperties& props) {
+        if (CACHE_FILE_MAGIC != header.m_magic) {
+            return false;
+        }
+        if (props.vendorID != header.m_vendor_id || props.deviceID != header.m_device_id) {
+            return false;
+        }
+        if (props.driverVersion != header.m_driver_version) {
+            return false;
+        }
+        if (0 != std::memcmp(props.pipelineCacheUUID, header.m_cache_uuid, VK_UUID_SIZE)) {
+            return false;
+        }
+
+        return true;
+    }
+
+    // Header that every implementation puts at the start of the cache data. It must agree with the file header.
+    bool is_data_compatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& props) {
+        VkPipelineCacheHeaderVersionOne header;
+        if (data.size() < sizeof(header)) {
+            return false;
+        }
+
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        if (VK_PIPELINE_CACHE_HEADER_VERSION_ONE != header.headerVersion) {
+            return false;
+        }
+        if (props.vendorID != header.vendorID || props.deviceID != header.deviceID) {
+            return false;
+        }
+        if (0 != std::memcmp(props.pipelineCacheUUID, header.pipelineCacheUUID, VK_UUID_SIZE)) {
+            return false;
+        }
+
+        return true;
+    }
+
+    std::vector<char> load_cache_data(const std::string& path, const VkPhysicalDeviceProperties& props) {
+        std::ifstream file{ path, std::ios::binary };
+        if (!file.is_open()) {
+            return {};
+        }
+
+        CacheFileHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return {};
+        }
+        if (!::is_header_compatible(header, props)) {
+            std::cout << "pipeline cache file was saved with another device or driver, ignored: " << path << '\n';
+            return {};
+        }
+
+        std::vector<char> data(header.m_data_size);
+        if (!file.read(data.data(), data.size())) {
+            return {};
+        }
+        if (!::is_data_compatible(data, props)) {
+            return {};
+        }
+
+        return data;
+    }
+
+}
+
+
+namespace dal {
+
+    void PipelineCache::init(const std::string& path, const VkDevice logi_device, const PhysDeviceProps& phys_props) {
+        this->destroy(logi_device);
+
+#if DAL_USE_PIPELINE_CACHE
+        this->m_path = path;
+
+        const auto data = ::load_cache_data(this->m_path, phys_props.props());
+        this->m_loaded_size = data.size();
+
+        VkPipelineCacheCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = data.size();
+        create_info.pInitialData = data.empty() ? nullptr : data.data();
+
+        if (VK_SUCCESS != vkCreatePipelineCache(logi_device, &create_info, nullptr, &this->m_handle)) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+
+        this->m_phys_props = phys_props.props();
+#endif
+    }
+
+    void PipelineCache::destroy(const VkDevice logi_device) {
+        if (VK_NULL_HANDLE != this->m_handle) {
+            this->save(logi_device);
+
+            vkDestroyPipelineCache(logi_device, this->m_handle, nullptr);
+            this->m_handle = VK_NULL_HANDLE;
+        }
+
+        this->m_path.clear();
+        this->m_loaded_size = 0;
+    }
+
+    void PipelineCache::save(const VkDevice logi_device) const {
+        if (VK_NULL_HANDLE == this->m_handle) {
+            return;
+        }
+
+        // Failing to save only costs the next startup some time, so it does not throw. It is called on shutdown.
+        size_t data_size = 0;
+        if (VK_SUCCESS != vkGetPipelineCacheData(logi_device, this->m_handle, &data_size, nullptr)) {
+            std::cout << "failed to get pipeline cache data size\n";
+            return;
+        }
+
+        std::vector<char> data(data_size);
+        if (VK_SUCCESS != vkGetPipelineCacheData(logi_device, this->m_handle, &data_size, data.data())) {
+            std::cout << "failed to get pipeline cache data\n";
+            return;
+        }
+
+        std::ofstream file{ this->m_path, std::ios::binary | std::ios::trunc };
+        if (!file.is_open()) {
+            std::cout << "failed to save pipeline cache: " << this->m_path << '\n';
+            return;
+        }
+
+        const auto header = ::make_header(this->m_phys_props, data_size);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), data_size);
+    }
+
+}
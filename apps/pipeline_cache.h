@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+#include "physdevice.h"
+
+
+// If true, pipelines are created with a VkPipelineCache which is saved to a file on shutdown.
+// Otherwise VK_NULL_HANDLE is used as the pipeline cache so startup can be timed without it.
+#define DAL_USE_PIPELINE_CACHE true
+
+
+namespace dal {
+
+    class PipelineCache {
+
+    private:
+        VkPipelineCache m_handle = VK_NULL_HANDLE;
+        std::string m_path;
+        VkPhysicalDeviceProperties m_phys_props{};  // Written to the file header
+        size_t m_loaded_size = 0;
+
+    public:
+        // Data in the file is used only if it was saved with the same device and driver.
+        // Otherwise the cache starts empty. A missing file is not an error.
+        void init(const std::string& path, const VkDevice logi_device, const PhysDeviceProps& phys_props);
+        // Saves to the path given to init before destroying
+        void destroy(const VkDevice logi_device);
+
+        void save(const VkDevice logi_device) const;
+
+        // VK_NULL_HANDLE if not initialized or disabled by DAL_USE_PIPELINE_CACHE
+        VkPipelineCache get() const {
+            return this->m_handle;
+        }
+        // 0 if nothing valid was loaded
+        size_t loaded_size() const {
+            return this->m_loaded_size;
+        }
+
+    };
+
+}
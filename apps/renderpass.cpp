@@ -7,8 +7,8 @@
 
 namespace {
 
-    VkRenderPass create_renderpass_rendering(const VkDevice logiDevice, const std::array<VkFormat, 6>& attachment_formats) {
-        std::array<VkAttachmentDescription, 6> attachments{};
+    VkRenderPass create_renderpass_rendering(const VkDevice logiDevice, const std::array<VkFormat, 5>& attachment_formats) {
+        std::array<VkAttachmentDescription, 5> attachments{};
         {
             // Presented
             attachments[0].format = attachment_formats[0];
@@ -30,7 +30,7 @@ namespace {
             attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-            // Position
+            // Normal
             attachments[2].format = attachment_formats[2];
             attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
             attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -40,7 +40,7 @@ namespace {
             attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             attachments[2].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            // Normal
+            // Albedo, roughness and metallic
             attachments[3].format = attachment_formats[3];
             attachments[3].samples = VK_SAMPLE_COUNT_1_BIT;
             attachments[3].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -50,7 +50,7 @@ namespace {
             attachments[3].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             attachments[3].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            // Albedo
+            // Lighting, HDR
             attachments[4].format = attachment_formats[4];
             attachments[4].samples = VK_SAMPLE_COUNT_1_BIT;
             attachments[4].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -59,28 +59,16 @@ namespace {
             attachments[4].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             attachments[4].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             attachments[4].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            // Material
-            attachments[5].format = attachment_formats.at(5);
-            attachments[5].samples = VK_SAMPLE_COUNT_1_BIT;
-            attachments[5].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            attachments[5].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            attachments[5].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            attachments[5].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            attachments[5].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            attachments[5].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         }
 
-        std::array<VkSubpassDescription, 2> subpasses{};
+        std::array<VkSubpassDescription, 3> subpasses{};
 
         // First subpass: fill G-Buffers
         // ---------------------------------------------------------------------------------
 
-        std::array<VkAttachmentReference, 4> colorAttachmentRef{};
+        std::array<VkAttachmentReference, 2> colorAttachmentRef{};
         colorAttachmentRef[0] = { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
         colorAttachmentRef[1] = { 3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-        colorAttachmentRef[2] = { 4, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-        colorAttachmentRef[3] = { 5, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
         VkAttachmentReference depthReference{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
 
         subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -90,30 +78,42 @@ namespace {
         // like "layout(location = 0) out vec4 outColor".
         subpasses[0].pDepthStencilAttachment = &depthReference;
 
-        // Second subpass: Final composition using G-Buffer contents
+        // Second subpass: Lighting using G-Buffer contents
         // ---------------------------------------------------------------------------------
 
-        VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        VkAttachmentReference lightingReference{ 4, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        // Depth is read as input attachment and depth tested against by light volumes at the same time, so read only
+        VkAttachmentReference depthReadOnlyReference{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
 
-        std::array<VkAttachmentReference, 5> inputReferences;
-        inputReferences[0] = { 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        std::array<VkAttachmentReference, 3> inputReferences;
+        inputReferences[0] = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
         inputReferences[1] = { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
         inputReferences[2] = { 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-        inputReferences[3] = { 4, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-        inputReferences[4] = { 5, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
 
         subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
         subpasses[1].colorAttachmentCount = 1;
-        subpasses[1].pColorAttachments = &colorReference;
-        subpasses[1].pDepthStencilAttachment = nullptr;
+        subpasses[1].pColorAttachments = &lightingReference;
+        subpasses[1].pDepthStencilAttachment = &depthReadOnlyReference;
         // Use the color attachments filled in the first pass as input attachments
         subpasses[1].inputAttachmentCount = inputReferences.size();
         subpasses[1].pInputAttachments = inputReferences.data();
 
+        // Third subpass: Tone mapping into presented image
+        // ---------------------------------------------------------------------------------
+
+        VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        VkAttachmentReference lightingInputReference{ 4, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+        subpasses[2].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[2].colorAttachmentCount = 1;
+        subpasses[2].pColorAttachments = &colorReference;
+        subpasses[2].inputAttachmentCount = 1;
+        subpasses[2].pInputAttachments = &lightingInputReference;
+
         // Subpass dependencies
         // ---------------------------------------------------------------------------------
 
-        std::array<VkSubpassDependency, 3> dependencies;
+        std::array<VkSubpassDependency, 4> dependencies;
 
         dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
         dependencies[0].dstSubpass = 0;
@@ -125,20 +125,28 @@ namespace {
 
         dependencies[1].srcSubpass = 0;
         dependencies[1].dstSubpass = 1;
-        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
         dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
-        dependencies[2].srcSubpass = 0;
-        dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[2].srcSubpass = 1;
+        dependencies[2].dstSubpass = 2;
         dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[2].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[2].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
         dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+        dependencies[3].srcSubpass = 2;
+        dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[3].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
         // Check out https://vulkan-tutorial.com/en/Drawing_a_triangle/Drawing/Rendering_and_presentation
         /*
         VkSubpassDependency dependency = {};
@@ -183,12 +191,31 @@ namespace {
         subpasses.at(0).pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
         subpasses.at(0).pDepthStencilAttachment = &depth_attachment;
 
+        // A shadow map is shared by all frames in flight, so the previous frame must be done sampling it
+        std::array<VkSubpassDependency, 2> dependencies{};
+
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
         VkRenderPassCreateInfo render_pass_info = {};
         render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
         render_pass_info.attachmentCount = attachments.size();
         render_pass_info.pAttachments    = attachments.data();
         render_pass_info.subpassCount    = subpasses.size();
         render_pass_info.pSubpasses      = subpasses.data();
+        render_pass_info.dependencyCount = dependencies.size();
+        render_pass_info.pDependencies   = dependencies.data();
 
         VkRenderPass render_pass = VK_NULL_HANDLE;
         if ( VK_SUCCESS != vkCreateRenderPass(logi_device, &render_pass_info, nullptr, &render_pass) ) {
@@ -203,7 +230,7 @@ namespace {
 
 namespace dal {
 
-    void RenderPass::init(const VkDevice logiDevice, const std::array<VkFormat, 6>& attachment_formats) {
+    void RenderPass::init(const VkDevice logiDevice, const std::array<VkFormat, 5>& attachment_formats) {
         this->destroy(logiDevice);
 
         this->m_rendering_rp = ::create_renderpass_rendering(logiDevice, attachment_formats);
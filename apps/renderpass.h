@@ -14,7 +14,7 @@ namespace dal {
         VkRenderPass m_shadow_map_rp = VK_NULL_HANDLE;
 
     public:
-        void init(const VkDevice logiDevice, const std::array<VkFormat, 6>& attachment_formats);
+        void init(const VkDevice logiDevice, const std::array<VkFormat, 5>& attachment_formats);
         void destroy(VkDevice logiDevice);
 
         auto get(void) const {
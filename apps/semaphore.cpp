@@ -85,32 +85,104 @@ namespace dal {
 }
 
 
-// SyncMaster
+// TimelineSemaphore
 namespace dal {
 
-    void SyncMaster::init(VkDevice device, const unsigned swapChainImgCount) {
-        for ( unsigned i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i ) {
-            this->m_imageAvailable[i].init(device);
-            this->m_renderFinished[i].init(device);
-            this->m_inFlightFences[i].init(device);
+    void TimelineSemaphore::init(VkDevice device, const uint64_t initial_value) {
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = initial_value;
+
+        auto info = ::createSemaphoreInfo();
+        info.pNext = &type_info;
+
+        if ( VK_SUCCESS != vkCreateSemaphore(device, &info, nullptr, &this->m_handle) ) {
+            throw std::runtime_error{ "failed to create a timeline semaphore!" };
+        }
+    }
+
+    void TimelineSemaphore::destroy(VkDevice device) {
+        if (VK_NULL_HANDLE != this->m_handle) {
+            vkDestroySemaphore(device, this->m_handle, nullptr);
+            this->m_handle = VK_NULL_HANDLE;
         }
+    }
+
+    void TimelineSemaphore::wait(VkDevice device, const uint64_t value) const {
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &this->m_handle;
+        wait_info.pValues = &value;
+
+        vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+    }
 
-        this->m_imageInFlight.resize(swapChainImgCount, VK_NULL_HANDLE);
+    uint64_t TimelineSemaphore::value(VkDevice device) const {
+        uint64_t result = 0;
+        vkGetSemaphoreCounterValue(device, this->m_handle, &result);
+        return result;
     }
 
-    void SyncMaster::destroy(VkDevice device) {
-        this->m_imageInFlight.clear();
+}
+
+
+// FrameScheduler
+namespace dal {
 
-        for ( unsigned i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i ) {
-            this->m_inFlightFences[i].destroy(device);
+    void FrameScheduler::init(VkDevice device, const uint32_t frame_count) {
+        this->m_frame_count = frame_count;
+        this->m_submitted_value = 0;
+        this->m_frame_value = 0;
+
+        this->m_timeline.init(device, 0);
+
+        this->m_imageAvailable.resize(frame_count);
+        this->m_renderFinished.resize(frame_count);
+        this->m_shadowFinished.resize(frame_count);
+
+        for ( uint32_t i = 0; i < frame_count; ++i ) {
+            this->m_imageAvailable[i].init(device);
+            this->m_renderFinished[i].init(device);
+            this->m_shadowFinished[i].init(device);
+        }
+    }
+
+    void FrameScheduler::destroy(VkDevice device) {
+        for ( uint32_t i = 0; i < this->m_imageAvailable.size(); ++i ) {
+            this->m_shadowFinished[i].destroy(device);
             this->m_renderFinished[i].destroy(device);
             this->m_imageAvailable[i].destroy(device);
         }
+        this->m_shadowFinished.clear();
+        this->m_renderFinished.clear();
+        this->m_imageAvailable.clear();
+
+        this->m_timeline.destroy(device);
+    }
+
+    void FrameScheduler::begin_frame(VkDevice device) {
+        this->m_frame_value = this->m_submitted_value + 1;
+
+        if (this->m_frame_value > this->m_frame_count) {
+            this->m_timeline.wait(device, this->m_frame_value - this->m_frame_count);
+        }
+    }
+
+    void FrameScheduler::end_frame() {
+        this->m_submitted_value = this->m_frame_value;
+    }
+
+    void FrameScheduler::reset_image_available(VkDevice device) {
+        auto& semaphore = this->m_imageAvailable.at(this->frame_index());
+        semaphore.destroy(device);
+        semaphore.init(device);
     }
 
-    std::pair<uint32_t, VkResult> SyncMaster::acquireGetNextImgIndex(const unsigned index, VkDevice device, VkSwapchainKHR swapChain) {
+    std::pair<uint32_t, VkResult> FrameScheduler::acquireGetNextImgIndex(VkDevice device, VkSwapchainKHR swapChain) const {
         uint32_t imageIndex;
-        const VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, this->m_imageAvailable[index].get(), VK_NULL_HANDLE, &imageIndex);
+        const VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, this->semaphImageAvailable().get(), VK_NULL_HANDLE, &imageIndex);
         return {imageIndex, result};
     }
 
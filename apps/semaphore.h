@@ -1,12 +1,10 @@
 #pragma once
 
-#include <array>
 #include <vector>
 #include <utility>
 
 #include <vulkan/vulkan.h>
 
-#include "konst.h"
 
 
 namespace dal {
@@ -52,35 +50,75 @@ namespace dal {
     };
 
 
-    class SyncMaster {
+    // Counter whose value only increases. Host and GPU can both wait for it to reach a value.
+    class TimelineSemaphore {
 
     private:
-        std::array<Semaphore, MAX_FRAMES_IN_FLIGHT> m_imageAvailable, m_renderFinished;
-        std::array<Fence, MAX_FRAMES_IN_FLIGHT> m_inFlightFences;
-        std::vector<VkFence> m_imageInFlight;
+        VkSemaphore m_handle = VK_NULL_HANDLE;
+
+    public:
+        void init(VkDevice device, const uint64_t initial_value);
+        void destroy(VkDevice device);
+
+        auto get(void) const {
+            return this->m_handle;
+        }
+
+        void wait(VkDevice device, const uint64_t value) const;
+        uint64_t value(VkDevice device) const;
+
+    };
+
+
+    // Frame n, counted from 1, signals value n of a timeline semaphore when GPU finishes it.
+    // Per-frame resources are indexed by frame_index() so recording frame n only has to wait for frame n - frame_count().
+    class FrameScheduler {
+
+    private:
+        TimelineSemaphore m_timeline;
+        std::vector<Semaphore> m_imageAvailable, m_renderFinished;
+        std::vector<Semaphore> m_shadowFinished;  // Shadow map batch to composition
+        uint64_t m_submitted_value = 0;  // Last frame submitted to GPU
+        uint64_t m_frame_value = 0;      // Frame being recorded
+        uint32_t m_frame_count = 0;
 
     public:
-        void init(VkDevice device, const unsigned swapChainImgCount);
+        void init(VkDevice device, const uint32_t frame_count);
         void destroy(VkDevice device);
 
-        auto& semaphImageAvailable(const unsigned index) const {
-            return this->m_imageAvailable[index];
+        // Waits until per-frame resources of the next frame are no longer in use by GPU.
+        // A frame that began but was never submitted is begun again with the same value.
+        void begin_frame(VkDevice device);
+        // Must be called after submitting a batch that signals timeline() with frame_value()
+        void end_frame();
+
+        std::pair<uint32_t, VkResult> acquireGetNextImgIndex(VkDevice device, VkSwapchainKHR swapChain) const;
+        // A frame abandoned after acquiring may leave its acquire semaphore signaled with nothing to wait on it.
+        // Replaces it so the frame can acquire again. Device must be idle.
+        void reset_image_available(VkDevice device);
+
+        uint32_t frame_count() const {
+            return this->m_frame_count;
         }
-        auto& semaphRenderFinished(const unsigned index) const {
-            return this->m_renderFinished[index];
+        uint32_t frame_index() const {
+            return this->m_frame_value % this->m_frame_count;
         }
-        auto& fenceInFlight(const unsigned index) const {
-            return this->m_inFlightFences[index];
+        uint64_t frame_value() const {
+            return this->m_frame_value;
         }
 
-        auto& fencesImageInFlight(void) {
-            return this->m_imageInFlight;
+        auto& timeline() const {
+            return this->m_timeline;
         }
-        auto& fencesImageInFlight(void) const {
-            return this->m_imageInFlight;
+        auto& semaphImageAvailable() const {
+            return this->m_imageAvailable.at(this->frame_index());
+        }
+        auto& semaphRenderFinished() const {
+            return this->m_renderFinished.at(this->frame_index());
+        }
+        auto& semaphShadowFinished() const {
+            return this->m_shadowFinished.at(this->frame_index());
         }
-
-        std::pair<uint32_t, VkResult> acquireGetNextImgIndex(const unsigned index, VkDevice device, VkSwapchainKHR swapChain);
 
     };
 
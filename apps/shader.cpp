@@ -2,12 +2,15 @@
 
 #include <tuple>
 #include <array>
+#include <future>
 #include <vector>
 #include <fstream>
+#include <exception>
 
 #include "util_windows.h"
 #include "vert_data.h"
 #include "model_data.h"
+#include "light_volume.h"
 
 
 #define DAL_ALPHA_BLEND false
@@ -68,18 +71,37 @@ namespace {
 // Pipeline creation functions
 namespace {
 
-    auto create_info_shader_stage(const ShaderModule& vert_shader_module, const ShaderModule& frag_shader_module) {
+    auto create_info_shader_stage(
+        const ShaderModule& vert_shader_module,
+        const ShaderModule& frag_shader_module,
+        const VkSpecializationInfo* const spec_info = nullptr
+    ) {
         std::array<VkPipelineShaderStageCreateInfo, 2> result{};
 
         result[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         result[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
         result[0].module = vert_shader_module.get();
         result[0].pName = "main";
+        result[0].pSpecializationInfo = spec_info;
 
         result[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         result[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         result[1].module = frag_shader_module.get();
         result[1].pName = "main";
+        result[1].pSpecializationInfo = spec_info;
+
+        return result;
+    }
+
+    // For a single uint32 or VkBool32 at constant_id = 0
+    auto create_info_specialization(const uint32_t& value) {
+        static const VkSpecializationMapEntry map_entry{ 0, 0, sizeof(uint32_t) };
+
+        VkSpecializationInfo result{};
+        result.mapEntryCount = 1;
+        result.pMapEntries = &map_entry;
+        result.dataSize = sizeof(uint32_t);
+        result.pData = &value;
 
         return result;
     }
@@ -207,6 +229,22 @@ namespace {
         return result;
     }
 
+    // Sums outputs of multiple draws, alpha is left untouched
+    auto create_info_color_blend_attachment_additive() {
+        std::array<VkPipelineColorBlendAttachmentState, 1> result{};
+
+        result[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT;
+        result[0].blendEnable = VK_TRUE;
+        result[0].colorBlendOp = VK_BLEND_OP_ADD;
+        result[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        result[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        result[0].alphaBlendOp = VK_BLEND_OP_ADD;
+        result[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        result[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+
+        return result;
+    }
+
     auto create_info_color_blend(
         const VkPipelineColorBlendAttachmentState* const color_blend_attachments,
         const uint32_t attachment_count, const bool alpha_blend
@@ -226,13 +264,13 @@ namespace {
         return colorBlending;
     }
 
-    auto create_info_depth_stencil(const bool depth_write) {
+    auto create_info_depth_stencil(const bool depth_test, const bool depth_write, const VkCompareOp compare_op = VK_COMPARE_OP_LESS) {
         VkPipelineDepthStencilStateCreateInfo depthStencil{};
         depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 
-        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthTestEnable = depth_test ? VK_TRUE : VK_FALSE;
         depthStencil.depthWriteEnable = depth_write ? VK_TRUE : VK_FALSE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthCompareOp = compare_op;
         depthStencil.depthBoundsTestEnable = VK_FALSE;
         depthStencil.minDepthBounds = 0; // Optional
         depthStencil.maxDepthBounds = 1; // Optional
@@ -253,40 +291,7 @@ namespace {
         return dynamicState;
     }
 
-    template <typename _Struct>
-    auto create_info_push_constant() {
-        std::array<VkPushConstantRange, 1> result;
-
-        result[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        result[0].offset = 0;
-        result[0].size = sizeof(_Struct);
-
-        return result;
-    }
-
-    auto create_pipeline_layout(
-        const VkDescriptorSetLayout* const layouts, const uint32_t layout_count,
-        const VkPushConstantRange* const push_consts, const uint32_t push_const_count,
-        const VkDevice logi_device
-    ) {
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-
-        pipelineLayoutInfo.setLayoutCount = layout_count;
-        pipelineLayoutInfo.pSetLayouts = layouts;
-        pipelineLayoutInfo.pushConstantRangeCount = push_const_count;
-        pipelineLayoutInfo.pPushConstantRanges = push_consts;
-
-        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-        if ( vkCreatePipelineLayout(logi_device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS ) {
-            throw std::runtime_error("failed to create pipeline layout!");
-        }
-
-        return pipelineLayout;
-    }
-
-
-    auto createGraphicsPipeline_deferred(const VkDevice device, VkRenderPass renderPass, const VkExtent2D& extent, const VkDescriptorSetLayout descriptorSetLayout) {
+    VkPipeline createGraphicsPipeline_deferred(const VkDevice device, const VkPipelineCache pipeline_cache, VkRenderPass renderPass, const VkPipelineLayout pipelineLayout) {
         // Shaders
         const auto vertShaderCode = dal::readFile(dal::get_res_path() + "/shader/triangle_v.spv");
         const auto fragShaderCode = dal::readFile(dal::get_res_path() + "/shader/triangle_f.spv");
@@ -303,8 +308,8 @@ namespace {
         const VkPipelineInputAssemblyStateCreateInfo inputAssembly = ::create_info_input_assembly();
 
         // Viewports and scissors
-        const auto [viewport, scissor] = ::create_info_viewport_scissor(extent);
-        const auto viewportState = ::create_info_viewport_state(&viewport, 1, &scissor, 1);
+        // Dynamic so that the pipeline survives window resizes
+        const auto viewportState = ::create_info_viewport_state(nullptr, 1, nullptr, 1);
 
         // Rasterizer
         const auto rasterizer = ::create_info_rasterizer(VK_CULL_MODE_BACK_BIT);
@@ -313,19 +318,16 @@ namespace {
         const auto multisampling = ::create_info_multisampling();
 
         // Color blending
-        const auto colorBlendAttachments = ::create_info_color_blend_attachment<4, false>();
+        const auto colorBlendAttachments = ::create_info_color_blend_attachment<2, false>();
         const auto colorBlending = ::create_info_color_blend(colorBlendAttachments.data(), colorBlendAttachments.size(), false);
 
         // Depth, stencil
-        const auto depthStencil = ::create_info_depth_stencil(true);
+        const auto depthStencil = ::create_info_depth_stencil(true, true);
 
         // Dynamic state
-        constexpr std::array<VkDynamicState, 0> dynamicStates{};
+        constexpr std::array<VkDynamicState, 2> dynamicStates{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
         const auto dynamicState = ::create_info_dynamic_state(dynamicStates.data(), dynamicStates.size());
 
-        // Pipeline layout
-        const auto pipelineLayout = ::create_pipeline_layout(&descriptorSetLayout, 1, nullptr, 0, device);
-
         // Pipeline, finally
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -346,20 +348,22 @@ namespace {
         pipelineInfo.basePipelineIndex = -1; // Optional
 
         VkPipeline graphicsPipeline = VK_NULL_HANDLE;
-        if (VK_SUCCESS != vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline)) {
+        if (VK_SUCCESS != vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo, nullptr, &graphicsPipeline)) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
-        return std::make_pair(pipelineLayout, graphicsPipeline);
+        return graphicsPipeline;
     }
 
-    auto createGraphicsPipeline_composition(const VkDevice device, VkRenderPass renderPass, const VkExtent2D& extent, const VkDescriptorSetLayout descriptorSetLayout) {
+    VkPipeline createGraphicsPipeline_composition(const VkDevice device, const VkPipelineCache pipeline_cache, VkRenderPass renderPass, const VkPipelineLayout pipelineLayout) {
         // Shaders
         const auto vertShaderCode = dal::readFile(dal::get_res_path() + "/shader/fillsc_v.spv");
         const auto fragShaderCode = dal::readFile(dal::get_res_path() + "/shader/fillsc_f.spv");
         const ShaderModule vert_shader_module(device, vertShaderCode.data(), vertShaderCode.size());
         const ShaderModule frag_shader_module(device, fragShaderCode.data(), fragShaderCode.size());
-        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = ::create_info_shader_stage(vert_shader_module, frag_shader_module);
+        const VkBool32 use_clustered_lights = DAL_LIGHT_VOLUME ? VK_FALSE : VK_TRUE;
+        const auto spec_info = ::create_info_specialization(use_clustered_lights);
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = ::create_info_shader_stage(vert_shader_module, frag_shader_module, &spec_info);
 
         // Vertex input
         const auto vertexInputInfo = ::create_vertex_input_state(nullptr, 0, nullptr, 0);
@@ -368,8 +372,8 @@ namespace {
         const auto inputAssembly = ::create_info_input_assembly();
 
         // Viewports and scissors
-        const auto [viewport, scissor] = ::create_info_viewport_scissor(extent);
-        const auto viewportState = ::create_info_viewport_state(&viewport, 1, &scissor, 1);
+        // Dynamic so that the pipeline survives window resizes
+        const auto viewportState = ::create_info_viewport_state(nullptr, 1, nullptr, 1);
 
         // Rasterizer
         auto rasterizer = ::create_info_rasterizer(VK_CULL_MODE_NONE);
@@ -384,14 +388,88 @@ namespace {
         );
 
         // Depth, stencil
-        const auto depthStencil = ::create_info_depth_stencil(false);
+        // Full screen, so nothing to test against. Depth is only read as input attachment here.
+        const auto depthStencil = ::create_info_depth_stencil(false, false);
 
         // Dynamic state
-        constexpr std::array<VkDynamicState, 0> dynamicStates{};
+        constexpr std::array<VkDynamicState, 2> dynamicStates{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
         const auto dynamicState = ::create_info_dynamic_state(dynamicStates.data(), dynamicStates.size());
 
-        // Pipeline layout
-        VkPipelineLayout pipelineLayout = ::create_pipeline_layout(&descriptorSetLayout, 1, nullptr, 0, device);
+        // Pipeline, finally
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = shaderStages.size();
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 1;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+        pipelineInfo.basePipelineIndex = -1; // Optional
+
+        VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+        if ( vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS ) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        return graphicsPipeline;
+    }
+
+    VkPipeline createGraphicsPipeline_light_volume(
+        const VkDevice device,
+        const VkPipelineCache pipeline_cache,
+        const VkRenderPass renderPass,
+        const VkPipelineLayout pipelineLayout,
+        const dal::LightVolumeType light_type
+    ) {
+        // Shaders
+        const auto vertShaderCode = dal::readFile(dal::get_res_path() + "/shader/light_volume_v.spv");
+        const auto fragShaderCode = dal::readFile(dal::get_res_path() + "/shader/light_volume_f.spv");
+        const ShaderModule vert_shader_module(device, vertShaderCode.data(), vertShaderCode.size());
+        const ShaderModule frag_shader_module(device, fragShaderCode.data(), fragShaderCode.size());
+        const auto light_type_value = static_cast<uint32_t>(light_type);
+        const auto spec_info = ::create_info_specialization(light_type_value);
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = ::create_info_shader_stage(vert_shader_module, frag_shader_module, &spec_info);
+
+        // Vertex input
+        // Vertices are generated in vertex shader
+        const auto vertexInputInfo = ::create_vertex_input_state(nullptr, 0, nullptr, 0);
+
+        // Input assembly
+        const auto inputAssembly = ::create_info_input_assembly();
+
+        // Viewports and scissors
+        // Dynamic so that the pipeline survives window resizes
+        const auto viewportState = ::create_info_viewport_state(nullptr, 1, nullptr, 1);
+
+        // Rasterizer
+        // Back faces only, so a volume still covers the screen when camera is inside it
+        auto rasterizer = ::create_info_rasterizer(VK_CULL_MODE_FRONT_BIT);
+
+        // Multisampling
+        const auto multisampling = ::create_info_multisampling();
+
+        // Color blending
+        const auto colorBlendAttachments = ::create_info_color_blend_attachment_additive();
+        const auto colorBlending = ::create_info_color_blend(
+            colorBlendAttachments.data(), colorBlendAttachments.size(), false
+        );
+
+        // Depth, stencil
+        // Passes where scene surface is in front of the back face, that is, surface may be inside the volume.
+        // Pixels in front of the volume are rejected by the light's range in fragment shader.
+        const auto depthStencil = ::create_info_depth_stencil(true, false, VK_COMPARE_OP_GREATER_OR_EQUAL);
+
+        // Dynamic state
+        constexpr std::array<VkDynamicState, 2> dynamicStates{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        const auto dynamicState = ::create_info_dynamic_state(dynamicStates.data(), dynamicStates.size());
 
         // Pipeline, finally
         VkGraphicsPipelineCreateInfo pipelineInfo{};
@@ -413,14 +491,78 @@ namespace {
         pipelineInfo.basePipelineIndex = -1; // Optional
 
         VkPipeline graphicsPipeline = VK_NULL_HANDLE;
-        if ( vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS ) {
+        if ( vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS ) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
-        return std::make_pair(pipelineLayout, graphicsPipeline);
+        return graphicsPipeline;
     }
 
-    auto createGraphicsPipeline_shadow(const VkDevice device, VkRenderPass renderPass, const VkExtent2D& extent, const VkDescriptorSetLayout descriptorSetLayout) {
+    VkPipeline createGraphicsPipeline_tonemap(const VkDevice device, const VkPipelineCache pipeline_cache, VkRenderPass renderPass, const VkPipelineLayout pipelineLayout) {
+        // Shaders
+        const auto vertShaderCode = dal::readFile(dal::get_res_path() + "/shader/fillsc_v.spv");
+        const auto fragShaderCode = dal::readFile(dal::get_res_path() + "/shader/tonemap_f.spv");
+        const ShaderModule vert_shader_module(device, vertShaderCode.data(), vertShaderCode.size());
+        const ShaderModule frag_shader_module(device, fragShaderCode.data(), fragShaderCode.size());
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = ::create_info_shader_stage(vert_shader_module, frag_shader_module);
+
+        // Vertex input
+        const auto vertexInputInfo = ::create_vertex_input_state(nullptr, 0, nullptr, 0);
+
+        // Input assembly
+        const auto inputAssembly = ::create_info_input_assembly();
+
+        // Viewports and scissors
+        // Dynamic so that the pipeline survives window resizes
+        const auto viewportState = ::create_info_viewport_state(nullptr, 1, nullptr, 1);
+
+        // Rasterizer
+        auto rasterizer = ::create_info_rasterizer(VK_CULL_MODE_NONE);
+
+        // Multisampling
+        const auto multisampling = ::create_info_multisampling();
+
+        // Color blending
+        const auto colorBlendAttachments = ::create_info_color_blend_attachment<1, false>();
+        const auto colorBlending = ::create_info_color_blend(
+            colorBlendAttachments.data(), colorBlendAttachments.size(), false
+        );
+
+        // Depth, stencil
+        const auto depthStencil = ::create_info_depth_stencil(false, false);
+
+        // Dynamic state
+        constexpr std::array<VkDynamicState, 2> dynamicStates{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        const auto dynamicState = ::create_info_dynamic_state(dynamicStates.data(), dynamicStates.size());
+
+        // Pipeline, finally
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = shaderStages.size();
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 2;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+        pipelineInfo.basePipelineIndex = -1; // Optional
+
+        VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+        if ( vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS ) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        return graphicsPipeline;
+    }
+
+    VkPipeline createGraphicsPipeline_shadow(const VkDevice device, const VkPipelineCache pipeline_cache, VkRenderPass renderPass, const VkExtent2D& extent, const VkPipelineLayout pipelineLayout) {
         // Shaders
         const auto vertShaderCode = dal::readFile(dal::get_res_path() + "/shader/shadow_map_v.spv");
         const auto fragShaderCode = dal::readFile(dal::get_res_path() + "/shader/shadow_map_f.spv");
@@ -453,16 +595,12 @@ namespace {
         );
 
         // Depth, stencil
-        const auto depthStencil = ::create_info_depth_stencil(true);
+        const auto depthStencil = ::create_info_depth_stencil(true, true);
 
         // Dynamic state
         constexpr std::array<VkDynamicState, 0> dynamicStates{};
         const auto dynamicState = ::create_info_dynamic_state(dynamicStates.data(), dynamicStates.size());
 
-        // Pipeline layout
-        const auto push_consts = ::create_info_push_constant<dal::PushedConstValues>();
-        const auto pipelineLayout = ::create_pipeline_layout(&descriptorSetLayout, 1, push_consts.data(), push_consts.size(), device);
-
         // Pipeline, finally
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -483,11 +621,11 @@ namespace {
         pipelineInfo.basePipelineIndex = -1; // Optional
 
         VkPipeline graphicsPipeline = VK_NULL_HANDLE;
-        if ( vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS ) {
+        if ( vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS ) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
-        return std::make_pair(pipelineLayout, graphicsPipeline);
+        return graphicsPipeline;
     }
 
 }
@@ -498,32 +636,85 @@ namespace dal {
 
     void ShaderPipeline::init(
         const VkDevice device,
+        const VkPipelineCache pipeline_cache,
         const VkRenderPass renderPass,
         const VkRenderPass shadow_renderpass,
-        const VkExtent2D& extent,
         const VkExtent2D& shadow_extent,
-        const VkDescriptorSetLayout desc_layout_deferred,
-        const VkDescriptorSetLayout desc_layout_composition,
-        const VkDescriptorSetLayout desc_layout_shadow
+        const DescriptorSetLayout& layouts
     ) {
-        std::tie(this->m_layout_deferred, this->m_pipeline_deferred) = ::createGraphicsPipeline_deferred(device, renderPass, extent, desc_layout_deferred);
-        std::tie(this->m_layout_composition, this->m_pipeline_composition) = ::createGraphicsPipeline_composition(device, renderPass, extent, desc_layout_composition);
-        std::tie(this->m_layout_shadow, this->m_pipeline_shadow) = ::createGraphicsPipeline_shadow(device, shadow_renderpass, shadow_extent, desc_layout_shadow);
+        this->begin_init(device, pipeline_cache, renderPass, shadow_renderpass, shadow_extent, layouts);
+        this->wait();
     }
 
-    void ShaderPipeline::destroy(VkDevice device) {
-        if (VK_NULL_HANDLE != this->m_layout_deferred) {
-            vkDestroyPipelineLayout(device, this->m_layout_deferred, nullptr);
-            this->m_layout_deferred = VK_NULL_HANDLE;
-        }
-        if (VK_NULL_HANDLE != this->m_layout_composition) {
-            vkDestroyPipelineLayout(device, this->m_layout_composition, nullptr);
-            this->m_layout_composition = VK_NULL_HANDLE;
+    void ShaderPipeline::begin_init(
+        const VkDevice device,
+        const VkPipelineCache pipeline_cache,
+        const VkRenderPass renderPass,
+        const VkRenderPass shadow_renderpass,
+        const VkExtent2D& shadow_extent,
+        const DescriptorSetLayout& layouts
+    ) {
+        // Deferred launch runs each task on the thread which calls wait
+        const auto policy = DAL_PARALLEL_PIPELINE_CREATION ? std::launch::async : std::launch::deferred;
+
+        this->m_layout_deferred = layouts.pipeline_layout_deferred();
+        this->m_layout_composition = layouts.pipeline_layout_composition();
+        this->m_layout_tonemap = layouts.pipeline_layout_tonemap();
+        this->m_layout_shadow = layouts.pipeline_layout_shadow();
+
+        const auto layout_deferred = this->m_layout_deferred;
+        const auto layout_composition = this->m_layout_composition;
+        const auto layout_tonemap = this->m_layout_tonemap;
+        const auto layout_shadow = this->m_layout_shadow;
+
+        // Each task writes to its own members only. Pipeline cache is internally synchronized.
+        this->m_pending.push_back(std::async(policy, [=]() {
+            this->m_pipeline_deferred = ::createGraphicsPipeline_deferred(device, pipeline_cache, renderPass, layout_deferred);
+        }));
+        this->m_pending.push_back(std::async(policy, [=]() {
+            this->m_pipeline_composition = ::createGraphicsPipeline_composition(device, pipeline_cache, renderPass, layout_composition);
+        }));
+        this->m_pending.push_back(std::async(policy, [=]() {
+            this->m_pipeline_plight_volume = ::createGraphicsPipeline_light_volume(device, pipeline_cache, renderPass, layout_composition, LightVolumeType::point);
+        }));
+        this->m_pending.push_back(std::async(policy, [=]() {
+            this->m_pipeline_slight_volume = ::createGraphicsPipeline_light_volume(device, pipeline_cache, renderPass, layout_composition, LightVolumeType::spot);
+        }));
+        this->m_pending.push_back(std::async(policy, [=]() {
+            this->m_pipeline_tonemap = ::createGraphicsPipeline_tonemap(device, pipeline_cache, renderPass, layout_tonemap);
+        }));
+        this->m_pending.push_back(std::async(policy, [=]() {
+            this->m_pipeline_shadow = ::createGraphicsPipeline_shadow(device, pipeline_cache, shadow_renderpass, shadow_extent, layout_shadow);
+        }));
+    }
+
+    void ShaderPipeline::wait() {
+        std::exception_ptr error = nullptr;
+
+        // Every task must finish before rethrowing, or a late one would write to members after destroy
+        for (auto& task : this->m_pending) {
+            try {
+                task.get();
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
         }
-        if (VK_NULL_HANDLE != this->m_layout_shadow) {
-            vkDestroyPipelineLayout(device, this->m_layout_shadow, nullptr);
-            this->m_layout_shadow = VK_NULL_HANDLE;
+        this->m_pending.clear();
+
+        if (nullptr != error) {
+            std::rethrow_exception(error);
         }
+    }
+
+    void ShaderPipeline::destroy(VkDevice device) {
+        this->wait();
+
+        // Layouts are owned by DescriptorSetLayout
+        this->m_layout_deferred = VK_NULL_HANDLE;
+        this->m_layout_composition = VK_NULL_HANDLE;
+        this->m_layout_shadow = VK_NULL_HANDLE;
+        this->m_layout_tonemap = VK_NULL_HANDLE;
 
         if (VK_NULL_HANDLE != this->m_pipeline_deferred) {
             vkDestroyPipeline(device, this->m_pipeline_deferred, nullptr);
@@ -537,6 +728,18 @@ namespace dal {
             vkDestroyPipeline(device, this->m_pipeline_shadow, nullptr);
             this->m_pipeline_shadow = VK_NULL_HANDLE;
         }
+        if (VK_NULL_HANDLE != this->m_pipeline_plight_volume) {
+            vkDestroyPipeline(device, this->m_pipeline_plight_volume, nullptr);
+            this->m_pipeline_plight_volume = VK_NULL_HANDLE;
+        }
+        if (VK_NULL_HANDLE != this->m_pipeline_slight_volume) {
+            vkDestroyPipeline(device, this->m_pipeline_slight_volume, nullptr);
+            this->m_pipeline_slight_volume = VK_NULL_HANDLE;
+        }
+        if (VK_NULL_HANDLE != this->m_pipeline_tonemap) {
+            vkDestroyPipeline(device, this->m_pipeline_tonemap, nullptr);
+            this->m_pipeline_tonemap = VK_NULL_HANDLE;
+        }
     }
 
 }
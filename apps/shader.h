@@ -1,35 +1,65 @@
 #pragma once
 
+#include <vector>
+#include <future>
 #include <cassert>
 
 #include <vulkan/vulkan.h>
 
+#include "uniform.h"
+
+
+// If true, ShaderPipeline::begin_init creates each pipeline on its own thread.
+// Otherwise every pipeline is created on the thread which calls ShaderPipeline::wait.
+#define DAL_PARALLEL_PIPELINE_CREATION true
+
 
 namespace dal {
 
     class ShaderPipeline {
 
     private:
+        // Pipeline layouts are not owned
         VkPipelineLayout m_layout_deferred = VK_NULL_HANDLE;
         VkPipeline m_pipeline_deferred = VK_NULL_HANDLE;
 
         VkPipelineLayout m_layout_composition = VK_NULL_HANDLE;
         VkPipeline m_pipeline_composition = VK_NULL_HANDLE;
+        // Use m_layout_composition
+        VkPipeline m_pipeline_plight_volume = VK_NULL_HANDLE;
+        VkPipeline m_pipeline_slight_volume = VK_NULL_HANDLE;
+
+        VkPipelineLayout m_layout_tonemap = VK_NULL_HANDLE;
+        VkPipeline m_pipeline_tonemap = VK_NULL_HANDLE;
 
         VkPipelineLayout m_layout_shadow = VK_NULL_HANDLE;
         VkPipeline m_pipeline_shadow = VK_NULL_HANDLE;
 
+        std::vector<std::future<void>> m_pending;
+
     public:
+        // Pipelines of the main render pass take viewport and scissor as dynamic states. Shadow pipeline has fixed shadow_extent.
+        // pipeline_cache may be VK_NULL_HANDLE.
         void init(
             const VkDevice device,
+            const VkPipelineCache pipeline_cache,
             const VkRenderPass renderPass,
             const VkRenderPass shadow_renderpass,
-            const VkExtent2D& extent,
             const VkExtent2D& shadow_extent,
-            const VkDescriptorSetLayout desc_layout_deferred,
-            const VkDescriptorSetLayout desc_layout_composition,
-            const VkDescriptorSetLayout desc_layout_shadow
+            const DescriptorSetLayout& layouts
         );
+        // Same as init but returns right after starting pipeline creation, so that the caller can load assets meanwhile.
+        // No pipeline may be used before wait returns.
+        void begin_init(
+            const VkDevice device,
+            const VkPipelineCache pipeline_cache,
+            const VkRenderPass renderPass,
+            const VkRenderPass shadow_renderpass,
+            const VkExtent2D& shadow_extent,
+            const DescriptorSetLayout& layouts
+        );
+        // Rethrows an exception thrown while creating any of the pipelines
+        void wait();
         void destroy(VkDevice device);
 
         auto& layout_deferred() const {
@@ -45,6 +75,19 @@ namespace dal {
         auto& pipeline_composition() const {
             return this->m_pipeline_composition;
         }
+        auto& pipeline_plight_volume() const {
+            return this->m_pipeline_plight_volume;
+        }
+        auto& pipeline_slight_volume() const {
+            return this->m_pipeline_slight_volume;
+        }
+
+        auto& layout_tonemap() const {
+            return this->m_layout_tonemap;
+        }
+        auto& pipeline_tonemap() const {
+            return this->m_pipeline_tonemap;
+        }
 
         auto& layout_shadow() const {
             return this->m_layout_shadow;
@@ -0,0 +1,464 @@
+#include "spirv_reflect.h"
+
+#include <tuple>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+
+#include "util_windows.h"
+
+
+// SPIR-V constants. Only the ones the parser reads are listed.
+namespace {
+
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+    constexpr uint32_t SPIRV_HEADER_WORD_COUNT = 5;
+
+    enum class Op : uint16_t {
+        entry_point = 15,
+        type_int = 21,
+        type_float = 22,
+        type_vector = 23,
+        type_matrix = 24,
+        type_image = 25,
+        type_sampler = 26,
+        type_sampled_image = 27,
+        type_array = 28,
+        type_runtime_array = 29,
+        type_struct = 30,
+        type_pointer = 32,
+        constant = 43,
+        spec_constant = 50,
+        variable = 59,
+        decorate = 71,
+        member_decorate = 72,
+    };
+
+    enum class Decoration : uint32_t {
+        block = 2,
+        buffer_block = 3,
+        array_stride = 6,
+        matrix_stride = 7,
+        binding = 33,
+        descriptor_set = 34,
+        offset = 35,
+    };
+
+    enum class StorageClass : uint32_t {
+        uniform_constant = 0,
+        uniform = 2,
+        push_constant = 9,
+        storage_buffer = 12,
+    };
+
+    constexpr uint32_t IMAGE_DIM_BUFFER = 5;
+    constexpr uint32_t IMAGE_DIM_SUBPASS_DATA = 6;
+
+    VkShaderStageFlags convert_execution_model(const uint32_t model) {
+        switch (model) {
+            case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+            default: throw std::runtime_error("unsupported SPIR-V execution model");
+        }
+    }
+
+}
+
+
+// Parser
+namespace {
+
+    struct TypeInfo {
+        Op m_op;
+        std::vector<uint32_t> m_operands;  // Operands after the result id
+    };
+
+    struct DecorationInfo {
+        uint32_t m_set = 0;
+        uint32_t m_binding = 0;
+        uint32_t m_array_stride = 0;
+        bool m_has_binding = false;
+        bool m_block = false;
+        bool m_buffer_block = false;
+    };
+
+    struct MemberInfo {
+        uint32_t m_offset = 0;
+        uint32_t m_matrix_stride = 0;
+    };
+
+    struct VariableInfo {
+        uint32_t m_pointer_type;
+        StorageClass m_storage_class;
+    };
+
+
+    class SpirvModule {
+
+    private:
+        std::unordered_map<uint32_t, TypeInfo> m_types;
+        std::unordered_map<uint32_t, uint32_t> m_constants;  // Only 32 bit scalar constants
+        std::unordered_map<uint32_t, DecorationInfo> m_decorations;
+        std::unordered_map<uint32_t, std::vector<MemberInfo>> m_members;
+        std::unordered_map<uint32_t, VariableInfo> m_variables;
+        VkShaderStageFlags m_stages = 0;
+
+    public:
+        SpirvModule(const uint32_t* const code, const size_t word_count) {
+            if (word_count < SPIRV_HEADER_WORD_COUNT || SPIRV_MAGIC != code[0]) {
+                throw std::runtime_error("not a SPIR-V binary");
+            }
+
+            size_t pos = SPIRV_HEADER_WORD_COUNT;
+            while (pos < word_count) {
+                const auto instruction_size = code[pos] >> 16;
+                const auto opcode = static_cast<Op>(code[pos] & 0xFFFF);
+
+                if (0 == instruction_size || pos + instruction_size > word_count) {
+                    throw std::runtime_error("malformed SPIR-V instruction");
+                }
+
+                this->parse_instruction(opcode, code + pos + 1, instruction_size - 1);
+                pos += instruction_size;
+            }
+        }
+
+        dal::ShaderInterface make_interface() const {
+            dal::ShaderInterface result;
+
+            for (auto& [id, var] : this->m_variables) {
+                const auto& pointer = this->type_at(var.m_pointer_type);
+                const auto pointee_id = pointer.m_operands.at(1);
+
+                if (StorageClass::push_constant == var.m_storage_class) {
+                    result.m_push_const_size = std::max(result.m_push_const_size, this->size_of(pointee_id, 0));
+                    result.m_push_const_stages = this->m_stages;
+                    continue;
+                }
+
+                const auto found = this->m_decorations.find(id);
+                if (this->m_decorations.end() == found || !found->second.m_has_binding) {
+                    continue;
+                }
+
+                dal::ReflectedBinding binding;
+                binding.m_set = found->second.m_set;
+                binding.m_binding = found->second.m_binding;
+                binding.m_stages = this->m_stages;
+                std::tie(binding.m_type, binding.m_count) = this->descriptor_of(pointee_id, var.m_storage_class);
+
+                result.m_bindings.push_back(binding);
+            }
+
+            std::sort(result.m_bindings.begin(), result.m_bindings.end(), [](auto& a, auto& b) {
+                return std::make_pair(a.m_set, a.m_binding) < std::make_pair(b.m_set, b.m_binding);
+            });
+
+            return result;
+        }
+
+    private:
+        void parse_instruction(const Op opcode, const uint32_t* const operands, const uint32_t operand_count) {
+            switch (opcode) {
+                case Op::entry_point:
+                    this->m_stages |= ::convert_execution_model(operands[0]);
+                    break;
+
+                case Op::type_int:
+                case Op::type_float:
+                case Op::type_vector:
+                case Op::type_matrix:
+                case Op::type_image:
+                case Op::type_sampler:
+                case Op::type_sampled_image:
+                case Op::type_array:
+                case Op::type_runtime_array:
+                case Op::type_struct:
+                case Op::type_pointer:
+                    this->m_types[operands[0]] = TypeInfo{ opcode, std::vector<uint32_t>(operands + 1, operands + operand_count) };
+                    break;
+
+                case Op::constant:
+                case Op::spec_constant:
+                    // Specialization constant sizing an array is taken at its default value
+                    if (operand_count == 3) {
+                        this->m_constants[operands[1]] = operands[2];
+                    }
+                    break;
+
+                case Op::variable:
+                    this->m_variables[operands[1]] = VariableInfo{ operands[0], static_cast<StorageClass>(operands[2]) };
+                    break;
+
+                case Op::decorate:
+                    this->parse_decoration(operands[0], static_cast<Decoration>(operands[1]), operand_count > 2 ? operands[2] : 0);
+                    break;
+
+                case Op::member_decorate:
+                    this->parse_member_decoration(operands[0], operands[1], static_cast<Decoration>(operands[2]), operand_count > 3 ? operands[3] : 0);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        void parse_decoration(const uint32_t target, const Decoration decoration, const uint32_t literal) {
+            auto& info = this->m_decorations[target];
+
+            switch (decoration) {
+                case Decoration::descriptor_set:
+                    info.m_set = literal;
+                    break;
+                case Decoration::binding:
+                    info.m_binding = literal;
+                    info.m_has_binding = true;
+                    break;
+                case Decoration::array_stride:
+                    info.m_array_stride = literal;
+                    break;
+                case Decoration::block:
+                    info.m_block = true;
+                    break;
+                case Decoration::buffer_block:
+                    info.m_buffer_block = true;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void parse_member_decoration(const uint32_t target, const uint32_t member, const Decoration decoration, const uint32_t literal) {
+            auto& members = this->m_members[target];
+            if (members.size() <= member) {
+                members.resize(member + 1);
+            }
+
+            switch (decoration) {
+                case Decoration::offset:
+                    members[member].m_offset = literal;
+                    break;
+                case Decoration::matrix_stride:
+                    members[member].m_matrix_stride = literal;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        const TypeInfo& type_at(const uint32_t id) const {
+            const auto found = this->m_types.find(id);
+            if (this->m_types.end() == found) {
+                throw std::runtime_error("SPIR-V refers to an undeclared type");
+            }
+            return found->second;
+        }
+
+        const DecorationInfo& decoration_at(const uint32_t id) const {
+            static const DecorationInfo NONE;
+            const auto found = this->m_decorations.find(id);
+            return this->m_decorations.end() == found ? NONE : found->second;
+        }
+
+        uint32_t constant_at(const uint32_t id) const {
+            const auto found = this->m_constants.find(id);
+            if (this->m_constants.end() == found) {
+                throw std::runtime_error("SPIR-V array length is not a 32 bit constant");
+            }
+            return found->second;
+        }
+
+        std::pair<VkDescriptorType, uint32_t> descriptor_of(uint32_t type_id, const StorageClass storage_class) const {
+            uint32_t count = 1;
+
+            // Arrays of resources, possibly nested
+            while (true) {
+                const auto& type = this->type_at(type_id);
+
+                if (Op::type_array == type.m_op) {
+                    count *= this->constant_at(type.m_operands.at(1));
+                    type_id = type.m_operands.at(0);
+                }
+                else if (Op::type_runtime_array == type.m_op) {
+                    throw std::runtime_error("unsized descriptor arrays are not supported");
+                }
+                else {
+                    break;
+                }
+            }
+
+            const auto& type = this->type_at(type_id);
+
+            switch (type.m_op) {
+                case Op::type_sampler:
+                    return { VK_DESCRIPTOR_TYPE_SAMPLER, count };
+                case Op::type_sampled_image:
+                    return { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, count };
+                case Op::type_image: {
+                    const auto dim = type.m_operands.at(1);
+                    const auto sampled = type.m_operands.at(5);
+
+                    if (IMAGE_DIM_SUBPASS_DATA == dim) {
+                        return { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, count };
+                    }
+                    else if (IMAGE_DIM_BUFFER == dim) {
+                        return { 2 == sampled ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, count };
+                    }
+                    else {
+                        return { 2 == sampled ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, count };
+                    }
+                }
+                case Op::type_struct: {
+                    // Before SPIR-V 1.3 storage buffers are Uniform storage class with BufferBlock decoration
+                    if (StorageClass::storage_buffer == storage_class || this->decoration_at(type_id).m_buffer_block) {
+                        return { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, count };
+                    }
+                    else if (StorageClass::uniform == storage_class) {
+                        return { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, count };
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            throw std::runtime_error("unsupported SPIR-V resource type");
+        }
+
+        // Byte size of a type in a block. matrix_stride comes from the member decoration a matrix is declared by.
+        uint32_t size_of(const uint32_t type_id, const uint32_t matrix_stride) const {
+            const auto& type = this->type_at(type_id);
+
+            switch (type.m_op) {
+                case Op::type_int:
+                case Op::type_float:
+                    return type.m_operands.at(0) / 8;
+                case Op::type_vector:
+                    return this->size_of(type.m_operands.at(0), 0) * type.m_operands.at(1);
+                case Op::type_matrix: {
+                    const auto column_size = this->size_of(type.m_operands.at(0), 0);
+                    return std::max(matrix_stride, column_size) * type.m_operands.at(1);
+                }
+                case Op::type_array: {
+                    const auto stride = this->decoration_at(type_id).m_array_stride;
+                    return stride * this->constant_at(type.m_operands.at(1));
+                }
+                case Op::type_struct: {
+                    static const std::vector<MemberInfo> NO_MEMBERS;
+                    const auto found = this->m_members.find(type_id);
+                    const auto& members = this->m_members.end() == found ? NO_MEMBERS : found->second;
+
+                    uint32_t size = 0;
+                    for (size_t i = 0; i < type.m_operands.size(); ++i) {
+                        const auto member = i < members.size() ? members[i] : MemberInfo{};
+                        size = std::max(size, member.m_offset + this->size_of(type.m_operands[i], member.m_matrix_stride));
+                    }
+                    return size;
+                }
+                default:
+                    throw std::runtime_error("unsupported SPIR-V type in a block");
+            }
+        }
+
+    };
+
+}
+
+
+namespace dal {
+
+    void ShaderInterface::merge(const ShaderInterface& other) {
+        for (auto& x : other.m_bindings) {
+            const auto found = std::find_if(this->m_bindings.begin(), this->m_bindings.end(), [&x](auto& y) {
+                return x.m_set == y.m_set && x.m_binding == y.m_binding;
+            });
+
+            if (this->m_bindings.end() == found) {
+                this->m_bindings.push_back(x);
+            }
+            else if (found->m_type != x.m_type || found->m_count != x.m_count) {
+                throw std::runtime_error("shader stages disagree on a descriptor binding");
+            }
+            else {
+                found->m_stages |= x.m_stages;
+            }
+        }
+
+        std::sort(this->m_bindings.begin(), this->m_bindings.end(), [](auto& a, auto& b) {
+            return std::make_pair(a.m_set, a.m_binding) < std::make_pair(b.m_set, b.m_binding);
+        });
+
+        this->m_push_const_size = std::max(this->m_push_const_size, other.m_push_const_size);
+        this->m_push_const_stages |= other.m_push_const_stages;
+    }
+
+    uint32_t ShaderInterface::set_count() const {
+        uint32_t result = 0;
+
+        for (auto& x : this->m_bindings) {
+            result = std::max(result, x.m_set + 1);
+        }
+
+        return result;
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> ShaderInterface::make_layout_bindings(const uint32_t set) const {
+        std::vector<VkDescriptorSetLayoutBinding> result;
+
+        for (auto& x : this->m_bindings) {
+            if (set != x.m_set) {
+                continue;
+            }
+
+            auto& binding = result.emplace_back();
+            binding.binding = x.m_binding;
+            binding.descriptorType = x.m_type;
+            binding.descriptorCount = x.m_count;
+            binding.stageFlags = x.m_stages;
+            binding.pImmutableSamplers = nullptr;
+        }
+
+        return result;
+    }
+
+    std::vector<VkPushConstantRange> ShaderInterface::make_push_const_ranges() const {
+        std::vector<VkPushConstantRange> result;
+
+        if (0 != this->m_push_const_size) {
+            auto& range = result.emplace_back();
+            range.stageFlags = this->m_push_const_stages;
+            range.offset = 0;
+            range.size = this->m_push_const_size;
+        }
+
+        return result;
+    }
+
+
+    ShaderInterface reflect_spirv(const uint32_t* const code, const size_t word_count) {
+        return ::SpirvModule{ code, word_count }.make_interface();
+    }
+
+    ShaderInterface reflect_spirv(const std::vector<char>& code) {
+        std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+        std::memcpy(words.data(), code.data(), words.size() * sizeof(uint32_t));
+        return dal::reflect_spirv(words.data(), words.size());
+    }
+
+    ShaderInterface reflect_shader_files(const std::vector<std::string>& file_names) {
+        ShaderInterface result;
+
+        for (auto& name : file_names) {
+            const auto code = dal::readFile(dal::get_res_path() + "/shader/" + name);
+            result.merge(dal::reflect_spirv(code));
+        }
+
+        return result;
+    }
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+
+namespace dal {
+
+    struct ReflectedBinding {
+        uint32_t m_set = 0;
+        uint32_t m_binding = 0;
+        VkDescriptorType m_type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+        uint32_t m_count = 1;  // Length of the array if the variable is an array
+        VkShaderStageFlags m_stages = 0;
+    };
+
+
+    // Resources some shader stages declare, which is all that descriptor set layouts and pipeline layouts need
+    struct ShaderInterface {
+        std::vector<ReflectedBinding> m_bindings;  // Sorted by set then binding
+        uint32_t m_push_const_size = 0;
+        VkShaderStageFlags m_push_const_stages = 0;
+
+        // Union of both. Stages of the same binding are combined.
+        // Throws if the same binding is declared with another type or count.
+        void merge(const ShaderInterface& other);
+
+        // One past the greatest set index used
+        uint32_t set_count() const;
+        std::vector<VkDescriptorSetLayoutBinding> make_layout_bindings(const uint32_t set) const;
+        std::vector<VkPushConstantRange> make_push_const_ranges() const;
+    };
+
+
+    // Parses SPIR-V binary without any external library. Throws if the binary is malformed.
+    ShaderInterface reflect_spirv(const uint32_t* const code, const size_t word_count);
+    ShaderInterface reflect_spirv(const std::vector<char>& code);
+
+    // Reads .spv files in resource/shader and merges all of them
+    ShaderInterface reflect_shader_files(const std::vector<std::string>& file_names);
+
+}
@@ -0,0 +1,109 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <exception>
+
+#include "astc_decoder.h"
+#include "thread_pool.h"
+#include "util_windows.h"
+
+
+// Decodes blocks of every footprint and compares them byte for byte to what a conformant decoder made of them.
+// test/astc/make_fixtures.py wrote the blocks and reference images, see there for what they cover.
+
+
+namespace {
+
+    constexpr uint32_t THREAD_COUNT = 4;
+    constexpr uint32_t STACK_COUNT = 4;
+
+    const char* const FOOTPRINTS[] = {
+        "4x4", "5x4", "5x5", "6x5", "6x6", "8x5", "8x6",
+        "8x8", "10x5", "10x6", "10x8", "10x10", "12x10", "12x12",
+    };
+
+
+    bool check_image(const std::string& fixture_dir, const char* const footprint, const bool srgb, dal::ThreadPool& one_thread, dal::ThreadPool& many_threads) {
+        const auto name = std::string{ footprint } + (srgb ? " srgb" : " unorm");
+        const auto base_path = fixture_dir + '/' + footprint;
+
+        // Files say only the footprint, which is opened as SRGB
+        const auto compressed = dal::open_image_astc((base_path + ".astc").c_str());
+        auto view = compressed.view();
+        if (!srgb) {
+            view.format = static_cast<VkFormat>(view.format - 1);
+        }
+
+        const auto reference = dal::readFile(base_path + (srgb ? "_srgb.rgba" : "_unorm.rgba"));
+        const auto decoded = dal::decode_astc(view, one_thread);
+
+        if (decoded.buffer.size() != reference.size()) {
+            std::cout << "FAIL " << name << ": decoded " << decoded.buffer.size() << " bytes, expected " << reference.size() << '\n';
+            return false;
+        }
+
+        // Fixtures are too short to be split among threads, so blocks are stacked until every thread gets rows
+        std::vector<uint8_t> stacked;
+        for (uint32_t i = 0; i < STACK_COUNT; ++i) {
+            stacked.insert(stacked.end(), compressed.buffer.begin(), compressed.buffer.end());
+        }
+        auto stacked_view = view;
+        stacked_view.height = view.height + (STACK_COUNT - 1) * (view.height + 1);
+        stacked_view.data = stacked.data();
+        stacked_view.size = stacked.size();
+
+        if (dal::decode_astc(stacked_view, one_thread).buffer != dal::decode_astc(stacked_view, many_threads).buffer) {
+            std::cout << "FAIL " << name << ": result depends on thread count\n";
+            return false;
+        }
+
+        if (0 != std::memcmp(decoded.buffer.data(), reference.data(), reference.size())) {
+            size_t i = 0;
+            while (decoded.buffer[i] == static_cast<uint8_t>(reference[i])) {
+                ++i;
+            }
+
+            const auto texel = i / 4;
+            std::cout << "FAIL " << name << ": first differs at texel (" << texel % decoded.width << ", " << texel / decoded.width
+                      << ") channel " << i % 4 << ", decoded " << +decoded.buffer[i] << ", expected " << +static_cast<uint8_t>(reference[i]) << '\n';
+            return false;
+        }
+
+        std::cout << "pass " << name << '\n';
+        return true;
+    }
+
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "usage: test_astc_decoder <directory of test/astc>\n";
+        return EXIT_FAILURE;
+    }
+
+    dal::ThreadPool one_thread, many_threads;
+    one_thread.init(1);
+    many_threads.init(THREAD_COUNT);
+
+    int fail_count = 0;
+
+    for (const auto footprint : FOOTPRINTS) {
+        for (const auto srgb : { false, true }) {
+            try {
+                if (!::check_image(argv[1], footprint, srgb, one_thread, many_threads)) {
+                    ++fail_count;
+                }
+            }
+            catch (const std::exception& e) {
+                std::cout << "FAIL " << footprint << ": " << e.what() << '\n';
+                ++fail_count;
+            }
+        }
+    }
+
+    return 0 == fail_count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,108 +1,217 @@
 #include "texture.h"
 
 #include <cmath>
+#include <array>
 #include <iostream>
+#include <algorithm>
 #include <iterator>
 #include <stdexcept>
 
+#include "konst.h"
+#include "mip_gen.h"
 #include "util_vulkan.h"
+#include "astc_decoder.h"
 
 
 namespace {
 
+    constexpr uint32_t TEXTURE_DECODE_THREAD_COUNT = 2;
+    constexpr VkImageUsageFlags TEXTURE_IMAGE_USAGE = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    uint32_t level_extent(const uint32_t base_extent, const uint32_t level) {
+        return std::max<uint32_t>(base_extent >> level, 1);
+    }
+
+    // Only for a KTX2 file of a single level, which goes through the same path as decoded images
+    dal::ImageData to_image_data(const dal::ImageDataView& view) {
+        dal::ImageData result;
+        result.width = view.width;
+        result.height = view.height;
+        result.channels = 0;
+        result.format = view.format;
+        result.buffer.assign(view.data, view.data + view.size);
+        return result;
+    }
+
     template <typename T>
     uint32_t calc_mip_level(const T texture_width, const T texture_height) {
         const auto a = std::floor(std::log2(std::max<T>(texture_width, texture_height)));
-        return static_cast<uint32_t>(a);
+        return static_cast<uint32_t>(a) + 1;
     }
 
-    void copyBufferToImage(
-        VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mip_level,
-        VkDevice logiDevice, dal::CommandPool& cmdPool, VkQueue graphicsQ
+    // Levels share one staging buffer, which is retired to upload_queues once copies are recorded.
+    // levels[i] goes to mip level base_mip + i, which must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+    void upload_levels(
+        VkImage image, const dal::ImageDataView* const levels, const uint32_t level_count, const uint32_t base_mip,
+        VkDevice logiDevice, VkPhysicalDevice physDevice, dal::UploadQueues& upload_queues
     ) {
-        const auto cmdBuffer = cmdPool.beginSingleTimeCmd(logiDevice);
-        {
-            VkBufferImageCopy region{};
-            region.bufferOffset = 0;
-            region.bufferRowLength = 0;
-            region.bufferImageHeight = 0;
-
+        // Offsets are aligned for any texel block size
+        constexpr VkDeviceSize OFFSET_ALIGN = 16;
+
+        std::vector<VkBufferImageCopy> regions;
+        VkDeviceSize staging_size = 0;
+        for (uint32_t i = 0; i < level_count; ++i) {
+            auto& region = regions.emplace_back();
+            region.bufferOffset = staging_size;
             region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            region.imageSubresource.mipLevel = mip_level;
+            region.imageSubresource.mipLevel = base_mip + i;
             region.imageSubresource.baseArrayLayer = 0;
             region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { levels[i].width, levels[i].height, 1 };
 
-            region.imageOffset = {0, 0, 0};
-            region.imageExtent = {width, height, 1};
+            staging_size += (levels[i].size + OFFSET_ALIGN - 1) / OFFSET_ALIGN * OFFSET_ALIGN;
+        }
 
-            vkCmdCopyBufferToImage(
-                cmdBuffer,
-                buffer,
-                image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1,
-                &region
-            );
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+        dal::createBuffer(
+            staging_size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
+            stagingBufferMemory,
+            logiDevice,
+            physDevice
+        );
+
+        uint8_t* data = nullptr;
+        vkMapMemory(logiDevice, stagingBufferMemory, 0, staging_size, 0, reinterpret_cast<void**>(&data));
+        for (uint32_t i = 0; i < level_count; ++i) {
+            // Straight from the mapped file for KTX2
+            memcpy(data + regions[i].bufferOffset, levels[i].data, levels[i].size);
         }
-        cmdPool.endSingleTimeCmd(cmdBuffer, logiDevice, graphicsQ);
+        vkUnmapMemory(logiDevice, stagingBufferMemory);
+
+        vkCmdCopyBufferToImage(
+            upload_queues.transfer_cmd(logiDevice),
+            stagingBuffer,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            regions.size(),
+            regions.data()
+        );
+
+        upload_queues.retire_staging_buffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    // mip_level levels from base_mip
+    VkImageMemoryBarrier make_image_barrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mip_level, uint32_t base_mip = 0) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = base_mip;
+        barrier.subresourceRange.levelCount = mip_level;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        return barrier;
+    }
+
+    // Moves an image written on the transfer queue to the graphics queue family.
+    // Release and acquire barriers must describe the same layout transition, which happens only once.
+    // Acquire is recorded in the graphics batch, which waits for the transfer batch holding the release.
+    void transferImageOwnership(
+        VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mip_level,
+        VkAccessFlags dst_access, VkPipelineStageFlags dst_stage,
+        VkDevice logiDevice, dal::UploadQueues& upload_queues, uint32_t base_mip = 0
+    ) {
+        auto barrier = ::make_image_barrier(image, oldLayout, newLayout, mip_level, base_mip);
+        barrier.srcQueueFamilyIndex = upload_queues.transfer_family();
+        barrier.dstQueueFamilyIndex = upload_queues.graphics_family();
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(
+            upload_queues.transfer_cmd(logiDevice),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier
+        );
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dst_access;
+        vkCmdPipelineBarrier(
+            upload_queues.graphics_cmd(logiDevice),
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier
+        );
     }
 
     void transitionImageLayout(
         VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mip_level,
-        VkDevice logiDevice, dal::CommandPool& cmdPool, VkQueue graphicsQ
+        VkDevice logiDevice, dal::UploadQueues& upload_queues, uint32_t base_mip = 0
     ) {
-        const auto cmdBuffer = cmdPool.beginSingleTimeCmd(logiDevice);
-        {
-            VkImageMemoryBarrier barrier{};
-            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            barrier.oldLayout = oldLayout;
-            barrier.newLayout = newLayout;
-            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.image = image;
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            barrier.subresourceRange.baseMipLevel = 0;
-            barrier.subresourceRange.levelCount = mip_level;
-            barrier.subresourceRange.baseArrayLayer = 0;
-            barrier.subresourceRange.layerCount = 1;
-            barrier.srcAccessMask = 0; // TODO
-            barrier.dstAccessMask = 0; // TODO
-
-            VkPipelineStageFlags sourceStage;
-            VkPipelineStageFlags destinationStage;
-            if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-                barrier.srcAccessMask = 0;
-                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-                sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-                destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+            // Copies follow on the transfer queue. Contents are undefined so no queue owns the image yet.
+            const auto cmdBuffer = upload_queues.transfer_cmd(logiDevice);
+
+            auto barrier = ::make_image_barrier(image, oldLayout, newLayout, mip_level, base_mip);
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 
-                sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-                destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-            } else {
-                throw std::invalid_argument("unsupported layout transition!");
+            vkCmdPipelineBarrier(
+                cmdBuffer,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier
+            );
+        }
+        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+            if (upload_queues.needs_ownership_transfer()) {
+                ::transferImageOwnership(
+                    image, oldLayout, newLayout, mip_level,
+                    VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    logiDevice, upload_queues, base_mip
+                );
+                return;
             }
 
+            const auto cmdBuffer = upload_queues.graphics_cmd(logiDevice);
+
+            auto barrier = ::make_image_barrier(image, oldLayout, newLayout, mip_level, base_mip);
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
             vkCmdPipelineBarrier(
                 cmdBuffer,
-                sourceStage, destinationStage,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                 0,
                 0, nullptr,
                 0, nullptr,
                 1, &barrier
             );
         }
-        cmdPool.endSingleTimeCmd(cmdBuffer, logiDevice, graphicsQ);
+        else {
+            throw std::invalid_argument("unsupported layout transition!");
+        }
     }
 
     void generateMipmaps(
         VkImage image, int32_t tex_width, int32_t tex_height, uint32_t mip_levels,
-        VkDevice logiDevice, dal::CommandPool& cmdPool, VkQueue graphicsQ
+        VkDevice logiDevice, dal::UploadQueues& upload_queues
     ) {
-        const auto cmdBuffer = cmdPool.beginSingleTimeCmd(logiDevice);
+        // Blits need a graphics queue
+        if (upload_queues.needs_ownership_transfer()) {
+            ::transferImageOwnership(
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels,
+                VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                logiDevice, upload_queues
+            );
+        }
+
+        const auto cmdBuffer = upload_queues.graphics_cmd(logiDevice);
         {
             VkImageMemoryBarrier barrier{};
             barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -185,7 +294,6 @@ namespace {
                 1, &barrier
             );
         }
-        cmdPool.endSingleTimeCmd(cmdBuffer, logiDevice, graphicsQ);
     }
 
 
@@ -205,63 +313,60 @@ namespace {
 namespace dal {
     void TextureImage::init_img(
         const char* const image_path, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-        dal::CommandPool& cmdPool, VkQueue graphicsQ
+        dal::UploadQueues& upload_queues
     ) {
-        const auto image_data = dal::open_image_stb(image_path);
-        if ( physDevice.info().is_mipmap_gen_available_for(image_data.format) ) {
-            this->init_gen_mipmaps(image_data, logiDevice, physDevice, cmdPool, graphicsQ);
-        }
-        else {
-            this->init_without_mipmaps(image_data, logiDevice, physDevice, cmdPool, graphicsQ);
-        }
+        this->init_from_data(dal::open_image_stb(image_path), logiDevice, physDevice, upload_queues);
     }
 
     void TextureImage::init_astc(
         const char* const image_path, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-        dal::CommandPool& cmdPool, VkQueue graphicsQ
+        dal::UploadQueues& upload_queues, dal::ThreadPool& decode_threads
+    ) {
+        auto image_data = dal::open_image_astc(image_path);
+        if (!physDevice.does_support_astc()) {
+            image_data = dal::decode_astc(image_data.view(), decode_threads);
+        }
+
+        this->init_from_data(image_data, logiDevice, physDevice, upload_queues);
+    }
+
+    void TextureImage::init_from_data(
+        const ImageData& image_data, VkDevice logiDevice, const dal::PhysDevice& physDevice,
+        dal::UploadQueues& upload_queues
     ) {
-        const auto image_data = dal::open_image_astc(image_path);
         if ( physDevice.info().is_mipmap_gen_available_for(image_data.format) ) {
-            this->init_gen_mipmaps(image_data, logiDevice, physDevice, cmdPool, graphicsQ);
+            this->init_gen_mipmaps(image_data, logiDevice, physDevice, upload_queues);
+        }
+        else if ( dal::is_cpu_mipmap_gen_available_for(image_data.format) ) {
+            this->init_mipmaps(dal::generate_mipmaps(image_data), logiDevice, physDevice, upload_queues);
         }
         else {
-            this->init_without_mipmaps(image_data, logiDevice, physDevice, cmdPool, graphicsQ);
+            this->init_without_mipmaps(image_data, logiDevice, physDevice, upload_queues);
         }
     }
 
     void TextureImage::init_gen_mipmaps(
         const ImageData& image_data, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-        dal::CommandPool& cmdPool, VkQueue graphicsQ
+        dal::UploadQueues& upload_queues
     ) {
         if (!physDevice.info().is_mipmap_gen_available_for(image_data.format)) {
             throw std::runtime_error("texture image format does not support linear blitting!");
         }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        dal::createBuffer(
-            image_data.buffer.size(),
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer,
-            stagingBufferMemory,
-            logiDevice,
-            physDevice.get()
-        );
-
-        void* data;
-        vkMapMemory(logiDevice, stagingBufferMemory, 0, image_data.buffer.size(), 0, &data);
-        memcpy(data, image_data.buffer.data(), image_data.buffer.size());
-        vkUnmapMemory(logiDevice, stagingBufferMemory);
-
+        this->m_width = image_data.width;
+        this->m_height = image_data.height;
+        this->m_base_width = this->m_width;
+        this->m_base_height = this->m_height;
         this->m_mip_levels = ::calc_mip_level(image_data.width, image_data.height);
+        this->m_resident_base_mip = 0;
+        this->m_first_level = 0;
         this->m_alloc_size = dal::createImage(
             image_data.width,
             image_data.height,
             this->mip_level(),
             image_data.format,
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            ::TEXTURE_IMAGE_USAGE,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             textureImage,
             textureImageMemory,
@@ -275,30 +380,20 @@ namespace dal {
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             this->mip_level(),
-            logiDevice, cmdPool, graphicsQ
-        );
-        ::copyBufferToImage(
-            stagingBuffer,
-            this->textureImage,
-            image_data.width,
-            image_data.height,
-            0,
-            logiDevice, cmdPool, graphicsQ
+            logiDevice, upload_queues
         );
+        const auto view = image_data.view();
+        ::upload_levels(this->textureImage, &view, 1, 0, logiDevice, physDevice.get(), upload_queues);
         ::generateMipmaps(
             this->image(),
             image_data.width,
             image_data.height,
             this->mip_level(),
             logiDevice,
-            cmdPool,
-            graphicsQ
+            upload_queues
         );
         std::cout << "Mipmap generated" << std::endl;
 
-        vkDestroyBuffer(logiDevice, stagingBuffer, nullptr);
-        vkFreeMemory(logiDevice, stagingBufferMemory, nullptr);
-
         this->m_format = image_data.format;
 
         ::print_image_info(image_data.buffer.size(), this->m_alloc_size, this->format());
@@ -306,17 +401,23 @@ namespace dal {
 
     void TextureImage::init_mipmaps(
         const std::vector<ImageData>& image_datas, VkDevice logiDevice,
-        const dal::PhysDevice& physDevice, dal::CommandPool& cmdPool, VkQueue graphicsQ
+        const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
     ) {
         this->m_format = image_datas[0].format;
+        this->m_width = image_datas[0].width;
+        this->m_height = image_datas[0].height;
+        this->m_base_width = this->m_width;
+        this->m_base_height = this->m_height;
         this->m_mip_levels = image_datas.size();
+        this->m_resident_base_mip = 0;
+        this->m_first_level = 0;
         this->m_alloc_size = dal::createImage(
             image_datas[0].width,
             image_datas[0].height,
             this->mip_level(),
             this->format(),
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            ::TEXTURE_IMAGE_USAGE,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             textureImage,
             textureImageMemory,
@@ -330,38 +431,14 @@ namespace dal {
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             this->mip_level(),
-            logiDevice, cmdPool, graphicsQ
+            logiDevice, upload_queues
         );
 
-
-        VkBuffer stagingBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
-        dal::createBuffer(
-            image_datas[0].buffer.size() * 2,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer,
-            stagingBufferMemory,
-            logiDevice,
-            physDevice.get()
-        );
-        for (int i = 0; i < image_datas.size(); ++i) {
-            void* data = nullptr;
-            vkMapMemory(logiDevice, stagingBufferMemory, 0, image_datas[i].buffer.size(), 0, &data);
-            memcpy(data, image_datas[i].buffer.data(), image_datas[i].buffer.size());
-            vkUnmapMemory(logiDevice, stagingBufferMemory);
-
-            ::copyBufferToImage(
-                stagingBuffer,
-                this->textureImage,
-                image_datas[i].width,
-                image_datas[i].height,
-                i,
-                logiDevice, cmdPool, graphicsQ
-            );
+        std::vector<ImageDataView> views;
+        for (auto& x : image_datas) {
+            views.push_back(x.view());
         }
-        vkDestroyBuffer(logiDevice, stagingBuffer, nullptr);
-        vkFreeMemory(logiDevice, stagingBufferMemory, nullptr);
+        ::upload_levels(this->textureImage, views.data(), views.size(), 0, logiDevice, physDevice.get(), upload_queues);
 
         ::transitionImageLayout(
             this->textureImage,
@@ -369,7 +446,7 @@ namespace dal {
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
             this->mip_level(),
-            logiDevice, cmdPool, graphicsQ
+            logiDevice, upload_queues
         );
 
         ::print_image_info(image_datas[0].buffer.size(), this->m_alloc_size, this->format());
@@ -377,17 +454,23 @@ namespace dal {
 
     void TextureImage::init_without_mipmaps(
         const ImageData& image_data, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-        dal::CommandPool& cmdPool, VkQueue graphicsQ
+        dal::UploadQueues& upload_queues
     ) {
         this->m_format = image_data.format;
+        this->m_width = image_data.width;
+        this->m_height = image_data.height;
+        this->m_base_width = this->m_width;
+        this->m_base_height = this->m_height;
         this->m_mip_levels = 1;
+        this->m_resident_base_mip = 0;
+        this->m_first_level = 0;
         this->m_alloc_size = dal::createImage(
             image_data.width,
             image_data.height,
             this->mip_level(),
             this->format(),
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            ::TEXTURE_IMAGE_USAGE,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             textureImage,
             textureImageMemory,
@@ -401,48 +484,195 @@ namespace dal {
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             this->mip_level(),
-            logiDevice, cmdPool, graphicsQ
+            logiDevice, upload_queues
         );
 
-        VkBuffer stagingBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
-        dal::createBuffer(
-            image_data.buffer.size(),
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer,
-            stagingBufferMemory,
+        const auto view = image_data.view();
+        ::upload_levels(this->textureImage, &view, 1, 0, logiDevice, physDevice.get(), upload_queues);
+
+        ::transitionImageLayout(
+            this->textureImage,
+            this->format(),
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            this->mip_level(),
+            logiDevice, upload_queues
+        );
+
+        ::print_image_info(image_data.buffer.size(), this->m_alloc_size, this->format());
+    }
+
+    void TextureImage::init_for_streaming(
+        const std::vector<ImageDataView>& levels, const uint32_t first_level, VkDevice logiDevice,
+        const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
+    ) {
+        this->m_format = levels[first_level].format;
+        this->m_width = levels[first_level].width;
+        this->m_height = levels[first_level].height;
+        this->m_base_width = levels[0].width;
+        this->m_base_height = levels[0].height;
+        this->m_mip_levels = levels.size() - first_level;
+        this->m_resident_base_mip = this->m_mip_levels;
+        this->m_first_level = first_level;
+        this->m_alloc_size = dal::createImage(
+            this->m_width,
+            this->m_height,
+            this->mip_level(),
+            this->format(),
+            VK_IMAGE_TILING_OPTIMAL,
+            ::TEXTURE_IMAGE_USAGE,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            textureImage,
+            textureImageMemory,
             logiDevice,
             physDevice.get()
         );
 
-        void* data = nullptr;
-        vkMapMemory(logiDevice, stagingBufferMemory, 0, image_data.buffer.size(), 0, &data);
-        memcpy(data, image_data.buffer.data(), image_data.buffer.size());
-        vkUnmapMemory(logiDevice, stagingBufferMemory);
-
-        ::copyBufferToImage(
-            stagingBuffer,
+        ::transitionImageLayout(
             this->textureImage,
-            image_data.width,
-            image_data.height,
-            0,
-            logiDevice, cmdPool, graphicsQ
+            this->format(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            this->mip_level(),
+            logiDevice, upload_queues
         );
+    }
 
-        vkDestroyBuffer(logiDevice, stagingBuffer, nullptr);
-        vkFreeMemory(logiDevice, stagingBufferMemory, nullptr);
+    void TextureImage::stream_levels(
+        const std::vector<ImageDataView>& levels, const uint32_t first, VkDevice logiDevice,
+        const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
+    ) {
+        const auto end = this->resident_level();
+        if (first >= end) {
+            return;
+        }
+        if (first < this->m_first_level) {
+            throw std::out_of_range("mip level to stream is not in the texture image");
+        }
+
+        ::upload_levels(this->textureImage, &levels[first], end - first, first - this->m_first_level, logiDevice, physDevice.get(), upload_queues);
 
         ::transitionImageLayout(
             this->textureImage,
             this->format(),
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            end - first,
+            logiDevice, upload_queues, first - this->m_first_level
+        );
+
+        this->m_resident_base_mip = first - this->m_first_level;
+    }
+
+    void TextureImage::init_smaller(
+        const TextureImage& src, const uint32_t first_level, VkDevice logiDevice,
+        const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
+    ) {
+        if (first_level < src.first_level() || first_level > src.resident_level()) {
+            throw std::out_of_range("smaller texture image must start at a resident level");
+        }
+
+        const auto dropped = first_level - src.first_level();
+
+        this->m_format = src.format();
+        this->m_width = ::level_extent(src.m_width, dropped);
+        this->m_height = ::level_extent(src.m_height, dropped);
+        this->m_base_width = src.m_base_width;
+        this->m_base_height = src.m_base_height;
+        this->m_mip_levels = src.chain_end() - first_level;
+        this->m_resident_base_mip = this->m_mip_levels;
+        this->m_first_level = first_level;
+        this->m_alloc_size = dal::createImage(
+            this->m_width,
+            this->m_height,
             this->mip_level(),
-            logiDevice, cmdPool, graphicsQ
+            this->format(),
+            VK_IMAGE_TILING_OPTIMAL,
+            ::TEXTURE_IMAGE_USAGE,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            textureImage,
+            textureImageMemory,
+            logiDevice,
+            physDevice.get()
         );
 
-        ::print_image_info(image_data.buffer.size(), this->m_alloc_size, this->format());
+        this->copy_resident_levels(src, logiDevice, upload_queues);
+    }
+
+    void TextureImage::copy_resident_levels(const TextureImage& src, VkDevice logiDevice, dal::UploadQueues& upload_queues) {
+        const auto first = src.resident_level();
+        const auto end = src.chain_end();
+        if (first < this->m_first_level || end != this->resident_level() || src.format() != this->format()) {
+            throw std::invalid_argument("texture images to copy mip levels between do not match");
+        }
+
+        const auto count = end - first;
+        const auto src_base = first - src.first_level();
+        const auto dst_base = first - this->m_first_level;
+
+        std::vector<VkImageCopy> regions;
+        for (uint32_t i = 0; i < count; ++i) {
+            auto& region = regions.emplace_back();
+            region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.srcSubresource.mipLevel = src_base + i;
+            region.srcSubresource.baseArrayLayer = 0;
+            region.srcSubresource.layerCount = 1;
+            region.dstSubresource = region.srcSubresource;
+            region.dstSubresource.mipLevel = dst_base + i;
+            region.srcOffset = { 0, 0, 0 };
+            region.dstOffset = { 0, 0, 0 };
+            // Whole levels, so extents of block compressed formats need not be multiples of the block size
+            region.extent = { ::level_extent(src.m_width, src_base + i), ::level_extent(src.m_height, src_base + i), 1 };
+        }
+
+        // On the graphics queue, which owns src and is where frames sampling it were submitted.
+        // Queue submission order makes the barriers wait for those frames.
+        const auto cmdBuffer = upload_queues.graphics_cmd(logiDevice);
+        {
+            std::array<VkImageMemoryBarrier, 2> barriers{
+                ::make_image_barrier(src.image(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, count, src_base),
+                // Previous contents of the levels are not needed, even if they were transitioned on the transfer queue
+                ::make_image_barrier(this->image(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, count, dst_base),
+            };
+            barriers[0].srcAccessMask = 0;
+            barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barriers[1].srcAccessMask = 0;
+            barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(
+                cmdBuffer,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                barriers.size(), barriers.data()
+            );
+
+            vkCmdCopyImage(
+                cmdBuffer,
+                src.image(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                this->image(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                regions.size(), regions.data()
+            );
+
+            barriers[0] = ::make_image_barrier(src.image(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, count, src_base);
+            barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barriers[1] = ::make_image_barrier(this->image(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, count, dst_base);
+            barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(
+                cmdBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                barriers.size(), barriers.data()
+            );
+        }
+
+        this->m_resident_base_mip = dst_base;
     }
 
     void TextureImage::destroy(VkDevice logiDevice) {
@@ -465,6 +695,11 @@ namespace dal {
         this->textureImageView = dal::createImageView(textureImage, format, mip_level, VK_IMAGE_ASPECT_COLOR_BIT, logiDevice);
     }
 
+    void TextureImageView::init_resident(VkDevice logiDevice, const TextureImage& image) {
+        const auto base_mip = image.resident_base_mip();
+        this->textureImageView = dal::createImageView(image.image(), image.format(), base_mip, image.mip_level() - base_mip, VK_IMAGE_ASPECT_COLOR_BIT, logiDevice);
+    }
+
     void TextureImageView::destroy(VkDevice logiDevice) {
         if (VK_NULL_HANDLE != this->textureImageView) {
             vkDestroyImageView(logiDevice, this->textureImageView, nullptr);
@@ -547,159 +782,367 @@ namespace dal {
 
 namespace dal {
 
-    void TextureManager::init(const VkDevice logi_device, const VkPhysicalDevice phys_device) {
-        this->m_sampler1.init(logi_device, phys_device);
-        this->m_sampler_shadow_map.init_for_shadow_map(logi_device, phys_device);
+    void TextureManager::init(
+        const VkDescriptorSetLayout texture_table_layout,
+        dal::UploadQueues& upload_queues,
+        const VkDevice logi_device,
+        const dal::PhysDevice& phys_device
+    ) {
+        this->m_sampler1.init(logi_device, phys_device.get());
+        this->m_sampler_shadow_map.init_for_shadow_map(logi_device, phys_device.get());
+        this->m_table.init(dal::MAX_BINDLESS_TEXTURE_COUNT, texture_table_layout, logi_device);
+
+        {
+            const ImageData white{ 1, 1, 4, VK_FORMAT_R8G8B8A8_SRGB, { 255, 255, 255, 255 } };
+
+            this->m_placeholder.image.init_without_mipmaps(white, logi_device, phys_device, upload_queues);
+            this->m_placeholder.view.init(logi_device, this->m_placeholder.image.image(), this->m_placeholder.image.format(), 1);
+            this->m_placeholder.table_index = this->m_table.add(this->m_placeholder.view.get(), this->m_sampler1.get());
+            this->m_table.flush(logi_device);
+        }
+
+        // Formats GPU can't blit get their mipmaps on decoder threads instead
+        std::vector<VkFormat> cpu_mipmap_formats;
+        for (const auto format : dal::CPU_MIPMAP_FORMATS) {
+            if (!phys_device.info().is_mipmap_gen_available_for(format)) {
+                cpu_mipmap_formats.push_back(format);
+            }
+        }
+
+        // Assets are only in ASTC, which is transcoded on decoder threads where GPU can't sample it
+        this->m_decoder.init(::TEXTURE_DECODE_THREAD_COUNT, cpu_mipmap_formats, !phys_device.does_support_astc());
     }
 
     void TextureManager::destroy(const VkDevice logi_device) {
-        this->m_sampler1.destroy(logi_device);
-        this->m_sampler_shadow_map.destroy(logi_device);
+        this->m_decoder.destroy();
+        this->m_streaming.clear();
+
+        for (auto& x : this->m_retired) {
+            x.m_view.destroy(logi_device);
+        }
+        this->m_retired.clear();
+
+        for (auto& x : this->m_retired_images) {
+            x.m_image.destroy(logi_device);
+        }
+        this->m_retired_images.clear();
+        this->m_update_count = 0;
+        this->m_frame_value = 0;
 
         for (auto& [name, tex] : this->m_textures) {
             tex->view.destroy(logi_device);
             tex->image.destroy(logi_device);
         }
-
         this->m_textures.clear();
+
+        this->m_placeholder.view.destroy(logi_device);
+        this->m_placeholder.image.destroy(logi_device);
+
+        this->m_sampler1.destroy(logi_device);
+        this->m_sampler_shadow_map.destroy(logi_device);
+        this->m_table.destroy(logi_device);
     }
 
     bool TextureManager::has_texture(const std::string& tex_name) const {
         return this->m_textures.end() != this->m_textures.find(tex_name);
     }
 
-    std::shared_ptr<TextureUnit> TextureManager::request_texture(
-        const char* const tex_name_ext,
-        dal::CommandPool& cmd_pool,
-        const VkDevice logi_device,
-        const dal::PhysDevice& phys_device,
-        const VkQueue graphics_queue
-    ) {
-        const auto iter = this->m_textures.find(tex_name_ext);
+    std::shared_ptr<TextureUnit> TextureManager::request_texture_async(const std::vector<std::string>& tex_names_ext) {
+        const auto iter = this->m_textures.find(tex_names_ext.at(0));
         if (this->m_textures.end() != iter) {
             return iter->second;
         }
 
         std::shared_ptr<TextureUnit> tex;
         tex.reset(new TextureUnit);
+        tex->table_index = this->m_placeholder.table_index;
+        tex->loading = true;
 
-        tex->image.init_img(
-            (dal::get_res_path() + "/image/" + tex_name_ext).c_str(),
-            logi_device,
-            phys_device,
-            cmd_pool,
-            graphics_queue
-        );
-        tex->view.init(
-            logi_device,
-            tex->image.image(),
-            tex->image.format(),
-            tex->image.mip_level()
-        );
+        for (auto& x : tex_names_ext) {
+            tex->paths.push_back(dal::get_res_path() + "/image/" + x);
+        }
+        this->m_decoder.push(TextureDecoder::Job{ tex, tex->paths });
 
-        this->m_textures[tex_name_ext] = tex;
+        this->m_textures[tex_names_ext[0]] = tex;
         return tex;
     }
 
-    std::shared_ptr<TextureUnit> TextureManager::request_texture_astc(
-        const char* const tex_name_ext,
-        dal::CommandPool& cmd_pool,
+    void TextureManager::update_streaming(
+        const uint64_t frame_value,
+        const uint64_t completed_frame_value,
+        const VkDeviceSize upload_budget,
+        dal::UploadQueues& upload_queues,
         const VkDevice logi_device,
-        const dal::PhysDevice& phys_device,
-        const VkQueue graphics_queue
+        const dal::PhysDevice& phys_device
     ) {
-        const auto iter = this->m_textures.find(tex_name_ext);
-        if (this->m_textures.end() != iter) {
-            return iter->second;
+        ++this->m_update_count;
+        this->m_frame_value = frame_value;
+
+        for (auto iter = this->m_retired.begin(); iter != this->m_retired.end();) {
+            if (iter->m_retired_frame <= completed_frame_value) {
+                iter->m_view.destroy(logi_device);
+                this->m_table.remove(iter->m_table_index);
+                iter = this->m_retired.erase(iter);
+            }
+            else {
+                ++iter;
+            }
         }
 
-        std::shared_ptr<TextureUnit> tex;
-        tex.reset(new TextureUnit);
+        for (auto iter = this->m_retired_images.begin(); iter != this->m_retired_images.end();) {
+            if (iter->m_retired_frame <= completed_frame_value) {
+                iter->m_image.destroy(logi_device);
+                iter = this->m_retired_images.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
 
-        tex->image.init_astc(
-            (dal::get_res_path() + "/image/" + tex_name_ext).c_str(),
-            logi_device,
-            phys_device,
-            cmd_pool,
-            graphics_queue
-        );
-        tex->view.init(
-            logi_device,
-            tex->image.image(),
-            tex->image.format(),
-            tex->image.mip_level()
+        for (auto& result : this->m_decoder.pop_results()) {
+            if (result.m_error) {
+                std::rethrow_exception(result.m_error);
+            }
+
+            auto& tex = *result.m_texture;
+            const auto reloading = VK_NULL_HANDLE != tex.image.image();
+
+            // KTX2 may be of any format, and BC is not on every device
+            if (result.m_ktx && !phys_device.info().is_sampling_available_for(result.m_ktx->format())) {
+                throw std::runtime_error("texture image format is not supported by the device!");
+            }
+
+            // A single image goes up in one piece with mipmaps generated from it
+            if (1 == result.m_levels.size()) {
+                auto& x = this->m_streaming.emplace_back();
+                x.m_texture = std::move(result.m_texture);
+                x.m_levels = std::move(result.m_levels);
+                x.m_decoded = std::move(result.m_decoded);
+                x.m_ktx = std::move(result.m_ktx);
+                x.m_uploaded_base = 1;
+                x.m_target_level = 0;
+                continue;
+            }
+
+            tex.has_file_levels = true;
+
+            // Reloading goes as far as draws need now, which may have changed since it was requested
+            const auto target = reloading ? std::min(tex.required_level, tex.image.first_level()) : 0;
+            if (reloading && target == tex.image.first_level()) {
+                tex.loading = false;
+                continue;
+            }
+
+            // Levels still resident are copied on GPU rather than uploaded again
+            TextureImage image;
+            image.init_for_streaming(result.m_levels, target, logi_device, phys_device, upload_queues);
+            if (reloading) {
+                image.copy_resident_levels(tex.image, logi_device, upload_queues);
+            }
+            this->replace_image(tex, image, logi_device);
+
+            auto& x = this->m_streaming.emplace_back();
+            x.m_texture = std::move(result.m_texture);
+            x.m_levels = std::move(result.m_levels);
+            x.m_decoded = std::move(result.m_decoded);
+            x.m_ktx = std::move(result.m_ktx);
+            x.m_uploaded_base = x.m_texture->image.resident_level();
+            x.m_target_level = target;
+        }
+
+        // One level of each texture in turn, so every texture gets its small mips before any gets its large ones
+        std::vector<uint32_t> new_bases;
+        for (auto& x : this->m_streaming) {
+            new_bases.push_back(x.m_uploaded_base);
+        }
+
+        VkDeviceSize spent = 0;
+        bool any_left = true;
+        while (any_left && (0 == spent || spent < upload_budget)) {
+            any_left = false;
+
+            for (size_t i = 0; i < new_bases.size() && (0 == spent || spent < upload_budget); ++i) {
+                if (this->m_streaming[i].m_target_level == new_bases[i]) {
+                    continue;
+                }
+
+                --new_bases[i];
+                spent += this->m_streaming[i].m_levels[new_bases[i]].size;
+                any_left = true;
+            }
+        }
+
+        for (size_t i = 0; i < new_bases.size(); ++i) {
+            auto& x = this->m_streaming[i];
+            if (new_bases[i] == x.m_uploaded_base) {
+                continue;
+            }
+
+            if (x.m_levels.size() > 1) {
+                x.m_texture->image.stream_levels(x.m_levels, new_bases[i], logi_device, phys_device, upload_queues);
+                this->make_resident_view(*x.m_texture, logi_device);
+            }
+            else {
+                TextureImage image;
+                image.init_from_data(x.m_decoded.empty() ? ::to_image_data(x.m_levels[0]) : x.m_decoded[0], logi_device, phys_device, upload_queues);
+                this->replace_image(*x.m_texture, image, logi_device);
+            }
+
+            x.m_uploaded_base = new_bases[i];
+        }
+
+        for (auto& x : this->m_streaming) {
+            if (x.m_target_level == x.m_uploaded_base) {
+                x.m_texture->loading = false;
+            }
+        }
+        this->m_streaming.erase(
+            std::remove_if(this->m_streaming.begin(), this->m_streaming.end(), [](auto& x) { return x.m_target_level == x.m_uploaded_base; }),
+            this->m_streaming.end()
         );
 
-        this->m_textures[tex_name_ext] = tex;
-        return tex;
+        this->m_table.flush(logi_device);
     }
 
-    std::shared_ptr<TextureUnit> TextureManager::request_texture_with_mipmaps(
-        const std::vector<std::string> tex_names_ext,
-        dal::CommandPool& cmd_pool,
+    void TextureManager::update_residency(
+        const VkDeviceSize vram_budget,
+        dal::UploadQueues& upload_queues,
         const VkDevice logi_device,
-        const dal::PhysDevice& phys_device,
-        const VkQueue graphics_queue
+        const dal::PhysDevice& phys_device
     ) {
-        std::vector<dal::ImageData> image_datas;
+        // Draws of the last frame were stamped before update_streaming of this frame counted it
+        const auto last_frame = this->m_update_count - 1;
+        auto total = this->resident_size();
+
+        // Reload levels draws need again, reserving their size so eviction below doesn't undo it in the same update
+        for (auto& [name, tex] : this->m_textures) {
+            if (tex->loading || tex->last_used != last_frame) {
+                continue;
+            }
+
+            // A single image is always loaded whole with mipmaps generated from it
+            const auto target = tex->has_file_levels ? std::min(tex->required_level, tex->image.chain_end() - 1) : 0;
+            if (target >= tex->image.first_level()) {
+                continue;
+            }
+
+            const auto growth = this->image_alloc_size(tex->image, target, logi_device) - tex->image.alloc_size();
+            if (total + growth > vram_budget) {
+                continue;
+            }
 
-        for (const auto& tex_name_ext : tex_names_ext) {
-            image_datas.emplace_back(dal::open_image_stb((dal::get_res_path() + "/image/" + tex_name_ext).c_str()));
+            total += growth;
+            tex->loading = true;
+            this->m_decoder.push(TextureDecoder::Job{ tex, tex->paths });
         }
 
-        std::shared_ptr<TextureUnit> tex;
-        tex.reset(new TextureUnit);
+        if (total <= vram_budget) {
+            this->m_table.flush(logi_device);
+            return;
+        }
 
-        tex->image.init_mipmaps(
-            image_datas,
-            logi_device,
-            phys_device,
-            cmd_pool,
-            graphics_queue
-        );
-        tex->view.init(
-            logi_device,
-            tex->image.image(),
-            tex->image.format(),
-            tex->image.mip_level()
-        );
+        std::vector<TextureUnit*> candidates;
+        for (auto& [name, tex] : this->m_textures) {
+            if (!tex->loading && tex->image.mip_level() > 1) {
+                candidates.push_back(tex.get());
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](auto a, auto b) { return a->last_used < b->last_used; });
 
-        this->m_textures[tex_names_ext[0]] = tex;
-        return tex;
+        std::vector<uint32_t> new_firsts;
+        for (auto x : candidates) {
+            new_firsts.push_back(x->image.first_level());
+        }
+
+        const auto drop_levels = [&](const size_t i, const uint32_t limit) {
+            const auto& image = candidates[i]->image;
+            while (total > vram_budget && new_firsts[i] < limit) {
+                total -= this->image_alloc_size(image, new_firsts[i], logi_device) - this->image_alloc_size(image, new_firsts[i] + 1, logi_device);
+                ++new_firsts[i];
+            }
+        };
+
+        // Levels no draw needed, least recently used textures first. Ones not drawn last frame need none but the smallest.
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const auto smallest = candidates[i]->image.chain_end() - 1;
+            const auto needed = candidates[i]->last_used == last_frame ? candidates[i]->required_level : smallest;
+            drop_levels(i, std::min(needed, smallest));
+        }
+        // Then levels draws need, which are not loaded again until they fit
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            drop_levels(i, candidates[i]->image.chain_end() - 1);
+        }
+
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            auto& tex = *candidates[i];
+            if (new_firsts[i] == tex.image.first_level()) {
+                continue;
+            }
+
+            TextureImage image;
+            image.init_smaller(tex.image, new_firsts[i], logi_device, phys_device, upload_queues);
+            this->replace_image(tex, image, logi_device);
+        }
+
+        this->m_table.flush(logi_device);
     }
 
-    std::shared_ptr<TextureUnit> TextureManager::request_texture_with_mipmaps_astc(
-        const std::vector<std::string> tex_names_ext,
-        dal::CommandPool& cmd_pool,
-        const VkDevice logi_device,
-        const dal::PhysDevice& phys_device,
-        const VkQueue graphics_queue
-    ) {
-        std::vector<dal::ImageData> image_datas;
+    VkDeviceSize TextureManager::resident_size() const {
+        VkDeviceSize result = this->m_placeholder.image.alloc_size();
 
-        for (const auto& tex_name_ext : tex_names_ext) {
-            image_datas.emplace_back(dal::open_image_astc((dal::get_res_path() + "/image/" + tex_name_ext).c_str()));
+        for (auto& [name, tex] : this->m_textures) {
+            result += tex->image.alloc_size();
         }
 
-        std::shared_ptr<TextureUnit> tex;
-        tex.reset(new TextureUnit);
+        return result;
+    }
 
-        tex->image.init_mipmaps(
-            image_datas,
-            logi_device,
-            phys_device,
-            cmd_pool,
-            graphics_queue
-        );
-        tex->view.init(
-            logi_device,
-            tex->image.image(),
-            tex->image.format(),
-            tex->image.mip_level()
-        );
+    void TextureManager::make_resident_view(TextureUnit& tex, const VkDevice logi_device) {
+        // The old element may be in use by frames in flight, so the new view goes into another one
+        if (VK_NULL_HANDLE != tex.view.get()) {
+            this->m_retired.push_back(RetiredView{ tex.view, tex.table_index, this->m_frame_value });
+        }
 
-        this->m_textures[tex_names_ext[0]] = tex;
-        return tex;
+        tex.view = TextureImageView{};
+        if (tex.image.resident_level() == tex.image.chain_end()) {
+            tex.table_index = this->m_placeholder.table_index;
+            return;
+        }
+
+        tex.view.init_resident(logi_device, tex.image);
+        tex.table_index = this->m_table.add(tex.view.get(), this->m_sampler1.get());
+    }
+
+    void TextureManager::replace_image(TextureUnit& tex, const TextureImage& new_image, const VkDevice logi_device) {
+        if (VK_NULL_HANDLE != tex.image.image()) {
+            this->m_retired_images.push_back(RetiredImage{ tex.image, this->m_frame_value });
+        }
+
+        tex.image = new_image;
+        this->make_resident_view(tex, logi_device);
+    }
+
+    VkDeviceSize TextureManager::image_alloc_size(const TextureImage& image, const uint32_t first_level, const VkDevice logi_device) {
+        if (first_level == image.first_level()) {
+            return image.alloc_size();
+        }
+
+        const auto width = ::level_extent(image.base_width(), first_level);
+        const auto height = ::level_extent(image.base_height(), first_level);
+        const auto mip_levels = image.chain_end() - first_level;
+        const std::array<uint32_t, 4> key{ static_cast<uint32_t>(image.format()), width, height, mip_levels };
+
+        const auto found = this->m_alloc_sizes.find(key);
+        if (this->m_alloc_sizes.end() != found) {
+            return found->second;
+        }
+
+        // Padding and alignment of small levels differ between drivers, so ask for the size of an unbound image of the same shape
+        const auto size = dal::query_image_alloc_size(
+            width, height, mip_levels, image.format(), VK_IMAGE_TILING_OPTIMAL, ::TEXTURE_IMAGE_USAGE, logi_device
+        );
+        this->m_alloc_sizes.emplace(key, size);
+        return size;
     }
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+#include <array>
 #include <vector>
 #include <memory>
 #include <string>
@@ -9,6 +11,9 @@
 
 #include "command_pool.h"
 #include "physdevice.h"
+#include "thread_pool.h"
+#include "texture_table.h"
+#include "texture_stream.h"
 #include "util_windows.h"
 
 
@@ -21,29 +26,60 @@ namespace dal {
         VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
         VkFormat m_format;
         VkDeviceSize m_alloc_size = 0;
+        uint32_t m_width = 0, m_height = 0;  // Of the first level of the image
+        uint32_t m_base_width = 0, m_base_height = 0;  // Of level 0 of the full mip chain
         uint32_t m_mip_levels = 1;
+        uint32_t m_resident_base_mip = 0;  // Levels from this one up are uploaded and readable
+        // Level of the full mip chain the first level of the image is. Larger ones are evicted or not loaded yet.
+        uint32_t m_first_level = 0;
 
     public:
         void init_img(
             const char* const image_path, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-            dal::CommandPool& cmdPool, VkQueue graphicsQ
+            dal::UploadQueues& upload_queues
         );
+        // Transcoded with decode_threads if the device can't sample ASTC
         void init_astc(
             const char* const image_path, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-            dal::CommandPool& cmdPool, VkQueue graphicsQ
+            dal::UploadQueues& upload_queues, dal::ThreadPool& decode_threads
         );
         void init_gen_mipmaps(
             const ImageData& image_data, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-            dal::CommandPool& cmdPool, VkQueue graphicsQ
+            dal::UploadQueues& upload_queues
         );
         void init_without_mipmaps(
             const ImageData& image_data, VkDevice logiDevice, const dal::PhysDevice& physDevice,
-            dal::CommandPool& cmdPool, VkQueue graphicsQ
+            dal::UploadQueues& upload_queues
         );
         void init_mipmaps(
             const std::vector<ImageData>& image_datas, VkDevice logiDevice,
-            const dal::PhysDevice& physDevice, dal::CommandPool& cmdPool, VkQueue graphicsQ
+            const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
         );
+        // Generates mipmaps if the format allows
+        void init_from_data(
+            const ImageData& image_data, VkDevice logiDevice, const dal::PhysDevice& physDevice,
+            dal::UploadQueues& upload_queues
+        );
+
+        // Creates the image with levels [first_level, levels.size()) of the full chain, none of them readable yet
+        void init_for_streaming(
+            const std::vector<ImageDataView>& levels, const uint32_t first_level, VkDevice logiDevice,
+            const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
+        );
+        // Uploads levels [first, resident_level()) of the full chain in one batch and makes them readable
+        void stream_levels(
+            const std::vector<ImageDataView>& levels, const uint32_t first, VkDevice logiDevice,
+            const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
+        );
+        // Creates the image with levels [first_level, src.chain_end()) of the full chain, then copies
+        // the ones src has resident on GPU. first_level must not be larger than src.resident_level().
+        void init_smaller(
+            const TextureImage& src, const uint32_t first_level, VkDevice logiDevice,
+            const dal::PhysDevice& physDevice, dal::UploadQueues& upload_queues
+        );
+        // Copies levels src has resident, which must all exist in this image and not be readable yet.
+        // src stays readable, so frames in flight may keep sampling it.
+        void copy_resident_levels(const TextureImage& src, VkDevice logiDevice, dal::UploadQueues& upload_queues);
 
         void destroy(VkDevice logiDevice);
 
@@ -56,6 +92,28 @@ namespace dal {
         auto& mip_level() const {
             return this->m_mip_levels;
         }
+        auto& resident_base_mip() const {
+            return this->m_resident_base_mip;
+        }
+        auto& alloc_size() const {
+            return this->m_alloc_size;
+        }
+        auto& first_level() const {
+            return this->m_first_level;
+        }
+        // Levels are counted in the full chain from here on
+        uint32_t resident_level() const {
+            return this->m_first_level + this->m_resident_base_mip;
+        }
+        uint32_t chain_end() const {
+            return this->m_first_level + this->m_mip_levels;
+        }
+        uint32_t base_width() const {
+            return this->m_base_width;
+        }
+        uint32_t base_height() const {
+            return this->m_base_height;
+        }
 
     };
 
@@ -63,10 +121,12 @@ namespace dal {
     class TextureImageView {
 
     private:
-        VkImageView textureImageView;
+        VkImageView textureImageView = VK_NULL_HANDLE;
 
     public:
         void init(VkDevice logiDevice, VkImage textureImage, VkFormat format, uint32_t mip_level);
+        // Sees only levels the image has made readable
+        void init_resident(VkDevice logiDevice, const TextureImage& image);
         void destroy(VkDevice logiDevice);
 
         auto& get() const {
@@ -78,7 +138,30 @@ namespace dal {
 
     struct TextureUnit {
         TextureImage image;
-        TextureImageView view;
+        TextureImageView view;  // Null until the first mips are uploaded
+        uint32_t table_index = 0;  // In the bindless texture table of TextureManager. Placeholder's until view is made.
+
+        // Files it's decoded from, kept to load evicted levels again
+        std::vector<std::string> paths;
+        // The files have mip levels of their own rather than one image mipmaps are generated from
+        bool has_file_levels = false;
+        // Being decoded or uploaded, so not evicted meanwhile
+        bool loading = false;
+
+        // Feedback from draws. Smallest level of the full chain any draw needed in the last update it was used.
+        uint32_t required_level = 0;
+        uint64_t last_used = 0;
+
+        // Called by every draw of every frame that samples the texture. stamp is TextureManager::update_count() of the frame.
+        void notify_use(const uint32_t level, const uint64_t stamp) {
+            if (stamp != this->last_used) {
+                this->required_level = level;
+                this->last_used = stamp;
+            }
+            else if (level < this->required_level) {
+                this->required_level = level;
+            }
+        }
     };
 
 
@@ -101,14 +184,56 @@ namespace dal {
 
     class TextureManager {
 
+    private:
+        struct StreamingTexture {
+            std::shared_ptr<TextureUnit> m_texture;
+            std::vector<ImageDataView> m_levels;  // From the largest, pointing into one of the two below
+            std::vector<ImageData> m_decoded;
+            std::shared_ptr<KtxTexture> m_ktx;
+            uint32_t m_uploaded_base = 0;  // Levels from this one up are uploaded
+            uint32_t m_target_level = 0;  // Done once this level is uploaded
+        };
+
+        // Table element and view a texture stopped using.
+        // Freed once the frame timeline reaches m_retired_frame, as frames before it may refer to them.
+        struct RetiredView {
+            TextureImageView m_view;
+            uint32_t m_table_index;
+            uint64_t m_retired_frame;
+        };
+
+        // Image a texture was moved out of by eviction or reloading.
+        // Uploads copying from it are waited for by frame m_retired_frame, so the same value covers them.
+        struct RetiredImage {
+            TextureImage m_image;
+            uint64_t m_retired_frame;
+        };
+
     private:
         TextureSampler m_sampler1;
         TextureSampler m_sampler_shadow_map;
 
+        TextureTable m_table;
+        TextureUnit m_placeholder;
+
+        TextureDecoder m_decoder;
+        std::vector<StreamingTexture> m_streaming;
+        std::vector<RetiredView> m_retired;
+        std::vector<RetiredImage> m_retired_images;
+        uint64_t m_update_count = 0;
+        uint64_t m_frame_value = 0;  // Of the frame being recorded, given to update_streaming
+        // Allocation sizes of images by format, width, height and mip level count, queried from the driver
+        std::map<std::array<uint32_t, 4>, VkDeviceSize> m_alloc_sizes;
+
         std::unordered_map< std::string, std::shared_ptr<TextureUnit> > m_textures;
 
     public:
-        void init(const VkDevice logi_device, const VkPhysicalDevice phys_device);
+        void init(
+            const VkDescriptorSetLayout texture_table_layout,
+            dal::UploadQueues& upload_queues,
+            const VkDevice logi_device,
+            const dal::PhysDevice& phys_device
+        );
         void destroy(const VkDevice logi_device);
 
         auto& sampler_1() const {
@@ -117,38 +242,60 @@ namespace dal {
         auto& sampler_shadow_map() const {
             return this->m_sampler_shadow_map;
         }
+        // Every texture requested so far, sampled with sampler 1
+        auto& texture_table() const {
+            return this->m_table;
+        }
 
         bool has_texture(const std::string& tex_name) const;
 
-        std::shared_ptr<TextureUnit> request_texture(
-            const char* const tex_name_ext,
-            dal::CommandPool& cmd_pool,
-            const VkDevice logi_device,
-            const dal::PhysDevice& phys_device,
-            const VkQueue graphics_queue
-        );
-        std::shared_ptr<TextureUnit> request_texture_astc(
-            const char* const tex_name_ext,
-            dal::CommandPool& cmd_pool,
+        // Returns at once with the texture showing a 1x1 white placeholder. Files are decoded on worker threads
+        // and uploaded by update_streaming. A .ktx2 file has its own mip levels, any other single file gets mipmaps generated,
+        // and several files are mip levels from the largest.
+        // table_index of the texture changes as mips arrive, so materials must read it again every frame.
+        std::shared_ptr<TextureUnit> request_texture_async(const std::vector<std::string>& tex_names_ext);
+
+        // Records uploads of decoded mip levels, the smallest of every texture first, until upload_budget bytes are spent.
+        // At least one level goes up even if it's over budget. Then textures that got new levels are given new table elements.
+        // Call once per frame before materials are uploaded, and submit upload_queues before the frame, which must wait for them.
+        // frame_value is of the frame being recorded and completed_frame_value is what the frame timeline has reached.
+        void update_streaming(
+            const uint64_t frame_value,
+            const uint64_t completed_frame_value,
+            const VkDeviceSize upload_budget,
+            dal::UploadQueues& upload_queues,
             const VkDevice logi_device,
-            const dal::PhysDevice& phys_device,
-            const VkQueue graphics_queue
+            const dal::PhysDevice& phys_device
         );
-        std::shared_ptr<TextureUnit> request_texture_with_mipmaps(
-            const std::vector<std::string> tex_names_ext,
-            dal::CommandPool& cmd_pool,
+        // Keeps VRAM of textures under vram_budget by evicting the largest levels, first ones draws don't need,
+        // then ones of textures least recently used. Evicted levels draws need again are loaded through streaming
+        // if they fit in the budget. Call after update_streaming, with draw feedback from the last frame given by TextureUnit::notify_use.
+        void update_residency(
+            const VkDeviceSize vram_budget,
+            dal::UploadQueues& upload_queues,
             const VkDevice logi_device,
-            const dal::PhysDevice& phys_device,
-            const VkQueue graphics_queue
-        );
-        std::shared_ptr<TextureUnit> request_texture_with_mipmaps_astc(
-            const std::vector<std::string> tex_names_ext,
-            dal::CommandPool& cmd_pool,
-            const VkDevice logi_device,
-            const dal::PhysDevice& phys_device,
-            const VkQueue graphics_queue
+            const dal::PhysDevice& phys_device
         );
 
+        // Textures still being decoded or uploaded
+        uint32_t streaming_count() {
+            return this->m_decoder.unfinished_count() + this->m_streaming.size();
+        }
+        // Number of update_streaming calls so far, which stamps draw feedback
+        auto& update_count() const {
+            return this->m_update_count;
+        }
+        // Images of every texture and the placeholder, not counting ones waiting to be freed
+        VkDeviceSize resident_size() const;
+
+    private:
+        // Gives the texture a view of its readable levels in a new table element
+        void make_resident_view(TextureUnit& tex, const VkDevice logi_device);
+        // Old image is freed once no frame or upload in flight can read it. A view of new_image is made if any level is readable.
+        void replace_image(TextureUnit& tex, const TextureImage& new_image, const VkDevice logi_device);
+        // Size image would take in VRAM if it held levels [first_level, chain_end()) of its full chain
+        VkDeviceSize image_alloc_size(const TextureImage& image, const uint32_t first_level, const VkDevice logi_device);
+
     };
 
 }
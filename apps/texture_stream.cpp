@@ -0,0 +1,165 @@
+#include "texture_stream.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "mip_gen.h"
+#include "thread_pool.h"
+#include "astc_decoder.h"
+
+
+namespace {
+
+    bool ends_with(const std::string& str, const char* const suffix) {
+        const std::string suffix_str{ suffix };
+        return str.size() >= suffix_str.size() && 0 == str.compare(str.size() - suffix_str.size(), suffix_str.size(), suffix_str);
+    }
+
+    dal::ImageData decode_image(const std::string& path) {
+        if (::ends_with(path, ".astc")) {
+            return dal::open_image_astc(path.c_str());
+        }
+        else {
+            return dal::open_image_stb(path.c_str());
+        }
+    }
+
+}
+
+
+namespace dal {
+
+    void TextureDecoder::init(const uint32_t thread_count, const std::vector<VkFormat>& cpu_mipmap_formats, const bool transcode_astc) {
+        this->destroy();
+
+        this->m_stop = false;
+        this->m_cpu_mipmap_formats = cpu_mipmap_formats;
+
+        // Cores are shared among workers, which may all be transcoding at once
+        this->m_astc_thread_count = 0;
+        if (transcode_astc) {
+            this->m_astc_thread_count = std::max<uint32_t>(std::thread::hardware_concurrency() / std::max<uint32_t>(thread_count, 1), 1);
+        }
+
+        for (uint32_t i = 0; i < thread_count; ++i) {
+            this->m_workers.emplace_back(&TextureDecoder::worker_main, this);
+        }
+    }
+
+    void TextureDecoder::destroy() {
+        {
+            std::unique_lock<std::mutex> lck{ this->m_mut };
+            this->m_stop = true;
+            this->m_jobs.clear();
+        }
+        this->m_cv.notify_all();
+
+        for (auto& x : this->m_workers) {
+            x.join();
+        }
+        this->m_workers.clear();
+
+        this->m_results.clear();
+        this->m_unfinished_count = 0;
+    }
+
+    void TextureDecoder::push(Job job) {
+        {
+            std::unique_lock<std::mutex> lck{ this->m_mut };
+            this->m_jobs.push_back(std::move(job));
+            ++this->m_unfinished_count;
+        }
+        this->m_cv.notify_one();
+    }
+
+    std::vector<TextureDecoder::Result> TextureDecoder::pop_results() {
+        std::vector<Result> result;
+
+        std::unique_lock<std::mutex> lck{ this->m_mut };
+        result.swap(this->m_results);
+        this->m_unfinished_count -= result.size();
+
+        return result;
+    }
+
+    uint32_t TextureDecoder::unfinished_count() {
+        std::unique_lock<std::mutex> lck{ this->m_mut };
+        return this->m_unfinished_count;
+    }
+
+    void TextureDecoder::worker_main() {
+        // Kept for the worker's lifetime so threads aren't started for every image
+        dal::ThreadPool astc_threads;
+        if (0 != this->m_astc_thread_count) {
+            astc_threads.init(this->m_astc_thread_count);
+        }
+
+        while (true) {
+            Job job;
+
+            {
+                std::unique_lock<std::mutex> lck{ this->m_mut };
+                this->m_cv.wait(lck, [this]() { return this->m_stop || !this->m_jobs.empty(); });
+
+                if (this->m_stop) {
+                    return;
+                }
+
+                job = std::move(this->m_jobs.front());
+                this->m_jobs.pop_front();
+            }
+
+            Result result;
+            result.m_texture = std::move(job.m_texture);
+
+            try {
+                if (1 == job.m_paths.size() && ::ends_with(job.m_paths[0], ".ktx2")) {
+                    result.m_ktx = std::make_shared<KtxTexture>();
+                    result.m_ktx->open(job.m_paths[0]);
+
+                    // Bindless table is of 2D samplers
+                    if (result.m_ktx->layer_count() > 1) {
+                        throw std::runtime_error("array textures are not supported: " + job.m_paths[0]);
+                    }
+                    result.m_levels = result.m_ktx->levels();
+
+                    if (0 != this->m_astc_thread_count && dal::is_astc_format(result.m_ktx->format())) {
+                        for (auto& x : result.m_levels) {
+                            result.m_decoded.push_back(dal::decode_astc(x, astc_threads));
+                            x = result.m_decoded.back().view();
+                        }
+                        result.m_ktx.reset();
+                    }
+                }
+                else {
+                    for (auto& path : job.m_paths) {
+                        result.m_decoded.push_back(::decode_image(path));
+
+                        auto& image = result.m_decoded.back();
+                        if (0 != this->m_astc_thread_count && dal::is_astc_format(image.format)) {
+                            image = dal::decode_astc(image.view(), astc_threads);
+                        }
+                    }
+
+                    const auto& cpu_formats = this->m_cpu_mipmap_formats;
+                    if (1 == result.m_decoded.size() && cpu_formats.end() != std::find(cpu_formats.begin(), cpu_formats.end(), result.m_decoded[0].format)) {
+                        result.m_decoded = dal::generate_mipmaps(std::move(result.m_decoded[0]));
+                    }
+                    for (auto& x : result.m_decoded) {
+                        result.m_levels.push_back(x.view());
+                    }
+                }
+            }
+            catch (...) {
+                result.m_levels.clear();
+                result.m_decoded.clear();
+                result.m_ktx.reset();
+                result.m_error = std::current_exception();
+            }
+
+            std::unique_lock<std::mutex> lck{ this->m_mut };
+            this->m_results.push_back(std::move(result));
+        }
+    }
+
+}
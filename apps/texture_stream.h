@@ -0,0 +1,77 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "util_windows.h"
+#include "ktx_texture.h"
+
+
+namespace dal {
+
+    struct TextureUnit;
+
+
+    // Decodes image files on worker threads so loading doesn't wait for them. KTX2 files are only mapped and checked.
+    // Nothing here touches Vulkan. Uploading what comes out is up to the thread that owns the device.
+    class TextureDecoder {
+
+    public:
+        struct Job {
+            std::shared_ptr<TextureUnit> m_texture;
+            // One file, or one for each mip level from the largest. ASTC if the extension is .astc,
+            // KTX2 with every mip level if it's .ktx2. ASTC comes out as RGBA8 on devices that can't sample it.
+            std::vector<std::string> m_paths;
+        };
+
+        struct Result {
+            std::shared_ptr<TextureUnit> m_texture;
+            // From the largest. They point into m_decoded or m_ktx, which moving this keeps valid.
+            std::vector<ImageDataView> m_levels;
+            std::vector<ImageData> m_decoded;  // In the order of paths
+            std::shared_ptr<KtxTexture> m_ktx;
+            std::exception_ptr m_error;
+        };
+
+    private:
+        std::vector<std::thread> m_workers;
+
+        std::mutex m_mut;
+        std::condition_variable m_cv;
+        std::deque<Job> m_jobs;
+        std::vector<Result> m_results;
+        uint32_t m_unfinished_count = 0;  // Pushed but not yet popped as a result
+        bool m_stop = false;
+
+        // Single images of these formats come out with every mip level. Only written by init.
+        std::vector<VkFormat> m_cpu_mipmap_formats;
+        // Threads each worker decodes ASTC with in a pool of its own, or 0 if it's left as it is for GPU. Only written by init.
+        uint32_t m_astc_thread_count = 0;
+
+    public:
+        ~TextureDecoder() {
+            this->destroy();
+        }
+
+        void init(const uint32_t thread_count, const std::vector<VkFormat>& cpu_mipmap_formats, const bool transcode_astc);
+        // Waits for files being decoded. Jobs not started are dropped.
+        void destroy();
+
+        void push(Job job);
+        // Every result finished since the last call, in the order they finished
+        std::vector<Result> pop_results();
+
+        uint32_t unfinished_count();
+
+    private:
+        void worker_main();
+
+    };
+
+}
@@ -0,0 +1,101 @@
+#include "texture_table.h"
+
+#include <stdexcept>
+
+
+namespace dal {
+
+    void TextureTable::init(const uint32_t capacity, const VkDescriptorSetLayout layout, const VkDevice logi_device) {
+        this->destroy(logi_device);
+
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_size.descriptorCount = capacity;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes = &pool_size;
+        pool_info.maxSets = 1;
+
+        if (VK_SUCCESS != vkCreateDescriptorPool(logi_device, &pool_info, nullptr, &this->m_pool)) {
+            throw std::runtime_error("failed to create descriptor pool for texture table!");
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = this->m_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &layout;
+
+        if (VK_SUCCESS != vkAllocateDescriptorSets(logi_device, &alloc_info, &this->m_desc_set)) {
+            throw std::runtime_error("failed to allocate descriptor set for texture table!");
+        }
+
+        this->m_capacity = capacity;
+    }
+
+    void TextureTable::destroy(const VkDevice logi_device) {
+        if (VK_NULL_HANDLE != this->m_pool) {
+            vkDestroyDescriptorPool(logi_device, this->m_pool, nullptr);
+            this->m_pool = VK_NULL_HANDLE;
+        }
+
+        this->m_desc_set = VK_NULL_HANDLE;
+        this->m_capacity = 0;
+        this->m_size = 0;
+        this->m_free_indices.clear();
+        this->m_pending.clear();
+    }
+
+    uint32_t TextureTable::add(const VkImageView view, const VkSampler sampler) {
+        uint32_t index = 0;
+
+        if (!this->m_free_indices.empty()) {
+            index = this->m_free_indices.back();
+            this->m_free_indices.pop_back();
+        }
+        else if (this->m_size < this->m_capacity) {
+            index = this->m_size++;
+        }
+        else {
+            throw std::runtime_error("texture table is full!");
+        }
+
+        auto& [pending_index, image_info] = this->m_pending.emplace_back();
+        pending_index = index;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info.imageView = view;
+        image_info.sampler = sampler;
+
+        return index;
+    }
+
+    void TextureTable::remove(const uint32_t index) {
+        // Partially bound, so the element is left as it is. Nothing samples it until add writes it again.
+        this->m_free_indices.push_back(index);
+    }
+
+    void TextureTable::flush(const VkDevice logi_device) {
+        if (this->m_pending.empty()) {
+            return;
+        }
+
+        std::vector<VkWriteDescriptorSet> writes(this->m_pending.size());
+        for (size_t i = 0; i < writes.size(); ++i) {
+            auto& write = writes[i];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = this->m_desc_set;
+            write.dstBinding = 0;
+            write.dstArrayElement = this->m_pending[i].first;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.descriptorCount = 1;
+            write.pImageInfo = &this->m_pending[i].second;
+        }
+
+        vkUpdateDescriptorSets(logi_device, writes.size(), writes.data(), 0, nullptr);
+        this->m_pending.clear();
+    }
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include <vulkan/vulkan.h>
+
+
+namespace dal {
+
+    // One descriptor set with every texture in a partially bound array of combined image samplers.
+    // A texture keeps its index until it is removed, so materials refer to textures by index
+    // and draws with different textures need no other descriptor set.
+    // Elements no pending command buffer uses can be written at any time, so textures can be added while the table is in use.
+    class TextureTable {
+
+    private:
+        VkDescriptorPool m_pool = VK_NULL_HANDLE;
+        VkDescriptorSet m_desc_set = VK_NULL_HANDLE;
+        uint32_t m_capacity = 0;
+        uint32_t m_size = 0;  // Elements ever handed out, including removed ones
+        std::vector<uint32_t> m_free_indices;
+        // Added after the last flush
+        std::vector<std::pair<uint32_t, VkDescriptorImageInfo>> m_pending;
+
+    public:
+        void init(const uint32_t capacity, const VkDescriptorSetLayout layout, const VkDevice logi_device);
+        void destroy(const VkDevice logi_device);
+
+        // Returns index of the texture in the array, which may be one removed before. Throws if the table is full.
+        // Not written until flush, so the texture must not be sampled before then.
+        uint32_t add(const VkImageView view, const VkSampler sampler);
+        // Index is given out again by add, so no command buffer that may still be pending may use it
+        void remove(const uint32_t index);
+        // Writes every texture added since the last flush in one call
+        void flush(const VkDevice logi_device);
+
+        auto& desc_set() const {
+            return this->m_desc_set;
+        }
+        uint32_t size() const {
+            return this->m_size - this->m_free_indices.size();
+        }
+
+    };
+
+}
@@ -0,0 +1,123 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+
+namespace dal {
+
+    uint32_t decide_record_thread_count() {
+#if DAL_MULTITHREADED_RECORD
+        const uint32_t hardware_count = std::thread::hardware_concurrency();
+        return std::clamp<uint32_t>(hardware_count, 1, MAX_RECORD_THREAD_COUNT);
+#else
+        return 1;
+#endif
+    }
+
+    std::pair<uint32_t, uint32_t> split_range(const uint32_t total, const uint32_t part_count, const uint32_t part_index) {
+        const auto base_size = total / part_count;
+        const auto remainder = total % part_count;
+
+        // First `remainder` parts get one more item
+        const auto begin = part_index * base_size + std::min(part_index, remainder);
+        const auto size = base_size + (part_index < remainder ? 1 : 0);
+
+        return std::make_pair(begin, begin + size);
+    }
+
+}
+
+
+namespace dal {
+
+    void ThreadPool::init(const uint32_t thread_count) {
+        this->destroy();
+
+        this->m_stop = false;
+        this->m_generation = 0;
+        this->m_errors.resize(std::max<uint32_t>(1, thread_count));
+
+        for (uint32_t i = 1; i < thread_count; ++i) {
+            this->m_workers.emplace_back(&ThreadPool::worker_main, this, i);
+        }
+    }
+
+    void ThreadPool::destroy() {
+        {
+            std::lock_guard<std::mutex> lock{ this->m_mut };
+            this->m_stop = true;
+        }
+        this->m_cv_start.notify_all();
+
+        for (auto& worker : this->m_workers) {
+            worker.join();
+        }
+        this->m_workers.clear();
+    }
+
+    void ThreadPool::run_on_each(const task_t& task) {
+        if (this->m_workers.empty()) {
+            task(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{ this->m_mut };
+            this->m_task = task;
+            this->m_pending_count = this->m_workers.size();
+            std::fill(this->m_errors.begin(), this->m_errors.end(), nullptr);
+            ++this->m_generation;
+        }
+        this->m_cv_start.notify_all();
+
+        try {
+            task(0);
+        }
+        catch (...) {
+            this->m_errors.at(0) = std::current_exception();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock{ this->m_mut };
+            this->m_cv_done.wait(lock, [this]() { return 0 == this->m_pending_count; });
+            this->m_task = nullptr;
+        }
+
+        for (auto& error : this->m_errors) {
+            if (nullptr != error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    void ThreadPool::worker_main(const uint32_t thread_index) {
+        uint64_t last_generation = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock{ this->m_mut };
+                this->m_cv_start.wait(lock, [&]() { return this->m_stop || last_generation != this->m_generation; });
+                if (this->m_stop) {
+                    return;
+                }
+                last_generation = this->m_generation;
+            }
+
+            // m_task is not modified until every worker decrements m_pending_count
+            try {
+                this->m_task(thread_index);
+            }
+            catch (...) {
+                this->m_errors.at(thread_index) = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{ this->m_mut };
+                if (0 == --this->m_pending_count) {
+                    this->m_cv_done.notify_one();
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+
+// If true, draws are recorded into secondary command buffers by several threads.
+// Otherwise every secondary command buffer is recorded on the calling thread.
+#define DAL_MULTITHREADED_RECORD true
+
+
+namespace dal {
+
+    constexpr uint32_t MAX_RECORD_THREAD_COUNT = 8;
+
+    // Number of threads a ThreadPool for command recording should have, including the calling thread
+    uint32_t decide_record_thread_count();
+
+    // [begin, end) of the part_index'th of part_count contiguous parts of [0, total)
+    std::pair<uint32_t, uint32_t> split_range(const uint32_t total, const uint32_t part_count, const uint32_t part_index);
+
+
+    // Runs one task on every thread at once and waits for all of them.
+    // Thread index 0 is the calling thread so a pool of size 1 has no worker at all.
+    class ThreadPool {
+
+    public:
+        using task_t = std::function<void(const uint32_t thread_index)>;
+
+    private:
+        std::vector<std::thread> m_workers;
+        std::vector<std::exception_ptr> m_errors;  // For each thread
+
+        std::mutex m_mut;
+        std::condition_variable m_cv_start, m_cv_done;
+        task_t m_task;
+        uint64_t m_generation = 0;
+        uint32_t m_pending_count = 0;
+        bool m_stop = false;
+
+    public:
+        ~ThreadPool() {
+            this->destroy();
+        }
+
+        void init(const uint32_t thread_count);
+        void destroy();
+
+        // Exception thrown by any of the threads is rethrown here after all of them are done
+        void run_on_each(const task_t& task);
+
+        uint32_t thread_count() const {
+            return this->m_workers.size() + 1;
+        }
+
+    private:
+        void worker_main(const uint32_t thread_index);
+
+    };
+
+}
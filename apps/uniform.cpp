@@ -1,6 +1,5 @@
 #include "uniform.h"
 
-#include <array>
 #include <chrono>
 #include <stdexcept>
 
@@ -8,6 +7,7 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "konst.h"
 #include "util_vulkan.h"
 
 
@@ -28,455 +28,247 @@ namespace dal {
         return std::make_pair(buffer, memory);
     }
 
-}
-
+    std::pair<VkBuffer, VkDeviceMemory> _create_storage_buffer_memory(const uint32_t data_size, const VkBufferUsageFlags extra_usage, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
 
-namespace {
+        dal::createBuffer(
+            data_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extra_usage,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            buffer, memory,
+            logi_device, phys_device
+        );
 
-    VkDescriptorSetLayout create_layout_deferred(const VkDevice logiDevice) {
-        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        return std::make_pair(buffer, memory);
+    }
 
-        bindings[0].binding = 0;
-        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings[0].descriptorCount = 1;
-        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        bindings[0].pImmutableSamplers = nullptr; // Optional
+}
 
-        bindings[1].binding = 1;
-        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        bindings[1].descriptorCount = 1;
-        bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        bindings[1].pImmutableSamplers = nullptr;
 
-        bindings[2].binding = 2;
-        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings[2].descriptorCount = 1;
-        bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        bindings[2].pImmutableSamplers = nullptr;
+// StorageBuffer
+namespace dal {
 
-        bindings.at(3).binding = 3;
-        bindings.at(3).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings.at(3).descriptorCount = 1;
-        bindings.at(3).stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    void StorageBuffer::init(const uint32_t data_size, const VkDevice logi_device, const VkPhysicalDevice phys_device, const VkBufferUsageFlags extra_usage) {
+        this->destroy(logi_device);
+        std::tie(this->m_buffer, this->m_memory) = dal::_create_storage_buffer_memory(data_size, extra_usage, logi_device, phys_device);
+        this->m_data_size = data_size;
 
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = bindings.size();
-        layoutInfo.pBindings = bindings.data();
+        dal::assert_vk_success( vkMapMemory(logi_device, this->m_memory, 0, data_size, 0, &this->m_mapped) );
+    }
 
-        VkDescriptorSetLayout result = VK_NULL_HANDLE;
-        if (VK_SUCCESS != vkCreateDescriptorSetLayout(logiDevice, &layoutInfo, nullptr, &result)) {
-            throw std::runtime_error("failed to create descriptor set layout!");
+    void StorageBuffer::destroy(const VkDevice logi_device) {
+        if (nullptr != this->m_mapped) {
+            vkUnmapMemory(logi_device, this->m_memory);
+            this->m_mapped = nullptr;
         }
 
-        return result;
-    }
+        if (VK_NULL_HANDLE != this->m_buffer) {
+            vkDestroyBuffer(logi_device, this->m_buffer, nullptr);
+            this->m_buffer = VK_NULL_HANDLE;
+        }
 
-    VkDescriptorSetLayout create_layout_composition(const VkDevice logiDevice) {
-        std::array<VkDescriptorSetLayoutBinding, 8> bindings{};
-
-        bindings[0].binding = 0;
-        bindings[0].descriptorCount = 1;
-        bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        bindings[1].binding = 1;
-        bindings[1].descriptorCount = 1;
-        bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        bindings[2].binding = 2;
-        bindings[2].descriptorCount = 1;
-        bindings[2].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        bindings[3].binding = 3;
-        bindings[3].descriptorCount = 1;
-        bindings[3].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        bindings[4].binding = 4;
-        bindings[4].descriptorCount = 1;
-        bindings[4].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        bindings[4].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        bindings[5].binding = 5;
-        bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings[5].descriptorCount = 1;
-        bindings[5].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        bindings[5].pImmutableSamplers = nullptr;
-
-        bindings[6].binding = 6;
-        bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        bindings[6].descriptorCount = dal::MAX_DLIGHT_COUNT;
-        bindings[6].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        bindings[7].binding = 7;
-        bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        bindings[7].descriptorCount = dal::MAX_SLIGHT_COUNT;
-        bindings[7].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = bindings.size();
-        layoutInfo.pBindings = bindings.data();
-
-        VkDescriptorSetLayout result = VK_NULL_HANDLE;
-        if (VK_SUCCESS != vkCreateDescriptorSetLayout(logiDevice, &layoutInfo, nullptr, &result)) {
-            throw std::runtime_error("failed to create descriptor set layout!");
+        if (VK_NULL_HANDLE != this->m_memory) {
+            vkFreeMemory(logi_device, this->m_memory, nullptr);
+            this->m_memory = VK_NULL_HANDLE;
         }
 
-        return result;
+        this->m_data_size = 0;
     }
 
-    VkDescriptorSetLayout create_layout_shadow(const VkDevice logiDevice) {
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
-
-        bindings.at(0).binding = 0;
-        bindings.at(0).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings.at(0).descriptorCount = 1;
-        bindings.at(0).stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-        bindings.at(1).binding = 1;
-        bindings.at(1).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        bindings.at(1).descriptorCount = 1;
-        bindings.at(1).stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = bindings.size();
-        layoutInfo.pBindings = bindings.data();
-
-        VkDescriptorSetLayout result = VK_NULL_HANDLE;
-        if (VK_SUCCESS != vkCreateDescriptorSetLayout(logiDevice, &layoutInfo, nullptr, &result)) {
-            throw std::runtime_error("failed to create descriptor set layout!");
-        }
-
-        return result;
+    void StorageBuffer::copy_to_buffer(const void* data, const uint32_t size, const uint32_t offset) {
+        assert(offset + size <= this->m_data_size);
+        memcpy(static_cast<uint8_t*>(this->m_mapped) + offset, data, size);
     }
 
 }
 
-namespace dal {
-
-    void DescriptorSetLayout::init(const VkDevice logiDevice) {
-        this->destroy(logiDevice);
 
-        this->m_layout_deferred = ::create_layout_deferred(logiDevice);
-        this->m_layout_composition = ::create_layout_composition(logiDevice);
-        this->m_layout_shadow = ::create_layout_shadow(logiDevice);
-    }
+// StorageBufferArray
+namespace dal {
 
-    void DescriptorSetLayout::destroy(const VkDevice logiDevice) {
-        if (VK_NULL_HANDLE != this->m_layout_deferred) {
-            vkDestroyDescriptorSetLayout(logiDevice, this->m_layout_deferred, nullptr);
-            this->m_layout_deferred = VK_NULL_HANDLE;
-        }
+    void StorageBufferArray::init(const uint32_t array_size, const uint32_t data_size, const VkDevice logi_device, const VkPhysicalDevice phys_device, const VkBufferUsageFlags extra_usage) {
+        this->destroy(logi_device);
 
-        if (VK_NULL_HANDLE != this->m_layout_composition) {
-            vkDestroyDescriptorSetLayout(logiDevice, this->m_layout_composition, nullptr);
-            this->m_layout_composition = VK_NULL_HANDLE;
+        for (uint32_t i = 0; i < array_size; ++i) {
+            this->m_buffers.emplace_back().init(data_size, logi_device, phys_device, extra_usage);
         }
+    }
 
-        if (VK_NULL_HANDLE != this->m_layout_shadow) {
-            vkDestroyDescriptorSetLayout(logiDevice, this->m_layout_shadow, nullptr);
-            this->m_layout_shadow = VK_NULL_HANDLE;
+    void StorageBufferArray::destroy(const VkDevice logi_device) {
+        for (auto& x : this->m_buffers) {
+            x.destroy(logi_device);
         }
+        this->m_buffers.clear();
     }
 
 }
 
 
+// DescriptorSetLayout
 namespace dal {
 
-    void DescSet::record_deferred(
-        const UniformBuffer<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-        const UniformBuffer<U_Material_InDeferred>& ubuf_material,
-        const UniformBuffer<U_PerInst_PerFrame_InDeferred>& ubuf_per_inst_per_frame,
-        const VkImageView textureImageView,
-        const VkSampler textureSampler,
-        const VkDevice logi_device
-    ) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = ubuf_per_frame_in_deferred.buffer();
-        bufferInfo.offset = 0;
-        bufferInfo.range = ubuf_per_frame_in_deferred.data_size();
-
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = textureImageView;
-        imageInfo.sampler = textureSampler;
-
-        VkDescriptorBufferInfo buffer_material_info{};
-        buffer_material_info.buffer = ubuf_material.buffer();
-        buffer_material_info.offset = 0;
-        buffer_material_info.range = ubuf_material.data_size();
-
-        VkDescriptorBufferInfo ubuf_info_per_inst_per_frame{};
-        ubuf_info_per_inst_per_frame.buffer = ubuf_per_inst_per_frame.buffer();
-        ubuf_info_per_inst_per_frame.offset = 0;
-        ubuf_info_per_inst_per_frame.range = ubuf_per_inst_per_frame.data_size();
-
-
-        std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
-
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = this->m_handle;
-        descriptorWrites[0].dstBinding = 0;  // specified in shader code
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-        descriptorWrites[0].pImageInfo = nullptr; // Optional
-        descriptorWrites[0].pTexelBufferView = nullptr; // Optional
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = this->m_handle;
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = nullptr; // Optional
-        descriptorWrites[1].pImageInfo = &imageInfo;
-        descriptorWrites[1].pTexelBufferView = nullptr; // Optional
-
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = this->m_handle;
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pBufferInfo = &buffer_material_info;
-        descriptorWrites[2].pImageInfo = nullptr;
-        descriptorWrites[2].pTexelBufferView = nullptr;
-
-        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3].dstSet = this->m_handle;
-        descriptorWrites[3].dstBinding = 3;
-        descriptorWrites[3].dstArrayElement = 0;
-        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[3].descriptorCount = 1;
-        descriptorWrites[3].pBufferInfo = &ubuf_info_per_inst_per_frame;
-
-
-        vkUpdateDescriptorSets(
-            logi_device,
-            static_cast<uint32_t>(descriptorWrites.size()),
-            descriptorWrites.data(),
-            0, nullptr
-        );
-    }
+    void DescriptorSetLayout::init(const VkDevice logiDevice) {
+        this->destroy(logiDevice);
 
-    void DescSet::record_composition(
-        const size_t swapchainImagesSize,
-        const UniformBuffer<U_PerFrame_InComposition> ubuf_per_frame,
-        const VkDescriptorSetLayout descriptorSetLayout,
-        const std::vector<VkImageView>& attachment_views,
-        const std::vector<VkImageView>& dlight_shadow_map_view,
-        const std::vector<VkImageView>& slight_shadow_map_view,
-        const VkSampler shadow_map_sampler,
-        const VkDevice logiDevice
-    ) {
-        std::vector<VkDescriptorImageInfo> imageInfo(attachment_views.size());
-        for (size_t i = 0; i < attachment_views.size(); ++i) {
-            auto& x = imageInfo.at(i);
-            x.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            x.imageView = attachment_views[i];
-            x.sampler = VK_NULL_HANDLE;
+        // SPIR-V has no binding flags, so the bindless texture table is not from reflection
+        {
+            VkDescriptorSetLayoutBinding binding{};
+            binding.binding = 0;
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            binding.descriptorCount = dal::MAX_BINDLESS_TEXTURE_COUNT;
+            binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+            this->m_layout_textures = this->m_cache.get_set_layout(
+                { binding },
+                { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT },
+                VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+                logiDevice
+            );
         }
 
-        std::vector<VkWriteDescriptorSet> descriptorWrites(imageInfo.size());
-        for (size_t i = 0; i < imageInfo.size(); ++i) {
-            auto& x = descriptorWrites.at(i);
-
-            x.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            x.dstSet = this->m_handle;
-            x.dstBinding = i;  // specified in shader code
-            x.dstArrayElement = 0;
-            x.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-            x.descriptorCount = 1;
-            x.pImageInfo = &imageInfo[i];
-        }
+        {
+            const auto program = this->init_program(
+                { "triangle_v.spv", "triangle_f.spv" },
+                3,
+                { VK_NULL_HANDLE, this->m_layout_textures, VK_NULL_HANDLE },
+                logiDevice
+            );
 
-        // Unifrom buffer
+            this->m_pipeline_layout_deferred = program.m_pipeline_layout;
+            this->m_layout_per_frame = program.m_set_layouts.at(DESC_SET_DEFERRED_PER_FRAME);
+            this->m_layout_per_inst = program.m_set_layouts.at(DESC_SET_DEFERRED_PER_INST);
+            this->m_template_per_frame = program.m_templates.at(DESC_SET_DEFERRED_PER_FRAME);
+            this->m_template_per_inst = program.m_templates.at(DESC_SET_DEFERRED_PER_INST);
+        }
 
-        VkDescriptorBufferInfo buffer_per_frame_info{};
-        buffer_per_frame_info.buffer = ubuf_per_frame.buffer();
-        buffer_per_frame_info.offset = 0;
-        buffer_per_frame_info.range = ubuf_per_frame.data_size();
         {
-            auto& x = descriptorWrites.emplace_back();
-            x.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            x.dstSet = this->m_handle;
-            x.dstBinding = descriptorWrites.size() - 1;
-            x.dstArrayElement = 0;
-            x.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            x.descriptorCount = 1;
-            x.pBufferInfo = &buffer_per_frame_info;
-            x.pImageInfo = nullptr;
-            x.pTexelBufferView = nullptr;
-        }
+            const auto program = this->init_program({ "shadow_map_v.spv", "shadow_map_f.spv" }, 2, {}, logiDevice);
 
-        std::array<VkDescriptorImageInfo, dal::MAX_DLIGHT_COUNT> dlight_shadow_map_info{};
-        for (uint32_t i = 0; i < dlight_shadow_map_info.size(); ++i) {
-            dlight_shadow_map_info.at(i).imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            dlight_shadow_map_info.at(i).imageView = dlight_shadow_map_view.at(i);
-            dlight_shadow_map_info.at(i).sampler = shadow_map_sampler;
+            // Layout cache gives the same handle for the same bindings
+            if (program.m_set_layouts.at(DESC_SET_SHADOW_PER_INST) != this->m_layout_per_inst) {
+                throw std::runtime_error("per instance sets of G-buffer and shadow shaders must have the same bindings");
+            }
+
+            this->m_pipeline_layout_shadow = program.m_pipeline_layout;
+            this->m_layout_per_light = program.m_set_layouts.at(DESC_SET_SHADOW_PER_LIGHT);
+            this->m_template_per_light = program.m_templates.at(DESC_SET_SHADOW_PER_LIGHT);
         }
+
         {
-            auto& x = descriptorWrites.emplace_back();
-            x.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            x.dstSet = this->m_handle;
-            x.dstBinding = descriptorWrites.size() - 1;
-            x.dstArrayElement = 0;
-            x.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            x.descriptorCount = dlight_shadow_map_info.size();
-            x.pImageInfo = dlight_shadow_map_info.data();
-        }
+            const auto program = this->init_program({ "fillsc_v.spv", "fillsc_f.spv", "light_volume_v.spv", "light_volume_f.spv" }, 1, {}, logiDevice);
 
-        std::array<VkDescriptorImageInfo, dal::MAX_SLIGHT_COUNT> slight_shadow_map_info{};
-        for (uint32_t i = 0; i < slight_shadow_map_info.size(); ++i) {
-            slight_shadow_map_info.at(i).imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            slight_shadow_map_info.at(i).imageView = slight_shadow_map_view.at(i);
-            slight_shadow_map_info.at(i).sampler = shadow_map_sampler;
+            this->m_pipeline_layout_composition = program.m_pipeline_layout;
+            this->m_layout_composition = program.m_set_layouts.at(0);
+            this->m_template_composition = program.m_templates.at(0);
         }
+
         {
-            auto& x = descriptorWrites.emplace_back();
-            x.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            x.dstSet = this->m_handle;
-            x.dstBinding = descriptorWrites.size() - 1;
-            x.dstArrayElement = 0;
-            x.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            x.descriptorCount = slight_shadow_map_info.size();
-            x.pImageInfo = slight_shadow_map_info.data();
-        }
+            const auto program = this->init_program({ "fillsc_v.spv", "tonemap_f.spv" }, 1, {}, logiDevice);
 
-        // Create
+            this->m_pipeline_layout_tonemap = program.m_pipeline_layout;
+            this->m_layout_tonemap = program.m_set_layouts.at(0);
+            this->m_template_tonemap = program.m_templates.at(0);
+        }
+    }
 
-        vkUpdateDescriptorSets(
-            logiDevice,
-            descriptorWrites.size(),
-            descriptorWrites.data(),
-            0, nullptr
-        );
+    void DescriptorSetLayout::destroy(const VkDevice logiDevice) {
+        this->m_cache.destroy(logiDevice);
+
+        this->m_layout_per_frame = VK_NULL_HANDLE;
+        this->m_layout_textures = VK_NULL_HANDLE;
+        this->m_layout_per_inst = VK_NULL_HANDLE;
+        this->m_layout_per_light = VK_NULL_HANDLE;
+        this->m_layout_composition = VK_NULL_HANDLE;
+        this->m_layout_tonemap = VK_NULL_HANDLE;
+
+        this->m_pipeline_layout_deferred = VK_NULL_HANDLE;
+        this->m_pipeline_layout_composition = VK_NULL_HANDLE;
+        this->m_pipeline_layout_shadow = VK_NULL_HANDLE;
+        this->m_pipeline_layout_tonemap = VK_NULL_HANDLE;
+
+        this->m_template_per_frame = VK_NULL_HANDLE;
+        this->m_template_per_inst = VK_NULL_HANDLE;
+        this->m_template_per_light = VK_NULL_HANDLE;
+        this->m_template_composition = VK_NULL_HANDLE;
+        this->m_template_tonemap = VK_NULL_HANDLE;
     }
 
-    void DescSet::record_shadow(
-        const UniformBuffer<U_PerInst_PerFrame_InDeferred>& ubuf_per_inst_per_frame,
-        const UniformBuffer<U_PerFrame_PerLight>& ubuf_per_light_per_frame,
+    DescriptorSetLayout::ProgramLayout DescriptorSetLayout::init_program(
+        const std::vector<std::string>& spv_file_names,
+        const uint32_t set_count,
+        const std::vector<VkDescriptorSetLayout>& preset_layouts,
         const VkDevice logi_device
     ) {
-        VkDescriptorBufferInfo ubuf_info_per_inst_per_frame{};
-        ubuf_info_per_inst_per_frame.buffer = ubuf_per_inst_per_frame.buffer();
-        ubuf_info_per_inst_per_frame.offset = 0;
-        ubuf_info_per_inst_per_frame.range = ubuf_per_inst_per_frame.data_size();
-
-        VkDescriptorBufferInfo ubuf_info_per_light_per_frame{};
-        ubuf_info_per_light_per_frame.buffer = ubuf_per_light_per_frame.buffer();
-        ubuf_info_per_light_per_frame.offset = 0;
-        ubuf_info_per_light_per_frame.range = ubuf_per_light_per_frame.data_size();
-
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-        descriptorWrites.at(0).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites.at(0).dstSet = this->m_handle;
-        descriptorWrites.at(0).dstBinding = 0;
-        descriptorWrites.at(0).dstArrayElement = 0;
-        descriptorWrites.at(0).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites.at(0).descriptorCount = 1;
-        descriptorWrites.at(0).pBufferInfo = &ubuf_info_per_inst_per_frame;
-
-        descriptorWrites.at(1).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites.at(1).dstSet = this->m_handle;
-        descriptorWrites.at(1).dstBinding = 1;
-        descriptorWrites.at(1).dstArrayElement = 0;
-        descriptorWrites.at(1).descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites.at(1).descriptorCount = 1;
-        descriptorWrites.at(1).pBufferInfo = &ubuf_info_per_light_per_frame;
-
-
-        vkUpdateDescriptorSets(
-            logi_device,
-            descriptorWrites.size(),
-            descriptorWrites.data(),
-            0, nullptr
-        );
-    }
-
-}
+        const auto shader_interface = dal::reflect_shader_files(spv_file_names);
+        if (set_count != shader_interface.set_count()) {
+            throw std::runtime_error("shaders use unexpected number of descriptor sets: " + spv_file_names.front());
+        }
 
+        ProgramLayout result;
 
-namespace dal {
+        for (uint32_t i = 0; i < set_count; ++i) {
+            if (i < preset_layouts.size() && VK_NULL_HANDLE != preset_layouts[i]) {
+                result.m_set_layouts.push_back(preset_layouts[i]);
+                result.m_templates.push_back(VK_NULL_HANDLE);
+                continue;
+            }
 
-    void DescPool::init(
-        const uint32_t uniform_buf_count,
-        const uint32_t image_sampler_count,
-        const uint32_t input_attachment_count,
-        const uint32_t desc_set_count,
-        const VkDevice logi_device
-    ) {
-        this->destroy(logi_device);
+            const auto bindings = shader_interface.make_layout_bindings(i);
+            const auto set_layout = this->m_cache.get_set_layout(bindings, logi_device);
 
-        std::array<VkDescriptorPoolSize, 3> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = uniform_buf_count;
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = image_sampler_count;
-        poolSizes[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        poolSizes[2].descriptorCount = input_attachment_count;
-
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = poolSizes.size();
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = desc_set_count;
-
-        if (VK_SUCCESS != vkCreateDescriptorPool(logi_device, &poolInfo, nullptr, &this->m_pool)) {
-            throw std::runtime_error("failed to create descriptor pool!");
+            result.m_set_layouts.push_back(set_layout);
+            result.m_templates.push_back(this->m_cache.get_update_template(set_layout, bindings, logi_device));
         }
-    }
 
-    void DescPool::destroy(const VkDevice logi_device) {
-        if (VK_NULL_HANDLE != this->m_pool) {
-            vkDestroyDescriptorPool(logi_device, this->m_pool, nullptr);
-            this->m_pool = VK_NULL_HANDLE;
-        }
+        result.m_pipeline_layout = this->m_cache.get_pipeline_layout(result.m_set_layouts, shader_interface.make_push_const_ranges(), logi_device);
+        return result;
     }
 
-    void DescPool::reset(const VkDevice logi_device) {
-        if (VK_SUCCESS != vkResetDescriptorPool(logi_device, this->m_pool, 0)) {
-            throw std::runtime_error{ "failed to reset descriptor pool" };
-        }
-    }
+}
 
-    DescSet DescPool::allocate(const VkDescriptorSetLayout layout, const VkDevice logi_device) {
-        return this->allocate(1, layout, logi_device).at(0);
-    }
 
-    std::vector<DescSet> DescPool::allocate(const uint32_t count, const VkDescriptorSetLayout layout, const VkDevice logi_device) {
-        std::vector<DescSet> result;
+namespace dal {
+
+    void DescSet::record_composition(
+        const VkDescriptorUpdateTemplate update_template,
+        const UniformBuffer<U_PerFrame_InComposition>& ubuf_per_frame,
+        const std::vector<VkImageView>& attachment_views,
+        const std::vector<VkImageView>& dlight_shadow_map_view,
+        const std::vector<VkImageView>& slight_shadow_map_view,
+        const VkSampler shadow_map_sampler,
+        const std::vector<VkBuffer>& storage_buffers,
+        const VkDevice logiDevice
+    ) {
+        // In the order of bindings in the shader
+        std::vector<DescriptorInfo> infos;
+        infos.reserve(attachment_views.size() + 1 + dal::MAX_DLIGHT_COUNT + dal::MAX_SLIGHT_SHADOW_COUNT + storage_buffers.size());
 
-        const std::vector<VkDescriptorSetLayout> layouts(count, layout);
+        for (size_t i = 0; i < attachment_views.size(); ++i) {
+            // Depth is also bound as read only depth attachment in the same subpass
+            const auto layout = (0 == i) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            infos.push_back(dal::make_desc_info_image(attachment_views[i], VK_NULL_HANDLE, layout));
+        }
 
-        VkDescriptorSetAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        alloc_info.descriptorPool = this->get();
-        alloc_info.descriptorSetCount = count;
-        alloc_info.pSetLayouts = layouts.data();
+        infos.push_back(dal::make_desc_info_buffer(ubuf_per_frame.buffer(), ubuf_per_frame.data_size()));
 
-        std::vector<VkDescriptorSet> desc_sets(count);
-        if (VK_SUCCESS != vkAllocateDescriptorSets(logi_device, &alloc_info, desc_sets.data())) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
+        for (uint32_t i = 0; i < dal::MAX_DLIGHT_COUNT; ++i) {
+            infos.push_back(dal::make_desc_info_image(dlight_shadow_map_view.at(i), shadow_map_sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+        }
+        for (uint32_t i = 0; i < dal::MAX_SLIGHT_SHADOW_COUNT; ++i) {
+            infos.push_back(dal::make_desc_info_image(slight_shadow_map_view.at(i), shadow_map_sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
         }
 
-        result.reserve(count);
-        for (const auto x : desc_sets) {
-            result.emplace_back().set(x);
+        for (auto x : storage_buffers) {
+            infos.push_back(dal::make_desc_info_buffer(x, VK_WHOLE_SIZE));
         }
 
-        return result;
+        vkUpdateDescriptorSetWithTemplate(logiDevice, this->m_handle, update_template, infos.data());
+    }
+
+    void DescSet::record_tonemap(const VkDescriptorUpdateTemplate update_template, const VkImageView lighting_view, const VkDevice logi_device) {
+        const auto info = dal::make_desc_info_image(lighting_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        vkUpdateDescriptorSetWithTemplate(logi_device, this->m_handle, update_template, &info);
     }
 
 }
@@ -485,38 +277,40 @@ namespace dal {
 namespace dal {
 
     void DescriptorSetManager::init(const uint32_t swapchain_count, const VkDevice logi_device) {
-        constexpr uint32_t POOL_SIZE_MULTIPLIER = 50;
-
-        this->m_pool.init(
-            swapchain_count * POOL_SIZE_MULTIPLIER,
-            swapchain_count * POOL_SIZE_MULTIPLIER,
-            swapchain_count * POOL_SIZE_MULTIPLIER,
-            swapchain_count * POOL_SIZE_MULTIPLIER,
-            logi_device
-        );
+        // A composition set and a tonemap set for each frame
+        this->m_allocator.init(swapchain_count * 2, logi_device);
     }
 
     void DescriptorSetManager::addSets_composition(
         const VkDevice logiDevice,
         const size_t swapchainImagesSize,
-        const VkDescriptorSetLayout descriptorSetLayout,
+        const DescriptorSetLayout& desc_layouts,
         const UniformBufferArray<U_PerFrame_InComposition>& ubuf_per_frame,
         const std::vector<VkImageView>& attachment_views,
         const std::vector<VkImageView>& dlight_shadow_map_view,
         const std::vector<VkImageView>& slight_shadow_map_view,
-        const VkSampler dlight_shadow_map_sampler
+        const VkSampler dlight_shadow_map_sampler,
+        const std::vector<const StorageBufferArray*>& storage_buffers
     ) {
-        auto desc_sets = this->m_pool.allocate(swapchainImagesSize, descriptorSetLayout, logiDevice);
+        const auto layout = desc_layouts.layout_composition();
+        std::vector<DescSet> desc_sets(swapchainImagesSize);
 
         for (uint32_t i = 0; i < desc_sets.size(); ++i) {
+            desc_sets.at(i).set(this->m_allocator.allocate(layout, desc_layouts.desc_counts(layout), logiDevice));
+
+            std::vector<VkBuffer> storage_buffers_of_frame;
+            for (auto x : storage_buffers) {
+                storage_buffers_of_frame.push_back(x->buffer_at(i).buffer());
+            }
+
             desc_sets.at(i).record_composition(
-                swapchainImagesSize,
+                desc_layouts.update_template_composition(),
                 ubuf_per_frame.buffer_at(i),
-                descriptorSetLayout,
                 attachment_views,
                 dlight_shadow_map_view,
                 slight_shadow_map_view,
                 dlight_shadow_map_sampler,
+                storage_buffers_of_frame,
                 logiDevice
             );
         }
@@ -524,9 +318,31 @@ namespace dal {
         this->m_descset_composition.emplace_back(desc_sets);
     }
 
+    void DescriptorSetManager::addSets_tonemap(
+        const VkDevice logi_device,
+        const size_t swapchain_count,
+        const DescriptorSetLayout& desc_layouts,
+        const VkImageView lighting_view
+    ) {
+        const auto layout = desc_layouts.layout_tonemap();
+        this->m_descset_tonemap.resize(swapchain_count);
+
+        for (auto& x : this->m_descset_tonemap) {
+            x.set(this->m_allocator.allocate(layout, desc_layouts.desc_counts(layout), logi_device));
+            x.record_tonemap(desc_layouts.update_template_tonemap(), lighting_view, logi_device);
+        }
+    }
+
     void DescriptorSetManager::destroy(VkDevice logiDevice) {
-        this->m_pool.destroy(logiDevice);
+        this->m_allocator.destroy(logiDevice);
         this->m_descset_composition.clear();
+        this->m_descset_tonemap.clear();
+    }
+
+    void DescriptorSetManager::reset(VkDevice logiDevice) {
+        this->m_allocator.reset(logiDevice);
+        this->m_descset_composition.clear();
+        this->m_descset_tonemap.clear();
     }
 
     std::vector<std::vector<VkDescriptorSet>> DescriptorSetManager::descset_composition() const {
@@ -543,4 +359,14 @@ namespace dal {
         return result;
     }
 
+    std::vector<VkDescriptorSet> DescriptorSetManager::descset_tonemap() const {
+        std::vector<VkDescriptorSet> result;
+
+        for (auto& x : this->m_descset_tonemap) {
+            result.push_back(x.get());
+        }
+
+        return result;
+    }
+
 }
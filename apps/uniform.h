@@ -1,8 +1,10 @@
 #pragma once
 
 #include <tuple>
+#include <string>
 #include <vector>
 #include <cassert>
+#include <cstring>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -10,22 +12,33 @@
 #include <vulkan/vulkan.h>
 
 #include "fbufmanager.h"
+#include "layout_cache.h"
+#include "desc_allocator.h"
 
 
 namespace dal {
 
-    constexpr uint32_t MAX_PLIGHT_COUNT = 5;
     constexpr uint32_t MAX_DLIGHT_COUNT = 3;
-    constexpr uint32_t MAX_SLIGHT_COUNT = 5;
+    // Only this many spot lights have their shadow maps bound in composition
+    constexpr uint32_t MAX_SLIGHT_SHADOW_COUNT = 5;
+    constexpr uint32_t MAX_MATERIAL_COUNT = 1024;
 
 
     struct U_PerFrame_InDeferred {
         glm::mat4 view, proj;
     };
 
+    // In deferred, storage buffer indexed by a push constant
     struct U_Material_InDeferred {
         float m_roughness = 0.5;
         float m_metallic = 0;
+        uint32_t m_albedo_index = 0;  // Into the bindless texture table
+        uint32_t m_padding = 0;
+    };
+
+    // Pushed before draws of G-buffer program whose material differs from the previous draw
+    struct PushConst_InDeferred {
+        uint32_t m_material_index = 0;
     };
 
     // In deferred, shadow
@@ -34,22 +47,45 @@ namespace dal {
     };
 
     struct U_PerFrame_InComposition {
+        glm::mat4 m_view_mat{ 1 };
+        // For light volumes
+        glm::mat4 m_view_proj{ 1 };
+        // Reconstructs world position from depth
+        glm::mat4 m_view_proj_inv{ 1 };
         glm::vec4 m_view_pos{ 0 };
+        // x: width, y: height
+        glm::vec4 m_screen_size{ 0 };
 
         glm::vec4 m_num_of_plight_dlight_slight{ 0 };
-
-        glm::vec4 m_plight_color[MAX_PLIGHT_COUNT]{};
-        glm::vec4 m_plight_pos[MAX_PLIGHT_COUNT]{};
+        // x: z slice scale, y: z slice bias, z: tile width, w: tile height
+        glm::vec4 m_cluster_params{ 0 };
 
         glm::vec4 m_dlight_color[MAX_DLIGHT_COUNT]{};
         glm::vec4 m_dlight_direc[MAX_DLIGHT_COUNT]{};
         glm::mat4 m_dlight_mat[MAX_DLIGHT_COUNT]{};
+    };
+
+    // In composition, storage buffer
+    struct U_PointLight {
+        glm::vec4 m_pos_max_dist{ 0 };
+        glm::vec4 m_color{ 0 };
+    };
+
+    // In composition, storage buffer
+    struct U_SpotLight {
+        glm::vec4 m_pos_max_dist{ 0 };
+        glm::vec4 m_direc_shadow_index{ 0 };  // Negative shadow index means no shadow map
+        glm::vec4 m_color{ 0 };
+        glm::vec4 m_fade_start_end{ 0 };
+        glm::mat4 m_light_mat{ 1 };
+    };
 
-        glm::vec4 m_slight_pos[MAX_SLIGHT_COUNT]{};
-        glm::vec4 m_slight_direc[MAX_SLIGHT_COUNT]{};
-        glm::vec4 m_slight_color[MAX_SLIGHT_COUNT]{};
-        glm::vec4 m_slight_fade_start_end[MAX_SLIGHT_COUNT]{};
-        glm::mat4 m_slight_mat[MAX_SLIGHT_COUNT]{};
+    // In composition, storage buffer
+    struct U_ClusterRange {
+        uint32_t m_offset = 0;
+        uint32_t m_plight_count = 0;
+        uint32_t m_slight_count = 0;
+        uint32_t m_padding = 0;
     };
 
     // In shadow
@@ -63,6 +99,7 @@ namespace dal {
 namespace dal {
 
     std::pair<VkBuffer, VkDeviceMemory> _create_uniform_buffer_memory(const uint32_t data_size, const VkDevice logi_device, const VkPhysicalDevice phys_device);
+    std::pair<VkBuffer, VkDeviceMemory> _create_storage_buffer_memory(const uint32_t data_size, const VkBufferUsageFlags extra_usage, const VkDevice logi_device, const VkPhysicalDevice phys_device);
 
 
     template <typename _DataStruct>
@@ -146,26 +183,248 @@ namespace dal {
     };
 
 
+    // Host coherent and persistently mapped
+    class StorageBuffer {
+
+    private:
+        VkBuffer m_buffer = VK_NULL_HANDLE;
+        VkDeviceMemory m_memory = VK_NULL_HANDLE;
+        void* m_mapped = nullptr;
+        uint32_t m_data_size = 0;
+
+    public:
+        // extra_usage is added to VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, e.g. for buffers that also hold indirect draw arguments
+        void init(const uint32_t data_size, const VkDevice logi_device, const VkPhysicalDevice phys_device, const VkBufferUsageFlags extra_usage = 0);
+        void destroy(const VkDevice logi_device);
+
+        uint32_t data_size() const {
+            return this->m_data_size;
+        }
+        auto buffer() const {
+            return this->m_buffer;
+        }
+
+        void copy_to_buffer(const void* data, const uint32_t size, const uint32_t offset);
+
+    };
+
+
+    class StorageBufferArray {
+
+    private:
+        std::vector<StorageBuffer> m_buffers;
+
+    public:
+        void init(const uint32_t array_size, const uint32_t data_size, const VkDevice logi_device, const VkPhysicalDevice phys_device, const VkBufferUsageFlags extra_usage = 0);
+        void destroy(const VkDevice logi_device);
+
+        uint32_t array_size() const {
+            return this->m_buffers.size();
+        }
+        auto& buffer_at(const uint32_t index) const {
+            return this->m_buffers.at(index);
+        }
+
+        void copy_to_buffer(const size_t index, const void* data, const uint32_t size, const uint32_t offset) {
+            this->m_buffers.at(index).copy_to_buffer(data, size, offset);
+        }
+
+    };
+
+
+    // Array of records in a storage buffer for each swapchain image, with a CPU copy.
+    // Records are compared when set and only the changed ones are uploaded, in contiguous ranges.
+    template <typename _Record>
+    class StorageBufferTable {
+
+    private:
+        StorageBufferArray m_buffers;
+        std::vector<_Record> m_records;
+        std::vector<uint32_t> m_dirty_masks;  // A bit for each swapchain image that has an outdated copy
+        uint32_t m_capacity = 0;
+        uint32_t m_full_mask = 0;
+
+    public:
+        void init(const uint32_t swapchain_count, const uint32_t buffer_size, const VkDevice logi_device, const VkPhysicalDevice phys_device) {
+            assert(swapchain_count <= 32);
+
+            this->destroy(logi_device);
+            this->m_buffers.init(swapchain_count, buffer_size, logi_device, phys_device);
+            this->m_capacity = buffer_size / sizeof(_Record);
+            this->m_full_mask = 32 == swapchain_count ? 0xFFFFFFFF : (1u << swapchain_count) - 1;
+        }
+
+        void destroy(const VkDevice logi_device) {
+            this->m_buffers.destroy(logi_device);
+            this->m_records.clear();
+            this->m_dirty_masks.clear();
+            this->m_capacity = 0;
+        }
+
+        uint32_t capacity() const {
+            return this->m_capacity;
+        }
+        uint32_t size() const {
+            return this->m_records.size();
+        }
+        auto& buffers() const {
+            return this->m_buffers;
+        }
+
+        void set_records(const _Record* const records, const uint32_t count) {
+            assert(count <= this->capacity());
+
+            this->m_records.resize(count);
+            this->m_dirty_masks.resize(count, this->m_full_mask);
+
+            for (uint32_t i = 0; i < count; ++i) {
+                if (0 != memcmp(&this->m_records[i], &records[i], sizeof(_Record))) {
+                    this->m_records[i] = records[i];
+                    this->m_dirty_masks[i] = this->m_full_mask;
+                }
+            }
+        }
+
+        // Returns uploaded size in bytes
+        uint32_t upload(const uint32_t index) {
+            const uint32_t bit = 1u << index;
+            uint32_t uploaded_size = 0;
+
+            for (uint32_t i = 0; i < this->m_records.size();) {
+                if (0 == (this->m_dirty_masks[i] & bit)) {
+                    ++i;
+                    continue;
+                }
+
+                const auto begin = i;
+                for (; i < this->m_records.size() && (this->m_dirty_masks[i] & bit); ++i) {
+                    this->m_dirty_masks[i] &= ~bit;
+                }
+
+                const uint32_t size = sizeof(_Record) * (i - begin);
+                this->m_buffers.copy_to_buffer(index, &this->m_records[begin], size, sizeof(_Record) * begin);
+                uploaded_size += size;
+            }
+
+            return uploaded_size;
+        }
+
+    };
+
+
+    // Sets of G-buffer and shadow programs are split by how often they change,
+    // so a draw only binds the sets that differ from the previous draw
+    // Materials are a push constant indexing a storage buffer in the per frame set, and textures are a bindless array.
+    constexpr uint32_t DESC_SET_DEFERRED_PER_FRAME = 0;
+    constexpr uint32_t DESC_SET_DEFERRED_TEXTURES = 1;
+    constexpr uint32_t DESC_SET_DEFERRED_PER_INST = 2;
+    constexpr uint32_t DESC_SET_SHADOW_PER_LIGHT = 0;
+    constexpr uint32_t DESC_SET_SHADOW_PER_INST = 1;
+
+
+    // Descriptor set layouts and pipeline layouts are derived from SPIR-V of the shaders which use them
     class DescriptorSetLayout {
 
     private:
-        VkDescriptorSetLayout m_layout_deferred = VK_NULL_HANDLE;
+        struct ProgramLayout {
+            VkPipelineLayout m_pipeline_layout = VK_NULL_HANDLE;
+            std::vector<VkDescriptorSetLayout> m_set_layouts;  // For each set index
+            std::vector<VkDescriptorUpdateTemplate> m_templates;  // For each set index
+        };
+
+    private:
+        LayoutCache m_cache;
+
+        VkDescriptorSetLayout m_layout_per_frame = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_layout_textures = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_layout_per_inst = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_layout_per_light = VK_NULL_HANDLE;
         VkDescriptorSetLayout m_layout_composition = VK_NULL_HANDLE;
-        VkDescriptorSetLayout m_layout_shadow = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_layout_tonemap = VK_NULL_HANDLE;
+
+        VkPipelineLayout m_pipeline_layout_deferred = VK_NULL_HANDLE;
+        VkPipelineLayout m_pipeline_layout_composition = VK_NULL_HANDLE;
+        VkPipelineLayout m_pipeline_layout_shadow = VK_NULL_HANDLE;
+        VkPipelineLayout m_pipeline_layout_tonemap = VK_NULL_HANDLE;
+
+        VkDescriptorUpdateTemplate m_template_per_frame = VK_NULL_HANDLE;
+        VkDescriptorUpdateTemplate m_template_per_inst = VK_NULL_HANDLE;
+        VkDescriptorUpdateTemplate m_template_per_light = VK_NULL_HANDLE;
+        VkDescriptorUpdateTemplate m_template_composition = VK_NULL_HANDLE;
+        VkDescriptorUpdateTemplate m_template_tonemap = VK_NULL_HANDLE;
 
     public:
         void init(const VkDevice logiDevice);
         void destroy(const VkDevice logiDevice);
 
-        auto& layout_deferred() const {
-            return this->m_layout_deferred;
+        // Set 0 of G-buffer program
+        auto& layout_per_frame() const {
+            return this->m_layout_per_frame;
+        }
+        // Set 1 of G-buffer program, a partially bound array of combined image samplers updated after bind
+        auto& layout_textures() const {
+            return this->m_layout_textures;
+        }
+        // Set 2 of G-buffer program and set 1 of shadow program, so the same sets serve both
+        auto& layout_per_inst() const {
+            return this->m_layout_per_inst;
+        }
+        // Set 0 of shadow program
+        auto& layout_per_light() const {
+            return this->m_layout_per_light;
         }
         auto& layout_composition() const {
             return this->m_layout_composition;
         }
-        auto& layout_shadow() const {
-            return this->m_layout_shadow;
+        auto& layout_tonemap() const {
+            return this->m_layout_tonemap;
+        }
+
+        auto& pipeline_layout_deferred() const {
+            return this->m_pipeline_layout_deferred;
+        }
+        // Light volume pipelines use it too
+        auto& pipeline_layout_composition() const {
+            return this->m_pipeline_layout_composition;
+        }
+        auto& pipeline_layout_shadow() const {
+            return this->m_pipeline_layout_shadow;
+        }
+        auto& pipeline_layout_tonemap() const {
+            return this->m_pipeline_layout_tonemap;
+        }
+
+        // For sizing descriptor pools
+        auto& desc_counts(const VkDescriptorSetLayout layout) const {
+            return this->m_cache.desc_counts(layout);
+        }
+
+        // Each reads an array of DescriptorInfo in the order of bindings
+        auto& update_template_per_frame() const {
+            return this->m_template_per_frame;
+        }
+        auto& update_template_per_inst() const {
+            return this->m_template_per_inst;
         }
+        auto& update_template_per_light() const {
+            return this->m_template_per_light;
+        }
+        auto& update_template_composition() const {
+            return this->m_template_composition;
+        }
+        auto& update_template_tonemap() const {
+            return this->m_template_tonemap;
+        }
+
+    private:
+        // Throws if the shaders don't use exactly set_count sets.
+        // Non null elements of preset_layouts are used for their set index instead of ones from reflection, and get no update template.
+        ProgramLayout init_program(
+            const std::vector<std::string>& spv_file_names,
+            const uint32_t set_count,
+            const std::vector<VkDescriptorSetLayout>& preset_layouts,
+            const VkDevice logi_device
+        );
 
     };
 
@@ -184,55 +443,18 @@ namespace dal {
             return this->m_handle;
         }
 
-        void record_deferred(
-            const UniformBuffer<U_PerFrame_InDeferred>& ubuf_per_frame_in_deferred,
-            const UniformBuffer<U_Material_InDeferred>& ubuf_material,
-            const UniformBuffer<U_PerInst_PerFrame_InDeferred>& ubuf_per_inst_per_frame,
-            const VkImageView textureImageView,
-            const VkSampler textureSampler,
-            const VkDevice logi_device
-        );
+        // Both write every descriptor of the set in one call through the update template of its layout
         void record_composition(
-            const size_t swapchainImagesSize,
-            const UniformBuffer<U_PerFrame_InComposition> ubuf_per_frame,
-            const VkDescriptorSetLayout descriptorSetLayout,
+            const VkDescriptorUpdateTemplate update_template,
+            const UniformBuffer<U_PerFrame_InComposition>& ubuf_per_frame,
             const std::vector<VkImageView>& attachment_views,
             const std::vector<VkImageView>& dlight_shadow_map_view,
             const std::vector<VkImageView>& slight_shadow_map_view,
             const VkSampler dlight_shadow_map_sampler,
+            const std::vector<VkBuffer>& storage_buffers,
             const VkDevice logiDevice
         );
-        void record_shadow(
-            const UniformBuffer<U_PerInst_PerFrame_InDeferred>& ubuf_per_inst_per_frame,
-            const UniformBuffer<U_PerFrame_PerLight>& ubuf_per_light_per_frame,
-            const VkDevice logi_device
-        );
-
-    };
-
-
-    class DescPool {
-
-    private:
-        VkDescriptorPool m_pool = VK_NULL_HANDLE;
-
-    public:
-        void init(
-            const uint32_t uniform_buf_count,
-            const uint32_t image_sampler_count,
-            const uint32_t input_attachment_count,
-            const uint32_t desc_set_count,
-            const VkDevice logi_device
-        );
-        void destroy(const VkDevice logi_device);
-        void reset(const VkDevice logi_device);
-
-        DescSet allocate(const VkDescriptorSetLayout layout, const VkDevice logi_device);
-        std::vector<DescSet> allocate(const uint32_t count, const VkDescriptorSetLayout layout, const VkDevice logi_device);
-
-        auto get() const {
-            return this->m_pool;
-        }
+        void record_tonemap(const VkDescriptorUpdateTemplate update_template, const VkImageView lighting_view, const VkDevice logi_device);
 
     };
 
@@ -240,29 +462,36 @@ namespace dal {
     class DescriptorSetManager {
 
     private:
-        DescPool m_pool;
+        DescAllocator m_allocator;
 
         std::vector<std::vector<DescSet>> m_descset_composition;
+        std::vector<DescSet> m_descset_tonemap;
 
     public:
         void init(const uint32_t swapchain_count, const VkDevice logi_device);
         void addSets_composition(
             const VkDevice logiDevice,
             const size_t swapchainImagesSize,
-            const VkDescriptorSetLayout descriptorSetLayout,
+            const DescriptorSetLayout& desc_layouts,
             const UniformBufferArray<U_PerFrame_InComposition>& ubuf_per_frame,
             const std::vector<VkImageView>& attachment_views,
             const std::vector<VkImageView>& dlight_shadow_map_view,
             const std::vector<VkImageView>& slight_shadow_map_view,
-            const VkSampler dlight_shadow_map_sampler
+            const VkSampler dlight_shadow_map_sampler,
+            const std::vector<const StorageBufferArray*>& storage_buffers
+        );
+        void addSets_tonemap(
+            const VkDevice logi_device,
+            const size_t swapchain_count,
+            const DescriptorSetLayout& desc_layouts,
+            const VkImageView lighting_view
         );
         void destroy(VkDevice logiDevice);
-
-        auto& pool() {
-            return this->m_pool;
-        }
+        // Frees every set but keeps the pools, for writing sets again after the attachments they refer to are recreated
+        void reset(VkDevice logiDevice);
 
         std::vector<std::vector<VkDescriptorSet>> descset_composition() const;
+        std::vector<VkDescriptorSet> descset_tonemap() const;
 
     };
 
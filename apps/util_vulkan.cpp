@@ -4,6 +4,31 @@
 #include <stdexcept>
 
 
+namespace {
+
+    VkImageCreateInfo make_image_info(
+        uint32_t width, uint32_t height, uint32_t mip_level, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage
+    ) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mip_level;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        return imageInfo;
+    }
+
+}
+
+
 namespace dal {
 
     uint32_t QueueFamilyIndices::graphicsFamily(void) const {
@@ -21,6 +46,11 @@ namespace dal {
     }
 
 
+    uint32_t QueueFamilyIndices::transferFamily(void) const {
+        return this->hasDedicatedTransfer() ? this->m_transferFamily : this->graphicsFamily();
+    }
+
+
     QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice device, const VkSurfaceKHR surface) {
         QueueFamilyIndices indices;
 
@@ -30,21 +60,34 @@ namespace dal {
         std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-        int i = 0;
-        for ( const auto& queueFamily : queueFamilies ) {
-            if ( queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT )
+        // Transfer only families are usually DMA engines, so they are preferred over ones that can also compute
+        bool is_transfer_only = false;
+
+        for ( uint32_t i = 0; i < queueFamilies.size(); ++i ) {
+            const auto flags = queueFamilies[i].queueFlags;
+
+            if ( (flags & VK_QUEUE_GRAPHICS_BIT) && !indices.isComplete() )
                 indices.setGraphicsFamily(i);
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-            if ( presentSupport ) {
-                indices.setPresentFamily(i);
+            if ( !indices.isComplete() ) {
+                VkBool32 presentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+                if ( presentSupport ) {
+                    indices.setPresentFamily(i);
+                }
             }
 
-            if ( indices.isComplete() )
-                break;
+            if ( flags & VK_QUEUE_GRAPHICS_BIT )
+                continue;
+
+            if ( (flags & VK_QUEUE_COMPUTE_BIT) && !indices.hasDedicatedCompute() )
+                indices.setComputeFamily(i);
 
-            i++;
+            // Compute queues support transfer even without the bit
+            if ( (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !is_transfer_only ) {
+                indices.setTransferFamily(i);
+                is_transfer_only = !(flags & VK_QUEUE_COMPUTE_BIT);
+            }
         }
 
         return indices;
@@ -86,6 +129,20 @@ namespace dal {
         throw std::runtime_error("failed to find suitable memory type!");
     }
 
+    uint32_t find_transient_mem_type(const uint32_t typeFilter, const VkPhysicalDevice physDevice) {
+        VkPhysicalDeviceMemoryProperties memProps;
+        vkGetPhysicalDeviceMemoryProperties(physDevice, &memProps);
+
+        constexpr VkMemoryPropertyFlags LAZY_PROPS = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
+            if (typeFilter & (1 << i) && (memProps.memoryTypes[i].propertyFlags & LAZY_PROPS) == LAZY_PROPS) {
+                return i;
+            }
+        }
+
+        return dal::findMemType(typeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physDevice);
+    }
+
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
         VkBuffer& buffer, VkDeviceMemory& bufferMemory, VkDevice logiDevice, VkPhysicalDevice physDevice)
     {
@@ -121,20 +178,7 @@ namespace dal {
         VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
         VkDeviceMemory& imageMemory, VkDevice logiDevice, VkPhysicalDevice physDevice
     ) {
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = width;
-        imageInfo.extent.height = height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = mip_level;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = format;
-        imageInfo.tiling = tiling;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = usage;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        const auto imageInfo = ::make_image_info(width, height, mip_level, format, tiling, usage);
 
         if (vkCreateImage(logiDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image!");
@@ -158,9 +202,34 @@ namespace dal {
         return allocInfo.allocationSize;
     }
 
+    VkDeviceSize query_image_alloc_size(
+        uint32_t width, uint32_t height, uint32_t mip_level, VkFormat format, VkImageTiling tiling,
+        VkImageUsageFlags usage, VkDevice logiDevice
+    ) {
+        const auto imageInfo = ::make_image_info(width, height, mip_level, format, tiling, usage);
+
+        VkImage image = VK_NULL_HANDLE;
+        if (vkCreateImage(logiDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(logiDevice, image, &memRequirements);
+        vkDestroyImage(logiDevice, image, nullptr);
+
+        return memRequirements.size;
+    }
+
     VkImageView createImageView(
         const VkImage image, const VkFormat format, const uint32_t mip_level,
         const VkImageAspectFlags aspectFlags, const VkDevice logiDevice
+    ) {
+        return dal::createImageView(image, format, 0, mip_level, aspectFlags, logiDevice);
+    }
+
+    VkImageView createImageView(
+        const VkImage image, const VkFormat format, const uint32_t base_mip, const uint32_t mip_level,
+        const VkImageAspectFlags aspectFlags, const VkDevice logiDevice
     ) {
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -168,7 +237,7 @@ namespace dal {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.format = format;
         viewInfo.subresourceRange.aspectMask = aspectFlags;
-        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.baseMipLevel = base_mip;
         viewInfo.subresourceRange.levelCount = mip_level;
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = 1;
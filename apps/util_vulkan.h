@@ -16,6 +16,8 @@ namespace dal {
     private:
         uint32_t m_graphicsFamily = NULL_VAL;
         uint32_t m_presentFamily = NULL_VAL;
+        uint32_t m_transferFamily = NULL_VAL;  // Without graphics capability
+        uint32_t m_computeFamily = NULL_VAL;   // Without graphics capability
 
     public:
         bool isComplete(void) const {
@@ -27,6 +29,15 @@ namespace dal {
 
         uint32_t graphicsFamily(void) const;
         uint32_t presentFamily(void) const;
+        // Falls back to the graphics family if the device has no dedicated one
+        uint32_t transferFamily(void) const;
+
+        bool hasDedicatedTransfer(void) const {
+            return this->NULL_VAL != this->m_transferFamily;
+        }
+        bool hasDedicatedCompute(void) const {
+            return this->NULL_VAL != this->m_computeFamily;
+        }
 
         void setGraphicsFamily(const uint32_t v) {
             this->m_graphicsFamily = v;
@@ -34,6 +45,12 @@ namespace dal {
         void setPresentFamily(const uint32_t v) {
             this->m_presentFamily = v;
         }
+        void setTransferFamily(const uint32_t v) {
+            this->m_transferFamily = v;
+        }
+        void setComputeFamily(const uint32_t v) {
+            this->m_computeFamily = v;
+        }
 
     };
 
@@ -51,6 +68,10 @@ namespace dal {
 
     uint32_t findMemType(const uint32_t typeFilter, const VkMemoryPropertyFlags props, const VkPhysicalDevice physDevice);
 
+    // For images with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT.
+    // Lazily allocated memory is preferred so tile based GPUs never have to back them. Falls back to device local.
+    uint32_t find_transient_mem_type(const uint32_t typeFilter, const VkPhysicalDevice physDevice);
+
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
         VkBuffer& buffer, VkDeviceMemory& bufferMemory, VkDevice logiDevice, VkPhysicalDevice physDevice);
 
@@ -59,11 +80,21 @@ namespace dal {
         VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
         VkDeviceMemory& imageMemory, VkDevice logiDevice, VkPhysicalDevice physDevice
     );
+    // Allocation size createImage would return for the same arguments, without allocating any memory
+    VkDeviceSize query_image_alloc_size(
+        uint32_t width, uint32_t height, uint32_t mip_level, VkFormat format, VkImageTiling tiling,
+        VkImageUsageFlags usage, VkDevice logiDevice
+    );
 
     VkImageView createImageView(
         const VkImage image, const VkFormat format, const uint32_t mip_level,
         const VkImageAspectFlags aspectFlags, const VkDevice logiDevice
     );
+    // Sees mip_level levels from base_mip
+    VkImageView createImageView(
+        const VkImage image, const VkFormat format, const uint32_t base_mip, const uint32_t mip_level,
+        const VkImageAspectFlags aspectFlags, const VkDevice logiDevice
+    );
 
 
     void assert_vk_success(VkResult result);
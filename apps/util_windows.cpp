@@ -5,6 +5,7 @@
 #include <sstream>
 #include <algorithm>
 #include <iterator>
+#include <utility>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -213,6 +214,76 @@ namespace dal {
 }
 
 
+namespace dal {
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        this->close();
+
+        std::swap(this->m_file, other.m_file);
+        std::swap(this->m_mapping, other.m_mapping);
+        std::swap(this->m_data, other.m_data);
+        std::swap(this->m_size, other.m_size);
+
+        return *this;
+    }
+
+    void MappedFile::open(const std::string& path) {
+        this->close();
+
+        const auto file = ::CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (INVALID_HANDLE_VALUE == file) {
+            throw std::runtime_error(std::string{"failed to open file: "} + path);
+        }
+        this->m_file = file;
+
+        LARGE_INTEGER file_size;
+        if (!::GetFileSizeEx(file, &file_size)) {
+            this->close();
+            throw std::runtime_error(std::string{"failed to get size of file: "} + path);
+        }
+
+        // Empty files can't be mapped
+        if (0 == file_size.QuadPart) {
+            return;
+        }
+
+        this->m_mapping = ::CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (nullptr == this->m_mapping) {
+            this->close();
+            throw std::runtime_error(std::string{"failed to map file: "} + path);
+        }
+
+        this->m_data = reinterpret_cast<const uint8_t*>(::MapViewOfFile(this->m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (nullptr == this->m_data) {
+            this->close();
+            throw std::runtime_error(std::string{"failed to map file: "} + path);
+        }
+        this->m_size = static_cast<size_t>(file_size.QuadPart);
+    }
+
+    void MappedFile::close() {
+        if (nullptr != this->m_data) {
+            ::UnmapViewOfFile(this->m_data);
+            this->m_data = nullptr;
+        }
+        if (nullptr != this->m_mapping) {
+            ::CloseHandle(this->m_mapping);
+            this->m_mapping = nullptr;
+        }
+        if (nullptr != this->m_file) {
+            ::CloseHandle(this->m_file);
+            this->m_file = nullptr;
+        }
+        this->m_size = 0;
+    }
+
+}
+
+
 namespace dal {
 
     dal::ImageData open_image_stb(const char* const image_path) {
@@ -16,10 +16,55 @@ namespace dal {
     std::vector<char> readFile(const std::string& path);
 
 
+    // Read only view of a whole file through memory mapping, so its contents are paged in as they are read
+    // instead of being copied into a buffer first.
+    class MappedFile {
+
+    private:
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        ~MappedFile() {
+            this->close();
+        }
+
+        void open(const std::string& path);
+        void close();
+
+        auto data() const {
+            return this->m_data;
+        }
+        auto size() const {
+            return this->m_size;
+        }
+
+    };
+
+
+    // Texels of one mip level owned by something else, such as ImageData or a mapped file
+    struct ImageDataView {
+        uint32_t width, height;
+        VkFormat format;
+        const uint8_t* data;
+        size_t size;
+    };
+
     struct ImageData {
         uint32_t width, height, channels;
         VkFormat format;
         std::vector<uint8_t> buffer;
+
+        ImageDataView view() const {
+            return ImageDataView{ this->width, this->height, this->format, this->buffer.data(), this->buffer.size() };
+        }
     };
 
     dal::ImageData open_image_stb(const char* const image_path);
@@ -7,17 +7,54 @@
 
 namespace {
 
+    // Copies on the transfer queue. Then the destination is moved to the graphics queue family if it's another one.
+    // Only recorded. Nothing runs until upload_queues submits.
     void copyBuffer(
         VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
-        VkDevice logiDevice, dal::CommandPool& cmdPool, VkQueue graphicsQueue
+        const VkAccessFlags dst_access, const VkPipelineStageFlags dst_stage,
+        VkDevice logiDevice, dal::UploadQueues& upload_queues
     ) {
-        const auto commandBuffer = cmdPool.beginSingleTimeCmd(logiDevice);
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = upload_queues.transfer_family();
+        barrier.dstQueueFamilyIndex = upload_queues.graphics_family();
+        barrier.buffer = dstBuffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
         {
+            const auto commandBuffer = upload_queues.transfer_cmd(logiDevice);
+
             VkBufferCopy copyRegion{};
             copyRegion.size = size;
             vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+            if (upload_queues.needs_ownership_transfer()) {
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                vkCmdPipelineBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                    0, nullptr,
+                    1, &barrier,
+                    0, nullptr
+                );
+            }
+        }
+
+        if (upload_queues.needs_ownership_transfer()) {
+            const auto commandBuffer = upload_queues.graphics_cmd(logiDevice);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = dst_access;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0,
+                0, nullptr,
+                1, &barrier,
+                0, nullptr
+            );
         }
-        cmdPool.endSingleTimeCmd(commandBuffer, logiDevice, graphicsQueue);
     }
 
 }
@@ -62,7 +99,7 @@ namespace dal {
 namespace dal {
 
     void VertexBuffer::init(const std::vector<Vertex>& vertices, const VkDevice logiDevice,
-        const VkPhysicalDevice physDevice, dal::CommandPool& cmdPool, VkQueue graphicsQueue)
+        const VkPhysicalDevice physDevice, dal::UploadQueues& upload_queues)
     {
         VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
@@ -93,11 +130,15 @@ namespace dal {
             physDevice
         );
 
-        ::copyBuffer(stagingBuffer, this->buffer, bufferSize, logiDevice, cmdPool, graphicsQueue);
+        ::copyBuffer(
+            stagingBuffer, this->buffer, bufferSize,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            logiDevice, upload_queues
+        );
         this->vertSize = static_cast<uint32_t>(vertices.size());
 
-        vkDestroyBuffer(logiDevice, stagingBuffer, nullptr);
-        vkFreeMemory(logiDevice, stagingBufferMemory, nullptr);
+        // Copy is not done until the upload batch completes
+        upload_queues.retire_staging_buffer(stagingBuffer, stagingBufferMemory);
     }
 
     void VertexBuffer::destroy(const VkDevice device) {
@@ -116,7 +157,7 @@ namespace dal {
 namespace dal {
 
     void IndexBuffer::init(const std::vector<uint32_t>& indices, const VkDevice logiDevice,
-            const VkPhysicalDevice physDevice, dal::CommandPool& cmdPool, VkQueue graphicsQueue)
+            const VkPhysicalDevice physDevice, dal::UploadQueues& upload_queues)
     {
         VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
@@ -147,11 +188,15 @@ namespace dal {
             physDevice
         );
 
-        ::copyBuffer(stagingBuffer, indexBuffer, bufferSize, logiDevice, cmdPool, graphicsQueue);
+        ::copyBuffer(
+            stagingBuffer, indexBuffer, bufferSize,
+            VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            logiDevice, upload_queues
+        );
         this->arr_size = indices.size();
 
-        vkDestroyBuffer(logiDevice, stagingBuffer, nullptr);
-        vkFreeMemory(logiDevice, stagingBufferMemory, nullptr);
+        // Copy is not done until the upload batch completes
+        upload_queues.retire_staging_buffer(stagingBuffer, stagingBufferMemory);
     }
 
     void IndexBuffer::destroy(const VkDevice device) {
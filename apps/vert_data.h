@@ -32,7 +32,7 @@ namespace dal {
 
     public:
         void init(const std::vector<Vertex>& vertices, const VkDevice logiDevice,
-            const VkPhysicalDevice physDevice, dal::CommandPool& cmdPool, VkQueue graphicsQueue);
+            const VkPhysicalDevice physDevice, dal::UploadQueues& upload_queues);
         void destroy(const VkDevice device);
 
         auto getBuf() const {
@@ -63,7 +63,7 @@ namespace dal {
 
     public:
         void init(const std::vector<uint32_t>& indices, const VkDevice logiDevice,
-            const VkPhysicalDevice physDevice, dal::CommandPool& cmdPool, VkQueue graphicsQueue);
+            const VkPhysicalDevice physDevice, dal::UploadQueues& upload_queues);
         void destroy(const VkDevice device);
 
         auto getBuf() const {
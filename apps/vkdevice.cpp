@@ -6,7 +6,9 @@
 #include <iostream>
 #include <stdexcept>
 
+#include "konst.h"
 #include "util_windows.h"
+#include "util_vulkan.h"
 #include "model_data.h"
 #include "timer.h"
 
@@ -14,6 +16,8 @@
 namespace {
 
     constexpr int HALF_PROJ_BOX_LEN_OF_DLIGHT = 5;
+    constexpr float PROJ_NEAR = 0.1;
+    constexpr float PROJ_FAR = 100;
 
 
     bool isResizeNeeded(const VkResult res) {
@@ -28,10 +32,21 @@ namespace {
         }
     }
 
+    void print_elapsed(const char* const what, const double elapsed_sec, const dal::PipelineCache& pipeline_cache) {
+        std::cout << what << " took " << elapsed_sec * 1000.0 << " ms ";
+
+        if (VK_NULL_HANDLE == pipeline_cache.get()) {
+            std::cout << "(pipeline cache disabled)\n";
+        }
+        else {
+            std::cout << "(pipeline cache loaded " << pipeline_cache.loaded_size() << " bytes)\n";
+        }
+    }
+
     glm::mat4 make_perspective_proj_mat(const VkExtent2D extent) {
         const float ratio = static_cast<double>(extent.width) / static_cast<double>(extent.height);
 
-        auto mat = glm::perspective<float>(glm::radians<float>(45), ratio, 0.1, 100);
+        auto mat = glm::perspective<float>(glm::radians<float>(45), ratio, PROJ_NEAR, PROJ_FAR);
         mat[1][1] *= -1;
         return mat;
     }
@@ -66,26 +81,29 @@ namespace {
 namespace dal {
 
     void VulkanMaster::init(const VkInstance instance, const VkSurfaceKHR surface, const unsigned w, const unsigned h) {
+        dal::Timer startup_timer;
+
         this->m_physDevice.init(instance, surface);
         this->m_logiDevice.init(surface, this->m_physDevice.get());
+        this->m_pipeline_cache.init(dal::getCurrentDir() + "/pipeline_cache.bin", this->m_logiDevice.get(), this->m_physDevice.info());
+        this->m_record_threads.init(dal::decide_record_thread_count());
 
         // Set member variables
         {
-            this->m_currentFrame = 0;
             this->m_scrWidth = w;
             this->m_scrHeight = h;
 
             this->m_scene.m_camera.m_pos = glm::vec3{ 0, 2, 4 };
             auto& scene_node = this->m_scene.m_nodes.emplace_back();
-            scene_node.init(surface, this->m_logiDevice.get(), this->m_physDevice.get());
+            scene_node.init(this->m_record_threads.thread_count(), surface, this->m_logiDevice.get(), this->m_physDevice.get());
 
             // Lights
 
-            //scene_node.m_lights.m_plights.emplace_back().m_color = glm::vec3{ 10 };
-            //scene_node.m_lights.m_plights.emplace_back().m_color = glm::vec4{ 100 };
-            //scene_node.m_lights.m_plights.emplace_back().m_color = glm::vec4{ 30 };
-            //scene_node.m_lights.m_plights.emplace_back().m_color = glm::vec4{ 40 };
-            //scene_node.m_lights.m_plights.emplace_back().m_color = glm::vec4{ 50 };
+            for (int i = 0; i < 128; ++i) {
+                auto& plight = scene_node.lights().add_plight();
+                plight.m_color = glm::vec3{ i % 3 == 0, i % 3 == 1, i % 3 == 2 } * 2.f;
+                plight.m_max_dist = 3;
+            }
 
             {
                 auto& dlight = scene_node.lights().add_dlight();
@@ -112,92 +130,108 @@ namespace dal {
         this->m_swapchainImages.init(this->m_logiDevice.get(), this->m_swapchain.get(), this->m_swapchain.imageFormat(), this->m_swapchain.extent());
         this->m_depth_image.init(this->m_swapchain.extent(), this->m_logiDevice.get(), this->m_physDevice.get());
         this->m_gbuf.init(this->m_logiDevice.get(), this->m_physDevice.get(), this->m_swapchain.extent().width, this->m_swapchain.extent().height);
-        this->m_renderPass.init(this->m_logiDevice.get(), this->make_attachment_format_array());
+        this->m_attachment_formats = this->make_attachment_format_array();
+        this->m_renderPass.init(this->m_logiDevice.get(), this->m_attachment_formats);
         this->m_descSetLayout.init(this->m_logiDevice.get());
         this->m_fbuf.init(this->m_logiDevice.get(), this->m_renderPass.get(), this->m_swapchainImages.getViews(), this->m_swapchain.extent(), this->m_depth_image.image_view(), this->m_gbuf);
-        this->m_pipeline.init(
+        // Pipelines are created on other threads while textures and models load. Joined before the first recording.
+        dal::Timer pipeline_timer;
+        this->m_pipeline.begin_init(
             this->m_logiDevice.get(),
+            this->m_pipeline_cache.get(),
             this->m_renderPass.get(),
             this->m_renderPass.shadow_mapping(),
-            this->m_swapchain.extent(),
             SHADOW_MAP_EXTENT,
-            this->m_descSetLayout.layout_deferred(),
-            this->m_descSetLayout.layout_composition(),
-            this->m_descSetLayout.layout_shadow()
+            this->m_descSetLayout
         );
-        this->m_cmdPool.init(this->m_physDevice.get(), this->m_logiDevice.get(), surface);
-        this->m_tex_man.init(this->m_logiDevice.get(), this->m_physDevice.get());
+        this->m_upload_queues.init(
+            this->m_logiDevice.families().graphicsFamily(),
+            this->m_logiDevice.graphicsQ(),
+            this->m_logiDevice.families().transferFamily(),
+            this->m_logiDevice.transferQ(),
+            this->m_logiDevice.get()
+        );
+        this->m_tex_man.init(this->m_descSetLayout.layout_textures(), this->m_upload_queues, this->m_logiDevice.get(), this->m_physDevice);
 
         this->load_textures();
 
-        this->m_ubuf_per_frame_in_deferred.init(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
-        this->m_ubuf_per_frame_in_composition.init(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
-        this->m_desc_man.init(this->m_swapchainImages.size(), this->m_logiDevice.get());
+        this->m_ubuf_per_frame_in_deferred.init(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
+        this->m_ubuf_per_frame_in_composition.init(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
+        this->m_light_cluster_buffers.init(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
+        this->m_light_volume_args.init(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
+        this->m_light_cluster.rebuild_grid(::make_perspective_proj_mat(this->m_swapchain.extent()), PROJ_NEAR, PROJ_FAR, this->m_swapchain.extent());
+        this->m_desc_man.init(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get());
 
         this->load_models();
 
         for (auto& node : this->m_scene.m_nodes) {
-            node.on_swapchain_count_change(
-                this->m_swapchainImages.size(),
+            node.on_frame_count_change(
+                dal::FRAMES_IN_FLIGHT,
                 this->m_ubuf_per_frame_in_deferred,
-                this->m_tex_man.sampler_1().get(),
-                this->m_descSetLayout.layout_deferred(),
-                this->m_descSetLayout.layout_shadow(),
+                this->m_descSetLayout,
                 this->m_renderPass.shadow_mapping(),
-                this->m_pipeline.pipeline_shadow(),
-                this->m_pipeline.layout_shadow(),
                 this->m_logiDevice.get(),
                 this->m_physDevice.get()
             );
         }
 
-        for (size_t i = 0; i < this->m_swapchainImages.size(); ++i) {
-            this->m_desc_man.addSets_composition(
-                this->m_logiDevice.get(),
-                this->m_swapchainImages.size(),
-                this->m_descSetLayout.layout_composition(),
-                this->m_ubuf_per_frame_in_composition,
-                this->m_gbuf.make_views_vector(this->m_depth_image.image_view()),
-                this->m_scene.m_nodes.back().lights().make_view_list_dlight(dal::MAX_DLIGHT_COUNT),
-                this->m_scene.m_nodes.back().lights().make_view_list_slight(dal::MAX_SLIGHT_COUNT),
-                this->m_tex_man.sampler_shadow_map().get()
-            );
+        this->write_attachment_desc_sets();
+
+        // Textures and models loaded so far. Frames wait for them on GPU.
+        this->m_upload_queues.submit(this->m_logiDevice.get());
+
+        this->m_cmdBuffers.init(this->m_logiDevice.get(), dal::FRAMES_IN_FLIGHT, dal::findQueueFamilies(this->m_physDevice.get(), surface).graphicsFamily(), this->m_record_threads.thread_count());
+        this->m_frame_sched.init(this->m_logiDevice.get(), dal::FRAMES_IN_FLIGHT);
+
+        {
+            dal::Timer join_timer;
+            this->m_pipeline.wait();
+            ::print_elapsed("waiting for pipelines", join_timer.getElapsed(), this->m_pipeline_cache);
+            ::print_elapsed("pipeline creation overlapped with asset loading", pipeline_timer.getElapsed(), this->m_pipeline_cache);
         }
 
-        this->m_cmdBuffers.init(this->m_logiDevice.get(), this->m_fbuf.getList().size(), this->m_cmdPool.pool());
-        this->m_syncMas.init(this->m_logiDevice.get(), this->m_swapchainImages.size());
+        // Pairing of frames and swapchain images is only a guess here. A frame records again if it gets another image.
+        for (uint32_t i = 0; i < dal::FRAMES_IN_FLIGHT; ++i) {
+            this->record_cmd_bufs_at(i, i % this->m_swapchainImages.size());
+        }
 
-        this->m_cmdBuffers.record(
-            this->m_renderPass.get(),
-            this->m_pipeline.pipeline_deferred(),
-            this->m_pipeline.pipeline_composition(),
-            this->m_pipeline.layout_deferred(),
-            this->m_pipeline.layout_composition(),
-            this->m_swapchain.extent(),
-            this->m_fbuf.getList(),
-            this->m_desc_man.descset_composition(),
-            this->m_scene.m_nodes.back().models()
-        );
+        ::print_elapsed("renderer startup", startup_timer.getElapsed(), this->m_pipeline_cache);
 
-        // For shadow maps transition
-        this->submit_render_to_shadow_maps(0);
-        this->submit_render_to_shadow_maps(1);
-        this->submit_render_to_shadow_maps(2);
-        this->waitLogiDeviceIdle();
+        // Report how much sorting by keys saved
+        {
+            auto& scene_node = this->m_scene.m_nodes.back();
+            const auto unsorted = dal::count_unsorted_binds(scene_node.models(), DrawPass::gbuffer, this->m_record_threads.thread_count());
+            dal::print_bind_stats("G-buffer pass", unsorted, this->m_cmdBuffers.bind_stats());
+
+            BindStats unsorted_shadow;
+            const auto unsorted_per_shadow_map = dal::count_unsorted_binds(scene_node.models(), DrawPass::shadow, this->m_record_threads.thread_count());
+            const auto shadow_map_count = scene_node.lights().dlights().size() + scene_node.lights().slights().size();
+            for (size_t i = 0; i < shadow_map_count; ++i) {
+                unsorted_shadow += unsorted_per_shadow_map;
+            }
+            dal::print_bind_stats("shadow passes", unsorted_shadow, scene_node.shadow_bind_stats());
+
+            auto& desc_sets = scene_node.desc_set_cache();
+            std::cout << "textures still streaming at first frame: " << this->m_tex_man.streaming_count() << ", " << this->m_tex_man.resident_size() << " bytes resident\n";
+            std::cout << "descriptor sets of scene: " << desc_sets.set_count() << " written, " << desc_sets.hit_count() << " shared, " << desc_sets.pool_count() << " pools\n";
+        }
     }
 
     void VulkanMaster::destroy(void) {
         this->m_scene.destroy(this->m_logiDevice.get());
 
-        this->m_syncMas.destroy(this->m_logiDevice.get());
-        //this->m_cmdBuffers.destroy(this->m_logiDevice.get(), this->m_cmdPool.pool());
+        this->m_frame_sched.destroy(this->m_logiDevice.get());
+        this->m_cmdBuffers.destroy(this->m_logiDevice.get());
         this->m_desc_man.destroy(this->m_logiDevice.get());
+        this->m_light_cluster_buffers.destroy(this->m_logiDevice.get());
+        this->m_light_volume_args.destroy(this->m_logiDevice.get());
         this->m_ubuf_per_frame_in_composition.destroy(this->m_logiDevice.get());
         this->m_ubuf_per_frame_in_deferred.destroy(this->m_logiDevice.get());
         this->m_tex_man.destroy(this->m_logiDevice.get());
 
-        this->m_cmdPool.destroy(this->m_logiDevice.get());
+        this->m_upload_queues.destroy(this->m_logiDevice.get());
         this->m_pipeline.destroy(this->m_logiDevice.get());
+        this->m_pipeline_cache.destroy(this->m_logiDevice.get());
         this->m_fbuf.destroy(this->m_logiDevice.get());
         this->m_descSetLayout.destroy(this->m_logiDevice.get());
         this->m_renderPass.destroy(this->m_logiDevice.get());
@@ -206,61 +240,105 @@ namespace dal {
         this->m_swapchainImages.destroy(this->m_logiDevice.get());
         this->m_swapchain.destroy(this->m_logiDevice.get());
         this->m_logiDevice.destroy();
+        this->m_record_threads.destroy();
     }
 
     void VulkanMaster::render(const VkSurfaceKHR surface) {
-        auto& currentFence = this->m_syncMas.fenceInFlight(this->m_currentFrame);
-        currentFence.wait(this->m_logiDevice.get());
+        // Waits until GPU is done with the frame which used the same per-frame resources
+        this->m_frame_sched.begin_frame(this->m_logiDevice.get());
 
-        const auto imageIndex = this->m_syncMas.acquireGetNextImgIndex(this->m_currentFrame, this->m_logiDevice.get(), this->m_swapchain.get());
+        const auto imageIndex = this->m_frame_sched.acquireGetNextImgIndex(this->m_logiDevice.get(), this->m_swapchain.get());
         if (this->m_needResize || ::isResizeNeeded(imageIndex.second)) {
             this->recreateSwapChain(surface);
             this->m_needResize = false;
             return;
         }
-        else {
-            auto& imagesInFlight = this->m_syncMas.fencesImageInFlight();
-            // Check if a previous frame is using this image (i.e. there is its fence to wait on)
-            if ( imagesInFlight[imageIndex.first] != VK_NULL_HANDLE ) {
-                vkWaitForFences(this->m_logiDevice.get(), 1, &imagesInFlight[imageIndex.first], VK_TRUE, UINT64_MAX);
-            }
-            // Mark the image as now being in use by this frame
-            imagesInFlight[imageIndex.first] = this->m_syncMas.fenceInFlight(this->m_currentFrame).get();
-        }
-
-        // Update uniform buffers
-        this->udpate_uniform_buffers(imageIndex.first);
-
-        // Draw shadow map
-        this->submit_render_to_shadow_maps(imageIndex.first);
-        this->waitLogiDeviceIdle();
-
-        VkSubmitInfo submitInfo = {};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        const std::array<VkSemaphore, 1> waitSemaphores = { this->m_syncMas.semaphImageAvailable(this->m_currentFrame).get() };
-        const std::array<VkPipelineStageFlags, 1> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submitInfo.waitSemaphoreCount = waitSemaphores.size();
-        submitInfo.pWaitSemaphores = waitSemaphores.data();
-        submitInfo.pWaitDstStageMask = waitStages.data();
 
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &this->m_cmdBuffers.buffers()[imageIndex.first];
+        const auto frame_index = this->m_frame_sched.frame_index();
 
-        const std::array<VkSemaphore, 1> signalSemaphores = { this->m_syncMas.semaphRenderFinished(this->m_currentFrame).get() };
-        submitInfo.signalSemaphoreCount = signalSemaphores.size();
-        submitInfo.pSignalSemaphores = signalSemaphores.data();
+        // Materials get new texture table indices here, so before uniform buffers
+        this->m_tex_man.update_streaming(
+            this->m_frame_sched.frame_value(),
+            this->m_frame_sched.timeline().value(this->m_logiDevice.get()),
+            dal::TEXTURE_UPLOAD_BUDGET_PER_FRAME,
+            this->m_upload_queues,
+            this->m_logiDevice.get(),
+            this->m_physDevice
+        );
+        this->m_tex_man.update_residency(dal::TEXTURE_VRAM_BUDGET, this->m_upload_queues, this->m_logiDevice.get(), this->m_physDevice);
+        // Goes to GPU ahead of the frame, which waits for it below
+        this->m_upload_queues.submit(this->m_logiDevice.get());
 
-        currentFence.reset(this->m_logiDevice.get());
-        const auto submitRes = vkQueueSubmit(this->m_logiDevice.graphicsQ(), 1, &submitInfo, currentFence.get());
+        // Update uniform buffers
+        this->udpate_uniform_buffers(frame_index);
+
+        // Command buffers of this frame are no longer in use after begin_frame
+        this->record_cmd_bufs_at(frame_index, imageIndex.first);
+
+        // Shadow maps and the frame go in one submission, chained by a semaphore instead of CPU waiting for device idle.
+        // The frame value signaled on the timeline at the end covers both batches.
+        // Both batches also wait for uploads, which vertex input and texture sampling read.
+        const auto shadow_cmd_bufs = this->make_shadow_cmd_buf_list(frame_index);
+        const std::array<VkSemaphore, 1> shadowSemaphores = { this->m_frame_sched.semaphShadowFinished().get() };
+        const auto uploadSemaphore = this->m_upload_queues.timeline().get();
+        const auto uploadValue = this->m_upload_queues.last_value();
+        const VkPipelineStageFlags shadowWaitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+
+        const std::array<VkSemaphore, 3> waitSemaphores = { this->m_frame_sched.semaphImageAvailable().get(), shadowSemaphores[0], uploadSemaphore };
+        const std::array<VkPipelineStageFlags, 3> waitStages = {
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        };
+        const std::array<uint64_t, 3> waitValues = { 0, 0, uploadValue };
+        const std::array<VkSemaphore, 2> signalSemaphores = { this->m_frame_sched.semaphRenderFinished().get(), this->m_frame_sched.timeline().get() };
+        const std::array<uint64_t, 2> signalValues = { 0, this->m_frame_sched.frame_value() };  // Value of a binary semaphore is ignored
+
+        VkTimelineSemaphoreSubmitInfo shadowTimelineInfo{};
+        shadowTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        shadowTimelineInfo.waitSemaphoreValueCount = 1;
+        shadowTimelineInfo.pWaitSemaphoreValues = &uploadValue;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = waitValues.size();
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = signalValues.size();
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+        std::array<VkSubmitInfo, 2> submitInfos{};
+
+        submitInfos[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfos[0].pNext = &shadowTimelineInfo;
+        submitInfos[0].waitSemaphoreCount = 1;
+        submitInfos[0].pWaitSemaphores = &uploadSemaphore;
+        submitInfos[0].pWaitDstStageMask = &shadowWaitStage;
+        submitInfos[0].commandBufferCount = shadow_cmd_bufs.size();
+        submitInfos[0].pCommandBuffers = shadow_cmd_bufs.data();
+        submitInfos[0].signalSemaphoreCount = shadowSemaphores.size();
+        submitInfos[0].pSignalSemaphores = shadowSemaphores.data();
+
+        submitInfos[1].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfos[1].pNext = &timelineInfo;
+        submitInfos[1].waitSemaphoreCount = waitSemaphores.size();
+        submitInfos[1].pWaitSemaphores = waitSemaphores.data();
+        submitInfos[1].pWaitDstStageMask = waitStages.data();
+        submitInfos[1].commandBufferCount = 1;
+        submitInfos[1].pCommandBuffers = &this->m_cmdBuffers.buffers()[frame_index];
+        submitInfos[1].signalSemaphoreCount = signalSemaphores.size();
+        submitInfos[1].pSignalSemaphores = signalSemaphores.data();
+
+        const auto submitRes = vkQueueSubmit(this->m_logiDevice.graphicsQ(), submitInfos.size(), submitInfos.data(), VK_NULL_HANDLE);
         if ( submitRes != VK_SUCCESS ) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        this->m_frame_sched.end_frame();
 
         VkPresentInfoKHR presentInfo = {};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = signalSemaphores.size();
-        presentInfo.pWaitSemaphores = signalSemaphores.data();
+        // Presentation can't wait on a timeline semaphore
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &signalSemaphores[0];
         std::array<VkSwapchainKHR, 1> swapChains = { this->m_swapchain.get() };
         presentInfo.swapchainCount = swapChains.size();
         presentInfo.pSwapchains = swapChains.data();
@@ -273,8 +351,6 @@ namespace dal {
         // A comment said It's only needed when validation layer is enabled.
         // Check out the comment section in https://vulkan-tutorial.com/en/Drawing_a_triangle/Drawing/Rendering_and_presentation
         //vkQueueWaitIdle(this->m_logiDevice.presentQ());
-
-        this->m_currentFrame = (this->m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
     void VulkanMaster::waitLogiDeviceIdle(void) const {
@@ -283,16 +359,12 @@ namespace dal {
 
     void VulkanMaster::recreateSwapChain(const VkSurfaceKHR surface) {
         this->waitLogiDeviceIdle();
+        dal::Timer recreate_timer;
 
+        // Only what depends on the extent is rebuilt. Pipelines take viewport and scissor as dynamic states,
+        // and per-frame buffers and descriptor sets are sized by frames in flight, not by swapchain image count.
         {
-            this->m_syncMas.destroy(this->m_logiDevice.get());
-            this->m_cmdBuffers.destroy(this->m_logiDevice.get(), this->m_cmdPool.pool());
-            this->m_desc_man.destroy(this->m_logiDevice.get());
-            this->m_ubuf_per_frame_in_composition.destroy(this->m_logiDevice.get());
-            this->m_ubuf_per_frame_in_deferred.destroy(this->m_logiDevice.get());
-            this->m_pipeline.destroy(this->m_logiDevice.get());
             this->m_fbuf.destroy(this->m_logiDevice.get());
-            this->m_renderPass.destroy(this->m_logiDevice.get());
             this->m_gbuf.destroy(this->m_logiDevice.get());
             this->m_depth_image.destroy(this->m_logiDevice.get());
             this->m_swapchainImages.destroy(this->m_logiDevice.get());
@@ -304,131 +376,53 @@ namespace dal {
             this->m_swapchainImages.init(this->m_logiDevice.get(), this->m_swapchain.get(), this->m_swapchain.imageFormat(), this->m_swapchain.extent());
             this->m_depth_image.init(this->m_swapchain.extent(), this->m_logiDevice.get(), this->m_physDevice.get());
             this->m_gbuf.init(this->m_logiDevice.get(), this->m_physDevice.get(), this->m_swapchain.extent().width, this->m_swapchain.extent().height);
-            this->m_renderPass.init(this->m_logiDevice.get(), this->make_attachment_format_array());
-            this->m_fbuf.init(this->m_logiDevice.get(), this->m_renderPass.get(), this->m_swapchainImages.getViews(), this->m_swapchain.extent(), this->m_depth_image.image_view(), this->m_gbuf);
-            this->m_pipeline.init(
-                this->m_logiDevice.get(),
-                this->m_renderPass.get(),
-                this->m_renderPass.shadow_mapping(),
-                this->m_swapchain.extent(),
-                dal::SHADOW_MAP_EXTENT,
-                this->m_descSetLayout.layout_deferred(),
-                this->m_descSetLayout.layout_composition(),
-                this->m_descSetLayout.layout_shadow()
-            );
-            this->m_ubuf_per_frame_in_deferred.init(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
-            this->m_ubuf_per_frame_in_composition.init(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
-            this->m_desc_man.init(this->m_swapchainImages.size(), this->m_logiDevice.get());
-
-            for (auto& node : this->m_scene.m_nodes) {
-                node.on_swapchain_count_change(
-                    this->m_swapchainImages.size(),
-                    this->m_ubuf_per_frame_in_deferred,
-                    this->m_tex_man.sampler_1().get(),
-                    this->m_descSetLayout.layout_deferred(),
-                    this->m_descSetLayout.layout_shadow(),
-                    this->m_renderPass.shadow_mapping(),
-                    this->m_pipeline.pipeline_shadow(),
-                    this->m_pipeline.layout_shadow(),
-                    this->m_logiDevice.get(),
-                    this->m_physDevice.get()
-                );
-            }
 
-            for (size_t i = 0; i < this->m_swapchainImages.size(); ++i) {
-                this->m_desc_man.addSets_composition(
+            // Render pass and pipelines only depend on attachment formats, which hardly ever change on resize
+            const auto attachment_formats = this->make_attachment_format_array();
+            if (attachment_formats != this->m_attachment_formats) {
+                this->m_pipeline.destroy(this->m_logiDevice.get());
+                this->m_renderPass.destroy(this->m_logiDevice.get());
+
+                this->m_attachment_formats = attachment_formats;
+                this->m_renderPass.init(this->m_logiDevice.get(), this->m_attachment_formats);
+                this->m_pipeline.init(
                     this->m_logiDevice.get(),
-                    this->m_swapchainImages.size(),
-                    this->m_descSetLayout.layout_composition(),
-                    this->m_ubuf_per_frame_in_composition,
-                    this->m_gbuf.make_views_vector(this->m_depth_image.image_view()),
-                    this->m_scene.m_nodes.back().lights().make_view_list_dlight(3),
-                    this->m_scene.m_nodes.back().lights().make_view_list_slight(5),
-                    this->m_tex_man.sampler_shadow_map().get()
+                    this->m_pipeline_cache.get(),
+                    this->m_renderPass.get(),
+                    this->m_renderPass.shadow_mapping(),
+                    dal::SHADOW_MAP_EXTENT,
+                    this->m_descSetLayout
                 );
+
+                // Shadow map command buffers refer to the pipelines
+                this->m_scene.m_nodes.back().mark_dirty();
             }
 
-            this->m_cmdBuffers.init(this->m_logiDevice.get(), this->m_fbuf.getList().size(), this->m_cmdPool.pool());
-            this->m_syncMas.init(this->m_logiDevice.get(), this->m_swapchainImages.size());
+            this->m_fbuf.init(this->m_logiDevice.get(), this->m_renderPass.get(), this->m_swapchainImages.getViews(), this->m_swapchain.extent(), this->m_depth_image.image_view(), this->m_gbuf);
+            this->m_light_cluster.rebuild_grid(::make_perspective_proj_mat(this->m_swapchain.extent()), PROJ_NEAR, PROJ_FAR, this->m_swapchain.extent());
+
+            // G-buffer views are new
+            this->m_desc_man.reset(this->m_logiDevice.get());
+            this->write_attachment_desc_sets();
         }
 
-        this->m_cmdBuffers.record(
-            this->m_renderPass.get(),
-            this->m_pipeline.pipeline_deferred(),
-            this->m_pipeline.pipeline_composition(),
-            this->m_pipeline.layout_deferred(),
-            this->m_pipeline.layout_composition(),
-            this->m_swapchain.extent(),
-            this->m_fbuf.getList(),
-            this->m_desc_man.descset_composition(),
-            this->m_scene.m_nodes.back().models()
-        );
-    }
+        this->m_frame_sched.reset_image_available(this->m_logiDevice.get());
+        this->m_cmdBuffers.invalidate();
 
-    void VulkanMaster::load_textures() {
-        // grass1
-        {
-            if (this->m_physDevice.does_support_astc()) {
-                this->m_tex_grass = this->m_tex_man.request_texture_astc(
-                    "grass1.astc",
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
-            }
-            else {
-                this->m_tex_grass = this->m_tex_man.request_texture(
-                    "grass1.png",
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
-            }
+        // Pairing of frames and swapchain images is only a guess here. A frame records again if it gets another image.
+        for (uint32_t i = 0; i < dal::FRAMES_IN_FLIGHT; ++i) {
+            this->record_cmd_bufs_at(i, i % this->m_swapchainImages.size());
         }
 
-        // 0021di
-        {
-            if (this->m_physDevice.does_support_astc()) {
-                const std::vector<std::string> image_names{
-                    "0021di_512.astc",
-                    "0021di_256.astc",
-                    "0021di_128.astc",
-                    "0021di_64.astc",
-                    "0021di_32.astc",
-                    "0021di_16.astc",
-                    "0021di_8.astc",
-                };
+        ::print_elapsed("swapchain recreation", recreate_timer.getElapsed(), this->m_pipeline_cache);
+    }
 
-                this->m_tex_tile = this->m_tex_man.request_texture_with_mipmaps_astc(
-                    image_names,
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
-            }
-            else {
-                const std::vector<std::string> image_names{
-                    "0021di_512.png",
-                    "0021di_256.png",
-                    "0021di_128.png",
-                    "0021di_64.png",
-                    "0021di_32.png",
-                    "0021di_16.png",
-                    "0021di_8.png",
-                };
+    void VulkanMaster::load_textures() {
+        // Devices without ASTC get these transcoded by TextureManager
+        this->m_tex_grass = this->m_tex_man.request_texture_async({ "grass1.astc" });
 
-                this->m_tex_tile = this->m_tex_man.request_texture_with_mipmaps(
-                    image_names,
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
-            }
-        }
+        // Every mip level in one file, packed by script/pack_textures.py
+        this->m_tex_tile = this->m_tex_man.request_texture_async({ "0021di.ktx2" });
     }
 
     void VulkanMaster::load_models() {
@@ -438,28 +432,22 @@ namespace dal {
         {
             const auto mdoel_data = dal::get_horizontal_plane(500, 500);
             auto& model = node.add_model();
-            model.init(this->m_logiDevice.get());
 
-            auto& inst = model.add_instance(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
+            auto& inst = model.add_instance(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
 
             auto& unit = model.add_unit();
             unit.set_mesh(
                 mdoel_data.m_vertices,
                 mdoel_data.m_indices,
-                this->m_cmdPool,
+                this->m_upload_queues,
                 this->m_logiDevice.get(),
-                this->m_physDevice.get(),
-                this->m_logiDevice.graphicsQ()
+                this->m_physDevice.get()
             );
 
             unit.m_material.m_material_data.m_roughness = mdoel_data.m_material.m_roughness;
             unit.m_material.m_material_data.m_metallic = mdoel_data.m_material.m_metallic;
 
-            unit.m_material.set_material(
-                this->m_tex_grass->view.get(),
-                this->m_logiDevice.get(),
-                this->m_physDevice.get()
-            );
+            unit.m_material.set_albedo_map(this->m_tex_grass);
         }
 
         // Box
@@ -467,9 +455,8 @@ namespace dal {
             const auto model_data = dal::get_aabb_box();
 
             auto& model = node.add_model();
-            model.init(this->m_logiDevice.get());
 
-            auto& inst = model.add_instance(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
+            auto& inst = model.add_instance(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
             inst.transform().m_pos.x = 2;
             inst.update_ubuf(this->m_logiDevice.get());
 
@@ -477,29 +464,23 @@ namespace dal {
             unit.set_mesh(
                 model_data.m_vertices,
                 model_data.m_indices,
-                this->m_cmdPool,
+                this->m_upload_queues,
                 this->m_logiDevice.get(),
-                this->m_physDevice.get(),
-                this->m_logiDevice.graphicsQ()
+                this->m_physDevice.get()
             );
 
             unit.m_material.m_material_data.m_roughness = model_data.m_material.m_roughness;
             unit.m_material.m_material_data.m_metallic = model_data.m_material.m_metallic;
 
-            unit.m_material.set_material(
-                this->m_tex_tile->view.get(),
-                this->m_logiDevice.get(),
-                this->m_physDevice.get()
-            );
+            unit.m_material.set_albedo_map(this->m_tex_tile);
         }
 
         // Sphere
         {
             auto& model = node.add_model();
-            model.init(this->m_logiDevice.get());
 
             for (int i = 0; i < 8; ++i) {
-                auto& inst = model.add_instance(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
+                auto& inst = model.add_instance(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
                 inst.transform().m_scale = 0.3;
                 inst.update_ubuf(this->m_logiDevice.get());
             }
@@ -510,37 +491,25 @@ namespace dal {
                 unit.set_mesh(
                     model_data.m_vertices,
                     model_data.m_indices,
-                    this->m_cmdPool,
+                    this->m_upload_queues,
                     this->m_logiDevice.get(),
-                    this->m_physDevice.get(),
-                    this->m_logiDevice.graphicsQ()
+                    this->m_physDevice.get()
                 );
 
-                const auto& tex = this->m_tex_man.request_texture(
-                    model_data.m_material.m_albedo_map.c_str(),
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
+                const auto& tex = this->m_tex_man.request_texture_async({ model_data.m_material.m_albedo_map });
 
                 unit.m_material.m_material_data.m_roughness = model_data.m_material.m_roughness;
                 unit.m_material.m_material_data.m_metallic = model_data.m_material.m_metallic;
 
-                unit.m_material.set_material(
-                    tex->view.get(),
-                    this->m_logiDevice.get(),
-                    this->m_physDevice.get()
-                );
+                unit.m_material.set_albedo_map(tex);
             }
         }
 
         // Monkey
         {
             auto& model = node.add_model();
-            model.init(this->m_logiDevice.get());
 
-            auto& inst = model.add_instance(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
+            auto& inst = model.add_instance(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
             inst.transform().m_scale = 1;
             inst.transform().m_pos = glm::vec3{ -0, 0.5, 0 };
             inst.update_ubuf(this->m_logiDevice.get());
@@ -551,37 +520,25 @@ namespace dal {
                 unit.set_mesh(
                     model_data.m_vertices,
                     model_data.m_indices,
-                    this->m_cmdPool,
+                    this->m_upload_queues,
                     this->m_logiDevice.get(),
-                    this->m_physDevice.get(),
-                    this->m_logiDevice.graphicsQ()
+                    this->m_physDevice.get()
                 );
 
-                const auto& tex = this->m_tex_man.request_texture(
-                    model_data.m_material.m_albedo_map.c_str(),
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
+                const auto& tex = this->m_tex_man.request_texture_async({ model_data.m_material.m_albedo_map });
 
                 unit.m_material.m_material_data.m_roughness = model_data.m_material.m_roughness;
                 unit.m_material.m_material_data.m_metallic = model_data.m_material.m_metallic;
 
-                unit.m_material.set_material(
-                    tex->view.get(),
-                    this->m_logiDevice.get(),
-                    this->m_physDevice.get()
-                );
+                unit.m_material.set_albedo_map(tex);
             }
         }
 
         // Honoka
         {
             auto& model = node.add_model();
-            model.init(this->m_logiDevice.get());
 
-            auto& inst = model.add_instance(this->m_swapchainImages.size(), this->m_logiDevice.get(), this->m_physDevice.get());
+            auto& inst = model.add_instance(dal::FRAMES_IN_FLIGHT, this->m_logiDevice.get(), this->m_physDevice.get());
             inst.transform().m_scale = 0.5;
             inst.transform().m_pos = glm::vec3{ -1.5, 0, 0 };
             inst.update_ubuf(this->m_logiDevice.get());
@@ -592,28 +549,17 @@ namespace dal {
                 unit.set_mesh(
                     model_data.m_vertices,
                     model_data.m_indices,
-                    this->m_cmdPool,
+                    this->m_upload_queues,
                     this->m_logiDevice.get(),
-                    this->m_physDevice.get(),
-                    this->m_logiDevice.graphicsQ()
+                    this->m_physDevice.get()
                 );
 
-                const auto& tex = this->m_tex_man.request_texture(
-                    model_data.m_material.m_albedo_map.c_str(),
-                    this->m_cmdPool,
-                    this->m_logiDevice.get(),
-                    this->m_physDevice,
-                    this->m_logiDevice.graphicsQ()
-                );
+                const auto& tex = this->m_tex_man.request_texture_async({ model_data.m_material.m_albedo_map });
 
                 unit.m_material.m_material_data.m_roughness = model_data.m_material.m_roughness;
                 unit.m_material.m_material_data.m_metallic = model_data.m_material.m_metallic;
 
-                unit.m_material.set_material(
-                    tex->view.get(),
-                    this->m_logiDevice.get(),
-                    this->m_physDevice.get()
-                );
+                unit.m_material.set_albedo_map(tex);
             }
         }
     }
@@ -624,45 +570,77 @@ namespace dal {
         this->m_scrHeight = h;
     }
 
-    void VulkanMaster::submit_render_to_shadow_maps(const uint32_t swapchain_index) {
-        VkPipelineStageFlags shadow_map_wait_stages = 0;
-        VkSubmitInfo submit_info{ };
-        submit_info.pNext = NULL;
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.waitSemaphoreCount = 0;
-        submit_info.pWaitSemaphores = NULL;
-        submit_info.signalSemaphoreCount = 0;
-        submit_info.pSignalSemaphores = nullptr;
-        submit_info.pWaitDstStageMask = 0;
-        submit_info.commandBufferCount = 1;
+    void VulkanMaster::write_attachment_desc_sets() {
+        this->m_desc_man.addSets_composition(
+            this->m_logiDevice.get(),
+            dal::FRAMES_IN_FLIGHT,
+            this->m_descSetLayout,
+            this->m_ubuf_per_frame_in_composition,
+            this->m_gbuf.make_views_vector(this->m_depth_image.image_view()),
+            this->m_scene.m_nodes.back().lights().make_view_list_dlight(dal::MAX_DLIGHT_COUNT),
+            this->m_scene.m_nodes.back().lights().make_view_list_slight(dal::MAX_SLIGHT_SHADOW_COUNT),
+            this->m_tex_man.sampler_shadow_map().get(),
+            this->m_light_cluster_buffers.buffer_list()
+        );
 
-        for (auto& dlight : this->m_scene.m_nodes.back().lights().dlights()) {
-            submit_info.pCommandBuffers = &dlight.cmd_buf_at(swapchain_index);
+        this->m_desc_man.addSets_tonemap(this->m_logiDevice.get(), dal::FRAMES_IN_FLIGHT, this->m_descSetLayout, this->m_gbuf.lighting_view());
+    }
 
-            const auto submit_result = vkQueueSubmit(this->m_logiDevice.graphicsQ(), 1, &submit_info, nullptr);
-            if ( submit_result != VK_SUCCESS ) {
-                throw std::runtime_error("failed to submit draw command buffer!");
-            }
-        }
+    void VulkanMaster::record_cmd_bufs_at(const uint32_t frame_index, const uint32_t swapchain_index) {
+        auto& scene_node = this->m_scene.m_nodes.back();
 
-        for (auto& slight : this->m_scene.m_nodes.back().lights().slights()) {
-            submit_info.pCommandBuffers = &slight.cmd_buf_at(swapchain_index);
+        scene_node.record_shadow_cmd_bufs_at(
+            frame_index,
+            this->m_renderPass.shadow_mapping(),
+            this->m_pipeline.pipeline_shadow(),
+            this->m_pipeline.layout_shadow(),
+            this->m_record_threads,
+            this->m_logiDevice.get()
+        );
 
-            const auto submit_result = vkQueueSubmit(this->m_logiDevice.graphicsQ(), 1, &submit_info, nullptr);
-            if ( submit_result != VK_SUCCESS ) {
-                throw std::runtime_error("failed to submit draw command buffer!");
-            }
+        this->m_cmdBuffers.record_at(
+            frame_index,
+            swapchain_index,
+            scene_node.revision(),
+            this->m_renderPass.get(),
+            this->m_pipeline,
+            this->m_swapchain.extent(),
+            this->m_fbuf.getList(),
+            this->m_desc_man.descset_composition(),
+            this->m_desc_man.descset_tonemap(),
+            this->m_light_volume_args,
+            scene_node.models(),
+            scene_node.desc_set_per_frame_at(frame_index),
+            this->m_tex_man.texture_table().desc_set(),
+            this->m_scene.m_camera.m_pos,
+            this->m_record_threads,
+            this->m_logiDevice.get()
+        );
+    }
+
+    std::vector<VkCommandBuffer> VulkanMaster::make_shadow_cmd_buf_list(const uint32_t frame_index) const {
+        std::vector<VkCommandBuffer> result;
+
+        for (auto& dlight : this->m_scene.m_nodes.back().lights().dlights()) {
+            result.push_back(dlight.cmd_buf_at(frame_index));
+        }
+        for (auto& slight : this->m_scene.m_nodes.back().lights().slights()) {
+            result.push_back(slight.cmd_buf_at(frame_index));
         }
+
+        return result;
     }
 
-    void VulkanMaster::udpate_uniform_buffers(const uint32_t swapchain_index) {
+    void VulkanMaster::udpate_uniform_buffers(const uint32_t frame_index) {
+        this->m_scene.m_nodes.back().update_materials_at(frame_index, this->camera().m_pos, this->m_tex_man.update_count());
+
         {
             U_PerFrame_InDeferred data_per_frame_in_deferred;
             data_per_frame_in_deferred.proj = ::make_perspective_proj_mat(this->m_swapchain.extent());
             data_per_frame_in_deferred.view = this->camera().make_view_mat();
 
             this->m_ubuf_per_frame_in_deferred.copy_to_buffer(
-                swapchain_index,
+                frame_index,
                 data_per_frame_in_deferred,
                 this->m_logiDevice.get()
             );
@@ -670,14 +648,18 @@ namespace dal {
 
         {
             constexpr double RADIUS = 5;
+            constexpr double RING_SPACING = 1.5;
+            constexpr size_t RING_COUNT = 4;
 
             const auto plight_count = this->m_scene.m_nodes.back().lights().plight_count();
+            const auto plight_per_ring = (plight_count + RING_COUNT - 1) / RING_COUNT;
             for (size_t i = 0; i < plight_count; ++i) {
-                const auto rotate_phase_diff = 2.0 * M_PI / static_cast<double>(plight_count);
+                const auto rotate_phase_diff = 2.0 * M_PI / static_cast<double>(plight_per_ring);
+                const auto radius = RADIUS + RING_SPACING * (i % RING_COUNT);
                 this->m_scene.m_nodes.back().lights().plight_at(i).m_pos = glm::vec4{
-                    RADIUS * std::cos(dal::getTimeInSec() + rotate_phase_diff * i),
-                    4,
-                    RADIUS * std::sin(dal::getTimeInSec() + rotate_phase_diff * i),
+                    radius * std::cos(dal::getTimeInSec() + rotate_phase_diff * (i / RING_COUNT)),
+                    0.5,
+                    radius * std::sin(dal::getTimeInSec() + rotate_phase_diff * (i / RING_COUNT)),
                     1
                 };
             }
@@ -699,7 +681,7 @@ namespace dal {
                 inst.transform().m_pos.y +=    0.5 * std::sin(SPEED * dal::getTimeInSec() + phase_per_one * i);
                 inst.transform().m_pos.z += RADIUS * std::sin(SPEED * dal::getTimeInSec() + phase_per_one * i + M_PI);
 
-                inst.update_ubuf(swapchain_index, this->m_logiDevice.get());
+                inst.update_ubuf(frame_index, this->m_logiDevice.get());
             }
 
         }
@@ -713,7 +695,7 @@ namespace dal {
                 std::sin(SPEED * dal::getTimeInSec()),
                 -0.3,
             });
-            sun_light.update_ubuf_at(swapchain_index, this->m_logiDevice.get());
+            sun_light.update_ubuf_at(frame_index, this->m_logiDevice.get());
 
             auto& moon_light = this->m_scene.m_nodes.back().lights().dlights().at(1);
             moon_light.m_direc = glm::vec3(glm::vec3{
@@ -721,7 +703,7 @@ namespace dal {
                 std::sin(SPEED * dal::getTimeInSec() + M_PI),
                 -0.3,
             });
-            moon_light.update_ubuf_at(swapchain_index, this->m_logiDevice.get());
+            moon_light.update_ubuf_at(frame_index, this->m_logiDevice.get());
         }
 
         {
@@ -732,13 +714,30 @@ namespace dal {
                 std::cos(SPEED * dal::getTimeInSec()),
                 1
             });
-            this->m_scene.m_nodes.back().lights().slight_at(0).update_ubuf_at(swapchain_index, this->m_logiDevice.get());
+            this->m_scene.m_nodes.back().lights().slight_at(0).update_ubuf_at(frame_index, this->m_logiDevice.get());
         }
 
+        const auto view_mat = this->camera().make_view_mat();
+        this->m_light_cluster.assign_lights(
+            view_mat,
+            this->m_scene.m_nodes.back().lights(),
+            this->m_light_cluster_buffers.plight_capacity(),
+            this->m_light_cluster_buffers.slight_capacity()
+        );
+        this->m_light_cluster_buffers.copy_to_buffer(frame_index, this->m_light_cluster);
+        this->m_light_volume_args.update(frame_index, this->m_light_cluster.plights().size(), this->m_light_cluster.slights().size());
+
+        const auto extent = this->m_swapchain.extent();
+
         U_PerFrame_InComposition data;
+        data.m_view_mat = view_mat;
+        data.m_view_proj = ::make_perspective_proj_mat(extent) * view_mat;
+        data.m_view_proj_inv = glm::inverse(data.m_view_proj);
         data.m_view_pos = glm::vec4{ this->camera().m_pos, 1 };
+        data.m_screen_size = glm::vec4{ extent.width, extent.height, 0, 0 };
+        data.m_cluster_params = this->m_light_cluster.make_shader_params();
         this->m_scene.m_nodes.back().lights().fill_uniform_data(data);
-        this->m_ubuf_per_frame_in_composition.copy_to_buffer(swapchain_index, data, this->m_logiDevice.get());
+        this->m_ubuf_per_frame_in_composition.copy_to_buffer(frame_index, data, this->m_logiDevice.get());
     }
 
 }
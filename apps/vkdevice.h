@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -9,9 +10,11 @@
 #include "swapchain.h"
 #include "swapchain_images.h"
 #include "shader.h"
+#include "pipeline_cache.h"
 #include "renderpass.h"
 #include "fbufmanager.h"
 #include "command_pool.h"
+#include "thread_pool.h"
 #include "vkommand.h"
 #include "semaphore.h"
 #include "vert_data.h"
@@ -19,6 +22,8 @@
 #include "texture.h"
 #include "depth_image.h"
 #include "model_render.h"
+#include "light_cluster.h"
+#include "light_volume.h"
 
 
 namespace dal {
@@ -28,27 +33,32 @@ namespace dal {
     private:
         PhysDevice m_physDevice;
         LogiDeviceAndQueue m_logiDevice;
+        PipelineCache m_pipeline_cache;
         Swapchain m_swapchain;
         SwapchainImages m_swapchainImages;
         RenderPass m_renderPass;
         ShaderPipeline m_pipeline;
         FbufManager m_fbuf;
-        CommandPool m_cmdPool;
+        UploadQueues m_upload_queues;
+        ThreadPool m_record_threads;
         CommandBuffers m_cmdBuffers;
-        SyncMaster m_syncMas;
+        FrameScheduler m_frame_sched;
         DescriptorSetLayout m_descSetLayout;
         DescriptorSetManager m_desc_man;
         DepthImage m_depth_image;
         GbufManager m_gbuf;
         TextureManager m_tex_man;
+        std::array<VkFormat, 5> m_attachment_formats{};  // Render pass and pipelines were created with these
 
         UniformBufferArray<U_PerFrame_InDeferred> m_ubuf_per_frame_in_deferred;
         UniformBufferArray<U_PerFrame_InComposition> m_ubuf_per_frame_in_composition;
+        LightCluster m_light_cluster;
+        LightClusterBuffers m_light_cluster_buffers;
+        LightVolumeDrawArgs m_light_volume_args;
 
         Scene m_scene;
         std::shared_ptr<TextureUnit> m_tex_grass, m_tex_tile;
 
-        unsigned m_currentFrame = 0;
         bool m_needResize = false;
         unsigned m_scrWidth, m_scrHeight;
 
@@ -76,8 +86,12 @@ namespace dal {
     private:
         void initSwapChain(const VkSurfaceKHR surface);
         void destroySwapChain();
-        void submit_render_to_shadow_maps(const uint32_t swapchain_index);
-        void udpate_uniform_buffers(const uint32_t swapchain_index);
+        // Composition and tonemap descriptor sets, which refer to G-buffer attachments
+        void write_attachment_desc_sets();
+        std::vector<VkCommandBuffer> make_shadow_cmd_buf_list(const uint32_t frame_index) const;
+        // Re-records command buffers of the frame whose inputs changed. They must not be in use by GPU.
+        void record_cmd_bufs_at(const uint32_t frame_index, const uint32_t swapchain_index);
+        void udpate_uniform_buffers(const uint32_t frame_index);
 
         auto make_attachment_format_array() const {
             return this->m_gbuf.make_formats_array(this->m_swapchain.imageFormat(), this->m_depth_image.format());
@@ -1,57 +1,126 @@
 #include "vkommand.h"
 
 #include <array>
+#include <optional>
+#include <algorithm>
 #include <stdexcept>
 
 
+namespace {
+
+    // Pipelines of the main render pass take these as dynamic states
+    void set_viewport_scissor(const VkCommandBuffer cmd_buf, const VkExtent2D& extent) {
+        VkViewport viewport{};
+        viewport.x = 0;
+        viewport.y = 0;
+        viewport.width = static_cast<float>(extent.width);
+        viewport.height = static_cast<float>(extent.height);
+        viewport.minDepth = 0;
+        viewport.maxDepth = 1;
+        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = extent;
+        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+    }
+
+    // Sort keys are not compared, only which draw comes where
+    bool is_same_draw_order(const std::vector<dal::DrawItem>& a, const std::vector<dal::DrawItem>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].m_model_index != b[i].m_model_index || a[i].m_unit_index != b[i].m_unit_index || a[i].m_inst_index != b[i].m_inst_index) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+}
+
+
 namespace dal {
 
     void CommandBuffers::init(
         const VkDevice logiDevice,
-        const size_t swapchain_count,
-        const VkCommandPool cmdPool
+        const size_t frame_count,
+        const uint32_t queue_family_index,
+        const uint32_t record_thread_count
     ) {
-        this->destroy(logiDevice, cmdPool);
+        this->destroy(logiDevice);
+
+        this->m_pools.init(frame_count, record_thread_count, queue_family_index, logiDevice);
 
         // Create command buffers
         {
-            this->m_buffers.resize(swapchain_count);
+            this->m_buffers.resize(frame_count);
 
-            VkCommandBufferAllocateInfo allocInfo = {};
-            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            allocInfo.commandPool = cmdPool;
-            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            allocInfo.commandBufferCount = static_cast<uint32_t>(this->m_buffers.size());
+            // Primary buffer of each frame lives in the pool of thread 0 so that a pool reset covers it too
+            for (uint32_t i = 0; i < frame_count; ++i) {
+                VkCommandBufferAllocateInfo allocInfo = {};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = this->m_pools.pool_at(i, 0);
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                allocInfo.commandBufferCount = 1;
 
-            if ( vkAllocateCommandBuffers(logiDevice, &allocInfo, this->m_buffers.data()) != VK_SUCCESS ) {
-                throw std::runtime_error("failed to allocate command buffers!");
+                if ( vkAllocateCommandBuffers(logiDevice, &allocInfo, &this->m_buffers[i]) != VK_SUCCESS ) {
+                    throw std::runtime_error("failed to allocate command buffers!");
+                }
             }
         }
+
+        this->m_gbuf_secondaries.init(this->m_pools, logiDevice);
+        this->m_recorded_revisions.assign(frame_count, 0);
+        this->m_recorded_fbufs.assign(frame_count, VK_NULL_HANDLE);
+        this->m_recorded_draws.assign(frame_count, {});
     }
 
-    void CommandBuffers::record(
+    void CommandBuffers::record_at(
+        const uint32_t frame_index,
+        const uint32_t swapchain_index,
+        const uint64_t scene_revision,
         const VkRenderPass renderPass,
-        const VkPipeline pipeline_deferred,
-        const VkPipeline pipeline_composition,
-        const VkPipelineLayout pipelayout_deferred,
-        const VkPipelineLayout pipelayout_composition,
+        const ShaderPipeline& pipelines,
         const VkExtent2D& extent,
         const std::vector<VkFramebuffer>& swapChainFbufs,
         const std::vector<std::vector<VkDescriptorSet>>& descset_composition,
-        const std::vector<ModelVK>& models
+        const std::vector<VkDescriptorSet>& descset_tonemap,
+        const LightVolumeDrawArgs& light_volume_args,
+        const std::vector<ModelVK>& models,
+        const VkDescriptorSet desc_set_per_frame,
+        const VkDescriptorSet texture_table,
+        const glm::vec3& view_pos,
+        ThreadPool& record_threads,
+        const VkDevice logiDevice
     ) {
+        // Sorting is cheap next to recording, so it runs every frame to find out whether depth order changed
+        auto draw_list = dal::make_draw_list(models, DrawPass::gbuffer, view_pos);
+        dal::radix_sort_draws(draw_list, this->m_sort_scratch);
+
+        const auto fbuf = swapChainFbufs.at(swapchain_index);
+        auto& recorded_draws = this->m_recorded_draws.at(frame_index);
+        if (this->m_recorded_revisions.at(frame_index) == scene_revision && this->m_recorded_fbufs.at(frame_index) == fbuf && ::is_same_draw_order(recorded_draws, draw_list)) {
+            return;
+        }
+
+        // Pools of this frame are reset by the recording threads, which also resets the primary buffer
+        this->record_gbuf_secondaries(frame_index, swapchain_index, renderPass, pipelines, extent, swapChainFbufs, models, draw_list, desc_set_per_frame, texture_table, record_threads, logiDevice);
+
         VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = 0; // Optional
         beginInfo.pInheritanceInfo = nullptr; // Optional
 
-        std::array<VkClearValue, 6> clear_values{};
+        std::array<VkClearValue, 5> clear_values{};
         clear_values[0].color = {0.f, 0.f, 0.f, 1.f};
         clear_values[1].depthStencil = {1.f, 0};
         clear_values[2].color = {0.f, 0.f, 0.f, 1.f};
         clear_values[3].color = {0.f, 0.f, 0.f, 1.f};
         clear_values[4].color = {0.f, 0.f, 0.f, 1.f};
-        clear_values[5].color = {0.f, 0.f, 0.f, 1.f};
 
         VkRenderPassBeginInfo renderPassInfo = {};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -61,64 +130,202 @@ namespace dal {
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clear_values.size());
         renderPassInfo.pClearValues = clear_values.data();
 
-        for (uint32_t i = 0; i < this->m_buffers.size(); ++i) {
-            if ( VK_SUCCESS != vkBeginCommandBuffer(this->m_buffers[i], &beginInfo) ) {
-                throw std::runtime_error("failed to begin recording command buffer!");
+        const auto i = frame_index;
+
+        if ( VK_SUCCESS != vkBeginCommandBuffer(this->m_buffers[i], &beginInfo) ) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+        {
+            renderPassInfo.framebuffer = fbuf;
+
+            vkCmdBeginRenderPass(this->m_buffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            {
+                vkCmdExecuteCommands(this->m_buffers[i], this->m_gbuf_secondaries.thread_count(), this->m_gbuf_secondaries.data_at(i));
             }
             {
-                renderPassInfo.framebuffer = swapChainFbufs[i];
-
-                vkCmdBeginRenderPass(this->m_buffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-                {
-                    vkCmdBindPipeline(this->m_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_deferred);
-
-                    for (const auto& model : models) {
-                        for (uint32_t unit_index = 0; unit_index < model.render_units().size(); ++unit_index) {
-                            const auto& render_unit = model.render_units().at(unit_index);
-
-                            VkBuffer vertBuffers[] = {render_unit.m_mesh.vertices.getBuf()};
-                            VkDeviceSize offsets[] = {0};
-                            vkCmdBindVertexBuffers(this->m_buffers[i], 0, 1, vertBuffers, offsets);
-                            vkCmdBindIndexBuffer(this->m_buffers[i], render_unit.m_mesh.indices.getBuf(), 0, VK_INDEX_TYPE_UINT32);
-
-                            for (uint32_t inst_index = 0; inst_index < model.instances().size(); ++inst_index) {
-                                const auto& inst = model.instances().at(inst_index);
-
-                                vkCmdBindDescriptorSets(
-                                    this->m_buffers[i],
-                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    pipelayout_deferred,
-                                    0, 1, &model.desc_set(i, inst_index, unit_index).get(), 0, nullptr
-                                );
-
-                                vkCmdDrawIndexed(this->m_buffers[i], render_unit.m_mesh.indices.size(), 1, 0, 0, 0);
-                            }
-                        }
-                    }
+                vkCmdNextSubpass(this->m_buffers[i], VK_SUBPASS_CONTENTS_INLINE);
+                // Dynamic states are undefined after executing secondary command buffers. These stay for the last subpass too.
+                ::set_viewport_scissor(this->m_buffers[i], extent);
+                vkCmdBindPipeline(this->m_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pipeline_composition());
+                vkCmdBindDescriptorSets(
+                    this->m_buffers[i],
+                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelines.layout_composition(),
+                    0, 1, &descset_composition.front()[i], 0, nullptr
+                );
+                vkCmdDraw(this->m_buffers[i], 6, 1, 0, 0);
+
+#if DAL_LIGHT_VOLUME
+                // Same pipeline layout, so the descriptor set stays bound
+                const auto args_buffer = light_volume_args.buffer_at(i).buffer();
+
+                vkCmdBindPipeline(this->m_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pipeline_plight_volume());
+                vkCmdDrawIndirect(this->m_buffers[i], args_buffer, LightVolumeDrawArgs::plight_offset(), 1, sizeof(VkDrawIndirectCommand));
+
+                vkCmdBindPipeline(this->m_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pipeline_slight_volume());
+                vkCmdDrawIndirect(this->m_buffers[i], args_buffer, LightVolumeDrawArgs::slight_offset(), 1, sizeof(VkDrawIndirectCommand));
+#endif
+            }
+            {
+                vkCmdNextSubpass(this->m_buffers[i], VK_SUBPASS_CONTENTS_INLINE);
+                vkCmdBindPipeline(this->m_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pipeline_tonemap());
+                vkCmdBindDescriptorSets(
+                    this->m_buffers[i],
+                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelines.layout_tonemap(),
+                    0, 1, &descset_tonemap.at(i), 0, nullptr
+                );
+                vkCmdDraw(this->m_buffers[i], 6, 1, 0, 0);
+            }
+            vkCmdEndRenderPass(this->m_buffers[i]);
+        }
+        if ( VK_SUCCESS != vkEndCommandBuffer(this->m_buffers[i]) ) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+
+        this->m_recorded_revisions.at(frame_index) = scene_revision;
+        this->m_recorded_fbufs.at(frame_index) = fbuf;
+        recorded_draws = std::move(draw_list);
+    }
+
+    void CommandBuffers::invalidate() {
+        std::fill(this->m_recorded_revisions.begin(), this->m_recorded_revisions.end(), 0);
+    }
+
+    void CommandBuffers::destroy(const VkDevice logiDevice) {
+        for (uint32_t i = 0; i < this->m_buffers.size(); ++i) {
+            vkFreeCommandBuffers(logiDevice, this->m_pools.pool_at(i, 0), 1, &this->m_buffers[i]);
+        }
+        this->m_buffers.clear();
+        this->m_recorded_revisions.clear();
+        this->m_recorded_fbufs.clear();
+        this->m_recorded_draws.clear();
+
+        this->m_gbuf_secondaries.destroy(this->m_pools, logiDevice);
+        this->m_pools.destroy(logiDevice);
+    }
+
+    void CommandBuffers::record_gbuf_secondaries(
+        const uint32_t frame_index,
+        const uint32_t swapchain_index,
+        const VkRenderPass renderPass,
+        const ShaderPipeline& pipelines,
+        const VkExtent2D& extent,
+        const std::vector<VkFramebuffer>& swapChainFbufs,
+        const std::vector<ModelVK>& models,
+        const std::vector<DrawItem>& draw_list,
+        const VkDescriptorSet desc_set_per_frame,
+        const VkDescriptorSet texture_table,
+        ThreadPool& record_threads,
+        const VkDevice logiDevice
+    ) {
+        const auto thread_count = this->m_gbuf_secondaries.thread_count();
+        std::vector<BindStats> thread_stats(thread_count);
+
+        record_threads.run_on_each([&](const uint32_t thread_index) {
+            if (thread_index >= thread_count) {
+                return;
+            }
+
+            const auto [draw_begin, draw_end] = dal::split_range(draw_list.size(), thread_count, thread_index);
+            auto& stats = thread_stats[thread_index];
+
+            VkCommandBufferInheritanceInfo inheritance_info{};
+            inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance_info.renderPass = renderPass;
+            inheritance_info.subpass = 0;
+            inheritance_info.framebuffer = swapChainFbufs[swapchain_index];
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritance_info;
+
+            const auto cmd_buf = this->m_gbuf_secondaries.at(frame_index, thread_index);
+            this->m_pools.reset_at(frame_index, thread_index, logiDevice);
+
+            if ( VK_SUCCESS != vkBeginCommandBuffer(cmd_buf, &beginInfo) ) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+
+            // Secondary command buffers inherit no state from the primary one
+            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pipeline_deferred());
+            ::set_viewport_scissor(cmd_buf, extent);
+            ++stats.m_pipeline;
+            vkCmdBindDescriptorSets(
+                cmd_buf,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelines.layout_deferred(),
+                DESC_SET_DEFERRED_PER_FRAME, 1, &desc_set_per_frame, 0, nullptr
+            );
+            vkCmdBindDescriptorSets(
+                cmd_buf,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelines.layout_deferred(),
+                DESC_SET_DEFERRED_TEXTURES, 1, &texture_table, 0, nullptr
+            );
+            stats.m_desc_set += 2;
+
+            VkBuffer last_vert_buf = VK_NULL_HANDLE;
+            VkBuffer last_index_buf = VK_NULL_HANDLE;
+            VkDescriptorSet last_inst_set = VK_NULL_HANDLE;
+            std::optional<uint32_t> last_material;
+
+            for (uint32_t draw_index = draw_begin; draw_index < draw_end; ++draw_index) {
+                const auto& draw = draw_list[draw_index];
+                const auto& model = models[draw.m_model_index];
+                const auto& render_unit = model.render_units().at(draw.m_unit_index);
+                const auto material_index = render_unit.m_material.m_table_index;
+                const auto& inst_set = model.instances().at(draw.m_inst_index).desc_set_at(frame_index);
+
+                if (render_unit.m_mesh.vertices.getBuf() != last_vert_buf) {
+                    VkBuffer vertBuffers[] = {render_unit.m_mesh.vertices.getBuf()};
+                    VkDeviceSize offsets[] = {0};
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, vertBuffers, offsets);
+                    last_vert_buf = vertBuffers[0];
+                    ++stats.m_vertex_buffer;
                 }
-                {
-                    vkCmdNextSubpass(this->m_buffers[i], VK_SUBPASS_CONTENTS_INLINE);
-                    vkCmdBindPipeline(this->m_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_composition);
+                if (render_unit.m_mesh.indices.getBuf() != last_index_buf) {
+                    vkCmdBindIndexBuffer(cmd_buf, render_unit.m_mesh.indices.getBuf(), 0, VK_INDEX_TYPE_UINT32);
+                    last_index_buf = render_unit.m_mesh.indices.getBuf();
+                    ++stats.m_index_buffer;
+                }
+                if (material_index != last_material) {
+                    PushConst_InDeferred push_const;
+                    push_const.m_material_index = material_index;
+
+                    vkCmdPushConstants(
+                        cmd_buf,
+                        pipelines.layout_deferred(),
+                        VK_SHADER_STAGE_FRAGMENT_BIT,
+                        0, sizeof(push_const), &push_const
+                    );
+                    last_material = material_index;
+                    ++stats.m_push_const;
+                }
+                if (inst_set != last_inst_set) {
                     vkCmdBindDescriptorSets(
-                        this->m_buffers[i],
+                        cmd_buf,
                         VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        pipelayout_composition,
-                        0, 1, &descset_composition.front()[i], 0, nullptr
+                        pipelines.layout_deferred(),
+                        DESC_SET_DEFERRED_PER_INST, 1, &inst_set, 0, nullptr
                     );
-                    vkCmdDraw(this->m_buffers[i], 6, 1, 0, 0);
+                    last_inst_set = inst_set;
+                    ++stats.m_desc_set;
                 }
-                vkCmdEndRenderPass(this->m_buffers[i]);
+
+                vkCmdDrawIndexed(cmd_buf, render_unit.m_mesh.indices.size(), 1, 0, 0, 0);
+                ++stats.m_draw;
             }
-            if ( VK_SUCCESS != vkEndCommandBuffer(this->m_buffers[i]) ) {
-                throw std::runtime_error("failed to record command buffer!");
+
+            if ( VK_SUCCESS != vkEndCommandBuffer(cmd_buf) ) {
+                throw std::runtime_error("failed to record secondary command buffer!");
             }
-        }
-    }
+        });
 
-    void CommandBuffers::destroy(const VkDevice logiDevice, const VkCommandPool cmdPool) {
-        if (0 != this->m_buffers.size()) {
-            vkFreeCommandBuffers(logiDevice, cmdPool, this->m_buffers.size(), this->m_buffers.data());
-            this->m_buffers.clear();
+        this->m_bind_stats = BindStats{};
+        for (auto& x : thread_stats) {
+            this->m_bind_stats += x;
         }
     }
 
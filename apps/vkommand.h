@@ -5,7 +5,11 @@
 
 #include <vulkan/vulkan.h>
 
+#include "shader.h"
+#include "thread_pool.h"
+#include "command_pool.h"
 #include "model_render.h"
+#include "light_volume.h"
 
 
 namespace dal {
@@ -13,32 +17,74 @@ namespace dal {
     class CommandBuffers {
 
     private:
+        FrameCommandPools m_pools;
         std::vector<VkCommandBuffer> m_buffers;
+        SecondaryCommandBuffers m_gbuf_secondaries;  // G-buffer subpass, recorded by several threads
+        std::vector<uint64_t> m_recorded_revisions;  // Scene revision each frame was recorded with, 0 if never
+        std::vector<VkFramebuffer> m_recorded_fbufs;  // Swapchain framebuffer each frame was recorded with
+        std::vector<std::vector<DrawItem>> m_recorded_draws;  // Sorted G-buffer draws each frame was recorded with
+        std::vector<DrawItem> m_sort_scratch;
+        BindStats m_bind_stats;  // G-buffer subpass of the last recording
 
     public:
         void init(
             const VkDevice logiDevice,
-            const size_t swapchain_count,
-            const VkCommandPool cmdPool
+            const size_t frame_count,
+            const uint32_t queue_family_index,
+            const uint32_t record_thread_count
         );
-        void destroy(const VkDevice logiDevice, const VkCommandPool cmdPool);
+        void destroy(const VkDevice logiDevice);
 
-        void record(
+        // Does nothing if the buffers of the frame were already recorded with scene_revision for the same swapchain image,
+        // and sorting G-buffer draws for view_pos gives the same order as last time. Depth buckets change as the camera moves.
+        // Otherwise resets the pools of the frame, so they must not be in use by GPU.
+        // Frames in flight and swapchain images don't pair up one to one, so a frame usually records again when its image differs.
+        void record_at(
+            const uint32_t frame_index,
+            const uint32_t swapchain_index,
+            const uint64_t scene_revision,
             const VkRenderPass renderPass,
-            const VkPipeline pipeline_deferred,
-            const VkPipeline pipeline_composition,
-            const VkPipelineLayout pipelayout_deferred,
-            const VkPipelineLayout pipelayout_composition,
+            const ShaderPipeline& pipelines,
             const VkExtent2D& extent,
             const std::vector<VkFramebuffer>& swapChainFbufs,
             const std::vector<std::vector<VkDescriptorSet>>& descset_composition,
-            const std::vector<ModelVK>& models
+            const std::vector<VkDescriptorSet>& descset_tonemap,
+            const LightVolumeDrawArgs& light_volume_args,
+            const std::vector<ModelVK>& models,
+            const VkDescriptorSet desc_set_per_frame,
+            const VkDescriptorSet texture_table,
+            const glm::vec3& view_pos,
+            ThreadPool& record_threads,
+            const VkDevice logiDevice
         );
 
+        // Makes every frame record again, for changes scene revision doesn't cover like the swapchain extent
+        void invalidate();
+
         auto& buffers(void) const {
             assert(0 != this->m_buffers.size());
             return this->m_buffers;
         }
+        auto& bind_stats() const {
+            return this->m_bind_stats;
+        }
+
+    private:
+        // draw_list must be sorted by key. Each thread takes a contiguous range so executing them in thread order keeps the sorted order
+        void record_gbuf_secondaries(
+            const uint32_t frame_index,
+            const uint32_t swapchain_index,
+            const VkRenderPass renderPass,
+            const ShaderPipeline& pipelines,
+            const VkExtent2D& extent,
+            const std::vector<VkFramebuffer>& swapChainFbufs,
+            const std::vector<ModelVK>& models,
+            const std::vector<DrawItem>& draw_list,
+            const VkDescriptorSet desc_set_per_frame,
+            const VkDescriptorSet texture_table,
+            ThreadPool& record_threads,
+            const VkDevice logiDevice
+        );
 
     };
 
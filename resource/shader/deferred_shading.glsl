@@ -0,0 +1,139 @@
+// Lighting from G-buffer, shared by every pipeline in the composition subpass.
+// Include pbr_lighting.glsl, gbuffer.glsl and light_data.glsl before this.
+
+
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput input_depth;
+layout (input_attachment_index = 1, binding = 1) uniform subpassInput input_normal;
+layout (input_attachment_index = 2, binding = 2) uniform subpassInput input_albedo;
+
+layout(binding = 4) uniform sampler2D u_dlight_shadow_maps[3];
+layout(binding = 5) uniform sampler2D u_slight_shadow_maps[5];
+
+
+struct SurfaceData {
+    vec3 m_world_pos;
+    vec3 m_normal;
+    vec3 m_albedo;
+    float m_roughness;
+    float m_metallic;
+    vec3 m_F0;
+    vec3 m_view_direc;
+};
+
+SurfaceData load_surface_data() {
+    SurfaceData result;
+
+    const float depth = subpassLoad(input_depth).x;
+    result.m_world_pos = reconstruct_world_pos(depth, gl_FragCoord.xy, u_per_frame.m_screen_size.xy, u_per_frame.m_view_proj_inv);
+    result.m_normal = decode_normal(subpassLoad(input_normal).xy);
+
+    const vec4 albedo_material = subpassLoad(input_albedo);
+    const vec2 material = unpack_material(albedo_material.w);
+    result.m_albedo = albedo_material.xyz;
+    result.m_roughness = material.x;
+    result.m_metallic = material.y;
+
+    result.m_F0 = mix(vec3(0.04), result.m_albedo, result.m_metallic);
+    result.m_view_direc = normalize(u_per_frame.m_view_pos.xyz - result.m_world_pos);
+
+    return result;
+}
+
+
+float _sample_dlight_depth(uint index, vec2 coord) {
+    if (coord.x > 1.0 || coord.x < 0.0) return 1.0;
+    if (coord.y > 1.0 || coord.y < 0.0) return 1.0;
+    return texture(u_dlight_shadow_maps[index], coord).r;
+}
+
+float _sample_slight_depth(uint index, vec2 coord) {
+    if (coord.x > 1.0 || coord.x < 0.0) return 1.0;
+    if (coord.y > 1.0 || coord.y < 0.0) return 1.0;
+
+    // Index comes from a storage buffer so it is not dynamically uniform. Only constant indices are used here.
+    switch (index) {
+        case 0: return texture(u_slight_shadow_maps[0], coord).r;
+        case 1: return texture(u_slight_shadow_maps[1], coord).r;
+        case 2: return texture(u_slight_shadow_maps[2], coord).r;
+        case 3: return texture(u_slight_shadow_maps[3], coord).r;
+        case 4: return texture(u_slight_shadow_maps[4], coord).r;
+    }
+
+    return 1.0;
+}
+
+bool is_frag_in_dlight_shadow(uint index, vec3 frag_pos) {
+    const vec4 frag_pos_in_dlight = u_per_frame.m_dlight_mat[index] * vec4(frag_pos, 1);
+    const vec3 projCoords = frag_pos_in_dlight.xyz / frag_pos_in_dlight.w;
+
+    if (projCoords.z > 1.0)
+        return false;
+
+    const vec2 sample_coord = projCoords.xy * 0.5 + 0.5;
+    const float closestDepth = _sample_dlight_depth(index, sample_coord);
+    const float currentDepth = projCoords.z;
+
+    return currentDepth > closestDepth;
+}
+
+bool is_frag_in_slight_shadow(uint index, vec3 frag_pos) {
+    const float shadow_index = u_slights[index].m_direc_shadow_index.w;
+    if (shadow_index < 0.0)
+        return false;
+
+    const vec4 frag_pos_in_light = u_slights[index].m_light_mat * vec4(frag_pos, 1);
+    const vec3 projCoords = frag_pos_in_light.xyz / frag_pos_in_light.w;
+
+    if (projCoords.z > 1.0)
+        return false;
+
+    const vec2 sample_coord = projCoords.xy * 0.5 + 0.5;
+    const float closestDepth = _sample_slight_depth(uint(shadow_index), sample_coord);
+    const float currentDepth = projCoords.z;
+
+    return currentDepth > closestDepth;
+}
+
+
+vec3 calc_plight_light(uint index, SurfaceData surface) {
+    const PointLight plight = u_plights[index];
+    const vec3 frag_to_light_vec = plight.m_pos_max_dist.xyz - surface.m_world_pos;
+    const float light_distance = length(frag_to_light_vec);
+    const float window = calc_range_window(light_distance, plight.m_pos_max_dist.w);
+
+    return calc_pbr_illumination(
+        surface.m_roughness, surface.m_metallic, surface.m_albedo, surface.m_normal, surface.m_F0, surface.m_view_direc,
+        normalize(frag_to_light_vec), light_distance, plight.m_color.xyz
+    ) * window;
+}
+
+vec3 calc_dlight_light(uint index, SurfaceData surface) {
+    if (is_frag_in_dlight_shadow(index, surface.m_world_pos))
+        return vec3(0);
+
+    const vec3 frag_to_light_direc = normalize(-u_per_frame.m_dlight_direc[index].xyz);
+    return calc_pbr_illumination(
+        surface.m_roughness, surface.m_metallic, surface.m_albedo, surface.m_normal, surface.m_F0, surface.m_view_direc,
+        frag_to_light_direc, 1, u_per_frame.m_dlight_color[index].xyz
+    );
+}
+
+vec3 calc_slight_light(uint index, SurfaceData surface) {
+    const vec3 frag_to_light_vec = u_slights[index].m_pos_max_dist.xyz - surface.m_world_pos;
+    const float light_distance = length(frag_to_light_vec);
+    const float attenuation = calc_slight_attenuation(
+        surface.m_world_pos,
+        u_slights[index].m_pos_max_dist.xyz,
+        u_slights[index].m_direc_shadow_index.xyz,
+        u_slights[index].m_fade_start_end.x,
+        u_slights[index].m_fade_start_end.y
+    ) * calc_range_window(light_distance, u_slights[index].m_pos_max_dist.w);
+
+    if (attenuation <= 0.0 || is_frag_in_slight_shadow(index, surface.m_world_pos))
+        return vec3(0);
+
+    return calc_pbr_illumination(
+        surface.m_roughness, surface.m_metallic, surface.m_albedo, surface.m_normal, surface.m_F0, surface.m_view_direc,
+        normalize(frag_to_light_vec), light_distance, u_slights[index].m_color.xyz
+    ) * attenuation;
+}
@@ -0,0 +1,39 @@
+// G-buffer packing shared by triangle.frag and fillsc.frag
+
+
+vec2 _sign_not_zero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Octahedral normal encoding into [-1, 1]^2, stored in a RG16_SNORM attachment
+vec2 encode_normal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * _sign_not_zero(n.xy);
+}
+
+vec3 decode_normal(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * _sign_not_zero(n.xy);
+    return normalize(n);
+}
+
+// Roughness in high 4 bits, metallic in low 4 bits of albedo alpha
+float pack_material(float roughness, float metallic) {
+    const uint r = uint(clamp(roughness, 0.0, 1.0) * 15.0 + 0.5);
+    const uint m = uint(clamp(metallic, 0.0, 1.0) * 15.0 + 0.5);
+    return float((r << 4) | m) / 255.0;
+}
+
+// x: roughness, y: metallic
+vec2 unpack_material(float packed) {
+    const uint bits = uint(packed * 255.0 + 0.5);
+    return vec2(float(bits >> 4), float(bits & 15u)) / 15.0;
+}
+
+// Depth is in [0, 1] with Vulkan clip space
+vec3 reconstruct_world_pos(float depth, vec2 frag_coord, vec2 screen_size, mat4 view_proj_inv) {
+    const vec2 ndc = frag_coord / screen_size * 2.0 - 1.0;
+    const vec4 world_pos = view_proj_inv * vec4(ndc, depth, 1);
+    return world_pos.xyz / world_pos.w;
+}
@@ -0,0 +1,53 @@
+// Composition descriptor set except attachments and shadow maps. Must match create_layout_composition in uniform.cpp
+
+
+layout(binding = 3) uniform UniformBufferObject {
+    mat4 m_view_mat;
+    mat4 m_view_proj;
+    mat4 m_view_proj_inv;
+    vec4 m_view_pos;
+    vec4 m_screen_size;
+
+    vec4 m_num_of_plight_dlight_slight;
+    vec4 m_cluster_params;  // x: z slice scale, y: z slice bias, z: tile width, w: tile height
+
+    vec4 m_dlight_color[3];
+    vec4 m_dlight_direc[3];
+    mat4 m_dlight_mat[3];
+} u_per_frame;
+
+
+struct PointLight {
+    vec4 m_pos_max_dist;
+    vec4 m_color;
+};
+
+struct SpotLight {
+    vec4 m_pos_max_dist;
+    vec4 m_direc_shadow_index;
+    vec4 m_color;
+    vec4 m_fade_start_end;
+    mat4 m_light_mat;
+};
+
+layout(std430, binding = 6) readonly buffer PointLights {
+    PointLight u_plights[];
+};
+
+layout(std430, binding = 7) readonly buffer SpotLights {
+    SpotLight u_slights[];
+};
+
+// x: offset into u_light_indices, y: point light count, z: spot light count
+layout(std430, binding = 8) readonly buffer ClusterRanges {
+    uvec4 u_cluster_ranges[];
+};
+
+layout(std430, binding = 9) readonly buffer ClusterLightIndices {
+    uint u_light_indices[];
+};
+
+// Must match light_cluster.h
+const uint CLUSTER_COUNT_X = 16;
+const uint CLUSTER_COUNT_Y = 9;
+const uint CLUSTER_COUNT_Z = 24;
@@ -0,0 +1,25 @@
+#version 450
+
+#include "pbr_lighting.glsl"
+#include "gbuffer.glsl"
+#include "light_data.glsl"
+#include "deferred_shading.glsl"
+
+
+// 0: point light, 1: spot light. Must match light_volume.h
+layout (constant_id = 0) const uint LIGHT_TYPE = 0;
+
+
+layout(location = 0) flat in uint v_light_index;
+
+layout (location = 0) out vec4 out_color;
+
+
+void main() {
+    const SurfaceData surface = load_surface_data();
+
+    if (0 == LIGHT_TYPE)
+        out_color = vec4(calc_plight_light(v_light_index, surface), 0);
+    else
+        out_color = vec4(calc_slight_light(v_light_index, surface), 0);
+}
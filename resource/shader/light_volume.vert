@@ -0,0 +1,83 @@
+#version 450
+
+#include "light_data.glsl"
+
+
+// 0: point light as a sphere, 1: spot light as a cone. Must match light_volume.h
+layout (constant_id = 0) const uint LIGHT_TYPE = 0;
+
+const float PI = 3.14159265359;
+
+// Must match light_volume.h
+const uint SPHERE_SEGMENT_LON = 16;
+const uint SPHERE_SEGMENT_LAT = 8;
+const uint CONE_SEGMENT = 16;
+
+// Faces of a tessellated shape lie inside the true surface, so it is inflated to keep the volume conservative
+const float SPHERE_INFLATE = 1.0 / cos(PI / float(SPHERE_SEGMENT_LAT));
+const float CONE_INFLATE = 1.0 / cos(PI / float(CONE_SEGMENT));
+
+// Two counter clockwise triangles of a quad
+const uvec2 QUAD_CORNERS[6] = uvec2[](
+    uvec2(0, 0), uvec2(1, 0), uvec2(1, 1),
+    uvec2(0, 0), uvec2(1, 1), uvec2(0, 1)
+);
+
+
+layout(location = 0) flat out uint v_light_index;
+
+
+// Unit sphere, counter clockwise seen from outside
+vec3 make_sphere_vertex(uint vert_index) {
+    const uint quad = vert_index / 6;
+    const uvec2 corner = QUAD_CORNERS[vert_index % 6];
+    const float lon = 2.0 * PI * float(quad % SPHERE_SEGMENT_LON + corner.x) / float(SPHERE_SEGMENT_LON);
+    const float lat = PI * float(quad / SPHERE_SEGMENT_LON + corner.y) / float(SPHERE_SEGMENT_LAT);
+
+    return vec3(sin(lat) * cos(lon), cos(lat), sin(lat) * sin(lon));
+}
+
+// Apex at origin, opens toward +Z, base at z = 1 with radius 1. Each segment is a side and a base triangle.
+vec3 make_cone_vertex(uint vert_index) {
+    const uint segment = vert_index / 6;
+    const uint corner = vert_index % 6;
+
+    if (0 == corner)
+        return vec3(0, 0, 0);
+    if (3 == corner)
+        return vec3(0, 0, 1);
+
+    const uint edge = segment + ((1 == corner || 5 == corner) ? 1 : 0);
+    const float angle = 2.0 * PI * float(edge) / float(CONE_SEGMENT);
+    return vec3(cos(angle), sin(angle), 1);
+}
+
+
+void main() {
+    v_light_index = uint(gl_InstanceIndex);
+
+    vec3 world_pos;
+
+    if (0 == LIGHT_TYPE) {
+        const vec4 pos_max_dist = u_plights[gl_InstanceIndex].m_pos_max_dist;
+        world_pos = pos_max_dist.xyz + make_sphere_vertex(gl_VertexIndex) * (pos_max_dist.w * SPHERE_INFLATE);
+    }
+    else {
+        const SpotLight slight = u_slights[gl_InstanceIndex];
+        const vec3 direc = slight.m_direc_shadow_index.xyz;
+        const vec3 up = abs(direc.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+        const vec3 tangent = normalize(cross(up, direc));
+        const vec3 bitangent = cross(direc, tangent);
+
+        // Outer angle is clamped below 90 degrees, wider spot lights are not covered entirely
+        const float cos_outer = max(slight.m_fade_start_end.y, 0.1);
+        const float base_radius = sqrt(1.0 - cos_outer * cos_outer) / cos_outer * CONE_INFLATE;
+
+        const vec3 local = make_cone_vertex(gl_VertexIndex);
+        world_pos = slight.m_pos_max_dist.xyz + slight.m_pos_max_dist.w * (
+            tangent * (local.x * base_radius) + bitangent * (local.y * base_radius) + direc * local.z
+        );
+    }
+
+    gl_Position = u_per_frame.m_view_proj * vec4(world_pos, 1);
+}
@@ -11,6 +11,14 @@ float calc_slight_attenuation(vec3 frag_pos, vec3 light_pos, vec3 light_direc, f
     return clamp((theta - fade_end) / epsilon * attenFactor, 0.0, 1.0);
 }
 
+// Smoothly reaches 0 at max_dist so lights can be culled by their range without a visible edge
+float calc_range_window(float light_distance, float max_dist) {
+    const float ratio = light_distance / max_dist;
+    const float ratio4 = ratio * ratio * ratio * ratio;
+    const float window = clamp(1.0 - ratio4, 0.0, 1.0);
+    return window * window;
+}
+
 
 float _distribution_GGX(vec3 N, vec3 H, float roughness) {
     float a = roughness*roughness;
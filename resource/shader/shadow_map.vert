@@ -6,11 +6,11 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
 
 
-layout(binding = 0) uniform U_PerInst_PerFrame {
+layout(set = 1, binding = 0) uniform U_PerInst_PerFrame {
     mat4 m_model_mat;
 } u_obj_dynamic_data;
 
-layout(binding = 1) uniform U_PerLight_PerFrame {
+layout(set = 0, binding = 0) uniform U_PerLight_PerFrame {
     mat4 m_light_mat;
 } u_light_dynamic_data;
 
@@ -0,0 +1,22 @@
+#version 450
+
+
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput input_lighting;
+
+
+layout (location = 0) out vec4 out_color;
+
+
+vec3 fix_color(vec3 color) {
+    const float EXPOSURE = 0.8;
+
+    vec3 mapped = vec3(1.0) - exp(-color * EXPOSURE);
+    //vec3 mapped = color / (color + 1.0);
+    return mapped;
+}
+
+
+void main() {
+    out_color.xyz = fix_color(subpassLoad(input_lighting).xyz);
+    out_color.w = 1;
+}
@@ -1,27 +1,40 @@
 #version 450
 
+#include "gbuffer.glsl"
+
 
 layout(location = 0) in vec3 v_normal;
 layout(location = 1) in vec2 fragTexCoord;
-layout(location = 2) in vec3 v_frag_pos;
 
-layout(location = 0) out vec4 out_position;
-layout(location = 1) out vec4 out_normal;
-layout(location = 2) out vec4 out_albedo;
-layout(location = 3) out vec4 out_material;
+layout(location = 0) out vec2 out_normal;
+layout(location = 1) out vec4 out_albedo;
 
 
-layout(binding = 1) uniform sampler2D texSampler;
+// Must match dal::MAX_BINDLESS_TEXTURE_COUNT
+#define MAX_TEXTURE_COUNT 1024
 
-layout(binding = 2) uniform U_Material {
+struct U_Material {
     float m_roughness;
     float m_metallic;
-} u_material;
+    uint m_albedo_index;
+    uint m_padding;
+};
+
+layout(set = 0, binding = 1) readonly buffer U_MaterialTable {
+    U_Material m_materials[];
+} u_material_table;
+
+layout(set = 1, binding = 0) uniform sampler2D u_textures[MAX_TEXTURE_COUNT];
+
+layout(push_constant) uniform U_PerDraw {
+    uint m_material_index;
+} u_per_draw;
 
 
 void main() {
-    out_position = vec4(v_frag_pos, 1);
-    out_normal = vec4(v_normal, 1);
-    out_albedo = texture(texSampler, fragTexCoord);
-    out_material = vec4(u_material.m_roughness, u_material.m_metallic, 0, 0);
+    const U_Material material = u_material_table.m_materials[u_per_draw.m_material_index];
+
+    out_normal = encode_normal(normalize(v_normal));
+    out_albedo.xyz = texture(u_textures[material.m_albedo_index], fragTexCoord).xyz;
+    out_albedo.w = pack_material(material.m_roughness, material.m_metallic);
 }
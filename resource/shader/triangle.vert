@@ -7,15 +7,14 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 v_normal;
 layout(location = 1) out vec2 fragTexCoord;
-layout(location = 2) out vec3 v_frag_pos;
 
 
-layout(binding = 0) uniform UniformBufferObject {
+layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
 } ubo;
 
-layout(binding = 3) uniform U_PerInst_PerFrame {
+layout(set = 2, binding = 0) uniform U_PerInst_PerFrame {
     mat4 m_model_mat;
 } u_obj_dynamic_data;
 
@@ -35,7 +34,6 @@ vec3 colors[3] = vec3[](
 
 void main() {
     vec4 world_pos = u_obj_dynamic_data.m_model_mat * vec4(inPosition, 1.0);
-    v_frag_pos = world_pos.xyz;
     gl_Position = ubo.proj * ubo.view * world_pos;
     v_normal = normalize((u_obj_dynamic_data.m_model_mat * vec4(inNormal, 0)).xyz);
     fragTexCoord = inTexCoord;
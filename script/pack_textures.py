@@ -0,0 +1,133 @@
+import os
+import re
+import struct
+
+import local_tools.path_tools as ptt
+
+
+# Mip levels made by astcenc, such as 0021di_512.astc, 0021di_256.astc and so on, are packed into 0021di.ktx2
+MIP_FILE_PATTERN = re.compile(r"^(.+)_(\d+)\.astc$")
+
+KTX2_IDENTIFIER = b"\xABKTX 20\xBB\r\n\x1A\n"
+ASTC_MAGIC = 0x5CA1AB13
+
+ASTC_FOOTPRINTS = (
+    (4, 4), (5, 4), (5, 5), (6, 5), (6, 6), (8, 5), (8, 6),
+    (8, 8), (10, 5), (10, 6), (10, 8), (10, 10), (12, 10), (12, 12),
+)
+VK_FORMAT_ASTC_4x4_UNORM_BLOCK = 157
+
+KHR_DF_MODEL_ASTC = 162
+KHR_DF_PRIMARIES_BT709 = 1
+KHR_DF_TRANSFER_LINEAR = 1
+KHR_DF_TRANSFER_SRGB = 2
+
+
+class AstcLevel:
+    def __init__(self, path: str):
+        with open(path, "rb") as file:
+            data = file.read()
+
+        magic, = struct.unpack_from("<I", data, 0)
+        if ASTC_MAGIC != magic:
+            raise RuntimeError("not an ASTC file: {}".format(path))
+
+        self.block = (data[4], data[5])
+        if 1 != data[6]:
+            raise RuntimeError("3D ASTC is not supported: {}".format(path))
+
+        self.width = data[7] | (data[8] << 8) | (data[9] << 16)
+        self.height = data[10] | (data[11] << 8) | (data[12] << 16)
+        self.blocks = data[16:]
+
+
+def make_dfd(block, srgb: bool) -> bytes:
+    # Basic data format descriptor with the single sample ASTC has
+    block_size = 24 + 16
+    result = struct.pack("<I", 4 + block_size)
+    result += struct.pack("<II", 0, (block_size << 16) | 2)
+    result += struct.pack(
+        "<BBBB",
+        KHR_DF_MODEL_ASTC,
+        KHR_DF_PRIMARIES_BT709,
+        KHR_DF_TRANSFER_SRGB if srgb else KHR_DF_TRANSFER_LINEAR,
+        0
+    )
+    result += struct.pack("<BBBB", block[0] - 1, block[1] - 1, 0, 0)
+    result += struct.pack("<BBBBBBBB", 16, 0, 0, 0, 0, 0, 0, 0)
+    result += struct.pack("<I", (0 << 24) | (127 << 16) | 0)
+    result += struct.pack("<BBBB", 0, 0, 0, 0)
+    result += struct.pack("<II", 0, 0xFFFFFFFF)
+    return result
+
+
+def pack_ktx2(levels, srgb: bool) -> bytes:
+    block = levels[0].block
+    for i, level in enumerate(levels):
+        if level.block != block:
+            raise RuntimeError("mip levels have different block sizes")
+        if level.width != max(levels[0].width >> i, 1) or level.height != max(levels[0].height >> i, 1):
+            raise RuntimeError("mip level {} is {}x{}, which does not follow the first one".format(i, level.width, level.height))
+
+    vk_format = VK_FORMAT_ASTC_4x4_UNORM_BLOCK + ASTC_FOOTPRINTS.index(block) * 2 + (1 if srgb else 0)
+
+    header_size = 80
+    level_index_size = 24 * len(levels)
+    dfd = make_dfd(block, srgb)
+    dfd_offset = header_size + level_index_size
+
+    # Level data goes from the smallest, each aligned to the 16 byte block
+    level_offsets = [0] * len(levels)
+    level_data = b""
+    data_begin = dfd_offset + len(dfd)
+    for i in reversed(range(len(levels))):
+        padding = (-(data_begin + len(level_data))) % 16
+        level_data += b"\0" * padding
+        level_offsets[i] = data_begin + len(level_data)
+        level_data += levels[i].blocks
+
+    result = KTX2_IDENTIFIER
+    result += struct.pack(
+        "<IIIIIIIII",
+        vk_format,
+        1,  # typeSize of block compressed formats
+        levels[0].width,
+        levels[0].height,
+        0,
+        0,
+        1,
+        len(levels),
+        0
+    )
+    result += struct.pack("<IIIIQQ", dfd_offset, len(dfd), 0, 0, 0, 0)
+    for i, level in enumerate(levels):
+        result += struct.pack("<QQQ", level_offsets[i], len(level.blocks), len(level.blocks))
+    result += dfd
+    result += level_data
+    return result
+
+
+def main():
+    image_dir_path = os.path.join(ptt.find_repo_root_path(), "resource", "image")
+
+    groups = {}
+    for file_name_ext in os.listdir(image_dir_path):
+        match = MIP_FILE_PATTERN.match(file_name_ext)
+        if match is None:
+            continue
+
+        groups.setdefault(match.group(1), []).append((int(match.group(2)), file_name_ext))
+
+    for name, files in groups.items():
+        files.sort(reverse=True)
+        levels = [AstcLevel(os.path.join(image_dir_path, x[1])) for x in files]
+
+        output_file_name_ext = name + ".ktx2"
+        with open(os.path.join(image_dir_path, output_file_name_ext), "wb") as file:
+            file.write(pack_ktx2(levels, True))
+
+        print("- done {} levels -> {}".format(len(levels), output_file_name_ext))
+
+
+if "__main__" == __name__:
+    main()
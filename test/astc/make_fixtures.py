@@ -0,0 +1,705 @@
+"""
+Writes the ASTC blocks test_astc_decoder checks and the RGBA8 images a conformant decoder makes of them.
+
+For each 2D footprint this makes <footprint>.astc, then decodes it as UNORM into <footprint>_unorm.rgba and
+as SRGB into <footprint>_srgb.rgba. Blocks are built field by field to cover every kind the decoder must handle:
+void extent, 1 to 4 partitions with mixed endpoint modes, dual plane, blue contraction and error blocks.
+Generation is seeded, so running this again makes the same .astc files.
+
+Reference decoders, whichever is found first unless --decoder says:
+- astcenc: ARM's reference codec, "astcenc -dl" for UNORM and "astcenc -ds" for SRGB into uncompressed KTX.
+- mesa: the ASTC LDR decoder of Mesa, through a surfaceless EGL context on llvmpipe.
+  Texture uploaded with glCompressedTexImage2D and read back with glGetTexImage.
+"""
+
+import os
+import shutil
+import random
+import struct
+import argparse
+import tempfile
+import subprocess
+
+
+FOOTPRINTS = (
+    (4, 4), (5, 4), (5, 5), (6, 5), (6, 6), (8, 5), (8, 6),
+    (8, 8), (10, 5), (10, 6), (10, 8), (10, 10), (12, 10), (12, 12),
+)
+
+BLOCKS_PER_ROW = 6
+SEED = 20261019
+
+ASTC_MAGIC = 0x5CA1AB13
+
+
+# ---------------------------------------------------------------- Integer sequence encoding
+
+# (trits, quints, bits) of each range, in the order quant levels are numbered by the specification
+QUANT_RANGES = (
+    (2, (0, 0, 1)), (3, (1, 0, 0)), (4, (0, 0, 2)), (5, (0, 1, 0)), (6, (1, 0, 1)), (8, (0, 0, 3)),
+    (10, (0, 1, 1)), (12, (1, 0, 2)), (16, (0, 0, 4)), (20, (0, 1, 2)), (24, (1, 0, 3)), (32, (0, 0, 5)),
+    (40, (0, 1, 3)), (48, (1, 0, 4)), (64, (0, 0, 6)), (80, (0, 1, 4)), (96, (1, 0, 5)), (128, (0, 0, 7)),
+    (160, (0, 1, 5)), (192, (1, 0, 6)), (256, (0, 0, 8)),
+)
+QUANT_6 = 4
+
+
+def ise_bit_count(count, quant):
+    _, (trits, quints, bits) = QUANT_RANGES[quant]
+    if trits:
+        return count * bits + (8 * count + 4) // 5
+    if quints:
+        return count * bits + (7 * count + 2) // 3
+    return count * bits
+
+
+def decode_trit_block(t):
+    def bit(i):
+        return (t >> i) & 1
+
+    if (t >> 2) & 7 == 7:
+        c = (((t >> 5) & 7) << 2) | (t & 3)
+        t4, t3 = 2, 2
+    else:
+        c = t & 0x1F
+        if (t >> 5) & 3 == 3:
+            t4, t3 = 2, bit(7)
+        else:
+            t4, t3 = bit(7), (t >> 5) & 3
+
+    cb = lambda i: (c >> i) & 1
+    if c & 3 == 3:
+        t2, t1, t0 = 2, cb(4), (cb(3) << 1) | (cb(2) & (1 - cb(3)))
+    elif (c >> 2) & 3 == 3:
+        t2, t1, t0 = 2, 2, c & 3
+    else:
+        t2, t1, t0 = cb(4), (c >> 2) & 3, (cb(1) << 1) | (cb(0) & (1 - cb(1)))
+
+    return t0, t1, t2, t3, t4
+
+
+def decode_quint_block(q):
+    def bit(i):
+        return (q >> i) & 1
+
+    if (q >> 1) & 3 == 3 and (q >> 5) & 3 == 0:
+        q1, q0 = 4, 4
+        q2 = (bit(0) << 2) | ((bit(4) & (1 - bit(0))) << 1) | (bit(3) & (1 - bit(0)))
+    else:
+        if (q >> 1) & 3 == 3:
+            q2 = 4
+            c = (((q >> 3) & 3) << 3) | ((~(q >> 5) & 3) << 1) | bit(0)
+        else:
+            q2 = (q >> 5) & 3
+            c = q & 0x1F
+        if c & 7 == 5:
+            q1, q0 = 4, (c >> 3) & 3
+        else:
+            q1, q0 = (c >> 3) & 3, c & 7
+
+    return q0, q1, q2
+
+
+# Packed form of each tuple of trits or quints, the first one the decoding above maps to it
+TRIT_PACKING = {}
+for packed in range(256):
+    TRIT_PACKING.setdefault(decode_trit_block(packed), packed)
+QUINT_PACKING = {}
+for packed in range(128):
+    QUINT_PACKING.setdefault(decode_quint_block(packed), packed)
+assert 3 ** 5 == len(TRIT_PACKING) and 5 ** 3 == len(QUINT_PACKING)
+
+# Bits of the packed trits or quints that follow each value of a group
+TRIT_SPLITS = (2, 2, 1, 2, 1)
+QUINT_SPLITS = (3, 2, 2)
+
+
+def ise_encode(values, quant):
+    """ Bits from the lowest, as a list of 0 and 1 of length ise_bit_count(len(values), quant) """
+
+    _, (trits, quints, bits) = QUANT_RANGES[quant]
+    result = []
+
+    def push(value, count):
+        for i in range(count):
+            result.append((value >> i) & 1)
+
+    if not trits and not quints:
+        for v in values:
+            push(v, bits)
+        return result
+
+    group_size = 5 if trits else 3
+    splits = TRIT_SPLITS if trits else QUINT_SPLITS
+    packing = TRIT_PACKING if trits else QUINT_PACKING
+    for begin in range(0, len(values), group_size):
+        group = list(values[begin:begin + group_size])
+        highs = [v >> bits for v in group] + [0] * (group_size - len(group))
+        packed = packing[tuple(highs)]
+
+        shift = 0
+        for v, split in zip(group + [0] * (group_size - len(group)), splits):
+            push(v & ((1 << bits) - 1), bits)
+            push(packed >> shift, split)
+            shift += split
+
+    del result[ise_bit_count(len(values), quant):]
+    return result
+
+
+# ---------------------------------------------------------------- Color unquantization, only to know which blocks blue contract
+
+TRIT_COLOR_C = { 1: 204, 2: 93, 3: 44, 4: 22, 5: 11, 6: 5 }
+QUINT_COLOR_C = { 1: 113, 2: 54, 3: 26, 4: 13, 5: 6 }
+
+
+def unquantize_color(value, quant):
+    _, (trits, quints, bits) = QUANT_RANGES[quant]
+    if not trits and not quints:
+        result = 0
+        for shift in range(8 - bits, -bits, -bits):
+            result |= (value << shift) if shift >= 0 else (value >> -shift)
+        return result & 0xFF
+
+    low = value & ((1 << bits) - 1)
+    d = value >> bits
+    a = 0x1FF if low & 1 else 0
+    b_, c_, d_, e_, f_ = [(low >> i) & 1 for i in range(1, 6)]
+
+    if trits:
+        c = TRIT_COLOR_C[bits]
+        b = {
+            1: 0,
+            2: (b_ << 8) | (b_ << 4) | (b_ << 2) | (b_ << 1),
+            3: (c_ << 8) | (b_ << 7) | (c_ << 3) | (b_ << 2) | (c_ << 1) | b_,
+            4: (d_ << 8) | (c_ << 7) | (b_ << 6) | (d_ << 2) | (c_ << 1) | b_,
+            5: (e_ << 8) | (d_ << 7) | (c_ << 6) | (b_ << 5) | (e_ << 1) | d_,
+            6: (f_ << 8) | (e_ << 7) | (d_ << 6) | (c_ << 5) | (b_ << 4) | f_,
+        }[bits]
+    else:
+        c = QUINT_COLOR_C[bits]
+        b = {
+            1: 0,
+            2: (b_ << 8) | (b_ << 3) | (b_ << 2),
+            3: (c_ << 8) | (b_ << 7) | (c_ << 2) | (b_ << 1) | c_,
+            4: (d_ << 8) | (c_ << 7) | (b_ << 6) | (d_ << 1) | c_,
+            5: (e_ << 8) | (d_ << 7) | (c_ << 6) | (b_ << 5) | e_,
+        }[bits]
+
+    t = d * c + b
+    t ^= a
+    return (a & 0x80) | (t >> 2)
+
+
+# ---------------------------------------------------------------- Block modes
+
+def decode_block_mode(mode):
+    """ (weights_x, weights_y, dual_plane, weight_quant) of a 2D block mode, None for reserved ones """
+
+    r = (mode >> 4) & 1
+    h = (mode >> 9) & 1
+    d = (mode >> 10) & 1
+    a = (mode >> 5) & 3
+
+    if mode & 3:
+        r |= (mode & 3) << 1
+        b = (mode >> 7) & 3
+        kind = (mode >> 2) & 3
+        if 0 == kind:
+            x, y = b + 4, a + 2
+        elif 1 == kind:
+            x, y = b + 8, a + 2
+        elif 2 == kind:
+            x, y = a + 2, b + 8
+        elif mode & 0x100:
+            x, y = (b & 1) + 2, a + 2
+        else:
+            x, y = a + 2, (b & 1) + 6
+    else:
+        r |= ((mode >> 2) & 3) << 1
+        if 0 == (mode >> 2) & 3:
+            return None
+        b = (mode >> 9) & 3
+        kind = (mode >> 7) & 3
+        if 0 == kind:
+            x, y = 12, a + 2
+        elif 1 == kind:
+            x, y = a + 2, 12
+        elif 2 == kind:
+            x, y = a + 6, b + 6
+            d, h = 0, 0
+        elif 0 == a:
+            x, y = 6, 10
+        elif 1 == a:
+            x, y = 10, 6
+        else:
+            return None
+
+    return x, y, 1 == d, (r - 2) + 6 * h
+
+
+def block_mode_fits(mode, block_width, block_height):
+    decoded = decode_block_mode(mode)
+    if decoded is None:
+        return False
+
+    x, y, dual, quant = decoded
+    count = x * y * (2 if dual else 1)
+    bits = ise_bit_count(count, quant)
+    return x <= block_width and y <= block_height and count <= 64 and 24 <= bits <= 96
+
+
+# ---------------------------------------------------------------- Blocks
+
+LDR_MODES = (0, 1, 4, 5, 6, 8, 9, 10, 12, 13)
+HDR_MODES = (2, 3, 7, 11, 14, 15)
+
+
+class Block:
+    def __init__(self):
+        self.bits = [0] * 128
+
+    def put(self, pos, count, value):
+        for i in range(count):
+            self.bits[pos + i] = (value >> i) & 1
+
+    def put_bits(self, pos, bits):
+        self.bits[pos:pos + len(bits)] = bits
+
+    def to_bytes(self):
+        value = 0
+        for i, b in enumerate(self.bits):
+            value |= b << i
+        return value.to_bytes(16, "little")
+
+
+def endpoint_value_count(modes):
+    return sum(2 * ((m >> 2) + 1) for m in modes)
+
+
+def encode_modes(modes):
+    """ (6 bit field after partition index, high bits below weights, their count) of a multi partition block """
+
+    if all(m == modes[0] for m in modes):
+        return modes[0] << 2, 0, 0
+
+    base_class = min(m >> 2 for m in modes)
+    value = base_class + 1
+    pos = 2
+    for m in modes:
+        value |= ((m >> 2) - base_class) << pos
+        pos += 1
+    for m in modes:
+        value |= (m & 3) << pos
+        pos += 2
+
+    high_count = 3 * len(modes) - 4
+    return value & 0x3F, value >> 6, high_count
+
+
+def endpoint_quant(weight_bits, partition_count, modes, dual):
+    """ (quant level of endpoints, or None if even the smallest range doesn't fit, and bits high mode bits take) """
+
+    high_count = 0
+    if partition_count > 1 and any(m != modes[0] for m in modes):
+        high_count = 3 * partition_count - 4
+    color_bits = 128 - weight_bits - high_count - (2 if dual else 0) - (17 if 1 == partition_count else 29)
+
+    for quant in range(len(QUANT_RANGES) - 1, -1, -1):
+        if ise_bit_count(endpoint_value_count(modes), quant) <= color_bits:
+            return quant, high_count
+    return None, high_count
+
+
+def build_block(rng, mode, partition_count, modes, endpoint_maker=None, allow_error=False):
+    """ Block of given fields, with random weights, partition index and endpoints unless endpoint_maker gives them.
+        Returns None if the endpoints don't fit in the bits left, unless allow_error, where random bits fill them. """
+
+    x, y, dual, weight_quant = decode_block_mode(mode)
+    weight_count = x * y * (2 if dual else 1)
+    weight_bits = ise_bit_count(weight_count, weight_quant)
+    weight_levels = QUANT_RANGES[weight_quant][0]
+
+    color_quant, high_count = endpoint_quant(weight_bits, partition_count, modes, dual)
+    value_count = endpoint_value_count(modes)
+    is_error = color_quant is None or color_quant < QUANT_6 or value_count > 18
+    if is_error != allow_error:
+        return None
+
+    block = Block()
+    block.put(0, 11, mode)
+    block.put(11, 2, partition_count - 1)
+
+    below_weights = 128 - weight_bits
+    if 1 == partition_count:
+        block.put(13, 4, modes[0])
+        color_begin = 17
+    else:
+        block.put(13, 10, rng.randrange(1024))
+        field, high, _ = encode_modes(modes)
+        block.put(23, 6, field)
+        below_weights -= high_count
+        block.put(below_weights, high_count, high)
+        color_begin = 29
+
+    if dual:
+        below_weights -= 2
+        block.put(below_weights, 2, rng.randrange(4))
+
+    weights = [rng.randrange(weight_levels) for _ in range(weight_count)]
+    for i, b in enumerate(ise_encode(weights, weight_quant)):
+        block.bits[127 - i] = b
+
+    if is_error:
+        if below_weights > color_begin:
+            block.put(color_begin, below_weights - color_begin, rng.getrandbits(below_weights - color_begin))
+        return block
+
+    color_levels = QUANT_RANGES[color_quant][0]
+    if endpoint_maker is None:
+        values = [rng.randrange(color_levels) for _ in range(value_count)]
+    else:
+        values = endpoint_maker(rng, color_quant, value_count)
+    block.put_bits(color_begin, ise_encode(values, color_quant))
+
+    return block
+
+
+def is_blue_contracted(values, quant):
+    """ Of RGB or RGBA direct endpoints, mode 8 or 12 """
+
+    v = [unquantize_color(x, quant) for x in values]
+    return v[1] + v[3] + v[5] < v[0] + v[2] + v[4]
+
+
+def direct_endpoints(blue_contract):
+    def maker(rng, quant, count):
+        levels = QUANT_RANGES[quant][0]
+        while True:
+            values = [rng.randrange(levels) for _ in range(count)]
+            if is_blue_contracted(values, quant) == blue_contract:
+                return values
+    return maker
+
+
+class FixtureMaker:
+    def __init__(self, footprint, rng):
+        self.footprint = footprint
+        self.rng = rng
+        self.blocks = []
+        self.counts = {}
+
+        width, height = footprint
+        self.modes = [m for m in range(2048) if block_mode_fits(m, width, height)]
+        self.single_plane_modes = [m for m in self.modes if not decode_block_mode(m)[2]]
+        self.dual_plane_modes = [m for m in self.modes if decode_block_mode(m)[2]]
+
+    def add(self, kind, block):
+        self.blocks.append(block.to_bytes() if isinstance(block, Block) else block)
+        self.counts[kind] = self.counts.get(kind, 0) + 1
+
+    def add_encoded(self, kind, count, partition_count, mode_choices, dual=False, endpoint_maker=None, modes=None):
+        added = 0
+        while added < count:
+            mode = self.rng.choice(self.dual_plane_modes if dual else self.single_plane_modes)
+            # Partitions share one mode unless modes says otherwise
+            endpoint_modes = modes or [self.rng.choice(mode_choices)] * partition_count
+            block = build_block(self.rng, mode, partition_count, endpoint_modes, endpoint_maker=endpoint_maker)
+            if block is not None:
+                self.add(kind, block)
+                added += 1
+
+    def add_void_extent(self, count):
+        for i in range(count):
+            block = Block()
+            block.put(0, 9, 0x1FC)
+            block.put(10, 2, 3)
+            if 0 == i % 2:
+                block.put(12, 52, (1 << 52) - 1)
+            else:
+                s0, t0 = self.rng.randrange(4096), self.rng.randrange(4096)
+                coords = (s0, self.rng.randrange(s0 + 1, 8192), t0, self.rng.randrange(t0 + 1, 8192))
+                for j, c in enumerate(coords):
+                    block.put(12 + 13 * j, 13, c)
+            for j in range(4):
+                block.put(64 + 16 * j, 16, self.rng.randrange(65536))
+            self.add("void extent", block)
+
+    def add_errors(self):
+        rng = self.rng
+
+        # HDR void extent
+        block = Block()
+        block.put(0, 10, 0x3FC)
+        block.put(10, 2, 3)
+        block.put(12, 52, (1 << 52) - 1)
+        for j in range(4):
+            block.put(64 + 16 * j, 16, 0x3C00)
+        self.add("error: hdr void extent", block)
+
+        # Reserved block modes, low 4 bits zero but not void extent
+        for mode in (0x000, 0x100, 0x0F0, 0x5F0, 0x1C4, 0x1E4):
+            block = Block()
+            block.put(0, 11, mode)
+            block.put(11, 117, rng.getrandbits(117))
+            self.add("error: reserved block mode", block)
+
+        # Weight grid larger than the block
+        width, height = self.footprint
+        too_large = [m for m in range(2048) if decode_block_mode(m) is not None and not block_mode_fits(m, width, height)
+                     and (decode_block_mode(m)[0] > width or decode_block_mode(m)[1] > height)]
+        if too_large:
+            block = Block()
+            block.put(0, 11, rng.choice(too_large))
+            block.put(11, 117, rng.getrandbits(117))
+            self.add("error: weight grid larger than block", block)
+
+        # More than 64 weights, or weight bits out of 24 to 96
+        for predicate, kind in (
+            (lambda x, y, d, q: x * y * (d + 1) > 64, "error: too many weights"),
+            (lambda x, y, d, q: x * y * (d + 1) <= 64 and ise_bit_count(x * y * (d + 1), q) > 96, "error: too many weight bits"),
+            (lambda x, y, d, q: ise_bit_count(x * y * (d + 1), q) < 24, "error: too few weight bits"),
+        ):
+            candidates = []
+            for m in range(2048):
+                decoded = decode_block_mode(m)
+                if decoded is None:
+                    continue
+                x, y, d, q = decoded
+                if x <= width and y <= height and predicate(x, y, int(d), q):
+                    candidates.append(m)
+            if candidates:
+                block = Block()
+                block.put(0, 11, rng.choice(candidates))
+                block.put(11, 2, 0)
+                block.put(13, 4, 8)
+                block.put(17, 111, rng.getrandbits(111))
+                self.add(kind, block)
+
+        # Dual plane with four partitions
+        block = Block()
+        block.put(0, 11, rng.choice(self.dual_plane_modes))
+        block.put(11, 2, 3)
+        block.put(13, 115, rng.getrandbits(115))
+        self.add("error: dual plane with 4 partitions", block)
+
+        # HDR endpoint modes, which are errors to LDR decoding. Only texels of their own partition are.
+        for hdr_mode in HDR_MODES:
+            for partition_count in (1, 2):
+                for _ in range(100):
+                    mode = rng.choice(self.single_plane_modes)
+                    others = [rng.choice(LDR_MODES) for _ in range(partition_count - 1)]
+                    modes = [hdr_mode] + others
+                    # Mixed modes must be within one class of each other
+                    if max(m >> 2 for m in modes) - min(m >> 2 for m in modes) > 1:
+                        continue
+                    block = build_block(rng, mode, partition_count, modes)
+                    if block is not None:
+                        self.add("error: hdr endpoint mode" if 1 == partition_count else "hdr endpoints in one partition", block)
+                        break
+
+        # More than 18 endpoint values, then endpoints that don't fit in what the weights leave
+        for kind, partition_count, modes in (
+            ("error: more than 18 endpoint values", 3, [12, 12, 12]),
+            ("error: endpoints out of bits", 3, [8, 8, 8]),
+            ("error: endpoints out of bits", 2, [8, 12]),
+        ):
+            candidates = list(self.single_plane_modes)
+            rng.shuffle(candidates)
+            for mode in candidates:
+                block = build_block(rng, mode, partition_count, modes, allow_error=True)
+                if block is not None:
+                    self.add(kind, block)
+                    break
+
+    def make(self):
+        rng = self.rng
+
+        self.add_void_extent(6)
+        self.add_errors()
+
+        self.add_encoded("1 partition", 12, 1, LDR_MODES)
+        for partition_count in (2, 3, 4):
+            # Same mode everywhere, then modes mixed over two classes
+            self.add_encoded("{} partitions".format(partition_count), 4, partition_count, LDR_MODES)
+            for _ in range(4):
+                while True:
+                    base = rng.randrange(3)
+                    modes = [rng.choice([m for m in LDR_MODES if (m >> 2) in (base, base + 1)]) for _ in range(partition_count)]
+                    if len(set(modes)) > 1 and endpoint_value_count(modes) <= 18:
+                        break
+                self.add_encoded("{} partitions, mixed modes".format(partition_count), 1, partition_count, None, modes=modes)
+
+        for partition_count in (1, 2, 3):
+            self.add_encoded("dual plane, {} partitions".format(partition_count), 4, partition_count, LDR_MODES, dual=True)
+
+        for endpoint_mode in (8, 12):
+            self.add_encoded("blue contract", 4, 1, None, endpoint_maker=direct_endpoints(True), modes=[endpoint_mode])
+            self.add_encoded("no blue contract", 2, 1, None, endpoint_maker=direct_endpoints(False), modes=[endpoint_mode])
+        self.add_encoded("blue contract", 2, 2, None, endpoint_maker=direct_endpoints(True), modes=[8, 8])
+
+        # Base and offset modes blue contract depending on the sign of the offset sum
+        self.add_encoded("base and offset", 6, 1, (9, 13))
+
+        while len(self.blocks) % BLOCKS_PER_ROW:
+            self.add_encoded("1 partition", 1, 1, LDR_MODES)
+
+        return self.blocks
+
+
+def astc_file_bytes(footprint, blocks):
+    block_width, block_height = footprint
+    rows = len(blocks) // BLOCKS_PER_ROW
+    # One texel short of whole blocks on each axis, so edge blocks are cropped
+    width = BLOCKS_PER_ROW * block_width - 1
+    height = rows * block_height - 1
+
+    header = struct.pack("<I", ASTC_MAGIC)
+    header += bytes((block_width, block_height, 1))
+    for extent in (width, height, 1):
+        header += extent.to_bytes(3, "little")
+    return header + b"".join(blocks), width, height
+
+
+# ---------------------------------------------------------------- Reference decoders
+
+def decode_with_astcenc(astcenc, astc_path, srgb, width, height):
+    with tempfile.TemporaryDirectory() as tmp:
+        out_path = os.path.join(tmp, "out.ktx")
+        subprocess.check_call([astcenc, "-ds" if srgb else "-dl", astc_path, out_path], stdout=subprocess.DEVNULL)
+        with open(out_path, "rb") as file:
+            data = file.read()
+
+    # Uncompressed KTX 1, one level
+    endianness, gl_type, _, gl_format = struct.unpack_from("<IIII", data, 12)
+    if 0x04030201 != endianness or 0x1401 != gl_type or 0x1908 != gl_format:
+        raise RuntimeError("astcenc wrote something other than RGBA8 KTX: " + astc_path)
+    pixel_width, pixel_height = struct.unpack_from("<II", data, 36)
+    if (pixel_width, pixel_height) != (width, height):
+        raise RuntimeError("astcenc wrote an image of another size: " + astc_path)
+    key_value_size, = struct.unpack_from("<I", data, 60)
+    offset = 64 + key_value_size
+    image_size, = struct.unpack_from("<I", data, offset)
+    return data[offset + 4:offset + 4 + image_size]
+
+
+class MesaDecoder:
+    GL_TEXTURE_2D = 0x0DE1
+    GL_RGBA = 0x1908
+    GL_UNSIGNED_BYTE = 0x1401
+    GL_PACK_ALIGNMENT = 0x0D05
+    GL_UNPACK_ALIGNMENT = 0x0CF5
+    GL_COMPRESSED_RGBA_ASTC_4x4 = 0x93B0
+    GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 = 0x93D0
+
+    def __init__(self):
+        import ctypes
+
+        self.ctypes = ctypes
+        os.environ.setdefault("EGL_PLATFORM", "surfaceless")
+        egl = ctypes.CDLL("libEGL.so.1")
+        self.gl = ctypes.CDLL("libGL.so.1")
+
+        egl.eglGetProcAddress.restype = ctypes.c_void_p
+        egl.eglGetProcAddress.argtypes = [ctypes.c_char_p]
+        get_platform_display = ctypes.CFUNCTYPE(ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p)(
+            egl.eglGetProcAddress(b"eglGetPlatformDisplayEXT")
+        )
+        display = get_platform_display(0x31DD, None, None)  # EGL_PLATFORM_SURFACELESS_MESA
+        egl.eglInitialize.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+        if not display or not egl.eglInitialize(display, None, None):
+            raise RuntimeError("failed to initialize surfaceless EGL")
+
+        egl.eglBindAPI(0x30A2)  # EGL_OPENGL_API
+        egl.eglCreateContext.restype = ctypes.c_void_p
+        egl.eglCreateContext.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+        attribs = (ctypes.c_int * 1)(0x3038)  # EGL_NONE
+        context = egl.eglCreateContext(display, None, None, attribs)
+        egl.eglMakeCurrent.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+        if not context or not egl.eglMakeCurrent(display, None, None, context):
+            raise RuntimeError("failed to make an OpenGL context current")
+
+        self.gl.glGetString.restype = ctypes.c_char_p
+        extensions = self.gl.glGetString(0x1F03) or b""  # GL_EXTENSIONS
+        if b"GL_KHR_texture_compression_astc_ldr" not in extensions:
+            raise RuntimeError("OpenGL implementation can't decode ASTC")
+        self.renderer = "{} {}".format(self.gl.glGetString(0x1F01).decode(), self.gl.glGetString(0x1F02).decode())
+
+        self.compressed_tex_image_2d = ctypes.CFUNCTYPE(
+            None, ctypes.c_uint, ctypes.c_int, ctypes.c_uint, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_void_p
+        )(egl.eglGetProcAddress(b"glCompressedTexImage2D"))
+
+    def decode(self, astc_path, srgb, width, height):
+        ctypes = self.ctypes
+        gl = self.gl
+
+        with open(astc_path, "rb") as file:
+            data = file.read()
+        block_width, block_height = data[4], data[5]
+        footprint_index = FOOTPRINTS.index((block_width, block_height))
+        base = self.GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 if srgb else self.GL_COMPRESSED_RGBA_ASTC_4x4
+        blocks = data[16:]
+
+        texture = ctypes.c_uint(0)
+        gl.glGenTextures(1, ctypes.byref(texture))
+        gl.glBindTexture(self.GL_TEXTURE_2D, texture)
+        gl.glPixelStorei(self.GL_UNPACK_ALIGNMENT, 1)
+        gl.glPixelStorei(self.GL_PACK_ALIGNMENT, 1)
+        self.compressed_tex_image_2d(self.GL_TEXTURE_2D, 0, base + footprint_index, width, height, 0, len(blocks), blocks)
+        if 0 != gl.glGetError():
+            raise RuntimeError("failed to upload " + astc_path)
+
+        result = ctypes.create_string_buffer(width * height * 4)
+        gl.glGetTexImage(self.GL_TEXTURE_2D, 0, self.GL_RGBA, self.GL_UNSIGNED_BYTE, result)
+        if 0 != gl.glGetError():
+            raise RuntimeError("failed to read back " + astc_path)
+        gl.glDeleteTextures(1, ctypes.byref(texture))
+
+        return result.raw
+
+
+def make_reference_decoder(name):
+    if name in (None, "astcenc"):
+        for exe in ("astcenc", "astcenc-avx2", "astcenc-sse4.1", "astcenc-sse2", "astcenc-neon"):
+            path = shutil.which(exe)
+            if path:
+                return "astcenc ({})".format(path), lambda p, s, w, h: decode_with_astcenc(path, p, s, w, h)
+        if "astcenc" == name:
+            raise RuntimeError("astcenc not found")
+
+    mesa = MesaDecoder()
+    return "mesa ({})".format(mesa.renderer), mesa.decode
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--decoder", choices=("astcenc", "mesa"))
+    args = parser.parse_args()
+
+    out_dir = os.path.dirname(os.path.abspath(__file__))
+    decoder_name, decode = make_reference_decoder(args.decoder)
+    print("reference decoder: " + decoder_name)
+
+    rng = random.Random(SEED)
+    for footprint in FOOTPRINTS:
+        maker = FixtureMaker(footprint, rng)
+        blocks = maker.make()
+        data, width, height = astc_file_bytes(footprint, blocks)
+
+        name = "{}x{}".format(*footprint)
+        astc_path = os.path.join(out_dir, name + ".astc")
+        with open(astc_path, "wb") as file:
+            file.write(data)
+
+        for srgb in (False, True):
+            image = decode(astc_path, srgb, width, height)
+            if len(image) != width * height * 4:
+                raise RuntimeError("reference decoder returned {} bytes for {}".format(len(image), astc_path))
+            with open(os.path.join(out_dir, "{}_{}.rgba".format(name, "srgb" if srgb else "unorm")), "wb") as file:
+                file.write(image)
+
+        print("- {}: {} blocks, {}".format(name, len(blocks), ", ".join("{} {}".format(v, k) for k, v in sorted(maker.counts.items()))))
+
+
+if "__main__" == __name__:
+    main()